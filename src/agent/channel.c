@@ -99,6 +99,15 @@ struct multipart {
   struct pbuf_tailq multipart_list;
 };
 
+struct bundle {
+  uint32_t bundle_id;
+  uint16_t flags;
+  uint16_t used;
+  bool closed;
+  uint32_t count;
+  struct pbuf_tailq bundle_list;
+};
+
 /* OpenFlow channel. */
 struct channel {
   /* Datapath ID */
@@ -140,6 +149,9 @@ struct channel {
   struct pbuf_list *out;
 #define CHANNEL_SIMULTANEOUS_MULTIPART_MAX 16
   struct multipart multipart[CHANNEL_SIMULTANEOUS_MULTIPART_MAX];
+#define CHANNEL_SIMULTANEOUS_BUNDLE_MAX 16
+#define CHANNEL_BUNDLE_MESSAGE_MAX 65536
+  struct bundle bundle[CHANNEL_SIMULTANEOUS_BUNDLE_MAX];
 
   uint64_t channel_id;
   uint8_t  auxiliary_id;
@@ -925,6 +937,20 @@ multipart_init(struct multipart *m) {
   multipart_reset(m);
 }
 
+static void
+bundle_reset(struct bundle *b) {
+  b->used = 0;
+  b->closed = false;
+  b->count = 0;
+}
+
+/* Bundle object init. */
+static void
+bundle_init(struct bundle *b) {
+  TAILQ_INIT(&b->bundle_list);
+  bundle_reset(b);
+}
+
 /* Channel allocation. */
 static struct channel *
 channel_alloc_internal(lagopus_ip_address_t *controller) {
@@ -1012,6 +1038,10 @@ channel_alloc_internal(lagopus_ip_address_t *controller) {
   for (i = 0; i < CHANNEL_SIMULTANEOUS_MULTIPART_MAX; i++) {
     multipart_init(&channel->multipart[i]);
   }
+  /* Init bundle objects. */
+  for (i = 0; i < CHANNEL_SIMULTANEOUS_BUNDLE_MAX; i++) {
+    bundle_init(&channel->bundle[i]);
+  }
 
   ret = lagopus_mutex_create(&channel->lock);
   if (ret != LAGOPUS_RESULT_OK) {
@@ -1088,6 +1118,23 @@ multipart_free(struct multipart *m) {
   }
 }
 
+/* Bundle object free. */
+static void
+bundle_free(struct bundle *b) {
+  struct pbuf *p;
+
+  if (b->used == 1) {
+    lagopus_msg_info("uncommitted bundle discarded. bundle_id %u\n",
+                     b->bundle_id);
+    while ((p = TAILQ_FIRST(&b->bundle_list)) != NULL) {
+      TAILQ_REMOVE(&b->bundle_list, p, entry);
+      pbuf_reset(p);
+      pbuf_free(p);
+    }
+    bundle_reset(b);
+  }
+}
+
 void
 channel_refs_get(struct channel *channel) {
   channel_lock(channel);
@@ -1145,6 +1192,11 @@ channel_free(struct channel *channel) {
       multipart_free(&channel->multipart[i]);
     }
 
+    /* Free bundle objects. */
+    for (i = 0; i < CHANNEL_SIMULTANEOUS_BUNDLE_MAX; i++) {
+      bundle_free(&channel->bundle[i]);
+    }
+
     if (IS_USED_DPID_ENTRY(channel)) {
       LIST_REMOVE(channel, dpid_entry);
     }
@@ -1613,6 +1665,164 @@ channel_multipart_get(struct channel *channel, struct pbuf **pbuf,
   return ret;
 }
 
+/* Find the bundle, called with channel lock. */
+static struct bundle *
+bundle_lookup(struct channel *channel, uint32_t bundle_id) {
+  int i;
+
+  for (i = 0; i < CHANNEL_SIMULTANEOUS_BUNDLE_MAX; i++) {
+    if (channel->bundle[i].used == 1 &&
+        channel->bundle[i].bundle_id == bundle_id) {
+      return &channel->bundle[i];
+    }
+  }
+  return NULL;
+}
+
+/* Open the bundle, called with channel lock. */
+static lagopus_result_t
+bundle_open(struct channel *channel, uint32_t bundle_id, uint16_t flags,
+            struct bundle **bundle) {
+  int i;
+
+  if (bundle_lookup(channel, bundle_id) != NULL) {
+    return LAGOPUS_RESULT_ALREADY_EXISTS;
+  }
+  for (i = 0; i < CHANNEL_SIMULTANEOUS_BUNDLE_MAX; i++) {
+    if (channel->bundle[i].used == 0) {
+      channel->bundle[i].bundle_id = bundle_id;
+      channel->bundle[i].flags = flags;
+      channel->bundle[i].used = 1;
+      *bundle = &channel->bundle[i];
+      return LAGOPUS_RESULT_OK;
+    }
+  }
+  return LAGOPUS_RESULT_TOO_MANY_OBJECTS;
+}
+
+int
+channel_bundle_used_count_get(struct channel *channel) {
+  int i, cnt = 0;
+  channel_lock(channel);
+  for (i = 0; i < CHANNEL_SIMULTANEOUS_BUNDLE_MAX; i++) {
+    if (channel->bundle[i].used == 1) {
+      cnt++;
+    }
+  }
+  channel_unlock(channel);
+
+  return cnt;
+}
+
+lagopus_result_t
+channel_bundle_open(struct channel *channel, uint32_t bundle_id,
+                    uint16_t flags) {
+  struct bundle *b;
+  lagopus_result_t ret;
+
+  channel_lock(channel);
+  ret = bundle_open(channel, bundle_id, flags, &b);
+  channel_unlock(channel);
+  return ret;
+}
+
+lagopus_result_t
+channel_bundle_close(struct channel *channel, uint32_t bundle_id,
+                     uint16_t flags) {
+  struct bundle *b;
+  lagopus_result_t ret;
+
+  channel_lock(channel);
+  b = bundle_lookup(channel, bundle_id);
+  if (b == NULL) {
+    ret = LAGOPUS_RESULT_NOT_FOUND;
+  } else if (b->closed == true) {
+    ret = LAGOPUS_RESULT_INVALID_STATE;
+  } else if (b->flags != flags) {
+    ret = LAGOPUS_RESULT_INVALID_ARGS;
+  } else {
+    b->closed = true;
+    ret = LAGOPUS_RESULT_OK;
+  }
+  channel_unlock(channel);
+  return ret;
+}
+
+lagopus_result_t
+channel_bundle_put(struct channel *channel, uint32_t bundle_id,
+                   uint16_t flags, struct pbuf *pbuf) {
+  struct bundle *b;
+  lagopus_result_t ret = LAGOPUS_RESULT_OK;
+
+  channel_lock(channel);
+  b = bundle_lookup(channel, bundle_id);
+  if (b == NULL) {
+    /* adding to an unknown bundle opens it. */
+    ret = bundle_open(channel, bundle_id, flags, &b);
+  } else if (b->closed == true) {
+    ret = LAGOPUS_RESULT_INVALID_STATE;
+  } else if (b->flags != flags) {
+    ret = LAGOPUS_RESULT_INVALID_ARGS;
+  } else if (b->count >= CHANNEL_BUNDLE_MESSAGE_MAX) {
+    ret = LAGOPUS_RESULT_OUT_OF_RANGE;
+  }
+  if (ret == LAGOPUS_RESULT_OK) {
+    b->count++;
+    pbuf_get(pbuf);
+    TAILQ_INSERT_TAIL(&b->bundle_list, pbuf, entry);
+  }
+  channel_unlock(channel);
+  return ret;
+}
+
+lagopus_result_t
+channel_bundle_get(struct channel *channel, uint32_t bundle_id,
+                   uint16_t flags, struct pbuf_tailq *list) {
+  struct bundle *b;
+  struct pbuf *p;
+  lagopus_result_t ret;
+
+  channel_lock(channel);
+  b = bundle_lookup(channel, bundle_id);
+  if (b == NULL) {
+    ret = LAGOPUS_RESULT_NOT_FOUND;
+  } else if (b->flags != flags) {
+    ret = LAGOPUS_RESULT_INVALID_ARGS;
+  } else {
+    while ((p = TAILQ_FIRST(&b->bundle_list)) != NULL) {
+      TAILQ_REMOVE(&b->bundle_list, p, entry);
+      TAILQ_INSERT_TAIL(list, p, entry);
+    }
+    bundle_reset(b);
+    ret = LAGOPUS_RESULT_OK;
+  }
+  channel_unlock(channel);
+  return ret;
+}
+
+lagopus_result_t
+channel_bundle_discard(struct channel *channel, uint32_t bundle_id) {
+  struct bundle *b;
+  struct pbuf *p;
+  lagopus_result_t ret;
+
+  channel_lock(channel);
+  b = bundle_lookup(channel, bundle_id);
+  if (b == NULL) {
+    ret = LAGOPUS_RESULT_NOT_FOUND;
+  } else {
+    while ((p = TAILQ_FIRST(&b->bundle_list)) != NULL) {
+      TAILQ_REMOVE(&b->bundle_list, p, entry);
+      pbuf_reset(p);
+      pbuf_free(p);
+    }
+    bundle_reset(b);
+    ret = LAGOPUS_RESULT_OK;
+  }
+  channel_unlock(channel);
+  return ret;
+}
+
 uint8_t
 channel_auxiliary_id_get(struct channel *channel) {
   return channel->auxiliary_id;
@@ -564,6 +564,102 @@ lagopus_result_t
 channel_multipart_get(struct channel *channel, struct pbuf **pbuf,
                       struct ofp_header *xid_header, uint16_t mtype);
 
+/**
+ * Open a bundle.
+ *
+ *  @param[in]  channel    A channel pointer.
+ *  @param[in]  bundle_id  A bundle id.
+ *  @param[in]  flags      Bundle flags.
+ *
+ *  @retval LAGOPUS_RESULT_OK Succeeded.
+ *  @retval LAGOPUS_RESULT_ALREADY_EXISTS Failed, bundle_id is used.
+ *  @retval LAGOPUS_RESULT_TOO_MANY_OBJECTS Failed, number of bundles
+ *  is over CHANNEL_SIMULTANEOUS_BUNDLE_MAX(default 16).
+ *
+ */
+lagopus_result_t
+channel_bundle_open(struct channel *channel, uint32_t bundle_id,
+                    uint16_t flags);
+
+/**
+ * Close a bundle, no more messages are added.
+ *
+ *  @param[in]  channel    A channel pointer.
+ *  @param[in]  bundle_id  A bundle id.
+ *  @param[in]  flags      Bundle flags.
+ *
+ *  @retval LAGOPUS_RESULT_OK Succeeded.
+ *  @retval LAGOPUS_RESULT_NOT_FOUND Failed, bundle is not opened.
+ *  @retval LAGOPUS_RESULT_INVALID_STATE Failed, bundle is closed.
+ *  @retval LAGOPUS_RESULT_INVALID_ARGS Failed, flags are not matched.
+ *
+ */
+lagopus_result_t
+channel_bundle_close(struct channel *channel, uint32_t bundle_id,
+                     uint16_t flags);
+
+/**
+ * Put a message into a bundle.  The bundle is opened if not exists.
+ *
+ *  @param[in]  channel    A channel pointer.
+ *  @param[in]  bundle_id  A bundle id.
+ *  @param[in]  flags      Bundle flags.
+ *  @param[in]  pbuf       A pbuf of the message, referenced by the bundle.
+ *
+ *  @retval LAGOPUS_RESULT_OK Succeeded.
+ *  @retval LAGOPUS_RESULT_INVALID_STATE Failed, bundle is closed.
+ *  @retval LAGOPUS_RESULT_INVALID_ARGS Failed, flags are not matched.
+ *  @retval LAGOPUS_RESULT_OUT_OF_RANGE Failed, number of messages
+ *  is over CHANNEL_BUNDLE_MESSAGE_MAX(default 65536).
+ *  @retval LAGOPUS_RESULT_TOO_MANY_OBJECTS Failed, number of bundles
+ *  is over CHANNEL_SIMULTANEOUS_BUNDLE_MAX(default 16).
+ *
+ */
+lagopus_result_t
+channel_bundle_put(struct channel *channel, uint32_t bundle_id,
+                   uint16_t flags, struct pbuf *pbuf);
+
+/**
+ * Move messages of a bundle to the list and release the bundle.
+ *
+ *  @param[in]  channel    A channel pointer.
+ *  @param[in]  bundle_id  A bundle id.
+ *  @param[in]  flags      Bundle flags.
+ *  @param[out] list       A list of pbufs in added order.
+ *
+ *  @retval LAGOPUS_RESULT_OK Succeeded.
+ *  @retval LAGOPUS_RESULT_NOT_FOUND Failed, bundle is not opened.
+ *  @retval LAGOPUS_RESULT_INVALID_ARGS Failed, flags are not matched.
+ *
+ */
+lagopus_result_t
+channel_bundle_get(struct channel *channel, uint32_t bundle_id,
+                   uint16_t flags, struct pbuf_tailq *list);
+
+/**
+ * Discard a bundle and its messages.
+ *
+ *  @param[in]  channel    A channel pointer.
+ *  @param[in]  bundle_id  A bundle id.
+ *
+ *  @retval LAGOPUS_RESULT_OK Succeeded.
+ *  @retval LAGOPUS_RESULT_NOT_FOUND Failed, bundle is not opened.
+ *
+ */
+lagopus_result_t
+channel_bundle_discard(struct channel *channel, uint32_t bundle_id);
+
+/**
+ * Return number of used bundle entries.
+ *
+ *  @param[in]  channel    A channel pointer.
+ *
+ *  @retval Number of used bundle entries.
+ *
+ */
+int
+channel_bundle_used_count_get(struct channel *channel);
+
 /**
  * Return auxiliary id.
  *
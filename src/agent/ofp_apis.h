@@ -61,5 +61,6 @@
 #include "ofp_experimenter_mp_handler.h"
 #include "ofp_table_features_handler.h"
 #include "ofp_features_capabilities.h"
+#include "ofp_bundle_handler.h"
 
 #endif /* __OFP_APIS_H__ */
@@ -0,0 +1,354 @@
+/*
+ * Copyright 2014-2016 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lagopus_apis.h"
+#include "openflow.h"
+#include "openflow13packet.h"
+#include "ofp_apis.h"
+#include "lagopus/ofp_flow_mod_apis.h"
+
+#define OFPBF_FULL_MASK (OFPBF_ATOMIC | OFPBF_ORDERED)
+
+/* Set bundle error from the result of channel_bundle_*(). */
+static lagopus_result_t
+bundle_error_set(lagopus_result_t ret, struct ofp_error *error) {
+  switch (ret) {
+    case LAGOPUS_RESULT_OK:
+      return LAGOPUS_RESULT_OK;
+    case LAGOPUS_RESULT_ALREADY_EXISTS:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_BUNDLE_EXIST);
+      break;
+    case LAGOPUS_RESULT_TOO_MANY_OBJECTS:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_OUT_OF_BUNDLES);
+      break;
+    case LAGOPUS_RESULT_NOT_FOUND:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_BAD_ID);
+      break;
+    case LAGOPUS_RESULT_INVALID_STATE:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_BUNDLE_CLOSED);
+      break;
+    case LAGOPUS_RESULT_INVALID_ARGS:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_BAD_FLAGS);
+      break;
+    case LAGOPUS_RESULT_OUT_OF_RANGE:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_TOO_MANY);
+      break;
+    default:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_UNKNOWN);
+      break;
+  }
+  return LAGOPUS_RESULT_OFP_ERROR;
+}
+
+/* SEND */
+/* Send bundle control reply. */
+STATIC lagopus_result_t
+ofp_bundle_ctrl_reply_create(struct channel *channel,
+                             struct pbuf **pbuf,
+                             struct ofp_header *xid_header,
+                             struct ofp_bundle_ctrl_msg *ctrl_req) {
+  struct ofp_bundle_ctrl_msg ctrl_reply;
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+
+  if (channel != NULL && pbuf != NULL &&
+      xid_header != NULL && ctrl_req != NULL) {
+    *pbuf = NULL;
+    /* alloc */
+    *pbuf = channel_pbuf_list_get(channel,
+                                  sizeof(struct ofp_bundle_ctrl_msg));
+    if (*pbuf != NULL) {
+      pbuf_plen_set(*pbuf, sizeof(struct ofp_bundle_ctrl_msg));
+
+      ctrl_reply.experimenter = ONF_EXPERIMENTER_ID;
+      ctrl_reply.exp_type = ONF_ET_BUNDLE_CONTROL;
+      ctrl_reply.bundle_id = ctrl_req->bundle_id;
+      /* reply type is request type + 1. */
+      ctrl_reply.type = (uint16_t) (ctrl_req->type + 1);
+      ctrl_reply.flags = ctrl_req->flags;
+
+      /* Fill in header. */
+      ofp_header_set(&ctrl_reply.header, channel_version_get(channel),
+                     OFPT_EXPERIMENTER, (uint16_t) pbuf_plen_get(*pbuf),
+                     xid_header->xid);
+
+      /* Encode message. */
+      ret = ofp_bundle_ctrl_msg_encode(*pbuf, &ctrl_reply);
+      if (ret != LAGOPUS_RESULT_OK) {
+        lagopus_msg_warning("FAILED (%s).\n",
+                            lagopus_error_get_string(ret));
+      }
+    } else {
+      lagopus_msg_warning("Can't allocate pbuf.\n");
+      ret = LAGOPUS_RESULT_NO_MEMORY;
+    }
+
+    if (ret != LAGOPUS_RESULT_OK && *pbuf != NULL) {
+      channel_pbuf_list_unget(channel, *pbuf);
+      *pbuf = NULL;
+    }
+  } else {
+    ret = LAGOPUS_RESULT_INVALID_ARGS;
+  }
+
+  return ret;
+}
+
+/* Send error of the message in the bundle. */
+static void
+bundle_msg_error_send(struct channel *channel, uint32_t bundle_id,
+                      struct pbuf *msg, struct ofp_header *header,
+                      lagopus_result_t ret, struct ofp_error *msg_error) {
+  lagopus_msg_warning("bundle %u: FAILED (%s), xid %u.\n",
+                      bundle_id, lagopus_error_get_string(ret),
+                      header->xid);
+  if (ret == LAGOPUS_RESULT_OFP_ERROR) {
+    /* data is the head of the failed message. */
+    pbuf_plen_set(msg, header->length < OFP_ERROR_MAX_SIZE ?
+                  header->length : OFP_ERROR_MAX_SIZE);
+    msg_error->req = msg;
+    (void) ofp_error_msg_send(channel, header, msg_error);
+  }
+}
+
+/* Apply flow mods of the bundle in one flow_mod batch. */
+static lagopus_result_t
+bundle_commit(struct channel *channel, struct ofp_bundle_ctrl_msg *ctrl,
+              struct ofp_error *error) {
+  lagopus_result_t ret;
+  uint64_t dpid;
+  struct pbuf_tailq list;
+  struct pbuf *msg;
+  struct ofp_header header;
+  struct ofp_error msg_error;
+  bool atomic;
+
+  TAILQ_INIT(&list);
+  ret = channel_bundle_get(channel, ctrl->bundle_id, ctrl->flags, &list);
+  if (ret != LAGOPUS_RESULT_OK) {
+    return bundle_error_set(ret, error);
+  }
+
+  /* role may be changed after the messages are added. */
+  TAILQ_FOREACH(msg, &list, entry) {
+    /* checked when added. */
+    (void) ofp_header_decode_sneak(msg, &header);
+    if (ofp_role_check(channel, &header) == false) {
+      ofp_error_set(&msg_error, OFPET_BAD_REQUEST, OFPBRC_IS_SLAVE);
+      ret = LAGOPUS_RESULT_OFP_ERROR;
+      bundle_msg_error_send(channel, ctrl->bundle_id, msg, &header,
+                            ret, &msg_error);
+      break;
+    }
+  }
+
+  dpid = channel_dpid_get(channel);
+  atomic = ((ctrl->flags & OFPBF_ATOMIC) != 0);
+  if (ret == LAGOPUS_RESULT_OK) {
+    if (atomic == true) {
+      ret = ofp_flow_mod_batch_atomic_begin(dpid);
+    } else {
+      ret = ofp_flow_mod_batch_begin(dpid);
+    }
+  }
+  if (ret == LAGOPUS_RESULT_OK) {
+    TAILQ_FOREACH(msg, &list, entry) {
+      (void) ofp_header_decode_sneak(msg, &header);
+      ret = ofp_flow_mod_handle(channel, msg, &header, &msg_error);
+      if (ret != LAGOPUS_RESULT_OK) {
+        bundle_msg_error_send(channel, ctrl->bundle_id, msg, &header,
+                              ret, &msg_error);
+        break;
+      }
+    }
+    if (ret != LAGOPUS_RESULT_OK && atomic == true) {
+      /* flow mods applied before the failed one are undone. */
+      (void) ofp_flow_mod_batch_abort(dpid);
+    } else {
+      (void) ofp_flow_mod_batch_end(dpid);
+    }
+  }
+
+  while ((msg = TAILQ_FIRST(&list)) != NULL) {
+    TAILQ_REMOVE(&list, msg, entry);
+    pbuf_free(msg);
+  }
+
+  if (ret != LAGOPUS_RESULT_OK) {
+    ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_FAILED);
+    ret = LAGOPUS_RESULT_OFP_ERROR;
+  }
+  return ret;
+}
+
+/* RECV */
+static lagopus_result_t
+bundle_ctrl_handle(struct channel *channel, struct pbuf *pbuf,
+                   struct ofp_header *xid_header,
+                   struct ofp_error *error) {
+  lagopus_result_t ret;
+  struct pbuf *send_pbuf = NULL;
+  struct ofp_bundle_ctrl_msg ctrl;
+
+  ret = ofp_bundle_ctrl_msg_decode(pbuf, &ctrl);
+  if (ret != LAGOPUS_RESULT_OK) {
+    lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
+    ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+  /* properties are ignored. */
+  (void) pbuf_forward(pbuf, pbuf_plen_get(pbuf));
+
+  if ((ctrl.flags & ~OFPBF_FULL_MASK) != 0) {
+    ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_BAD_FLAGS);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+
+  switch (ctrl.type) {
+    case OFPBCT_OPEN_REQUEST:
+      ret = bundle_error_set(channel_bundle_open(channel, ctrl.bundle_id,
+                             ctrl.flags), error);
+      break;
+    case OFPBCT_CLOSE_REQUEST:
+      ret = bundle_error_set(channel_bundle_close(channel, ctrl.bundle_id,
+                             ctrl.flags), error);
+      break;
+    case OFPBCT_COMMIT_REQUEST:
+      ret = bundle_commit(channel, &ctrl, error);
+      break;
+    case OFPBCT_DISCARD_REQUEST:
+      ret = bundle_error_set(channel_bundle_discard(channel, ctrl.bundle_id),
+                             error);
+      break;
+    default:
+      ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_BAD_TYPE);
+      ret = LAGOPUS_RESULT_OFP_ERROR;
+      break;
+  }
+
+  if (ret == LAGOPUS_RESULT_OK) {
+    ret = ofp_bundle_ctrl_reply_create(channel, &send_pbuf,
+                                       xid_header, &ctrl);
+    if (ret == LAGOPUS_RESULT_OK) {
+      channel_send_packet(channel, send_pbuf);
+    } else {
+      lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
+    }
+  }
+
+  return ret;
+}
+
+static lagopus_result_t
+bundle_add_handle(struct channel *channel, struct pbuf *pbuf,
+                  struct ofp_header *xid_header,
+                  struct ofp_error *error) {
+  lagopus_result_t ret;
+  struct pbuf *msg;
+  struct ofp_bundle_add_msg add;
+  struct ofp_header header;
+
+  ret = ofp_bundle_add_msg_decode(pbuf, &add);
+  if (ret != LAGOPUS_RESULT_OK) {
+    lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
+    ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+
+  /* Check the message in the bundle. */
+  if (ofp_header_decode_sneak(pbuf, &header) != LAGOPUS_RESULT_OK ||
+      header.length < sizeof(struct ofp_header) ||
+      header.length > pbuf_plen_get(pbuf)) {
+    ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_BAD_LEN);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+  if (header.xid != xid_header->xid) {
+    ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_BAD_XID);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+  if (header.type != OFPT_FLOW_MOD) {
+    ofp_error_set(error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_UNSUP);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+  if (ofp_header_version_check(channel, &header) == false) {
+    ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_BAD_VERSION);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+  if (ofp_role_check(channel, &header) == false) {
+    ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_IS_SLAVE);
+    return LAGOPUS_RESULT_OFP_ERROR;
+  }
+
+  msg = pbuf_alloc(header.length);
+  if (msg == NULL) {
+    lagopus_msg_warning("Can't allocate pbuf.\n");
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  ret = pbuf_copy_with_length(msg, pbuf, header.length);
+  if (ret == LAGOPUS_RESULT_OK) {
+    /* parse the message in the request, properties are ignored. */
+    pbuf_plen_set(pbuf, header.length);
+    ret = ofp_flow_mod_check(channel, pbuf, error);
+    if (ret == LAGOPUS_RESULT_OK) {
+      ret = bundle_error_set(channel_bundle_put(channel, add.bundle_id,
+                             add.flags, msg), error);
+    }
+  } else {
+    lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
+  }
+  /* bundle has its own reference. */
+  pbuf_free(msg);
+
+  return ret;
+}
+
+lagopus_result_t
+ofp_bundle_handle(struct channel *channel, struct pbuf *pbuf,
+                  struct ofp_header *xid_header,
+                  struct ofp_error *error) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_experimenter_header exper_req;
+
+  if (channel != NULL && pbuf != NULL &&
+      xid_header != NULL && error != NULL) {
+    ret = ofp_experimenter_header_decode_sneak(pbuf, &exper_req);
+    if (ret != LAGOPUS_RESULT_OK) {
+      lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
+      ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+      ret = LAGOPUS_RESULT_OFP_ERROR;
+    } else if (exper_req.experimenter != ONF_EXPERIMENTER_ID) {
+      ret = ofp_bad_experimenter_handle(error);
+    } else {
+      switch (exper_req.exp_type) {
+        case ONF_ET_BUNDLE_CONTROL:
+          ret = bundle_ctrl_handle(channel, pbuf, xid_header, error);
+          break;
+        case ONF_ET_BUNDLE_ADD_MESSAGE:
+          ret = bundle_add_handle(channel, pbuf, xid_header, error);
+          break;
+        default:
+          ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_BAD_EXP_TYPE);
+          ret = LAGOPUS_RESULT_OFP_ERROR;
+          break;
+      }
+    }
+  } else {
+    ret = LAGOPUS_RESULT_INVALID_ARGS;
+  }
+
+  return ret;
+}
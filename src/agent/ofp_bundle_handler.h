@@ -0,0 +1,78 @@
+/*
+ * Copyright 2014-2016 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file	ofp_bundle_handler.h
+ */
+
+#ifndef __OFP_BUNDLE_HANDLER_H__
+#define __OFP_BUNDLE_HANDLER_H__
+
+#include "ofp_common.h"
+#include "channel.h"
+
+/**
+ * Bundle (ONF extension of OpenFlow 1.3) handler.
+ *
+ *     @param[in]	channel	A pointer to \e channel structure.
+ *     @param[in]	pbuf	A pointer to \e pbuf structure.
+ *     @param[in]	xid_header	A pointer to \e ofp_header structure in request.
+ *     @param[out]	error	A pointer to \e ofp_error structure.
+ *     If errors occur, set filed values.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_OFP_ERROR Failed, ofp_error.
+ *     @retval	LAGOPUS_RESULT_ANY_FAILURES Failed.
+ *
+ *     @details	Handles \b OFPT_EXPERIMENTER messages of bundle control
+ *     and bundle add.  Other experimenter messages are
+ *     \b OFPBRC_BAD_EXPERIMENTER or \b OFPBRC_BAD_EXP_TYPE errors.
+ *     Only \b OFPT_FLOW_MOD can be added to a bundle, and it is
+ *     checked when added.  On commit, role of the channel is checked
+ *     for all of them, then they are applied in added order under one
+ *     flow_mod batch, so that no other request sees the flow tables
+ *     partially updated.  If a flow mod fails on commit, its error is
+ *     sent and the rest of the bundle is discarded.  With
+ *     \b OFPBF_ATOMIC, flow mods applied before it are undone, and
+ *     \b OFPT_FLOW_REMOVED is sent only when the commit succeeds.
+ *     Packets see changes of each flow table at once at the end of
+ *     the commit.
+ */
+lagopus_result_t
+ofp_bundle_handle(struct channel *channel, struct pbuf *pbuf,
+                  struct ofp_header *xid_header,
+                  struct ofp_error *error);
+
+#ifdef __UNIT_TESTING__
+/**
+ * Create bundle control reply.
+ *
+ *     @param[in]	channel	A pointer to \e channel structure.
+ *     @param[out]	pbuf	A pointer to \e pbuf structure.
+ *     @param[in]	xid_header	A pointer to \e ofp_header structure.
+ *     @param[in]	ctrl_req	A pointer to \e ofp_bundle_ctrl_msg structure.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_ANY_FAILURES Failed.
+ */
+lagopus_result_t
+ofp_bundle_ctrl_reply_create(struct channel *channel,
+                             struct pbuf **pbuf,
+                             struct ofp_header *xid_header,
+                             struct ofp_bundle_ctrl_msg *ctrl_req);
+#endif /* __UNIT_TESTING__ */
+
+#endif /* __OFP_BUNDLE_HANDLER_H__ */
@@ -129,12 +129,17 @@ ofp_error_msg_create(struct channel *channel, struct ofp_error *error,
   size_t data_len;
   size_t size;
   struct ofp_error_msg msg;
+  struct ofp_error_experimenter_msg exp_msg;
 
   if (channel != NULL && error != NULL &&
       xid_header != NULL && pbuf != NULL) {
 
     /* Calculate message size. */
-    size = sizeof(struct ofp_error_msg);
+    if (error->type == OFPET_EXPERIMENTER) {
+      size = sizeof(struct ofp_error_experimenter_msg);
+    } else {
+      size = sizeof(struct ofp_error_msg);
+    }
     data_len = 0;
 
     switch (error->type) {
@@ -160,20 +165,34 @@ ofp_error_msg_create(struct channel *channel, struct ofp_error *error,
     *pbuf = channel_pbuf_list_get(channel, size);
 
     if (*pbuf != NULL) {
-      /* Fill in header. */
-      ofp_header_set(&msg.header, channel_version_get(channel),
-                     OFPT_ERROR, (uint16_t) size,
-                     xid_header->xid);
-
-      /* Fill in error. */
-      msg.type = error->type;
-      msg.code = error->code;
-
       /* Set size to pbuffer size. */
       pbuf_plen_set(*pbuf, size);
 
-      /* Encode message. */
-      ret = ofp_error_msg_encode(*pbuf, &msg);
+      if (error->type == OFPET_EXPERIMENTER) {
+        /* Experimenter errors sent by the switch are ONF extensions,
+           code is exp_type. */
+        ofp_header_set(&exp_msg.header, channel_version_get(channel),
+                       OFPT_ERROR, (uint16_t) size,
+                       xid_header->xid);
+        exp_msg.type = error->type;
+        exp_msg.exp_type = error->code;
+        exp_msg.experimenter = ONF_EXPERIMENTER_ID;
+
+        /* Encode message. */
+        ret = ofp_error_experimenter_msg_encode(*pbuf, &exp_msg);
+      } else {
+        /* Fill in header. */
+        ofp_header_set(&msg.header, channel_version_get(channel),
+                       OFPT_ERROR, (uint16_t) size,
+                       xid_header->xid);
+
+        /* Fill in error. */
+        msg.type = error->type;
+        msg.code = error->code;
+
+        /* Encode message. */
+        ret = ofp_error_msg_encode(*pbuf, &msg);
+      }
 
       if (ret == LAGOPUS_RESULT_OK) {
         /* Encode error string or failed request data. */
@@ -320,7 +339,7 @@ ofp_error_code_str_get(uint16_t type, uint16_t code) {
     case OFPET_TABLE_FEATURES_FAILED:
       return ofp_table_features_failed_code_str(code);
     case OFPET_EXPERIMENTER:
-      return "Not code";
+      return onf_bundle_error_type_str(code);
     default:
       return "Unknown";
   }
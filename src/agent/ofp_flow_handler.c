@@ -27,172 +27,169 @@
 #include "ofp_instruction.h"
 #include "ofp_tlv.h"
 
-static void
-s_ofp_flow_stats_list_elem_free(struct flow_stats_list *flow_stats_list) {
-  struct flow_stats *flow_stats;
-
-  while ((flow_stats = TAILQ_FIRST(flow_stats_list)) != NULL) {
-    TAILQ_REMOVE(flow_stats_list, flow_stats, entry);
-    ofp_match_list_elem_free(&flow_stats->match_list);
-    ofp_instruction_list_elem_free(&flow_stats->instruction_list);
-    free(flow_stats);
-  }
-}
+/* Argument of s_flow_stats_walk_proc(). */
+struct flow_stats_walk_arg {
+  struct pbuf_list *pbuf_list;
+  struct pbuf *pbuf;
+  struct pbuf *entry_pbuf;
+};
 
+/* called for each flow by ofp_flow_stats_walk(). */
 static lagopus_result_t
-s_flow_stats_list_encode(struct pbuf_list *pbuf_list,
-                         struct pbuf **pbuf,
-                         struct flow_stats_list *flow_stats_list) {
+s_flow_stats_walk_proc(const struct ofp_flow_stats *ofp,
+                       const uint8_t *body,
+                       uint16_t body_len,
+                       void *arg) {
   lagopus_result_t res = LAGOPUS_RESULT_ANY_FAILURES;
-  uint16_t match_total_len = 0;
-  uint16_t instruction_total_len = 0;
+  struct flow_stats_walk_arg *walk_arg = arg;
+  struct pbuf *entry_pbuf = walk_arg->entry_pbuf;
   uint16_t flow_stats_len;
   uint8_t *flow_stats_head = NULL;
-  struct flow_stats *flow_stats = NULL;
-  struct pbuf *entry_pbuf = NULL;
 
-  if (TAILQ_EMPTY(flow_stats_list) == false) {
-    /* encode flow_stats list */
-    TAILQ_FOREACH(flow_stats, flow_stats_list, entry) {
-      entry_pbuf = pbuf_alloc(OFP_PACKET_MAX_SIZE);
-      if (entry_pbuf == NULL) {
-        res = LAGOPUS_RESULT_NO_MEMORY;
-        goto done;
-      }
-      entry_pbuf->plen = OFP_PACKET_MAX_SIZE;
+  /* entry_pbuf is reused for each flow. */
+  pbuf_reset(entry_pbuf);
+  entry_pbuf->plen = OFP_PACKET_MAX_SIZE;
 
-      /* encode flow_stats */
-      res = ofp_flow_stats_encode(entry_pbuf, &(flow_stats->ofp));
-      if (res == LAGOPUS_RESULT_OK) {
+  /* encode flow_stats */
+  res = ofp_flow_stats_encode(entry_pbuf, ofp);
+  if (res == LAGOPUS_RESULT_OK) {
 
-        /* flow_stats head pointer. */
-        flow_stats_head = pbuf_putp_get(entry_pbuf) - sizeof(struct ofp_flow_stats);
+    /* flow_stats head pointer. */
+    flow_stats_head = pbuf_putp_get(entry_pbuf) - sizeof(struct ofp_flow_stats);
 
-        /* encode match */
-        res = ofp_match_list_encode(entry_pbuf, &(flow_stats->match_list),
-                                    &match_total_len);
+    /* match and instructions are already encoded by the dataplane. */
+    res = pbuf_encode(entry_pbuf, body, body_len);
+    if (res == LAGOPUS_RESULT_OK) {
+      flow_stats_len = body_len;
+      res = ofp_tlv_length_sum(&flow_stats_len,
+                               sizeof(struct ofp_flow_stats));
+      if (res == LAGOPUS_RESULT_OK) {
+        res = ofp_multipart_length_set(flow_stats_head, flow_stats_len);
         if (res == LAGOPUS_RESULT_OK) {
-          /* encode instruction */
-          res = ofp_instruction_list_encode(entry_pbuf,
-                                            &(flow_stats->instruction_list),
-                                            &instruction_total_len);
-          if (res == LAGOPUS_RESULT_OK) {
-            /* Set flow_stats length (match total length +       */
-            /*                        instruction total length + */
-            /*                        size of ofp_flow_stats).   */
-            /* And check overflow.                               */
-            flow_stats_len = match_total_len;
-            res = ofp_tlv_length_sum(&flow_stats_len, instruction_total_len);
-            if (res == LAGOPUS_RESULT_OK) {
-              res = ofp_tlv_length_sum(&flow_stats_len,
-                                       sizeof(struct ofp_flow_stats));
-              if (res == LAGOPUS_RESULT_OK) {
-                res = ofp_multipart_length_set(flow_stats_head,
-                                               flow_stats_len);
-                if (res == LAGOPUS_RESULT_OK) {
-                  res = ofp_multipart_append(pbuf_list, entry_pbuf, pbuf);
-                  if (res != LAGOPUS_RESULT_OK) {
-                    lagopus_msg_warning("FAILED (%s).\n",
-                                        lagopus_error_get_string(res));
-                  }
-                } else {
-                  lagopus_msg_warning("FAILED (%s).\n",
-                                      lagopus_error_get_string(res));
-                }
-              } else {
-                lagopus_msg_warning("over flow_stats length.\n");
-              }
-            } else {
-              lagopus_msg_warning("over flow_stats length.\n");
-            }
-          } else {
-            lagopus_msg_warning("FAILED : ofp_instruction_list_encode (%s).\n",
+          res = ofp_multipart_append(walk_arg->pbuf_list, entry_pbuf,
+                                     &walk_arg->pbuf);
+          if (res != LAGOPUS_RESULT_OK) {
+            lagopus_msg_warning("FAILED (%s).\n",
                                 lagopus_error_get_string(res));
           }
         } else {
-          lagopus_msg_warning("FAILED : ofp_match_list_encode (%s).\n",
+          lagopus_msg_warning("FAILED (%s).\n",
                               lagopus_error_get_string(res));
         }
       } else {
-        lagopus_msg_warning("FAILED : ofp_flow_stats_encode (%s).\n",
-                            lagopus_error_get_string(res));
+        lagopus_msg_warning("over flow_stats length.\n");
       }
+    } else {
+      lagopus_msg_warning("FAILED : pbuf_encode (%s).\n",
+                          lagopus_error_get_string(res));
+    }
+  } else {
+    lagopus_msg_warning("FAILED : ofp_flow_stats_encode (%s).\n",
+                        lagopus_error_get_string(res));
+  }
+
+  return res;
+}
 
-      pbuf_free(entry_pbuf);
-      entry_pbuf = NULL;
+/* encode header of flow_stats reply. */
+static lagopus_result_t
+s_flow_stats_reply_header_encode(struct channel *channel,
+                                 struct pbuf_list **pbuf_list,
+                                 struct pbuf **pbuf,
+                                 struct ofp_header *xid_header) {
+  lagopus_result_t res = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_multipart_reply reply;
+
+  /* alloc */
+  *pbuf_list = pbuf_list_alloc();
+  if (*pbuf_list != NULL) {
+    *pbuf = pbuf_list_last_get(*pbuf_list);
+    if (*pbuf != NULL) {
+      /* set data. */
+      memset(&reply, 0, sizeof(reply));
+      ofp_header_set(&reply.header,
+                     channel_version_get(channel),
+                     OFPT_MULTIPART_REPLY,
+                     0, /* length set in ofp_header_length_set()  */
+                     xid_header->xid);
+      reply.type = OFPMP_FLOW;
+
+      /* encode header, multipart reply */
+      pbuf_plen_set(*pbuf, pbuf_size_get(*pbuf));
+      res = ofp_multipart_reply_encode(*pbuf, &reply);
       if (res != LAGOPUS_RESULT_OK) {
-        break;
+        lagopus_msg_warning("FAILED : ofp_multipart_reply_encode (%s).\n",
+                            lagopus_error_get_string(res));
       }
+    } else {
+      /* pbuf_list_last_get returns NULL */
+      res = LAGOPUS_RESULT_NO_MEMORY;
     }
   } else {
-    /* flow_stats_list is empty. */
-    res = LAGOPUS_RESULT_OK;
+    /* pbuf_list_alloc returns NULL */
+    res = LAGOPUS_RESULT_NO_MEMORY;
   }
+  return res;
+}
+
+/* set length of the last pbuf of flow_stats reply. */
+static lagopus_result_t
+s_flow_stats_reply_length_set(struct pbuf *pbuf) {
+  lagopus_result_t res = LAGOPUS_RESULT_ANY_FAILURES;
+  uint16_t length = 0;
 
-done:
+  res = pbuf_length_get(pbuf, &length);
+  if (res == LAGOPUS_RESULT_OK) {
+    res = ofp_header_length_set(pbuf, length);
+    if (res == LAGOPUS_RESULT_OK) {
+      pbuf_plen_reset(pbuf);
+    } else {
+      lagopus_msg_warning("FAILED : ofp_header_length_set (%s).\n",
+                          lagopus_error_get_string(res));
+    }
+  } else {
+    lagopus_msg_warning("FAILED (%s).\n",
+                        lagopus_error_get_string(res));
+  }
   return res;
 }
 
-/* createflow_stats reply. */
+/* create flow_stats reply, encoding flows in the flowdb directly. */
 STATIC lagopus_result_t
 ofp_flow_stats_reply_create(struct channel *channel,
                             struct pbuf_list **pbuf_list,
-                            struct flow_stats_list *flow_stats_list,
-                            struct ofp_header *xid_header) {
+                            struct ofp_flow_stats_request *request,
+                            struct match_list *match_list,
+                            struct ofp_header *xid_header,
+                            struct ofp_error *error) {
   lagopus_result_t res = LAGOPUS_RESULT_ANY_FAILURES;
-  uint16_t length = 0;
-  struct pbuf *pbuf = NULL;
-  struct ofp_multipart_reply reply;
+  struct flow_stats_walk_arg walk_arg;
 
   /* check params */
   if (channel != NULL && pbuf_list != NULL &&
-      flow_stats_list != NULL && xid_header != NULL) {
-    /* alloc */
-    *pbuf_list = pbuf_list_alloc();
-    if (*pbuf_list != NULL) {
-      pbuf = pbuf_list_last_get(*pbuf_list);
-      if (pbuf != NULL) {
-        /* set data. */
-        memset(&reply, 0, sizeof(reply));
-        ofp_header_set(&reply.header,
-                       channel_version_get(channel),
-                       OFPT_MULTIPART_REPLY,
-                       0, /* length set in ofp_header_length_set()  */
-                       xid_header->xid);
-        reply.type = OFPMP_FLOW;
-
-        /* encode header, multipart reply */
-        pbuf_plen_set(pbuf, pbuf_size_get(pbuf));
-        res = ofp_multipart_reply_encode(pbuf, &reply);
+      request != NULL && match_list != NULL &&
+      xid_header != NULL && error != NULL) {
+    res = s_flow_stats_reply_header_encode(channel, pbuf_list,
+                                           &walk_arg.pbuf, xid_header);
+    if (res == LAGOPUS_RESULT_OK) {
+      walk_arg.pbuf_list = *pbuf_list;
+      walk_arg.entry_pbuf = pbuf_alloc(OFP_PACKET_MAX_SIZE);
+      if (walk_arg.entry_pbuf != NULL) {
+        res = ofp_flow_stats_walk(channel_dpid_get(channel),
+                                  request, match_list,
+                                  s_flow_stats_walk_proc, &walk_arg,
+                                  error);
         if (res == LAGOPUS_RESULT_OK) {
-          res = s_flow_stats_list_encode(*pbuf_list, &pbuf, flow_stats_list);
-          if (res == LAGOPUS_RESULT_OK) {
-            /* set packet length */
-            res = pbuf_length_get(pbuf, &length);
-            if (res == LAGOPUS_RESULT_OK) {
-              res = ofp_header_length_set(pbuf, length);
-              if (res == LAGOPUS_RESULT_OK) {
-                pbuf_plen_reset(pbuf);
-              } else {
-                lagopus_msg_warning("FAILED : ofp_header_length_set (%s).\n",
-                                    lagopus_error_get_string(res));
-              }
-            } else {
-              lagopus_msg_warning("FAILED (%s).\n",
-                                  lagopus_error_get_string(res));
-            }
-          }
+          /* set packet length */
+          res = s_flow_stats_reply_length_set(walk_arg.pbuf);
         } else {
-          lagopus_msg_warning("FAILED : ofp_multipart_reply_encode (%s).\n",
+          lagopus_msg_warning("flow_stats walk error (%s)\n",
                               lagopus_error_get_string(res));
         }
+        pbuf_free(walk_arg.entry_pbuf);
       } else {
-        /* pbuf_list_last_get returns NULL */
         res = LAGOPUS_RESULT_NO_MEMORY;
       }
-    } else {
-      /* pbuf_list_alloc returns NULL */
-      res = LAGOPUS_RESULT_NO_MEMORY;
     }
   } else {
     /* params are NULL */
@@ -210,7 +207,6 @@ ofp_flow_stats_request_handle(struct channel *channel, struct pbuf *pbuf,
   struct pbuf_list *send_pbuf_list = NULL;
   struct ofp_flow_stats_request request;
   struct match_list match_list;
-  struct flow_stats_list flow_stats_list;
 
   /* check params */
   if (channel != NULL && pbuf != NULL &&
@@ -220,24 +216,17 @@ ofp_flow_stats_request_handle(struct channel *channel, struct pbuf *pbuf,
     if (res == LAGOPUS_RESULT_OK) {
       /* init. */
       TAILQ_INIT(&match_list);
-      TAILQ_INIT(&flow_stats_list);
 
       /* decode */
       if ((res = ofp_match_parse(channel, pbuf, &match_list, error))
           != LAGOPUS_RESULT_OK) {
         lagopus_msg_warning("match decode error (%s)\n",
                             lagopus_error_get_string(res));
-      } else if ((res = ofp_flow_stats_get(
-                          channel_dpid_get(channel),
-                          &request, &match_list, &flow_stats_list, error))
-                 != LAGOPUS_RESULT_OK) {
-        lagopus_msg_warning("flow_stats decode error (%s)\n",
-                            lagopus_error_get_string(res));
       } else {                  /* decode success */
         /* create flow_stats_reply. */
         res = ofp_flow_stats_reply_create(channel, &send_pbuf_list,
-                                          &flow_stats_list,
-                                          xid_header);
+                                          &request, &match_list,
+                                          xid_header, error);
         if (res == LAGOPUS_RESULT_OK) {
           /* send flow_stats reply */
           res = channel_send_packet_list(channel, send_pbuf_list);
@@ -253,7 +242,6 @@ ofp_flow_stats_request_handle(struct channel *channel, struct pbuf *pbuf,
       }
 
       ofp_match_list_elem_free(&match_list);
-      s_ofp_flow_stats_list_elem_free(&flow_stats_list);
     } else {
       lagopus_msg_warning("flow_stats_request decode error (%s)\n",
                           lagopus_error_get_string(res));
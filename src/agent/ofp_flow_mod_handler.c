@@ -60,6 +60,67 @@ flow_mod_trace(struct ofp_flow_mod *flow_mod,
   }
 }
 
+/* Parse flow mod, lists are freed on failure. */
+static lagopus_result_t
+flow_mod_parse(struct channel *channel, struct pbuf *pbuf,
+               struct ofp_flow_mod *flow_mod,
+               struct match_list *match_list,
+               struct instruction_list *instruction_list,
+               struct ofp_error *error) {
+  lagopus_result_t ret;
+
+  /* Parse flow mod header. */
+  ret = ofp_flow_mod_decode(pbuf, flow_mod);
+
+  if (ret == LAGOPUS_RESULT_OK) {
+    ret = flow_mod_flags_check(flow_mod->flags, error);
+
+    if (ret == LAGOPUS_RESULT_OK) {
+      /* Parse matches. */
+      ret = ofp_match_parse(channel, pbuf, match_list, error);
+
+      if (ret == LAGOPUS_RESULT_OK) {
+        /* Parse instructions. */
+        if (flow_mod->command == OFPFC_DELETE ||
+            flow_mod->command == OFPFC_DELETE_STRICT) {
+          /* skip pbuf. */
+          ret = pbuf_forward(pbuf, pbuf_plen_get(pbuf));
+          if (ret != LAGOPUS_RESULT_OK) {
+            lagopus_msg_warning("FAILED (%s).\n",
+                                lagopus_error_get_string(ret));
+          }
+        } else {
+          while (pbuf_plen_get(pbuf) > 0) {
+            ret = ofp_instruction_parse(pbuf, instruction_list, error);
+            if (ret != LAGOPUS_RESULT_OK) {
+              lagopus_msg_warning("FAILED (%s).\n",
+                                  lagopus_error_get_string(ret));
+              break;
+            }
+          }
+        }
+      } else {
+        lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
+      }
+    } else {
+      lagopus_msg_warning("FAILED (%s).\n",
+                          lagopus_error_get_string(ret));
+    }
+  } else {
+    lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
+    ret = LAGOPUS_RESULT_OFP_ERROR;
+    ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+  }
+
+  /* free. */
+  if (ret != LAGOPUS_RESULT_OK) {
+    ofp_instruction_list_elem_free(instruction_list);
+    ofp_match_list_elem_free(match_list);
+  }
+
+  return ret;
+}
+
 /* RECV */
 /* FlowMod packet receive. */
 lagopus_result_t
@@ -77,87 +138,89 @@ ofp_flow_mod_handle(struct channel *channel, struct pbuf *pbuf,
     TAILQ_INIT(&match_list);
     TAILQ_INIT(&instruction_list);
 
-    /* Parse flow mod header. */
-    ret = ofp_flow_mod_decode(pbuf, &flow_mod);
+    ret = flow_mod_parse(channel, pbuf, &flow_mod,
+                         &match_list, &instruction_list, error);
 
     if (ret == LAGOPUS_RESULT_OK) {
-      ret = flow_mod_flags_check(flow_mod.flags, error);
-
-      if (ret == LAGOPUS_RESULT_OK) {
-        /* Parse matches. */
-        ret = ofp_match_parse(channel, pbuf, &match_list, error);
-
-        if (ret == LAGOPUS_RESULT_OK) {
-          /* Parse instructions. */
-          if (flow_mod.command == OFPFC_DELETE ||
-              flow_mod.command == OFPFC_DELETE_STRICT) {
-            /* skip pbuf. */
-            ret = pbuf_forward(pbuf, pbuf_plen_get(pbuf));
-            if (ret != LAGOPUS_RESULT_OK) {
-              lagopus_msg_warning("FAILED (%s).\n",
-                                  lagopus_error_get_string(ret));
-            }
-          } else {
-            while (pbuf_plen_get(pbuf) > 0) {
-              ret = ofp_instruction_parse(pbuf, &instruction_list, error);
-              if (ret != LAGOPUS_RESULT_OK) {
-                lagopus_msg_warning("FAILED (%s).\n",
-                                    lagopus_error_get_string(ret));
-                break;
-              }
-            }
-          }
-
-          if (ret == LAGOPUS_RESULT_OK) {
-            /* trace. */
-            flow_mod_trace(&flow_mod, &match_list, &instruction_list);
-
-            /* Flow add, modify, delete. */
-            dpid = channel_dpid_get(channel);
-            switch (flow_mod.command) {
-              case OFPFC_ADD:
-                ret = ofp_flow_mod_check_add(dpid, &flow_mod,
-                                             &match_list, &instruction_list,
-                                             error);
-                break;
-              case OFPFC_MODIFY:
-              case OFPFC_MODIFY_STRICT:
-                ret = ofp_flow_mod_modify(dpid, &flow_mod,
-                                          &match_list, &instruction_list,
-                                          error);
-                break;
-              case OFPFC_DELETE:
-              case OFPFC_DELETE_STRICT:
-                ret = ofp_flow_mod_delete(dpid,
-                                          &flow_mod, &match_list,
-                                          error);
-                break;
-              default:
-                ofp_error_set(error, OFPET_FLOW_MOD_FAILED, OFPFMFC_BAD_COMMAND);
-                ret = LAGOPUS_RESULT_OFP_ERROR;
-                break;
-            }
+      /* trace. */
+      flow_mod_trace(&flow_mod, &match_list, &instruction_list);
+
+      /* Flow add, modify, delete. */
+      dpid = channel_dpid_get(channel);
+      switch (flow_mod.command) {
+        case OFPFC_ADD:
+          ret = ofp_flow_mod_check_add(dpid, &flow_mod,
+                                       &match_list, &instruction_list,
+                                       error);
+          break;
+        case OFPFC_MODIFY:
+        case OFPFC_MODIFY_STRICT:
+          ret = ofp_flow_mod_modify(dpid, &flow_mod,
+                                    &match_list, &instruction_list,
+                                    error);
+          break;
+        case OFPFC_DELETE:
+        case OFPFC_DELETE_STRICT:
+          ret = ofp_flow_mod_delete(dpid,
+                                    &flow_mod, &match_list,
+                                    error);
+          break;
+        default:
+          ofp_error_set(error, OFPET_FLOW_MOD_FAILED, OFPFMFC_BAD_COMMAND);
+          ret = LAGOPUS_RESULT_OFP_ERROR;
+          break;
+      }
 
-            if (ret == LAGOPUS_RESULT_OFP_ERROR) {
-              lagopus_msg_warning("OFP ERROR (%s).\n",
-                                  lagopus_error_get_string(ret));
-            }
-          }
-        } else {
-          lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
-        }
-      } else {
-        lagopus_msg_warning("FAILED (%s).\n",
+      if (ret == LAGOPUS_RESULT_OFP_ERROR) {
+        lagopus_msg_warning("OFP ERROR (%s).\n",
                             lagopus_error_get_string(ret));
       }
-    } else {
-      lagopus_msg_warning("FAILED (%s).\n", lagopus_error_get_string(ret));
-      ret = LAGOPUS_RESULT_OFP_ERROR;
-      ofp_error_set(error, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN);
+
+      /* free. */
+      if (ret != LAGOPUS_RESULT_OK) {
+        ofp_instruction_list_elem_free(&instruction_list);
+        ofp_match_list_elem_free(&match_list);
+      }
     }
+  } else {
+    ret = LAGOPUS_RESULT_INVALID_ARGS;
+  }
+
+  return ret;
+}
+
+/* Check FlowMod packet without modifying flows. */
+lagopus_result_t
+ofp_flow_mod_check(struct channel *channel, struct pbuf *pbuf,
+                   struct ofp_error *error) {
+  lagopus_result_t ret;
+  struct ofp_flow_mod flow_mod;
+  struct match_list match_list;
+  struct instruction_list instruction_list;
+
+  if (channel != NULL && pbuf != NULL) {
+    /* Init lists. */
+    TAILQ_INIT(&match_list);
+    TAILQ_INIT(&instruction_list);
+
+    ret = flow_mod_parse(channel, pbuf, &flow_mod,
+                         &match_list, &instruction_list, error);
+
+    if (ret == LAGOPUS_RESULT_OK) {
+      switch (flow_mod.command) {
+        case OFPFC_ADD:
+        case OFPFC_MODIFY:
+        case OFPFC_MODIFY_STRICT:
+        case OFPFC_DELETE:
+        case OFPFC_DELETE_STRICT:
+          break;
+        default:
+          ofp_error_set(error, OFPET_FLOW_MOD_FAILED, OFPFMFC_BAD_COMMAND);
+          ret = LAGOPUS_RESULT_OFP_ERROR;
+          break;
+      }
 
-    /* free. */
-    if (ret != LAGOPUS_RESULT_OK) {
+      /* free. */
       ofp_instruction_list_elem_free(&instruction_list);
       ofp_match_list_elem_free(&match_list);
     }
@@ -41,4 +41,20 @@ ofp_flow_mod_handle(struct channel *channel, struct pbuf *pbuf,
                     struct ofp_header *xid_header,
                     struct ofp_error *error);
 
+/**
+ * Check ofp_flow_mod without modifying flows.
+ *
+ *     @param[in]	channel	A pointer to \e channel structure.
+ *     @param[in]	pbuf	A pointer to \e pbuf structure.
+ *     @param[out]	error	A pointer to \e ofp_error structure.
+ *     If errors occur, set filed values.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_OFP_ERROR Failed, ofp_error.
+ *     @retval	LAGOPUS_RESULT_ANY_FAILURES Failed.
+ */
+lagopus_result_t
+ofp_flow_mod_check(struct channel *channel, struct pbuf *pbuf,
+                   struct ofp_error *error);
+
 #endif /* __OFP_FLOW_MOD_HANDLER_H__ */
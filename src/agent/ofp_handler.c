@@ -683,9 +683,9 @@ s_process_channelq_entry(struct channelq_data *entry) {
       res = ofp_echo_request_handle(channel, pbuf, &header, &error);
       break;
     case OFPT_EXPERIMENTER:
-      /* unsupport. */
+      /* bundles only. */
       /* res = ofp_experimenter_request_handle(channel, pbuf, &header) */
-      res = ofp_bad_experimenter_handle(&error);
+      res = ofp_bundle_handle(channel, pbuf, &header, &error);
       break;
     case OFPT_FEATURES_REPLY:
       res = ofp_unsupported_handle(&error);
@@ -1080,6 +1080,22 @@ s_channel_freeup_proc(void **val) {
   }
 }
 
+/* get dpid if the entry is flow_mod. */
+static inline bool
+s_channelq_entry_flow_mod(struct channelq_data *entry, uint64_t *dpid) {
+  struct ofp_header header;
+
+  if (entry == NULL
+      || entry->channel == NULL
+      || entry->pbuf == NULL
+      || ofp_header_decode_sneak(entry->pbuf, &header) != LAGOPUS_RESULT_OK
+      || header.type != OFPT_FLOW_MOD) {
+    return false;
+  }
+  *dpid = channel_dpid_get(entry->channel);
+  return true;
+}
+
 /* read channelq */
 static inline lagopus_result_t
 s_channelq_dequeue(channelq_t *q_ptr,
@@ -1090,6 +1106,9 @@ s_channelq_dequeue(channelq_t *q_ptr,
   uint16_t max_batches = channelq_max_batches;
   size_t get_num;
   size_t i;
+  bool batch = false;
+  uint64_t batch_dpid = 0;
+  uint64_t dpid;
 
   lagopus_msg_debug(10,
                     "called. q_size: %lu, max_batches: %"PRIu16"\n",
@@ -1117,8 +1136,21 @@ s_channelq_dequeue(channelq_t *q_ptr,
       for (i = 0; i < get_num; i++) {
         lagopus_mutex_enter_critical(&(s_ofp_handler->m_status_lock), &cstate);
         {
+          /* consecutive flow_mods to a bridge are applied in a batch. */
+          if (batch == false
+              && s_channelq_entry_flow_mod(gets[i], &batch_dpid) == true
+              && ofp_flow_mod_batch_begin(batch_dpid) == LAGOPUS_RESULT_OK) {
+            batch = true;
+          }
           s_process_channelq_entry(gets[i]);
           channelq_data_destroy(gets[i]);
+          if (batch == true
+              && (i + 1 == get_num
+                  || s_channelq_entry_flow_mod(gets[i + 1], &dpid) == false
+                  || dpid != batch_dpid)) {
+            (void) ofp_flow_mod_batch_end(batch_dpid);
+            batch = false;
+          }
         }
         lagopus_mutex_leave_critical(&(s_ofp_handler->m_status_lock), cstate);
       }
@@ -25,6 +25,7 @@
 #include "ofp_match.h"
 #include "lagopus/flowdb.h"
 #include "lagopus/eventq_data.h"
+#include "lagopus/ofp_dp_apis.h"
 
 STATIC lagopus_result_t
 ofp_port_status_create(struct port_status *port_status,
@@ -74,6 +75,13 @@ ofp_port_status_handle(struct port_status *port_status, uint64_t dpid) {
   struct pbuf *send_pbuf = NULL;
 
   if (port_status != NULL) {
+    /* Fast failover groups follow the new port state. */
+    ret = ofp_group_live_update(dpid);
+    if (ret != LAGOPUS_RESULT_OK) {
+      lagopus_msg_warning("FAILED : ofp_group_live_update (%s).\n",
+                          lagopus_error_get_string(ret));
+    }
+
     /* PortStatus. */
     ret = ofp_port_status_create(port_status, &send_pbuf);
     if (ret == LAGOPUS_RESULT_OK) {
@@ -0,0 +1,384 @@
+/*
+ * Copyright 2014-2016 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unity.h"
+#include "lagopus/ofp_dp_apis.h"
+#include "../ofp_bundle_handler.h"
+#include "handler_test_utils.h"
+#include "../channel_mgr.h"
+
+/* bundle control, bundle_id = 1, flags = OFPBF_ATOMIC. */
+#define BUNDLE_CTRL(type)                               \
+  "04 04 00 18 00 00 00 10 4f 4e 46 00 00 00 08 fc"     \
+  "00 00 00 01 00 " type " 00 01"
+
+#define BUNDLE_OPEN     BUNDLE_CTRL("00")
+#define BUNDLE_CLOSE    BUNDLE_CTRL("02")
+#define BUNDLE_COMMIT   BUNDLE_CTRL("04")
+#define BUNDLE_DISCARD  BUNDLE_CTRL("06")
+
+/* bundle add, bundle_id = 1, flags = OFPBF_ATOMIC. */
+#define BUNDLE_ADD(len)                                 \
+  "04 04 00 " len " 00 00 00 10 4f 4e 46 00 00 00 08 fd"  \
+  "00 00 00 01 00 00 00 01"
+
+/* OFPFC_ADD, any match. */
+#define FLOW_MOD_ADD_PRIORITY(priority, flags)          \
+  "04 0e 00 50 00 00 00 10 00 00 00 00 00 00 00 00"     \
+  "00 00 00 00 00 00 00 00 00 00 00 00 00 00 " priority \
+  "00 00 ff ff ff ff ff ff ff ff ff ff " flags " 00 00" \
+  "00 01 00 04 00 00 00 00 00 04 00 18 00 00 00 00"     \
+  "00 00 00 10 00 00 00 00 00 00 00 00 00 00 00 00"
+
+#define FLOW_MOD_ADD FLOW_MOD_ADD_PRIORITY("00 64", "00 00")
+
+/* OFPFC_DELETE, OFPTT_ALL, any match. */
+#define FLOW_MOD_DELETE_ALL                             \
+  "04 0e 00 38 00 00 00 10 00 00 00 00 00 00 00 00"     \
+  "00 00 00 00 00 00 00 00 ff 03 00 00 00 00 00 00"     \
+  "ff ff ff ff ff ff ff ff ff ff ff ff 00 00 00 00"     \
+  "00 01 00 04 00 00 00 00"
+
+void
+setUp(void) {
+}
+
+void
+tearDown(void) {
+}
+
+static lagopus_result_t
+ofp_bundle_ctrl_reply_create_wrap(struct channel *channel,
+                                  struct pbuf **pbuf,
+                                  struct ofp_header *xid_header) {
+  struct ofp_bundle_ctrl_msg ctrl_req;
+
+  ctrl_req.bundle_id = 0x01;
+  ctrl_req.type = OFPBCT_COMMIT_REQUEST;
+  ctrl_req.flags = OFPBF_ATOMIC | OFPBF_ORDERED;
+
+  return ofp_bundle_ctrl_reply_create(channel, pbuf, xid_header, &ctrl_req);
+}
+
+/* flows in the flowdb after s_ofp_bundle_handle_flow_count_wrap(). */
+static int s_nflow;
+static uint16_t s_priority;
+
+/* Handle the request, then count flows of the bridge. */
+static lagopus_result_t
+s_ofp_bundle_handle_flow_count_wrap(struct channel *channel,
+                                    struct pbuf *pbuf,
+                                    struct ofp_header *xid_header,
+                                    struct ofp_error *error) {
+  lagopus_result_t ret;
+  struct ofp_flow_stats_request request;
+  struct match_list match_list;
+  struct flow_stats_list flow_stats_list;
+  struct flow_stats *flow_stats;
+  struct ofp_error stats_error;
+
+  ret = ofp_bundle_handle(channel, pbuf, xid_header, error);
+
+  memset(&request, 0, sizeof(request));
+  request.table_id = OFPTT_ALL;
+  request.out_port = OFPP_ANY;
+  request.out_group = OFPG_ANY;
+  TAILQ_INIT(&match_list);
+  TAILQ_INIT(&flow_stats_list);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OK,
+                            ofp_flow_stats_get(channel_dpid_get(channel),
+                                               &request, &match_list,
+                                               &flow_stats_list,
+                                               &stats_error),
+                            "ofp_flow_stats_get error.");
+  s_nflow = 0;
+  s_priority = 0;
+  while ((flow_stats = TAILQ_FIRST(&flow_stats_list)) != NULL) {
+    TAILQ_REMOVE(&flow_stats_list, flow_stats, entry);
+    s_nflow++;
+    s_priority = flow_stats->ofp.priority;
+    ofp_match_list_elem_free(&flow_stats->match_list);
+    ofp_instruction_list_elem_free(&flow_stats->instruction_list);
+    free(flow_stats);
+  }
+  return ret;
+}
+
+void
+test_prologue(void) {
+  lagopus_result_t r;
+  const char *argv0 =
+    ((IS_VALID_STRING(lagopus_get_command_name()) == true) ?
+     lagopus_get_command_name() : "callout_test");
+  const char *const argv[] = {
+    argv0, NULL
+  };
+
+#define N_CALLOUT_WORKERS	1
+  (void)lagopus_mainloop_set_callout_workers_number(N_CALLOUT_WORKERS);
+  r = lagopus_mainloop_with_callout(1, argv, NULL, NULL,
+                                    false, false, true);
+  TEST_ASSERT_EQUAL(r, LAGOPUS_RESULT_OK);
+  channel_mgr_initialize();
+}
+
+void
+test_ofp_bundle_ctrl_reply_create(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  ret = check_packet_create(ofp_bundle_ctrl_reply_create_wrap,
+                            "04 04 00 18 00 00 00 10 4f 4e 46 00 00 00 08 fc"
+                            "00 00 00 01 00 05 00 03");
+  /*                                     <---> type = OFPBCT_COMMIT_REPLY */
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OK, ret,
+                            "ofp_bundle_ctrl_reply_create(normal) error.");
+}
+
+void
+test_ofp_bundle_handle_commit(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  const char *data[4] = {
+    BUNDLE_OPEN,
+    BUNDLE_ADD("68") FLOW_MOD_ADD,
+    BUNDLE_CLOSE,
+    BUNDLE_COMMIT
+  };
+
+  ret = check_packet_parse_array(ofp_bundle_handle, data, 4);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OK, ret,
+                            "ofp_bundle_handle(commit) error.");
+}
+
+void
+test_ofp_bundle_handle_commit_atomic_failed(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[10] = {
+    /* a flow of priority 100 before the bundle. */
+    BUNDLE_OPEN,
+    BUNDLE_ADD("68") FLOW_MOD_ADD,
+    BUNDLE_CLOSE,
+    BUNDLE_COMMIT,
+    BUNDLE_OPEN,
+    /* new flow. */
+    BUNDLE_ADD("68") FLOW_MOD_ADD_PRIORITY("00 c8", "00 00"),
+    /* OFPFF_CHECK_OVERLAP with the flow before the bundle, fails. */
+    BUNDLE_ADD("68") FLOW_MOD_ADD_PRIORITY("00 64", "00 02"),
+    /* not applied. */
+    BUNDLE_ADD("50") FLOW_MOD_DELETE_ALL,
+    BUNDLE_CLOSE,
+    BUNDLE_COMMIT
+  };
+
+  ofp_error_set(&expected_error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_FAILED);
+  ret = check_packet_parse_array_expect_error(
+          s_ofp_bundle_handle_flow_count_wrap, data, 10, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(commit failed) error.");
+
+  /* the flow added by the 1st flow mod is undone. */
+  TEST_ASSERT_EQUAL_MESSAGE(1, s_nflow, "flowdb is changed.");
+  TEST_ASSERT_EQUAL_MESSAGE(0x64, s_priority, "flowdb is changed.");
+}
+
+void
+test_ofp_bundle_handle_implicit_open_discard(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  const char *data[2] = {
+    BUNDLE_ADD("68") FLOW_MOD_ADD,
+    BUNDLE_DISCARD
+  };
+
+  ret = check_packet_parse_array(ofp_bundle_handle, data, 2);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OK, ret,
+                            "ofp_bundle_handle(discard) error.");
+}
+
+void
+test_ofp_bundle_handle_bundle_exist(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[2] = {
+    BUNDLE_OPEN,
+    BUNDLE_OPEN
+  };
+
+  ofp_error_set(&expected_error, OFPET_EXPERIMENTER, ONFERR_ET_BUNDLE_EXIST);
+  ret = check_packet_parse_array_expect_error(ofp_bundle_handle,
+        data, 2, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(bundle exist) error.");
+}
+
+void
+test_ofp_bundle_handle_bad_id(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[1] = {
+    BUNDLE_COMMIT
+  };
+
+  ofp_error_set(&expected_error, OFPET_EXPERIMENTER, ONFERR_ET_BAD_ID);
+  ret = check_packet_parse_array_expect_error(ofp_bundle_handle,
+        data, 1, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(bad id) error.");
+}
+
+void
+test_ofp_bundle_handle_bundle_closed(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[3] = {
+    BUNDLE_OPEN,
+    BUNDLE_CLOSE,
+    BUNDLE_ADD("68") FLOW_MOD_ADD
+  };
+
+  ofp_error_set(&expected_error, OFPET_EXPERIMENTER, ONFERR_ET_BUNDLE_CLOSED);
+  ret = check_packet_parse_array_expect_error(ofp_bundle_handle,
+        data, 3, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(bundle closed) error.");
+}
+
+void
+test_ofp_bundle_handle_bad_flags(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[2] = {
+    BUNDLE_OPEN,
+    "04 04 00 18 00 00 00 10 4f 4e 46 00 00 00 08 fc"
+    "00 00 00 01 00 04 00 02"
+    /*                 <---> flags = OFPBF_ORDERED, opened with ATOMIC */
+  };
+
+  ofp_error_set(&expected_error, OFPET_EXPERIMENTER, ONFERR_ET_BAD_FLAGS);
+  ret = check_packet_parse_array_expect_error(ofp_bundle_handle,
+        data, 2, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(bad flags) error.");
+}
+
+void
+test_ofp_bundle_handle_msg_bad_xid(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[1] = {
+    BUNDLE_ADD("68")
+    "04 0e 00 50 00 00 00 11 00 00 00 00 00 00 00 00"
+    /*           <---------> xid is not the same as bundle add */
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 64"
+    "00 00 ff ff ff ff ff ff ff ff ff ff 00 00 00 00"
+    "00 01 00 04 00 00 00 00 00 04 00 18 00 00 00 00"
+    "00 00 00 10 00 00 00 00 00 00 00 00 00 00 00 00"
+  };
+
+  ofp_error_set(&expected_error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_BAD_XID);
+  ret = check_packet_parse_array_expect_error(ofp_bundle_handle,
+        data, 1, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(bad xid) error.");
+}
+
+void
+test_ofp_bundle_handle_msg_unsup(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[1] = {
+    BUNDLE_ADD("20")
+    "04 02 00 08 00 00 00 10"
+    /*<-> OFPT_ECHO_REQUEST */
+  };
+
+  ofp_error_set(&expected_error, OFPET_EXPERIMENTER, ONFERR_ET_MSG_UNSUP);
+  ret = check_packet_parse_array_expect_error(ofp_bundle_handle,
+        data, 1, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(unsupported message) error.");
+}
+
+void
+test_ofp_bundle_handle_msg_invalid(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+  const char *data[1] = {
+    BUNDLE_ADD("68")
+    "04 0e 00 50 00 00 00 10 00 00 00 00 00 00 00 00"
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 64"
+    "00 00 ff ff ff ff ff ff ff ff ff ff 00 00 00 00"
+    "00 01 00 04 00 00 00 00 ff fe 00 18 00 00 00 00"
+    /*                         <---> type (0xfffe -> invalid instruction) */
+    "00 00 00 10 00 00 00 00 00 00 00 00 00 00 00 00"
+  };
+
+  ofp_error_set(&expected_error, OFPET_BAD_INSTRUCTION, OFPBIC_UNKNOWN_INST);
+  ret = check_packet_parse_array_expect_error(ofp_bundle_handle,
+        data, 1, &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(invalid message) error.");
+}
+
+void
+test_ofp_bundle_handle_bad_experimenter(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct ofp_error expected_error = {0, 0, {NULL}};
+
+  ofp_error_set(&expected_error, OFPET_BAD_REQUEST, OFPBRC_BAD_EXPERIMENTER);
+  ret = check_packet_parse_expect_error(ofp_bundle_handle,
+                                        "04 04 00 10 00 00 00 10"
+                                        "00 00 00 01 00 00 00 02",
+                                        &expected_error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OFP_ERROR, ret,
+                            "ofp_bundle_handle(bad experimenter) error.");
+}
+
+void
+test_ofp_bundle_handle_null(void) {
+  lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  struct pbuf *pbuf = pbuf_alloc(65535);
+  struct ofp_header xid_header;
+  struct ofp_error error;
+  struct channel *channel = channel_alloc_ip4addr("127.0.0.1", "1000", 0x01);
+
+  ret = ofp_bundle_handle(NULL, pbuf, &xid_header, &error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
+                            "ofp_bundle_handle error.");
+
+  ret = ofp_bundle_handle(channel, NULL, &xid_header, &error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
+                            "ofp_bundle_handle error.");
+
+  ret = ofp_bundle_handle(channel, pbuf, NULL, &error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
+                            "ofp_bundle_handle error.");
+
+  ret = ofp_bundle_handle(channel, pbuf, &xid_header, NULL);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
+                            "ofp_bundle_handle error.");
+
+  /* after. */
+  channel_free(channel);
+  pbuf_free(pbuf);
+}
+
+void
+test_epilogue(void) {
+  lagopus_result_t r;
+  channel_mgr_finalize();
+  r = global_state_request_shutdown(SHUTDOWN_GRACEFULLY);
+  TEST_ASSERT_EQUAL(r, LAGOPUS_RESULT_OK);
+  lagopus_mainloop_wait_thread();
+}
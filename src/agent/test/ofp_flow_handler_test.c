@@ -39,28 +39,97 @@ ofp_multipart_request_handle_wrap(struct channel *channel,
   return ofp_multipart_request_handle(channel, pbuf, xid_header, error);
 }
 
-static struct flow_stats *
-s_flow_stats_alloc(void) {
-  struct flow_stats *flow_stats;
-
-  flow_stats = calloc(1, sizeof(struct flow_stats));
-  if (flow_stats != NULL) {
-    TAILQ_INIT(&flow_stats->match_list);
-    TAILQ_INIT(&flow_stats->instruction_list);
-  }
+/* number of flows added by s_ofp_flow_reply_create_wrap(). */
+static int s_nflow;
+
+/* add flows of priority s_nflow..1 into table 1. */
+static void
+s_flow_add(struct channel *channel) {
+  struct ofp_flow_mod flow_mod;
+  struct match_list match_list;
+  struct instruction_list instruction_list;
+  struct instruction *instruction;
+  struct ofp_error error;
+  int i;
 
-  return flow_stats;
+  memset(&flow_mod, 0, sizeof(flow_mod));
+  flow_mod.table_id = 0x01;
+  flow_mod.cookie = 0x08;
+  flow_mod.command = OFPFC_ADD;
+  flow_mod.buffer_id = OFP_NO_BUFFER;
+  flow_mod.out_port = OFPP_ANY;
+  flow_mod.out_group = OFPG_ANY;
+  for (i = 0; i < s_nflow; i++) {
+    TAILQ_INIT(&match_list);
+    TAILQ_INIT(&instruction_list);
+    if ((instruction = instruction_alloc()) != NULL) {
+      instruction->ofpit_goto_table.type = OFPIT_GOTO_TABLE;
+      instruction->ofpit_goto_table.len = 0x08;
+      instruction->ofpit_goto_table.table_id = 0x02;
+      TAILQ_INSERT_TAIL(&instruction_list, instruction, entry);
+    } else {
+      TEST_FAIL_MESSAGE("allocation error.");
+    }
+    flow_mod.priority = (uint16_t) (s_nflow - i);
+    TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OK,
+                              ofp_flow_mod_check_add(
+                                channel_dpid_get(channel), &flow_mod,
+                                &match_list, &instruction_list, &error),
+                              "flow add error.");
+  }
 }
 
-static struct flow_stats_list s_flow_stats_list;
+/*
+ * Check that flows are replied in descending order of priority, once
+ * each, then clear priorities and durations, which vary per flow and
+ * per run, so that replies can be compared with fixed data.
+ */
+static void
+s_flow_stats_normalize(struct pbuf_list *pbuf_list) {
+  struct pbuf *pbuf;
+  uint8_t *p;
+  uint16_t length, priority;
+  int n = s_nflow;
+
+  TAILQ_FOREACH(pbuf, &pbuf_list->tailq, entry) {
+    p = pbuf->getp + sizeof(struct ofp_multipart_reply);
+    while (p < pbuf->putp) {
+      length = (uint16_t) ((p[0] << 8) | p[1]);
+      TEST_ASSERT_TRUE_MESSAGE(length != 0, "flow_stats length error.");
+      priority = (uint16_t) ((p[12] << 8) | p[13]);
+      TEST_ASSERT_EQUAL_MESSAGE(n, priority, "flow_stats order error.");
+      n--;
+      memset(p + 4, 0, 8);      /* duration_sec, duration_nsec */
+      memset(p + 12, 0, 2);     /* priority */
+      p += length;
+    }
+  }
+  TEST_ASSERT_EQUAL_MESSAGE(0, n, "flow_stats count error.");
+}
 
 static lagopus_result_t
 s_ofp_flow_reply_create_wrap(struct channel *channel,
                              struct pbuf_list **pbuf_list,
                              struct ofp_header *xid_header) {
-  return ofp_flow_stats_reply_create(channel, pbuf_list,
-                                     &s_flow_stats_list,
-                                     xid_header);
+  lagopus_result_t ret;
+  struct ofp_flow_stats_request request;
+  struct match_list match_list;
+  struct ofp_error error;
+
+  s_flow_add(channel);
+
+  memset(&request, 0, sizeof(request));
+  request.table_id = OFPTT_ALL;
+  request.out_port = OFPP_ANY;
+  request.out_group = OFPG_ANY;
+  TAILQ_INIT(&match_list);
+  ret = ofp_flow_stats_reply_create(channel, pbuf_list,
+                                    &request, &match_list,
+                                    xid_header, &error);
+  if (ret == LAGOPUS_RESULT_OK) {
+    s_flow_stats_normalize(*pbuf_list);
+  }
+  return ret;
 }
 
 
@@ -522,125 +591,51 @@ test_ofp_flow_handle_null(void) {
 void
 test_ofp_flow_reply_create_01(void) {
   lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
-  struct flow_stats *flow_stats = NULL;
-  struct instruction *instruction = NULL;
-  struct match *match = NULL;
   const char *require[1] = {
-    "04 13 00 58 00 00 00 10 00 01 00 00 00 00 00 00 "
-    "00 48 01 00 00 00 00 02 00 00 00 03 00 04 00 05 "
-    "00 06 00 07 00 00 00 00 00 00 00 00 00 00 00 08 "
-    "00 00 00 00 00 00 00 09 00 00 00 00 00 00 00 0a "
-    "00 01 00 10 00 00 01 08 00 00 00 00 00 00 00 00 "
-    "00 01 00 08 00 00 00 00"
+    "04 13 00 50 00 00 00 10 00 01 00 00 00 00 00 00 "
+    "00 40 01 00 00 00 00 00 00 00 00 00 00 00 00 00 "
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 08 "
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 "
+    "00 01 00 04 00 00 00 00 "
+    "00 01 00 08 02 00 00 00"
   };
 
-  TAILQ_INIT(&s_flow_stats_list);
-  if ((flow_stats = s_flow_stats_alloc()) != NULL) {
-    /* flow_stats = 48, match = 16, instruction = 8, sum = 72 */
-    flow_stats->ofp.length = 48 + 16 + 8;
-    flow_stats->ofp.table_id = 0x01;
-    flow_stats->ofp.duration_sec = 0x02;
-    flow_stats->ofp.duration_nsec = 0x03;
-    flow_stats->ofp.priority = 0x04;
-    flow_stats->ofp.idle_timeout = 0x05;
-    flow_stats->ofp.hard_timeout = 0x06;
-    flow_stats->ofp.flags = 0x07;
-    flow_stats->ofp.cookie = 0x08;
-    flow_stats->ofp.packet_count = 0x09;
-    flow_stats->ofp.byte_count = 0x0a;
-    if ((match = match_alloc(8)) != NULL) {
-      match->oxm_class = 0x00;
-      match->oxm_field = 0x01;
-      match->oxm_length = 0x08;
-      TAILQ_INSERT_TAIL(&(flow_stats->match_list), match, entry);
-    }
-    if ((instruction = instruction_alloc()) != NULL) {
-      instruction->ofpit_goto_table.type = OFPIT_GOTO_TABLE;
-      instruction->ofpit_goto_table.len = 0x08; /* action_list empty */
-      instruction->ofpit_goto_table.table_id = 0x00;
-      TAILQ_INSERT_TAIL(&(flow_stats->instruction_list), instruction, entry);
-    }
-    TAILQ_INSERT_TAIL(&s_flow_stats_list, flow_stats, entry);
-  } else {
-    TEST_FAIL_MESSAGE("allocation error.");
-  }
-
-  /* port 0 */
+  /* flow_stats = 48, match = 8, instruction = 8, sum = 64 */
+  s_nflow = 1;
   ret = check_pbuf_list_packet_create(s_ofp_flow_reply_create_wrap, require, 1);
   TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OK, ret, "create port 0 error.");
-
-  /* free */
-  while ((flow_stats = TAILQ_FIRST(&s_flow_stats_list)) != NULL) {
-    TAILQ_REMOVE(&s_flow_stats_list, flow_stats, entry);
-    ofp_match_list_elem_free(&flow_stats->match_list);
-    ofp_instruction_list_elem_free(&flow_stats->instruction_list);
-    free(flow_stats);
-  }
 }
 
 void
 test_ofp_flow_reply_create_02(void) {
   lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
-  struct flow_stats *flow_stats = NULL;
-  struct match *match = NULL;
   const char *header_data[2] = {
-    "04 13 ff b8 00 00 00 10 00 01 00 01 00 00 00 00 ",
-    "04 13 00 58 00 00 00 10 00 01 00 00 00 00 00 00 "
+    "04 13 ff d0 00 00 00 10 00 01 00 01 00 00 00 00 ",
+    "04 13 77 50 00 00 00 10 00 01 00 00 00 00 00 00 "
   };
   const char *body_data[2] = {
-    "00 48 01 00 00 00 00 02 00 00 00 03 00 04 00 05 "
-    "00 06 00 07 00 00 00 00 00 00 00 00 00 00 00 08 "
-    "00 00 00 00 00 00 00 09 00 00 00 00 00 00 00 0a "
-    "00 01 00 18 00 00 01 10 00 00 00 00 00 00 00 00 "
-    "00 00 00 00 00 00 00 00",
-    "00 48 01 00 00 00 00 02 00 00 00 03 00 04 00 05 "
-    "00 06 00 07 00 00 00 00 00 00 00 00 00 00 00 08 "
-    "00 00 00 00 00 00 00 09 00 00 00 00 00 00 00 0a "
-    "00 01 00 18 00 00 01 10 00 00 00 00 00 00 00 00 "
-    "00 00 00 00 00 00 00 00"
+    "00 40 01 00 00 00 00 00 00 00 00 00 00 00 00 00 "
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 08 "
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 "
+    "00 01 00 04 00 00 00 00 "
+    "00 01 00 08 02 00 00 00",
+    "00 40 01 00 00 00 00 00 00 00 00 00 00 00 00 00 "
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 08 "
+    "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 "
+    "00 01 00 04 00 00 00 00 "
+    "00 01 00 08 02 00 00 00"
   };
-  size_t nums[2] = {909, 1};
-  int i;
-
-  /* data */
-  TAILQ_INIT(&s_flow_stats_list);
-  for (i = 0; i < 910; i++) {
-    if ((flow_stats = s_flow_stats_alloc()) != NULL) {
-      /* flow_stats = 48, match = 24, sum = 72 */
-      flow_stats->ofp.length = 0;
-      flow_stats->ofp.table_id = 0x01;
-      flow_stats->ofp.duration_sec = 0x02;
-      flow_stats->ofp.duration_nsec = 0x03;
-      flow_stats->ofp.priority = 0x04;
-      flow_stats->ofp.idle_timeout = 0x05;
-      flow_stats->ofp.hard_timeout = 0x06;
-      flow_stats->ofp.flags = 0x07;
-      flow_stats->ofp.cookie = 0x08;
-      flow_stats->ofp.packet_count = 0x09;
-      flow_stats->ofp.byte_count = 0x0a;
-      if ((match = match_alloc(16)) != NULL) {
-        match->oxm_class = 0x00;
-        match->oxm_field = 0x01;
-        match->oxm_length = 0x10;
-        TAILQ_INSERT_TAIL(&(flow_stats->match_list), match, entry);
-      }
-      TAILQ_INSERT_TAIL(&s_flow_stats_list, flow_stats, entry);
-    } else {
-      TEST_FAIL_MESSAGE("allocation error.");
-    }
-  }
+  size_t nums[2] = {1023, 477};
 
+  /*
+   * 1500 flows of 64 bytes span two multipart replies, and more than
+   * one chunk of ofp_flow_stats_walk() between which the flowdb is
+   * unlocked.
+   */
+  s_nflow = 1500;
   ret = check_pbuf_list_across_packet_create(s_ofp_flow_reply_create_wrap,
         header_data, body_data, nums, 2);
   TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_OK, ret, "create port 0 error.");
-
-  /* free */
-  while ((flow_stats = TAILQ_FIRST(&s_flow_stats_list)) != NULL) {
-    TAILQ_REMOVE(&s_flow_stats_list, flow_stats, entry);
-    ofp_match_list_elem_free(&flow_stats->match_list);
-    ofp_instruction_list_elem_free(&flow_stats->instruction_list);
-    free(flow_stats);
-  }
 }
 
 void
@@ -648,30 +643,46 @@ test_ofp_flow_reply_create_null(void) {
   lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
   struct channel *channel = channel_alloc_ip4addr("127.0.0.1", "1000", 0x01);
   struct pbuf_list *pbuf_list = NULL;
-  struct flow_stats_list flow_stats_list;
+  struct ofp_flow_stats_request request;
+  struct match_list match_list;
   struct ofp_header ofp_header;
+  struct ofp_error error;
 
   ret = ofp_flow_stats_reply_create(NULL, &pbuf_list,
-                                    &flow_stats_list,
-                                    &ofp_header);
+                                    &request, &match_list,
+                                    &ofp_header, &error);
   TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
                             "NULL-check error. (channel)");
 
   ret = ofp_flow_stats_reply_create(channel, NULL,
-                                    &flow_stats_list,
-                                    &ofp_header);
+                                    &request, &match_list,
+                                    &ofp_header, &error);
   TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
                             "NULL-check error. (pbuf)");
 
   ret = ofp_flow_stats_reply_create(channel, &pbuf_list,
-                                    NULL, &ofp_header);
+                                    NULL, &match_list,
+                                    &ofp_header, &error);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
+                            "NULL-check error. (request)");
+
+  ret = ofp_flow_stats_reply_create(channel, &pbuf_list,
+                                    &request, NULL,
+                                    &ofp_header, &error);
   TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
-                            "NULL-check error. (flow_stats_list)");
+                            "NULL-check error. (match_list)");
 
   ret = ofp_flow_stats_reply_create(channel, &pbuf_list,
-                                    &flow_stats_list, NULL);
+                                    &request, &match_list,
+                                    NULL, &error);
   TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
                             "NULL-check error. (ofp_header)");
+
+  ret = ofp_flow_stats_reply_create(channel, &pbuf_list,
+                                    &request, &match_list,
+                                    &ofp_header, NULL);
+  TEST_ASSERT_EQUAL_MESSAGE(LAGOPUS_RESULT_INVALID_ARGS, ret,
+                            "NULL-check error. (error)");
   channel_free(channel);
 }
 
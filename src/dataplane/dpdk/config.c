@@ -103,6 +103,7 @@ static const char usage[] =
   "    --kvstype TYPE: Select key-value store type for flow cache                 \n"
   "           hashmap_nolock  Use hashmap without rwlock (default)                \n"
   "           hashmap         Use hashmap                                         \n"
+  "           openhash        Use preallocated open hash with key verification    \n"
 #ifdef __SSE4_2__
   "           rte_hash        Use DPDK hash table                                 \n"
   "    --hashtype TYPE: Select hash type for flow cache                           \n"
@@ -585,6 +586,8 @@ parse_arg_kvstype(const char *arg) {
     app.kvs_type = FLOWCACHE_HASHMAP;
   } else if (!strcmp(arg, "rte_hash")) {
     app.kvs_type = FLOWCACHE_RTE_HASH;
+  } else if (!strcmp(arg, "openhash")) {
+    app.kvs_type = FLOWCACHE_OPEN_HASH;
   } else {
     return -1;
   }
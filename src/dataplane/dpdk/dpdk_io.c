@@ -99,6 +99,7 @@
 #include "lagopus/ethertype.h"
 #include "lagopus/flowdb.h"
 #include "lagopus/meter.h"
+#include "lagopus/group.h"
 #include "lagopus/port.h"
 #include "lagopus_gstate.h"
 #include "lagopus/ofp_dp_apis.h"
@@ -1112,6 +1113,7 @@ dpdk_update_port_link_status(struct port *port) {
   port->ofp_port.peer = 0;
 
   if (changed == true) {
+    group_port_live_update(port);
     send_port_status(port, OFPPR_MODIFY);
   }
   return LAGOPUS_RESULT_OK;
@@ -23,8 +23,7 @@
 #include <stdlib.h>
 
 #include <rte_config.h>
-#include <rte_cycles.h>
-#include <rte_meter.h>
+#include <rte_malloc.h>
 
 #include <openflow.h>
 #include "lagopus/flowdb.h"
@@ -33,6 +32,8 @@
 #include "lagopus/dataplane.h"
 #include "pktbuf.h"
 #include "packet.h"
+#include "counter.h"
+#include "srtcm.h"
 
 #undef METER_DEBUG
 #ifdef METER_DEBUG
@@ -42,23 +43,21 @@
 #endif
 
 #define KBPS2BYTEPS(kbps) ((kbps) * 1000 / 8)
+#define METER_MAX_FRAME_LEN 1518
 
 /*
  * implementation of OpwnFlow meter and (rate) queue.
  * meter is ralated with flow entry,
  * queue is related with output port.
  *
- * DPDK rte_meter defines committed (minimum) rate and
- * peak (maxmimum) rate and burst size.
+ * meter band is single rate three color marker same as DPDK
+ * rte_meter_srtcm, with committed tokens cached per worker lcore.
  */
 
 struct lagopus_band {
   TAILQ_ENTRY(lagopus_band) next;
   struct meter_band *band;
-  union {
-    struct rte_meter_srtcm kbps_meter;
-    struct rte_meter_srtcm pps_meter;
-  };
+  struct dp_srtcm_sharded srtcm;
 };
 
 TAILQ_HEAD(lagopus_band_list, lagopus_band);
@@ -80,103 +79,104 @@ lagopus_meter_init(void) {
  * - collect statistics
  *
  * srtcm parameters are:
- *  cir - commited information rate, in bytes per second
- *  cbs - commited burst size, in bytes
- *  ebs - excess burst size, in bytes
+ *  cir - commited information rate, in bytes (or packets) per second
+ *  cbs - commited burst size, in bytes (or packets)
+ *  ebs - excess burst size, in bytes (or packets)
+ * high rate bands are sharded per lcore.
  */
 static void
 dpdk_register_meter(struct meter *meter) {
   struct meter_band *band;
   struct lagopus_band_list *list;
-  struct rte_meter_srtcm_params param;
+  struct lagopus_band *lband;
+  uint64_t cir, ebs, unit;
 
   DPRINT("registering meter, id=%d\n", meter->meter_id);
+  meter->driverdata = NULL;
   list = calloc(1, sizeof(struct lagopus_band_list));
   if (list == NULL) {
     return;
   }
   TAILQ_INIT(list);
   TAILQ_FOREACH(band, &meter->band_list, entry) {
-    struct lagopus_band *lband;
-
-    lband = calloc(1, sizeof(struct lagopus_band));
+    lband = rte_zmalloc(NULL, sizeof(struct lagopus_band),
+                        RTE_CACHE_LINE_SIZE);
     if (lband == NULL) {
-      return;
+      break;
     }
     lband->band = band;
     if ((meter->flags & OFPMF_PKTPS) == 0) {
-      /* unit of rate is kbps, DPDK needs Bytes/sec */
+      /* unit of rate is kbps, srtcm needs Bytes/sec */
       DPRINT("rate limit: %d kilo bit per second\n", band->rate);
-      param.cir = KBPS2BYTEPS(band->rate);
-      if ((meter->flags & OFPMF_BURST) != 0) {
-        param.ebs = KBPS2BYTEPS(band->burst_size);
-        param.cbs = KBPS2BYTEPS(band->rate);
-      } else {
-        param.ebs = 0;
-        param.cbs = KBPS2BYTEPS(band->rate);
-      }
-      rte_meter_srtcm_config(&lband->kbps_meter, &param);
+      cir = KBPS2BYTEPS((uint64_t)band->rate);
+      ebs = KBPS2BYTEPS((uint64_t)band->burst_size);
+      unit = METER_MAX_FRAME_LEN;
     } else {
       /* unit of rate is pps */
       DPRINT("rate limit: %d packet per second\n", band->rate);
-      param.cir = band->rate;
-      if ((meter->flags & OFPMF_BURST) != 0) {
-        param.ebs = band->burst_size;
-        param.cbs = band->rate;
-      } else {
-        param.ebs = 0;
-        param.cbs = band->rate;
-      }
-      rte_meter_srtcm_config(&lband->pps_meter, &param);
+      cir = band->rate;
+      ebs = band->burst_size;
+      unit = 1;
+    }
+    if ((meter->flags & OFPMF_BURST) == 0) {
+      ebs = 0;
     }
+    dp_srtcm_sharded_config(&lband->srtcm, cir, cir, ebs, unit);
     TAILQ_INSERT_TAIL(list, lband, next);
   }
   meter->driverdata = list;
 }
 
-void
+static void
 dpdk_unregister_meter(struct meter *meter) {
-  free(meter->driverdata);
+  struct lagopus_band_list *list;
+  struct lagopus_band *lband;
+
+  list = meter->driverdata;
+  if (list == NULL) {
+    return;
+  }
+  while ((lband = TAILQ_FIRST(list)) != NULL) {
+    TAILQ_REMOVE(list, lband, next);
+    rte_free(lband);
+  }
+  free(list);
+  meter->driverdata = NULL;
 }
 
 int
 lagopus_meter_packet(struct lagopus_packet *pkt, struct meter *meter,
                      uint8_t *prec_level) {
-  enum rte_meter_color color;
   struct lagopus_band_list *list;
   struct lagopus_band *lband, *color_band;
+  uint64_t now, len;
 
   DPRINT("metering packet\n");
   if ((meter->flags & OFPMF_STATS) != 0) {
-    meter->input_packet_count++;
-    meter->input_byte_count += OS_M_PKTLEN(PKT2MBUF(pkt));
+    dp_counter_add(meter->counter_id, 1, OS_M_PKTLEN(PKT2MBUF(pkt)));
   }
   list = meter->driverdata;
-  color_band = NULL;
+  if (list == NULL) {
+    return 0;
+  }
   if ((meter->flags & OFPMF_PKTPS) == 0) {
-    TAILQ_FOREACH(lband, list, next) {
-      color = rte_meter_srtcm_color_blind_check(&lband->kbps_meter,
-                                                rte_rdtsc(),
-                                                OS_M_PKTLEN(PKT2MBUF(pkt)));
-      if (color_band == NULL && color == e_RTE_METER_RED) {
-        color_band = lband;
-      }
-    }
+    len = OS_M_PKTLEN(PKT2MBUF(pkt));
   } else {
-    TAILQ_FOREACH(lband, list, next) {
-      color = rte_meter_srtcm_color_blind_check(&lband->pps_meter,
-              rte_rdtsc(),
-              1);
-      if (color_band == NULL && color == e_RTE_METER_RED) {
-        color_band = lband;
-      }
+    len = 1;
+  }
+  now = dp_srtcm_now();
+  color_band = NULL;
+  TAILQ_FOREACH(lband, list, next) {
+    if (dp_srtcm_sharded_check(&lband->srtcm, now, len) == DP_SRTCM_RED &&
+        color_band == NULL) {
+      color_band = lband;
     }
   }
   if (color_band != NULL) {
     DPRINT("color == red\n");
     if ((meter->flags & OFPMF_STATS) != 0) {
-      color_band->band->stats.packet_band_count++;
-      color_band->band->stats.byte_band_count += OS_M_PKTLEN(PKT2MBUF(pkt));
+      dp_counter_add(color_band->band->counter_id,
+                     1, OS_M_PKTLEN(PKT2MBUF(pkt)));
     }
     if (color_band->band->type == OFPMBT_DSCP_REMARK) {
       *prec_level = color_band->band->prec_level;
@@ -111,6 +111,7 @@
 #include "packet.h"
 #include "csum.h"
 #include "lock.h"
+#include "counter.h"
 #include "dpdk/dpdk.h"
 
 #ifndef APP_LCORE_WORKER_FLUSH
@@ -142,8 +143,9 @@ dp_bulk_match_and_action(OS_MBUF *mbufs[], size_t n_mbufs,
                          struct flowcache *cache) {
   struct interface *ifp;
   struct lagopus_packet *pkt;
+  struct lagopus_packet *pkts[APP_MBUF_ARRAY_SIZE];
   enum switch_mode mode;
-  size_t i;
+  size_t i, npkts;
 
   APP_WORKER_PREFETCH1(rte_pktmbuf_mtod(mbufs[0], unsigned char *));
   APP_WORKER_PREFETCH0(mbufs[1]);
@@ -208,6 +210,7 @@ dp_bulk_match_and_action(OS_MBUF *mbufs[], size_t n_mbufs,
         continue;
       }
     }
+    npkts = 0;
     for (i = 0; i < n_mbufs; i++) {
       OS_MBUF *m;
 
@@ -225,8 +228,9 @@ dp_bulk_match_and_action(OS_MBUF *mbufs[], size_t n_mbufs,
       pkt = MBUF2PKT(m);
       APP_WORKER_PREFETCH0(pkt);
       pkt->cache = cache;
-      lagopus_match_and_action(pkt);
+      pkts[npkts++] = pkt;
     }
+    lagopus_match_and_action_bulk(pkts, npkts);
     flowdb_rdunlock(NULL);
 }
 
@@ -302,6 +306,9 @@ app_lcore_main_loop_worker(void *arg) {
   if (!app.no_cache) {
     lp->cache = init_flowcache(app.kvs_type);
   }
+  /* online only in dp_bulk_match_and_action(), see lock.h. */
+  (void) dp_rcu_thread_register();
+  (void) dp_counter_thread_register();
   i = 0;
   warg.pkt = NULL;
   FLOWDB_RWLOCK_RDLOCK();
@@ -318,6 +325,8 @@ app_lcore_main_loop_worker(void *arg) {
     app_lcore_worker(lp, bsz_rd, &warg);
     i++;
   }
+  dp_counter_thread_unregister();
+  dp_rcu_thread_unregister();
 }
 
 /*
@@ -336,6 +345,9 @@ app_lcore_main_loop_io_worker(void *arg) {
   if (!app.no_cache) {
     lp->cache = init_flowcache(app.kvs_type);
   }
+  /* online only in dp_bulk_match_and_action(), see lock.h. */
+  (void) dp_rcu_thread_register();
+  (void) dp_counter_thread_register();
   i = 0;
   warg.pkt = NULL;
   FLOWDB_RWLOCK_RDLOCK();
@@ -355,6 +367,8 @@ app_lcore_main_loop_io_worker(void *arg) {
     app_lcore_worker(lp, bsz_rd, &warg);
     i++;
   }
+  dp_counter_thread_unregister();
+  dp_rcu_thread_unregister();
 }
 
 void
@@ -385,6 +399,8 @@ dp_get_flowcache_statistics(struct bridge *bridge, struct ofcachestat *st) {
   st->nentries = 0;
   st->hit = 0;
   st->miss = 0;
+  st->wildcard_entries = 0;
+  st->wildcard_hit = 0;
   if (app.no_cache) {
     return;
   }
@@ -401,6 +417,8 @@ dp_get_flowcache_statistics(struct bridge *bridge, struct ofcachestat *st) {
     st->nentries += s.nentries;
     st->hit += s.hit;
     st->miss += s.miss;
+    st->wildcard_entries += s.wildcard_entries;
+    st->wildcard_hit += s.wildcard_hit;
   }
 }
 
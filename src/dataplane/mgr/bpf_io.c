@@ -45,6 +45,7 @@
 #include "csum.h"
 #include "thread.h"
 #include "lock.h"
+#include "counter.h"
 #include "sock_io.h"
 
 static struct port_stats *bpf_port_stats(struct port *port);
@@ -222,6 +223,9 @@ rawsock_dataplane_init(int argc, const char *const argv[]) {
             kvs_type = FLOWCACHE_HASHMAP_NOLOCK;
           } else if (!strcmp(optarg, "hashmap")) {
             kvs_type = FLOWCACHE_HASHMAP;
+          } else if (!strcmp(optarg, "openhash")) {
+            kvs_type = FLOWCACHE_OPEN_HASH;
+          } else {
             return -1;
           }
         }
@@ -415,6 +419,13 @@ bpf_port_stats(struct port *port) {
   return stats;
 }
 
+lagopus_result_t
+rawsock_update_port_link_status(struct port *port) {
+  (void) port;
+
+  return LAGOPUS_RESULT_OK;
+}
+
 lagopus_result_t
 rawsock_get_stats(struct interface *ifp, datastore_interface_stats_t *stats) {
   (void) ifp;
@@ -455,7 +466,6 @@ static lagopus_result_t
 dp_bpf_thread_loop(__UNUSED const lagopus_thread_t *selfptr, void *arg) {
   static const uint8_t eth_bcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
   struct lagopus_packet *pkt;
-  struct port_stats *stats;
   ssize_t len;
   unsigned int i;
   lagopus_result_t rv;
@@ -481,6 +491,17 @@ dp_bpf_thread_loop(__UNUSED const lagopus_thread_t *selfptr, void *arg) {
   dparg = arg;
   running = dparg->running;
 
+  /* refer flowdb without blocking writers. */
+  rv = dp_rcu_thread_register();
+  if (rv != LAGOPUS_RESULT_OK) {
+    return rv;
+  }
+  rv = dp_counter_thread_register();
+  if (rv != LAGOPUS_RESULT_OK) {
+    dp_rcu_thread_unregister();
+    return rv;
+  }
+
   while (*running == true) {
     struct port *port;
     struct pollfd_iter *iter;
@@ -510,12 +531,6 @@ dp_bpf_thread_loop(__UNUSED const lagopus_thread_t *selfptr, void *arg) {
         flowdb_rdunlock(NULL);
         continue;
       }
-      /* update port stats. */
-      if (ifp != NULL && ifp->port != NULL && ifp->stats != NULL) {
-        stats = ifp->stats(ifp->port);
-        free(stats);
-      }
-
       if ((iter->pollfd[i].revents & POLLIN) == 0) {
         flowdb_rdunlock(NULL);
         continue;
@@ -580,6 +595,8 @@ dp_bpf_thread_loop(__UNUSED const lagopus_thread_t *selfptr, void *arg) {
     }
     destroy_pollfds(iter);
   }
+  dp_counter_thread_unregister();
+  dp_rcu_thread_unregister();
 
   return LAGOPUS_RESULT_OK;
 }
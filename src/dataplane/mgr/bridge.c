@@ -34,6 +34,8 @@
 
 #include "lagopus/dp_apis.h"
 
+#include "sock_io.h"
+
 #define SET32_FLAG(V, F)        (V) = (V) | (uint32_t)(F)
 #define UNSET32_FLAG(V, F)      (V) = (V) & (uint32_t)~(F)
 
@@ -296,6 +298,7 @@ bridge_free(struct bridge *bridge) {
 #ifdef HAVE_DPDK
     clear_worker_flowcache(true);
 #endif /* HAVE_DPDK */
+    clear_rawsock_flowcache();
     flowdb_free(bridge->flowdb);
   }
   if (bridge->meter_table != NULL) {
@@ -0,0 +1,239 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   counter.c
+ *      @brief  Per worker statistics counters.
+ */
+
+#include <pthread.h>
+
+#include "lagopus_apis.h"
+#include "counter.h"
+
+/* chunk 0 holds the dummy counter 0, always available. */
+static struct dp_counter dp_counter_shared_chunk0[DP_COUNTER_CHUNK_SIZE];
+
+__thread struct dp_counter_slab *dp_counter_self = NULL;
+struct dp_counter_slab dp_counter_shared = {
+  .chunk = { dp_counter_shared_chunk0 }
+};
+
+static struct dp_counter_slab *dp_counter_slabs[DP_COUNTER_MAX_WORKERS];
+static bool dp_counter_slab_used[DP_COUNTER_MAX_WORKERS];
+static pthread_mutex_t dp_counter_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t dp_counter_nchunks = 1;
+static uint32_t dp_counter_next_id = 1;
+static uint32_t *dp_counter_free_ids = NULL;
+static uint32_t dp_counter_nfree = 0;
+static uint32_t dp_counter_free_alloced = 0;
+
+static struct dp_counter *
+chunk_alloc(void) {
+  return calloc(DP_COUNTER_CHUNK_SIZE, sizeof(struct dp_counter));
+}
+
+static struct dp_counter_slab *
+slab_alloc(void) {
+  struct dp_counter_slab *slab;
+  uint32_t i;
+
+  slab = calloc(1, sizeof(struct dp_counter_slab));
+  if (slab == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < dp_counter_nchunks; i++) {
+    slab->chunk[i] = chunk_alloc();
+    if (slab->chunk[i] == NULL) {
+      while (i-- > 0) {
+        free(slab->chunk[i]);
+      }
+      free(slab);
+      return NULL;
+    }
+  }
+  return slab;
+}
+
+lagopus_result_t
+dp_counter_thread_register(void) {
+  struct dp_counter_slab *slab;
+  int i;
+
+  if (dp_counter_self != NULL) {
+    return LAGOPUS_RESULT_OK;
+  }
+  slab = NULL;
+  pthread_mutex_lock(&dp_counter_lock);
+  for (i = 0; i < DP_COUNTER_MAX_WORKERS; i++) {
+    if (dp_counter_slab_used[i] == false) {
+      if (dp_counter_slabs[i] == NULL) {
+        slab = slab_alloc();
+        if (slab == NULL) {
+          break;
+        }
+        mbar();
+        dp_counter_slabs[i] = slab;
+      }
+      dp_counter_slab_used[i] = true;
+      dp_counter_self = dp_counter_slabs[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&dp_counter_lock);
+  if (dp_counter_self == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  return LAGOPUS_RESULT_OK;
+}
+
+void
+dp_counter_thread_unregister(void) {
+  int i;
+
+  if (dp_counter_self == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&dp_counter_lock);
+  for (i = 0; i < DP_COUNTER_MAX_WORKERS; i++) {
+    if (dp_counter_slabs[i] == dp_counter_self) {
+      dp_counter_slab_used[i] = false;
+      break;
+    }
+  }
+  dp_counter_self = NULL;
+  pthread_mutex_unlock(&dp_counter_lock);
+}
+
+/**
+ * Allocate chunk for all slabs.  Called with lock held.
+ */
+static lagopus_result_t
+dp_counter_grow(void) {
+  struct dp_counter *chunk[DP_COUNTER_MAX_WORKERS + 1];
+  uint32_t c;
+  int i;
+
+  c = dp_counter_nchunks;
+  if (c >= DP_COUNTER_MAX_CHUNKS) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  memset(chunk, 0, sizeof(chunk));
+  for (i = 0; i <= DP_COUNTER_MAX_WORKERS; i++) {
+    if (i < DP_COUNTER_MAX_WORKERS && dp_counter_slabs[i] == NULL) {
+      continue;
+    }
+    chunk[i] = chunk_alloc();
+    if (chunk[i] == NULL) {
+      while (i-- > 0) {
+        free(chunk[i]);
+      }
+      return LAGOPUS_RESULT_NO_MEMORY;
+    }
+  }
+  for (i = 0; i < DP_COUNTER_MAX_WORKERS; i++) {
+    if (dp_counter_slabs[i] != NULL) {
+      dp_counter_slabs[i]->chunk[c] = chunk[i];
+    }
+  }
+  dp_counter_shared.chunk[c] = chunk[DP_COUNTER_MAX_WORKERS];
+  dp_counter_nchunks++;
+  return LAGOPUS_RESULT_OK;
+}
+
+lagopus_result_t
+dp_counter_alloc(uint32_t *idp) {
+  lagopus_result_t rv;
+
+  rv = LAGOPUS_RESULT_OK;
+  pthread_mutex_lock(&dp_counter_lock);
+  if (dp_counter_nfree > 0) {
+    *idp = dp_counter_free_ids[--dp_counter_nfree];
+    goto out;
+  }
+  if ((dp_counter_next_id >> DP_COUNTER_CHUNK_SHIFT) >= dp_counter_nchunks) {
+    rv = dp_counter_grow();
+    if (rv != LAGOPUS_RESULT_OK) {
+      goto out;
+    }
+  }
+  *idp = dp_counter_next_id++;
+out:
+  pthread_mutex_unlock(&dp_counter_lock);
+  return rv;
+}
+
+void
+dp_counter_free(uint32_t id) {
+  uint32_t *ids;
+  uint32_t c, off;
+  int i;
+
+  if (id == 0) {
+    return;
+  }
+  c = id >> DP_COUNTER_CHUNK_SHIFT;
+  off = id & DP_COUNTER_CHUNK_MASK;
+  pthread_mutex_lock(&dp_counter_lock);
+  for (i = 0; i < DP_COUNTER_MAX_WORKERS; i++) {
+    if (dp_counter_slabs[i] != NULL) {
+      memset(&dp_counter_slabs[i]->chunk[c][off], 0,
+             sizeof(struct dp_counter));
+    }
+  }
+  memset(&dp_counter_shared.chunk[c][off], 0, sizeof(struct dp_counter));
+  if (dp_counter_nfree == dp_counter_free_alloced) {
+    ids = realloc(dp_counter_free_ids,
+                  sizeof(uint32_t) * (dp_counter_free_alloced + 1024));
+    if (ids == NULL) {
+      /* leak the index, counters are already cleared. */
+      goto out;
+    }
+    dp_counter_free_ids = ids;
+    dp_counter_free_alloced += 1024;
+  }
+  dp_counter_free_ids[dp_counter_nfree++] = id;
+out:
+  pthread_mutex_unlock(&dp_counter_lock);
+}
+
+void
+dp_counter_get(uint32_t id, uint64_t *packets, uint64_t *bytes) {
+  struct dp_counter *counter;
+  uint32_t c, off;
+  int i;
+
+  *packets = 0;
+  *bytes = 0;
+  if (id == 0) {
+    return;
+  }
+  c = id >> DP_COUNTER_CHUNK_SHIFT;
+  off = id & DP_COUNTER_CHUNK_MASK;
+  pthread_mutex_lock(&dp_counter_lock);
+  for (i = 0; i < DP_COUNTER_MAX_WORKERS; i++) {
+    if (dp_counter_slabs[i] != NULL) {
+      counter = &dp_counter_slabs[i]->chunk[c][off];
+      *packets += counter->packets;
+      *bytes += counter->bytes;
+    }
+  }
+  counter = &dp_counter_shared.chunk[c][off];
+  *packets += counter->packets;
+  *bytes += counter->bytes;
+  pthread_mutex_unlock(&dp_counter_lock);
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   counter.h
+ *      @brief  Per worker statistics counters.
+ *
+ * Each dataplane thread owns a slab of counters and updates it without
+ * atomic operations.  Flows, tables and meters refer to their counter
+ * by index, and the values are summed over all slabs when stats are
+ * requested.  Threads not registered share one slab updated atomically.
+ */
+
+#ifndef SRC_DATAPLANE_MGR_COUNTER_H_
+#define SRC_DATAPLANE_MGR_COUNTER_H_
+
+#define DP_COUNTER_MAX_WORKERS 64
+#define DP_COUNTER_CHUNK_SHIFT 10
+#define DP_COUNTER_CHUNK_SIZE  (1 << DP_COUNTER_CHUNK_SHIFT)
+#define DP_COUNTER_CHUNK_MASK  (DP_COUNTER_CHUNK_SIZE - 1)
+#define DP_COUNTER_MAX_CHUNKS  4096
+
+/**
+ * @brief Counter pair.
+ * For tables, packets is lookup count and bytes is matched count.
+ */
+struct dp_counter {
+  uint64_t packets;
+  uint64_t bytes;
+};
+
+/**
+ * @brief Counters owned by one thread.
+ * Chunks are allocated on demand and never moved.
+ */
+struct dp_counter_slab {
+  struct dp_counter *chunk[DP_COUNTER_MAX_CHUNKS];
+};
+
+extern __thread struct dp_counter_slab *dp_counter_self;
+extern struct dp_counter_slab dp_counter_shared;
+
+/**
+ * Assign counter slab to calling thread.
+ *
+ * @retval      LAGOPUS_RESULT_OK               Succeeded.
+ * @retval      LAGOPUS_RESULT_NO_MEMORY        Memory exhausted or no slot.
+ */
+lagopus_result_t
+dp_counter_thread_register(void);
+
+/**
+ * Release counter slab of calling thread.
+ * Counted values are kept and the slab is reused by next thread.
+ */
+void
+dp_counter_thread_unregister(void);
+
+/**
+ * Allocate counter.
+ *
+ * @param[out]  idp     Index of allocated counter, never 0.
+ *
+ * @retval      LAGOPUS_RESULT_OK               Succeeded.
+ * @retval      LAGOPUS_RESULT_NO_MEMORY        Memory exhausted.
+ */
+lagopus_result_t
+dp_counter_alloc(uint32_t *idp);
+
+/**
+ * Free counter.  Caller must ensure that no dataplane thread refers it.
+ * Index 0 is ignored.
+ */
+void
+dp_counter_free(uint32_t id);
+
+/**
+ * Get sum of counter values of all threads.
+ * Index 0 is always zero.
+ */
+void
+dp_counter_get(uint32_t id, uint64_t *packets, uint64_t *bytes);
+
+/**
+ * Add values to counter of calling thread.
+ */
+static inline void
+dp_counter_add(uint32_t id, uint64_t packets, uint64_t bytes) {
+  struct dp_counter *counter;
+
+  if (likely(dp_counter_self != NULL)) {
+    counter = &dp_counter_self->chunk[id >> DP_COUNTER_CHUNK_SHIFT]
+              [id & DP_COUNTER_CHUNK_MASK];
+    counter->packets += packets;
+    counter->bytes += bytes;
+  } else {
+    counter = &dp_counter_shared.chunk[id >> DP_COUNTER_CHUNK_SHIFT]
+              [id & DP_COUNTER_CHUNK_MASK];
+    __sync_fetch_and_add(&counter->packets, packets);
+    __sync_fetch_and_add(&counter->bytes, bytes);
+  }
+}
+
+#endif /* SRC_DATAPLANE_MGR_COUNTER_H_ */
@@ -23,6 +23,7 @@
 
 #include "openflow.h"
 #include "lagopus/bridge.h"
+#include "lagopus/group.h"
 #include "lagopus/port.h"
 #include "lagopus/interface.h"
 
@@ -528,9 +529,7 @@ dp_port_state_get(const char *name, uint32_t *state) {
   if (rv != LAGOPUS_RESULT_OK) {
     goto out;
   }
-  if (port->interface != NULL) {
-    port->interface->stats(port);
-  }
+  dp_port_update_link_status(port);
   *state = port->ofp_port.state;
 out:
   flowdb_rdunlock(NULL);
@@ -981,6 +980,7 @@ dp_bridge_port_set(const char *name,
     goto out;
   }
   port->bridge = bridge;
+  group_port_live_update(port);
   send_port_status(port, OFPPR_ADD);
 
 out:
@@ -1011,6 +1011,7 @@ dp_bridge_port_unset(const char *name, const char *port_name) {
   if (rv != LAGOPUS_RESULT_OK) {
     goto out;
   }
+  group_port_live_update(port);
   send_port_status(port, OFPPR_DELETE);
   port->bridge = NULL;
 
@@ -1043,6 +1044,7 @@ dp_bridge_port_unset_num(const char *name, uint32_t port_no) {
   if (rv != LAGOPUS_RESULT_OK) {
     goto out;
   }
+  group_port_live_update(port);
   send_port_status(port, OFPPR_DELETE);
   port->bridge = NULL;
 
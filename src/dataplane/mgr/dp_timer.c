@@ -20,6 +20,8 @@
  */
 
 #include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
 #include <time.h>
 #include <sys/queue.h>
 
@@ -38,7 +40,21 @@
 #define DPRINTF(...)
 #endif
 
-TAILQ_HEAD(dp_timer_list, dp_timer) dp_timer_list;
+TAILQ_HEAD(dp_timer_list, dp_timer);
+
+#define DP_TIMER_MAX_TIMEOUT \
+  ((1ULL << (DP_TIMER_WHEEL_BITS * DP_TIMER_LEVELS)) - 1)
+
+#define DP_TIMER_OPEN_SIZE 4096
+#define DP_TIMER_OPEN_MASK (DP_TIMER_OPEN_SIZE - 1)
+
+static struct dp_timer_list dp_timer_wheel[DP_TIMER_LEVELS]
+                                          [DP_TIMER_WHEEL_SIZE];
+/* block accepting entries, indexed by type and expiration tick. */
+static struct dp_timer *dp_timer_open[DP_TIMER_NTYPES][DP_TIMER_OPEN_SIZE];
+/* last processed tick, in seconds of CLOCK_MONOTONIC. */
+static uint64_t dp_timer_tick;
+static pthread_mutex_t dp_timer_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static lagopus_thread_t timer_thread = NULL;
 static bool timer_run = false;
@@ -47,36 +63,41 @@ static lagopus_mutex_t timer_lock = NULL;
 
 void
 init_dp_timer(void) {
-  TAILQ_INIT(&dp_timer_list);
-  (void)get_current_time();
+  struct dp_timer *dp_timer;
+  struct timespec now;
+  int level, i;
+
+  pthread_mutex_lock(&dp_timer_lock);
+  for (level = 0; level < DP_TIMER_LEVELS; level++) {
+    for (i = 0; i < DP_TIMER_WHEEL_SIZE; i++) {
+      while ((dp_timer = TAILQ_FIRST(&dp_timer_wheel[level][i])) != NULL) {
+        TAILQ_REMOVE(&dp_timer_wheel[level][i], dp_timer, next);
+        free(dp_timer);
+      }
+      TAILQ_INIT(&dp_timer_wheel[level][i]);
+    }
+  }
+  memset(dp_timer_open, 0, sizeof(dp_timer_open));
+  now = get_current_time();
+  dp_timer_tick = (uint64_t)now.tv_sec;
+  pthread_mutex_unlock(&dp_timer_lock);
 }
 
-static struct dp_timer *
-find_dp_timer(time_t timeout,
-              int type,
-              struct dp_timer **prev,
-              time_t *prev_timep) {
-  struct dp_timer *dp_timer;
-  time_t prev_time;
+/*
+ * Slot of the lowest level which covers the expiration tick.
+ */
+static struct dp_timer_list *
+dp_timer_slot(uint64_t expire) {
+  int level, shift;
 
-  *prev = NULL;
-  prev_time = 0;
-  TAILQ_FOREACH(dp_timer, &dp_timer_list, next) {
-    if (prev_time + dp_timer->timeout > timeout) {
-      dp_timer = NULL;
-      break;
-    }
-    if (prev_time + dp_timer->timeout == timeout &&
-        dp_timer->type == type &&
-        dp_timer->nentries < MAX_TIMEOUT_ENTRIES) {
-      /* found. */
+  for (level = 0; level < DP_TIMER_LEVELS - 1; level++) {
+    shift = DP_TIMER_WHEEL_BITS * (level + 1);
+    if ((expire >> shift) == (dp_timer_tick >> shift)) {
       break;
     }
-    *prev = dp_timer;
-    prev_time += dp_timer->timeout;
   }
-  *prev_timep = prev_time;
-  return dp_timer;
+  shift = DP_TIMER_WHEEL_BITS * level;
+  return &dp_timer_wheel[level][(expire >> shift) & DP_TIMER_WHEEL_MASK];
 }
 
 void *
@@ -84,58 +105,123 @@ add_dp_timer(int type,
              time_t timeout,
              void (*expire_func)(struct dp_timer *),
              void *arg) {
-  struct dp_timer *dp_timer, *prev;
-  time_t prev_time;
-  void *rv;
-
-  dp_timer = find_dp_timer(timeout, type, &prev, &prev_time);
-  if (dp_timer != NULL) {
-    int i;
-
-    for (i = 0; i < MAX_TIMEOUT_ENTRIES; i++) {
-      if (dp_timer->timer_entry[i] == NULL) {
-        break;
-      }
-    }
-    dp_timer->timer_entry[i] = arg;
-    rv = &dp_timer->timer_entry[i];
-    if (i == dp_timer->nentries) {
-      dp_timer->nentries++;
+  struct dp_timer *dp_timer, **openp;
+  uint64_t expire, now;
+  void **rv;
+  int size;
+
+  if (timeout < 1) {
+    timeout = 1;
+  } else if ((uint64_t)timeout > DP_TIMER_MAX_TIMEOUT) {
+    timeout = (time_t)DP_TIMER_MAX_TIMEOUT;
+  }
+  pthread_mutex_lock(&dp_timer_lock);
+  now = (uint64_t)now_ts.tv_sec;
+  if (now < dp_timer_tick) {
+    now = dp_timer_tick;
+  }
+  expire = now + (uint64_t)timeout;
+  openp = NULL;
+  dp_timer = NULL;
+  if (type >= 0 && type < DP_TIMER_NTYPES) {
+    openp = &dp_timer_open[type][expire & DP_TIMER_OPEN_MASK];
+    dp_timer = *openp;
+  }
+  if (dp_timer == NULL ||
+      dp_timer->expire != expire ||
+      dp_timer->expire_func != expire_func ||
+      dp_timer->nentries == dp_timer->size) {
+    if (dp_timer != NULL &&
+        dp_timer->expire == expire &&
+        dp_timer->expire_func == expire_func) {
+      size = MIN(dp_timer->size * 4, MAX_TIMEOUT_ENTRIES);
+    } else {
+      size = MIN_TIMEOUT_ENTRIES;
     }
-  } else {
-    dp_timer = calloc(1, sizeof(struct dp_timer));
+    dp_timer = calloc(1, sizeof(struct dp_timer) +
+                      sizeof(void *) * (size_t)size);
     if (dp_timer == NULL) {
+      pthread_mutex_unlock(&dp_timer_lock);
       return NULL;
     }
+    dp_timer->expire = expire;
     dp_timer->type = type;
-    dp_timer->timer_entry[0] = arg;
     dp_timer->expire_func = expire_func;
-    rv = &dp_timer->timer_entry[0];
-    dp_timer->nentries++;
-    if (prev == NULL) {
-      dp_timer->timeout = timeout;
-      TAILQ_INSERT_HEAD(&dp_timer_list, dp_timer, next);
-    } else {
-      timeout -= prev_time;
-      dp_timer->timeout = timeout;
-      TAILQ_INSERT_AFTER(&dp_timer_list, prev, dp_timer, next);
-    }
-    /* re-calculation timeout of entries after inserted entry */
-    if ((dp_timer = TAILQ_NEXT(dp_timer, next)) != NULL) {
-      dp_timer->timeout -= timeout;
+    dp_timer->size = size;
+    TAILQ_INSERT_TAIL(dp_timer_slot(expire), dp_timer, next);
+    if (openp != NULL) {
+      *openp = dp_timer;
     }
   }
+  rv = &dp_timer->timer_entry[dp_timer->nentries++];
+  *rv = arg;
+  pthread_mutex_unlock(&dp_timer_lock);
+
   return rv;
 }
 
+/*
+ * Advance the wheel by one tick and move expired blocks to the list.
+ */
 static void
-dp_timer_expire(struct dp_timer *dp_timer) {
-  dp_timer->expire_func(dp_timer);
+dp_timer_advance(struct dp_timer_list *expired) {
+  struct dp_timer_list *slot;
+  struct dp_timer *dp_timer;
+  uint64_t tick;
+  int level, shift;
+
+  tick = ++dp_timer_tick;
+  /* cascade from upper level, it may move timers to the next slot. */
+  for (level = DP_TIMER_LEVELS - 1; level > 0; level--) {
+    shift = DP_TIMER_WHEEL_BITS * level;
+    if ((tick & ((1ULL << shift) - 1)) != 0) {
+      continue;
+    }
+    slot = &dp_timer_wheel[level][(tick >> shift) & DP_TIMER_WHEEL_MASK];
+    while ((dp_timer = TAILQ_FIRST(slot)) != NULL) {
+      TAILQ_REMOVE(slot, dp_timer, next);
+      TAILQ_INSERT_TAIL(dp_timer_slot(dp_timer->expire), dp_timer, next);
+    }
+  }
+  slot = &dp_timer_wheel[0][tick & DP_TIMER_WHEEL_MASK];
+  while ((dp_timer = TAILQ_FIRST(slot)) != NULL) {
+    TAILQ_REMOVE(slot, dp_timer, next);
+    if (dp_timer->type >= 0 && dp_timer->type < DP_TIMER_NTYPES &&
+        dp_timer_open[dp_timer->type][tick & DP_TIMER_OPEN_MASK] ==
+        dp_timer) {
+      dp_timer_open[dp_timer->type][tick & DP_TIMER_OPEN_MASK] = NULL;
+    }
+    TAILQ_INSERT_TAIL(expired, dp_timer, next);
+  }
+}
+
+/*
+ * Expire all timers up to now.  Expire functions are called without
+ * the wheel lock, they may add timers.
+ */
+static void
+dp_timer_run(uint64_t now) {
+  struct dp_timer_list expired;
+  struct dp_timer *dp_timer;
+
+  TAILQ_INIT(&expired);
+  pthread_mutex_lock(&dp_timer_lock);
+  while (dp_timer_tick < now) {
+    dp_timer_advance(&expired);
+  }
+  pthread_mutex_unlock(&dp_timer_lock);
+  while ((dp_timer = TAILQ_FIRST(&expired)) != NULL) {
+    TAILQ_REMOVE(&expired, dp_timer, next);
+    DPRINTF("expire %d entries of type %d\n",
+            dp_timer->nentries, dp_timer->type);
+    dp_timer->expire_func(dp_timer);
+    free(dp_timer);
+  }
 }
 
 static lagopus_result_t
 dp_timer_thread_loop(const lagopus_thread_t *t, void *arg) {
-  struct dp_timer *dp_timer;
+  struct timespec now;
   lagopus_result_t rv;
   global_state_t cur_state;
   shutdown_grace_level_t cur_grace;
@@ -152,31 +238,9 @@ dp_timer_thread_loop(const lagopus_thread_t *t, void *arg) {
   }
 
   while (timer_run == true) {
-    /* XXX flowdb lock */
-    dp_timer = TAILQ_FIRST(&dp_timer_list);
-    if (dp_timer == NULL) {
-      sleep(1);
-      continue;
-    }
-    /* XXX flowdb unlock */
-    do {
-      unsigned int elapsed;
-
-      while (dp_timer->timeout > 0) {
-        elapsed = sleep(1);
-        (void)get_current_time();
-        if (elapsed == 0) {
-          dp_timer->timeout--;
-        }
-      }
-      /* XXX flowdb lock */
-      dp_timer_expire(dp_timer);
-      TAILQ_REMOVE(&dp_timer_list, dp_timer, next);
-      free(dp_timer);
-      dp_timer = TAILQ_FIRST(&dp_timer_list);
-      /* XXX flowdb unlock */
-    } while (dp_timer != NULL);
-    sched_yield();
+    now = get_current_time();
+    dp_timer_run((uint64_t)now.tv_sec);
+    sleep(1);
   }
 
   return LAGOPUS_RESULT_OK;
@@ -25,20 +25,53 @@ enum {
   THTABLE_TIMER,
 };
 
+#define DP_TIMER_NTYPES (THTABLE_TIMER + 1)
+
+#define MIN_TIMEOUT_ENTRIES 4
 #define MAX_TIMEOUT_ENTRIES 256
 
+/*
+ * Timers are kept in a hierarchical timing wheel of one second ticks.
+ * Each level has DP_TIMER_WHEEL_SIZE slots, a slot of level n covers
+ * DP_TIMER_WHEEL_SIZE^n seconds.  When the lower level wraps, timers
+ * in the next slot of the upper level are moved down (cascaded).
+ */
+#define DP_TIMER_WHEEL_BITS 8
+#define DP_TIMER_WHEEL_SIZE (1 << DP_TIMER_WHEEL_BITS)
+#define DP_TIMER_WHEEL_MASK (DP_TIMER_WHEEL_SIZE - 1)
+#define DP_TIMER_LEVELS 4
+
+/**
+ * @brief Block of timer entries of the same type and expiration time.
+ * Blocks are moved between slots as a whole, pointers to entries
+ * returned by add_dp_timer() are valid until the timer expires.
+ * The first block of an expiration time is small, and following
+ * blocks grow up to MAX_TIMEOUT_ENTRIES.
+ */
 struct dp_timer {
   TAILQ_ENTRY(dp_timer) next;
-  time_t timeout;
+  uint64_t expire;              /** Expiration tick. */
   int type;
   void (*expire_func)(struct dp_timer *);
   int nentries;
-  void *timer_entry[MAX_TIMEOUT_ENTRIES];
+  int size;                     /** Capacity of timer_entry. */
+  void *timer_entry[];
 };
 
 void
 init_dp_timer(void);
 
+/**
+ * Add timer entry.  Store NULL to the returned entry to cancel it.
+ *
+ * @param[in]   type            Timer type.
+ * @param[in]   timeout         Timeout in seconds.
+ * @param[in]   expire_func     Called with the block of expired entries.
+ * @param[in]   arg             Entry.
+ *
+ * @retval      !=NULL  Pointer to the entry.
+ * @retval      NULL    Memory exhausted.
+ */
 void *
 add_dp_timer(int type,
              time_t timeout,
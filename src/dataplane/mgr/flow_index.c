@@ -0,0 +1,203 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   flow_index.c
+ *      @brief  Hash index of flows by identity.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lagopus_apis.h"
+#include "lagopus/flowdb.h"
+#include "flow_index.h"
+
+#define FLOW_INDEX_MIN_BUCKETS 1024
+
+static inline uint64_t
+flow_hash_mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t
+match_hash(const struct match *match) {
+  uint64_t h;
+  int i;
+
+  /* FNV-1a */
+  h = 0xcbf29ce484222325ULL;
+  h = (h ^ match->oxm_class) * 0x100000001b3ULL;
+  h = (h ^ match->oxm_field) * 0x100000001b3ULL;
+  h = (h ^ match->oxm_length) * 0x100000001b3ULL;
+  for (i = 0; i < match->oxm_length; i++) {
+    h = (h ^ match->oxm_value[i]) * 0x100000001b3ULL;
+  }
+  return flow_hash_mix(h);
+}
+
+/*
+ * Sum of match hashes does not depend on the order of matches.
+ */
+static uint64_t
+flow_identity_hash(const struct flow *flow) {
+  const struct match *match;
+  uint64_t h;
+
+  h = flow_hash_mix((uint64_t)(uint32_t)flow->priority);
+  h += flow_hash_mix(flow->field_bits + 1);
+  TAILQ_FOREACH(match, &flow->match_list, entry) {
+    h += match_hash(match);
+  }
+  return h;
+}
+
+static bool
+match_exist(const struct match_list *match_list, const struct match *m) {
+  const struct match *match;
+
+  TAILQ_FOREACH(match, match_list, entry) {
+    if (match->oxm_class == m->oxm_class &&
+        match->oxm_field == m->oxm_field &&
+        match->oxm_length == m->oxm_length &&
+        memcmp(match->oxm_value, m->oxm_value, m->oxm_length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+flow_identical(const struct flow *f1, const struct flow *f2) {
+  const struct match *m1, *m2;
+
+  if (f1->priority != f2->priority || f1->field_bits != f2->field_bits) {
+    return false;
+  }
+  /* match fields are not duplicated, same count and all found. */
+  m1 = TAILQ_FIRST(&f1->match_list);
+  m2 = TAILQ_FIRST(&f2->match_list);
+  while (m1 != NULL && m2 != NULL) {
+    m1 = TAILQ_NEXT(m1, entry);
+    m2 = TAILQ_NEXT(m2, entry);
+  }
+  if (m1 != m2) {
+    return false;
+  }
+  TAILQ_FOREACH(m2, &f2->match_list, entry) {
+    if (match_exist(&f1->match_list, m2) == false) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static lagopus_result_t
+flow_index_resize(struct flow_index *index, uint32_t nbuckets) {
+  struct flow **buckets, *flow, *next;
+  uint32_t i, idx;
+
+  buckets = calloc(nbuckets, sizeof(struct flow *));
+  if (buckets == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  for (i = 0; i < index->nbuckets; i++) {
+    for (flow = index->buckets[i]; flow != NULL; flow = next) {
+      next = flow->identity_next;
+      idx = (uint32_t)flow->identity_hash & (nbuckets - 1);
+      flow->identity_next = buckets[idx];
+      buckets[idx] = flow;
+    }
+  }
+  free(index->buckets);
+  index->buckets = buckets;
+  index->nbuckets = nbuckets;
+  return LAGOPUS_RESULT_OK;
+}
+
+lagopus_result_t
+flow_index_add(struct flow_index *index, struct flow *flow) {
+  uint32_t idx;
+  lagopus_result_t rv;
+
+  if (index->buckets == NULL) {
+    rv = flow_index_resize(index, FLOW_INDEX_MIN_BUCKETS);
+    if (rv != LAGOPUS_RESULT_OK) {
+      return rv;
+    }
+  } else if (index->nflows >= index->nbuckets &&
+             index->nbuckets < (UINT32_MAX >> 1) + 1) {
+    /* chains just get longer if memory is exhausted. */
+    (void)flow_index_resize(index, index->nbuckets * 2);
+  }
+  flow->identity_hash = flow_identity_hash(flow);
+  idx = (uint32_t)flow->identity_hash & (index->nbuckets - 1);
+  flow->identity_next = index->buckets[idx];
+  index->buckets[idx] = flow;
+  index->nflows++;
+  return LAGOPUS_RESULT_OK;
+}
+
+void
+flow_index_del(struct flow_index *index, struct flow *flow) {
+  struct flow **flowp;
+
+  if (index->buckets == NULL) {
+    return;
+  }
+  flowp = &index->buckets[(uint32_t)flow->identity_hash &
+                          (index->nbuckets - 1)];
+  for (; *flowp != NULL; flowp = &(*flowp)->identity_next) {
+    if (*flowp == flow) {
+      *flowp = flow->identity_next;
+      flow->identity_next = NULL;
+      index->nflows--;
+      return;
+    }
+  }
+}
+
+struct flow *
+flow_index_find(const struct flow_index *index, const struct flow *flow) {
+  struct flow *f;
+  uint64_t hash;
+
+  if (index->buckets == NULL) {
+    return NULL;
+  }
+  hash = flow_identity_hash(flow);
+  for (f = index->buckets[(uint32_t)hash & (index->nbuckets - 1)];
+       f != NULL;
+       f = f->identity_next) {
+    if (f->identity_hash == hash && flow_identical(f, flow) == true) {
+      return f;
+    }
+  }
+  return NULL;
+}
+
+void
+flow_index_free(struct flow_index *index) {
+  free(index->buckets);
+  index->buckets = NULL;
+  index->nbuckets = 0;
+  index->nflows = 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   flow_index.h
+ *      @brief  Hash index of flows by identity.
+ *
+ * OpenFlow identifies a flow entry by its priority and match fields.
+ * Each table indexes its flows by the hash of them, and flow_mod add,
+ * strict modify and strict delete find the identical flow without
+ * scanning the flow list.  The hash does not depend on the order of
+ * match fields.  The index is updated by the flowdb writer only.
+ */
+
+#ifndef SRC_DATAPLANE_MGR_FLOW_INDEX_H_
+#define SRC_DATAPLANE_MGR_FLOW_INDEX_H_
+
+/**
+ * True if flows have the same priority and match fields.
+ */
+bool
+flow_identical(const struct flow *f1, const struct flow *f2);
+
+/**
+ * Add flow to the index.
+ *
+ * @param[in]   index   Index.
+ * @param[in]   flow    Flow not in the index.
+ *
+ * @retval      LAGOPUS_RESULT_OK               Succeeded.
+ * @retval      LAGOPUS_RESULT_NO_MEMORY        Memory exhausted.
+ */
+lagopus_result_t
+flow_index_add(struct flow_index *index, struct flow *flow);
+
+/**
+ * Delete flow from the index.  Flow not in the index is ignored.
+ */
+void
+flow_index_del(struct flow_index *index, struct flow *flow);
+
+/**
+ * Find flow identical to the given one.
+ *
+ * @param[in]   index   Index.
+ * @param[in]   flow    Flow, may not be in the index.
+ *
+ * @retval      !=NULL  Identical flow.
+ * @retval      NULL    Not found.
+ */
+struct flow *
+flow_index_find(const struct flow_index *index, const struct flow *flow);
+
+/**
+ * Free buckets of the index.  Flows are not freed.
+ */
+void
+flow_index_free(struct flow_index *index);
+
+#endif /* SRC_DATAPLANE_MGR_FLOW_INDEX_H_ */
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "openflow.h"
 #include "lagopus/dp_apis.h"
@@ -42,9 +43,40 @@
 #include "../agent/openflow13packet.h"
 
 #include "lock.h"
+#include "counter.h"
+#include "flow_index.h"
+#ifdef USE_MBTREE
+#include "mbtree.h"
+#endif /* USE_MBTREE */
 
 #include "callback.h"
 
+/**
+ * @brief Change of the flow database in the atomic flow_mod batch.
+ */
+struct flow_undo {
+  TAILQ_ENTRY(flow_undo) entry;
+  int type;                     /** FLOW_UNDO_*. */
+  struct flow *flow;            /** Changed flow. */
+  struct flow *staged;          /** Copy modified instead of the flow. */
+};
+
+TAILQ_HEAD(flow_undo_list, flow_undo);
+
+/**
+ * @brief Instructions replaced by flow_mod, which the dataplane may
+ * still refer until dp_rcu_synchronize().
+ */
+struct instruction_retired {
+  struct instruction_list list;                 /** Instructions. */
+  struct instruction_array_list arrays;         /** Instruction arrays. */
+};
+
+#define FLOW_UNDO_ADD           0       /* Flow is added. */
+#define FLOW_UNDO_MODIFY        1       /* Flow is replaced by its copy. */
+#define FLOW_UNDO_DELETE        2       /* Flow is unlinked, not freed. */
+#define FLOW_UNDO_DISCARD       3       /* Added flow is unlinked again. */
+
 /**
  * @brief Flow database.
  */
@@ -57,11 +89,26 @@ struct flowdb {
   uint8_t table_size;           /** Flow table size. */
   struct table **tables;        /** Flow table. */
   enum switch_mode switch_mode; /** Switch mode. */
-
+  struct instruction_retired retired;   /** Instructions replaced in
+                                         ** the flow_mod batch. */
+  bool atomic;                  /** Flow_mod batch can be aborted. */
+  struct flow_undo_list undo;   /** Changes in the atomic flow_mod
+                                 ** batch, latest first. */
 };
 
+/* flowdb of the flow_mod batch held by this thread. */
+static __thread struct flowdb *flowdb_batch = NULL;
+
+/* Table updates deferred to the end of the flow_mod batch. */
+#define TABLE_PENDING_CACHE     0x01    /* Invalidate flow cache. */
+#define TABLE_PENDING_REBUILD   0x02    /* Rebuild classifier. */
+#define TABLE_PENDING_PUBLISH   0x04    /* Publish classifier changes. */
+
 #define UPDATE_TIMEOUT 2
 
+/* Flows visited by flowdb_flow_stats_walk() per flowdb read lock. */
+#define FLOW_STATS_WALK_CHUNK 1024
+
 #define PUT_TIMEOUT 100LL * 1000LL * 1000LL
 
 #define OXM_FIELD_TYPE(X)       ((X) >> 1)
@@ -83,6 +130,12 @@ flow_del_from_meter(struct meter_table *meter_table, struct flow *flow);
 static void
 flow_del_from_group(struct group_table *group_table, struct flow *flow);
 
+static void
+flow_undo_commit(struct flowdb *flowdb);
+
+static void
+flow_undo_rollback(struct flowdb *flowdb);
+
 void
 match_list_entry_free(struct match_list *match_list) {
   struct match *match;
@@ -198,15 +251,55 @@ map_instruction_list_to_array(struct instruction **dest,
   return LAGOPUS_RESULT_OK;
 }
 
+/**
+ * Match and instructions of the flow encoded as they follow
+ * ofp_flow_stats, see flow_wire_get().
+ */
+struct flow_wire {
+  uint16_t length;
+  uint8_t data[];
+};
+
+/*
+ * Free the flow except its counter and timer, which are taken over
+ * by its copy.  See flow_stage().
+ */
+static void
+flow_free_copied(struct flow *flow) {
+  free(flow->wire);
+  match_list_entry_free(&flow->match_list);
+  instruction_list_entry_free(&flow->instruction_list);
+  free(flow->instruction);
+  free(flow);
+}
+
 static void
 flow_free(struct flow *flow) {
   if (flow->flow_timer != NULL) {
     /* clear relationship. */
     *flow->flow_timer = NULL;
   }
-  match_list_entry_free(&flow->match_list);
-  instruction_list_entry_free(&flow->instruction_list);
-  free(flow);
+  dp_counter_free(flow->counter_id);
+  flow_free_copied(flow);
+}
+
+void
+flow_get_counts(const struct flow *flow,
+                uint64_t *packet_count,
+                uint64_t *byte_count) {
+  dp_counter_get(flow->counter_id, packet_count, byte_count);
+  *packet_count -= flow->packet_count_base;
+  *byte_count -= flow->byte_count_base;
+}
+
+/**
+ * Reset counts of the flow.  Per worker counters are not cleared
+ * since workers update them without lock, current sum is saved instead.
+ */
+static void
+flow_reset_counts(struct flow *flow) {
+  dp_counter_get(flow->counter_id,
+                 &flow->packet_count_base, &flow->byte_count_base);
 }
 
 static lagopus_result_t
@@ -241,13 +334,27 @@ flow_alloc(struct ofp_flow_mod *flow_mod,
   TAILQ_CONCAT(&flow->match_list, match_list, entry);
   TAILQ_INIT(&flow->instruction_list);
   TAILQ_CONCAT(&flow->instruction_list, instruction_list, entry);
-  ret = map_instruction_list_to_array(flow->instruction,
+  flow->instruction = (struct instruction_array *)
+                      calloc(1, sizeof(struct instruction_array));
+  if (flow->instruction == NULL) {
+    flow_free(flow);
+    *flowp = NULL;
+    ret = LAGOPUS_RESULT_NO_MEMORY;
+    goto out;
+  }
+  ret = map_instruction_list_to_array(flow->instruction->index,
                                       &flow->instruction_list, error);
   if (ret != LAGOPUS_RESULT_OK) {
     flow_free(flow);
     *flowp = NULL;
     goto out;
   }
+  ret = dp_counter_alloc(&flow->counter_id);
+  if (ret != LAGOPUS_RESULT_OK) {
+    flow_free(flow);
+    *flowp = NULL;
+    goto out;
+  }
   flow->create_time = get_current_time();
   flow->update_time = flow->create_time;
 
@@ -256,7 +363,7 @@ out:
 }
 
 static struct table *
-table_alloc(uint8_t table_id) {
+table_alloc(struct flowdb *flowdb, uint8_t table_id) {
   struct table *table;
 
   table = (struct table *)calloc(1, sizeof(struct table));
@@ -264,17 +371,22 @@ table_alloc(uint8_t table_id) {
     return NULL;
   }
 
+  if (dp_counter_alloc(&table->counter_id) != LAGOPUS_RESULT_OK) {
+    free(table);
+    return NULL;
+  }
   table->table_id = table_id;
   table->flow_list = calloc(1, sizeof(struct flow_list)
                             + sizeof(void *) * 65536);
   table->flow_list->nbranch = 65536;
+  table->flow_list->flowdb = flowdb;
   return table;
 }
 
 struct table *
 flowdb_get_table(struct flowdb *flowdb, uint8_t table_id) {
   if (flowdb->tables[table_id] == NULL) {
-    flowdb->tables[table_id] = table_alloc(table_id);
+    DP_RCU_ASSIGN_POINTER(flowdb->tables[table_id], table_alloc(flowdb, table_id));
   }
 
   return flowdb->tables[table_id];
@@ -285,6 +397,159 @@ table_lookup(struct flowdb *flowdb, uint8_t table_id) {
   return flowdb->tables[table_id];
 }
 
+/**
+ * Invalidate flow cache entries which refer to the table.
+ * Stale entries are rejected lazily by cache_lookup().
+ */
+static inline void
+table_invalidate_cache(struct table *table) {
+  table->generation++;
+}
+
+#ifdef USE_MBTREE
+/**
+ * Schedule rebuild of the decision tree, it is built in background.
+ */
+static void
+table_mbtree_rebuild(struct table *table) {
+  if (table->flow_list->update_timer != NULL) {
+    *table->flow_list->update_timer = NULL;
+  }
+  add_mbtree_timer(table->flow_list, UPDATE_TIMEOUT);
+}
+#endif /* USE_MBTREE */
+
+/**
+ * Apply updates of the table after its flows are changed.
+ */
+static void
+table_pending_apply(struct table *table, uint8_t pending) {
+  if ((pending & TABLE_PENDING_CACHE) != 0) {
+    table_invalidate_cache(table);
+  }
+  if ((pending & TABLE_PENDING_PUBLISH) != 0) {
+    if (lagopus_publish_flow_hook != NULL) {
+      /* flowinfo waits for the dataplane. */
+      lagopus_publish_flow_hook(table);
+    } else {
+      dp_rcu_synchronize();
+    }
+  }
+  if ((pending & TABLE_PENDING_REBUILD) != 0) {
+#ifdef USE_MBTREE
+    table_mbtree_rebuild(table);
+#endif /* USE_MBTREE */
+#ifdef USE_THTABLE
+    if (table->flow_list->update_timer != NULL) {
+      *table->flow_list->update_timer = NULL;
+    }
+    add_thtable_timer(table->flow_list, UPDATE_TIMEOUT);
+#endif /* USE_THTABLE */
+  }
+}
+
+/**
+ * Update the table now, or at the end of the flow_mod batch.
+ */
+static void
+table_update(struct table *table, uint8_t pending) {
+  if (flowdb_batch == table->flow_list->flowdb) {
+    table->pending |= pending;
+  } else {
+    table_pending_apply(table, pending);
+  }
+}
+
+/**
+ * Remove the flow from lookup structure of the table.
+ * On return, the flow is not referred by the dataplane and can be freed,
+ * except in the flow_mod batch, see flow_release().
+ */
+static void
+table_flow_unlink(struct table *table, struct flow *flow) {
+#ifdef USE_MBTREE
+  if (mbtree_del_flow(table->flow_list, flow) == false) {
+    table_update(table, TABLE_PENDING_REBUILD);
+  }
+#endif /* USE_MBTREE */
+  if (lagopus_del_flow_hook != NULL) {
+    lagopus_del_flow_hook(flow, table);
+  }
+  /* cached entries must be invalidated before the grace period. */
+  table_update(table, TABLE_PENDING_CACHE | TABLE_PENDING_PUBLISH);
+}
+
+static void
+flow_instruction_examination(struct flow *flow,
+                             struct instruction_array *instruction_array);
+
+static void
+instruction_retired_init(struct instruction_retired *retired) {
+  TAILQ_INIT(&retired->list);
+  TAILQ_INIT(&retired->arrays);
+}
+
+/**
+ * Replace instructions of the flow.  The flow may be referred by the
+ * dataplane, so the new instructions are examined aside and published
+ * with a single pointer store.  Old instructions are moved to retired
+ * and must be freed after dp_rcu_synchronize().
+ */
+static lagopus_result_t
+flow_instruction_replace(struct flow *flow,
+                         struct instruction_list *instruction_list,
+                         struct instruction_retired *retired,
+                         struct ofp_error *error) {
+  struct instruction_array *instruction;
+  lagopus_result_t ret;
+
+  instruction = (struct instruction_array *)
+                calloc(1, sizeof(struct instruction_array));
+  if (instruction == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  ret = map_instruction_list_to_array(instruction->index,
+                                      instruction_list, error);
+  if (ret != LAGOPUS_RESULT_OK) {
+    free(instruction);
+    return ret;
+  }
+  flow_instruction_examination(flow, instruction);
+  TAILQ_INSERT_TAIL(&retired->arrays, flow->instruction, entry);
+  DP_RCU_ASSIGN_POINTER(flow->instruction, instruction);
+  TAILQ_CONCAT(&retired->list, &flow->instruction_list, entry);
+  TAILQ_CONCAT(&flow->instruction_list, instruction_list, entry);
+  /* wire is only read under the flowdb lock. */
+  free(flow->wire);
+  flow->wire = NULL;
+  return LAGOPUS_RESULT_OK;
+}
+
+/**
+ * Free instructions retired by flow_instruction_replace().  In the
+ * flow_mod batch, they are freed at the end of it.
+ */
+static void
+instruction_list_retire(struct flowdb *flowdb,
+                        struct instruction_retired *retired) {
+  struct instruction_array *instruction;
+
+  if (TAILQ_EMPTY(&retired->arrays)) {
+    return;
+  }
+  if (flowdb_batch == flowdb) {
+    TAILQ_CONCAT(&flowdb->retired.list, &retired->list, entry);
+    TAILQ_CONCAT(&flowdb->retired.arrays, &retired->arrays, entry);
+    return;
+  }
+  dp_rcu_synchronize();
+  instruction_list_entry_free(&retired->list);
+  while ((instruction = TAILQ_FIRST(&retired->arrays)) != NULL) {
+    TAILQ_REMOVE(&retired->arrays, instruction, entry);
+    free(instruction);
+  }
+}
+
 static void
 table_free(struct table *table) {
   struct flow_list *flow_list;
@@ -302,6 +567,8 @@ table_free(struct table *table) {
     flow_free(flow_list->flows[i]);
   }
   free(flow_list);
+  flow_index_free(&table->identity);
+  dp_counter_free(table->counter_id);
   free(table);
 }
 
@@ -311,6 +578,114 @@ flowdb_lock_init(struct flowdb *flowdb) {
   FLOWDB_RWLOCK_INIT();
 }
 
+void
+flowdb_mod_rdlock(struct flowdb *flowdb) {
+  if (flowdb_batch == flowdb) {
+    /* already held by the flow_mod batch. */
+    return;
+  }
+#ifdef HAVE_DPDK
+  rte_rwlock_read_lock(&flowdb->rwlock);
+#else
+  pthread_rwlock_rdlock(&flowdb->rwlock);
+#endif /* HAVE_DPDK */
+}
+
+void
+flowdb_mod_wrlock(struct flowdb *flowdb) {
+  if (flowdb_batch == flowdb) {
+    return;
+  }
+#if defined(USE_MBTREE) || defined(USE_THTABLE)
+  /*
+   * branch tree is updated and tuple hash table is rebuilt in place.
+   * taken before the flowdb lock as port status updates do.
+   */
+  flowdb_wrlock(NULL);
+#endif /* USE_MBTREE || USE_THTABLE */
+#ifdef HAVE_DPDK
+  rte_rwlock_write_lock(&flowdb->rwlock);
+#else
+  pthread_rwlock_wrlock(&flowdb->rwlock);
+#endif /* HAVE_DPDK */
+}
+
+void
+flowdb_mod_rdunlock(struct flowdb *flowdb) {
+  if (flowdb_batch == flowdb) {
+    return;
+  }
+#ifdef HAVE_DPDK
+  rte_rwlock_read_unlock(&flowdb->rwlock);
+#else
+  pthread_rwlock_unlock(&flowdb->rwlock);
+#endif /* HAVE_DPDK */
+}
+
+void
+flowdb_mod_wrunlock(struct flowdb *flowdb) {
+  if (flowdb_batch == flowdb) {
+    return;
+  }
+#ifdef HAVE_DPDK
+  rte_rwlock_write_unlock(&flowdb->rwlock);
+#else
+  pthread_rwlock_unlock(&flowdb->rwlock);
+#endif /* HAVE_DPDK */
+#if defined(USE_MBTREE) || defined(USE_THTABLE)
+  flowdb_wrunlock(NULL);
+#endif /* USE_MBTREE || USE_THTABLE */
+}
+
+void
+flowdb_batch_begin(struct flowdb *flowdb) {
+  if (flowdb_batch == flowdb) {
+    return;
+  }
+  if (flowdb_batch != NULL) {
+    flowdb_batch_end(flowdb_batch);
+  }
+  flowdb_mod_wrlock(flowdb);
+  flowdb_batch = flowdb;
+}
+
+void
+flowdb_batch_end(struct flowdb *flowdb) {
+  struct table *table;
+  int i;
+
+  if (flowdb_batch != flowdb) {
+    return;
+  }
+  /* one publication and grace period per changed table. */
+  for (i = 0; i < flowdb->table_size; i++) {
+    table = flowdb->tables[i];
+    if (table != NULL && table->pending != 0) {
+      table_pending_apply(table, table->pending);
+      table->pending = 0;
+    }
+  }
+  flowdb_batch = NULL;
+  flow_undo_commit(flowdb);
+  instruction_list_retire(flowdb, &flowdb->retired);
+  flowdb_mod_wrunlock(flowdb);
+}
+
+void
+flowdb_batch_atomic_begin(struct flowdb *flowdb) {
+  flowdb_batch_begin(flowdb);
+  flowdb->atomic = true;
+}
+
+void
+flowdb_batch_abort(struct flowdb *flowdb) {
+  if (flowdb_batch != flowdb) {
+    return;
+  }
+  flow_undo_rollback(flowdb);
+  flowdb_batch_end(flowdb);
+}
+
 /* Allocate flowdb. */
 struct flowdb *
 flowdb_alloc(uint8_t initial_table_size) {
@@ -324,6 +699,16 @@ flowdb_alloc(uint8_t initial_table_size) {
     return NULL;
   }
 
+  /* Initialize modification lock. */
+#ifdef HAVE_DPDK
+  rte_rwlock_init(&flowdb->rwlock);
+#else
+  pthread_rwlock_init(&flowdb->rwlock, NULL);
+#endif /* HAVE_DPDK */
+
+  instruction_retired_init(&flowdb->retired);
+  TAILQ_INIT(&flowdb->undo);
+
   /* Set default switch mode. */
   flowdb_switch_mode_set(flowdb, SWITCH_MODE_STANDALONE);
 
@@ -337,7 +722,7 @@ flowdb_alloc(uint8_t initial_table_size) {
 
   /* Allocate tables. */
   for (i = 0; i < initial_table_size; i++) {
-    flowdb->tables[i] = table_alloc(i);
+    flowdb->tables[i] = table_alloc(flowdb, i);
     if (flowdb->tables[i] == NULL) {
       flowdb_free(flowdb);
       return NULL;
@@ -366,6 +751,10 @@ flowdb_free(struct flowdb *flowdb) {
     flowdb->tables = NULL;
   }
 
+#ifndef HAVE_DPDK
+  pthread_rwlock_destroy(&flowdb->rwlock);
+#endif /* HAVE_DPDK */
+
   /* Free flowdb. */
   free(flowdb);
 }
@@ -384,6 +773,41 @@ flowdb_switch_mode_set(struct flowdb *flowdb, enum switch_mode switch_mode) {
   return LAGOPUS_RESULT_OK;
 }
 
+lagopus_result_t
+flowdb_table_classifier_set(struct flowdb *flowdb,
+                            uint8_t table_id,
+                            enum flow_classifier classifier) {
+  struct table *table;
+  lagopus_result_t rv;
+
+  if (classifier >= FLOW_CLASSIFIER_MAX) {
+    return LAGOPUS_RESULT_INVALID_ARGS;
+  }
+  flowdb_mod_wrlock(flowdb);
+  table = flowdb_get_table(flowdb, table_id);
+  if (table == NULL) {
+    rv = LAGOPUS_RESULT_NO_MEMORY;
+    goto out;
+  }
+  if (table->classifier == classifier) {
+    rv = LAGOPUS_RESULT_OK;
+    goto out;
+  }
+  if (lagopus_set_classifier_hook != NULL) {
+    /* flowinfo is rebuilt and the dataplane is switched to it. */
+    rv = lagopus_set_classifier_hook(table, (uint8_t)classifier);
+    if (rv != LAGOPUS_RESULT_OK) {
+      goto out;
+    }
+  }
+  table->classifier = (uint8_t)classifier;
+  table_invalidate_cache(table);
+  rv = LAGOPUS_RESULT_OK;
+out:
+  flowdb_mod_wrunlock(flowdb);
+  return rv;
+}
+
 /**
  * Pre-requisite condition check.  The match list must be sorted by
  * match field type. When duplicated match entry is found or
@@ -566,7 +990,7 @@ flow_action_check(struct bridge *bridge,
   meter_table = bridge->meter_table;
 
   for (i = 0; i < INSTRUCTION_INDEX_MAX; i++) {
-    instruction = flow->instruction[i];
+    instruction = flow->instruction->index[i];
     if (instruction == NULL) {
       continue;
     }
@@ -712,6 +1136,51 @@ copy_instruction_list(struct instruction_list *dst,
   return LAGOPUS_RESULT_OK;
 }
 
+/*
+ * Position of the flow in the list sorted by priority, or -1.
+ */
+static int
+flow_list_find(const struct flow_list *flow_list, const struct flow *flow) {
+  int st, ed, off;
+
+  st = 0;
+  ed = flow_list->nflow;
+  while (st < ed) {
+    off = st + (ed - st) / 2;
+    if (flow_list->flows[off]->priority > flow->priority) {
+      st = off + 1;
+    } else {
+      ed = off;
+    }
+  }
+  for (; st < flow_list->nflow; st++) {
+    if (flow_list->flows[st] == flow) {
+      return st;
+    }
+    if (flow_list->flows[st]->priority != flow->priority) {
+      break;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Remove the flow at the position from the table list and index.
+ */
+static void
+flow_list_remove(struct table *table, int i) {
+  struct flow_list *flow_list;
+
+  flow_list = table->flow_list;
+  flow_index_del(&table->identity, flow_list->flows[i]);
+  flow_list->nflow--;
+  if (i < flow_list->nflow) {
+    memmove(&flow_list->flows[i], &flow_list->flows[i + 1],
+            sizeof(struct flow *) *
+            (unsigned int)(flow_list->nflow - i));
+  }
+}
+
 lagopus_result_t
 flow_remove_with_reason(struct flow *flow,
                         struct bridge *bridge,
@@ -721,9 +1190,9 @@ flow_remove_with_reason(struct flow *flow,
 
   (void) error;
 
-  flowdb_wrlock(NULL);
+  flowdb_mod_wrlock(bridge->flowdb);
   ret = flow_remove_with_reason_nolock(flow, bridge, reason, error);
-  flowdb_wrunlock(NULL);
+  flowdb_mod_wrunlock(bridge->flowdb);
 
   return ret;
 }
@@ -744,40 +1213,24 @@ flow_remove_with_reason_nolock(struct flow *flow,
 
   ret = LAGOPUS_RESULT_OK;
 
-  /* Clear flow cache */
-#ifdef HAVE_DPDK
-  clear_worker_flowcache(false);
-#endif /* HAVE_DPDK */
-  clear_rawsock_flowcache();
-
   group_table = bridge->group_table;
   meter_table = bridge->meter_table;
   table = flowdb_get_table(bridge->flowdb, flow->table_id);
 
   flow_list = table->flow_list;
-  for (i = 0; i < flow_list->nflow; i++) {
-    if (flow == flow_list->flows[i]) {
-      /* call flowinfo cleanup. */
-      if (lagopus_del_flow_hook != NULL) {
-        lagopus_del_flow_hook(flow, table);
-      }
-      flow_del_from_group(group_table, flow);
-      flow_del_from_meter(meter_table, flow);
-      if ((flow->flags & OFPFF_SEND_FLOW_REM) != 0) {
-        /* send OFPT_FLOW_REMOVED message */
-        ret = send_flow_removed(bridge->dpid, flow, reason);
-      }
-      flow_free(flow);
-      flow_list->nflow--;
-      if (i < flow_list->nflow) {
-        memmove(&flow_list->flows[i], &flow_list->flows[i + 1],
-                sizeof(struct flow *) *
-                (unsigned int)(flow_list->nflow - i));
-      }
-      goto out;
-    }
+  i = flow_list_find(flow_list, flow);
+  if (i >= 0) {
+    /* call flowinfo cleanup. */
+    table_flow_unlink(table, flow);
+    flow_del_from_group(group_table, flow);
+    flow_del_from_meter(meter_table, flow);
+    if ((flow->flags & OFPFF_SEND_FLOW_REM) != 0) {
+      /* send OFPT_FLOW_REMOVED message */
+      ret = send_flow_removed(bridge->dpid, flow, reason);
+    }
+    flow_list_remove(table, i);
+    flow_free(flow);
   }
-out:
   return ret;
 }
 
@@ -804,61 +1257,27 @@ match_compare(struct match_list *ml1, struct match_list *ml2) {
   return true;
 }
 
+/*
+ * Output to these ports does not rewrite the packet, the packet may be
+ * referenced by the output instead of copied.
+ */
 static bool
-flow_compare(struct flow *f1, struct flow *f2) {
-  struct match *m1;
-  struct match *m2;
-
-  /* Priority compare. */
-  if (f1->priority != f2->priority) {
-    return false;
-  }
-
-  /* Field bits compare. */
-  if (f1->field_bits != f2->field_bits) {
-    return false;
-  }
-
-  m1 = TAILQ_FIRST(&f1->match_list);
-  m2 = TAILQ_FIRST(&f2->match_list);
-
-  while (m1 && m2) {
-    if (m1->oxm_class != m2->oxm_class ||
-        m1->oxm_field != m2->oxm_field ||
-        m1->oxm_length != m2->oxm_length ||
-        memcmp(m1->oxm_value, m2->oxm_value, m1->oxm_length) != 0) {
-      return false;
-    }
-
-    m1 = TAILQ_NEXT(m1, entry);
-    m2 = TAILQ_NEXT(m2, entry);
-  }
-
-  if (m1 != m2) {
-    return false;
-  }
-
-  return true;
-}
-
-static struct flow *
-flow_exist_sub(struct flow *flow, struct flow_list *flow_list) {
-  int i;
-  bool same;
-
-  for (i = 0; i < flow_list->nflow; i++) {
-    same = flow_compare(flow, flow_list->flows[i]);
-    if (same == true) {
-      return flow_list->flows[i];
-    }
+output_port_shareable(uint32_t port) {
+  switch (port) {
+    case OFPP_IN_PORT:
+    case OFPP_FLOOD:
+    case OFPP_ALL:
+      return true;
+    default:
+      return port <= OFPP_MAX;
   }
-  return NULL;
 }
 
 static struct action *
 flow_action_examination(struct flow *flow,
-                        struct action_list *action_list) {
-  struct action *action, *action_output, *action_push;
+                        struct action_list *action_list,
+                        bool last) {
+  struct action *action, *action_output, *action_push, *action_shared;
   struct group *group;
   struct bucket *bucket;
   uint32_t group_id;
@@ -867,6 +1286,7 @@ flow_action_examination(struct flow *flow,
   flags = 0;
   action_output = NULL;
   action_push = NULL;
+  action_shared = NULL;
   TAILQ_FOREACH(action, action_list, entry) {
     switch (action->ofpat.type) {
       case OFPAT_PUSH_VLAN:
@@ -879,6 +1299,7 @@ flow_action_examination(struct flow *flow,
           action_output->flags = OUTPUT_COPIED_PACKET;
         }
         action_push = action;
+        action_shared = NULL;
         flags = 0;
         break;
 
@@ -886,6 +1307,7 @@ flow_action_examination(struct flow *flow,
         if (action_output != NULL) {
           action_output->flags = OUTPUT_COPIED_PACKET;
         }
+        action_shared = NULL;
         if (action_push != NULL) {
           if (GET_OXM_FIELD(&action->ofpat) == OFPXMT_OFB_ETH_DST) {
             flags |= SET_FIELD_ETH_DST;
@@ -901,16 +1323,20 @@ flow_action_examination(struct flow *flow,
           action_output->flags = OUTPUT_COPIED_PACKET;
         }
         action_output = action;
+        if (action_shared == NULL) {
+          action_shared = action;
+        }
         action->cookie = flow->cookie;
         break;
 
       case OFPAT_GROUP:
+        action_shared = NULL;
         group_id = ((struct ofp_action_group *)&action->ofpat)->group_id;
         group = group_table_lookup(flow->bridge->group_table, group_id);
         if (group == NULL) {
           break;
         }
-        TAILQ_FOREACH(bucket, &group->bucket_list, entry) {
+        TAILQ_FOREACH(bucket, group->bucket_list, entry) {
           struct action *bucket_output;
 
           TAILQ_FOREACH(bucket_output,
@@ -922,23 +1348,36 @@ flow_action_examination(struct flow *flow,
         break;
 
       default:
+        action_shared = NULL;
         break;
     }
   }
+  if (last == true) {
+    /* outputs followed only by outputs don't need copied packet. */
+    for (action = action_shared;
+         action != NULL && action != action_output;
+         action = TAILQ_NEXT(action, entry)) {
+      if (output_port_shareable(
+            ((struct ofp_action_output *)&action->ofpat)->port) == true) {
+        action->flags |= OUTPUT_SHARED_PACKET;
+      }
+    }
+  }
 
   return action_output;
 }
 
 /* Examine apply-action for dataplane. */
 static void
-flow_instruction_examination(struct flow *flow) {
+flow_instruction_examination(struct flow *flow,
+                             struct instruction_array *instruction_array) {
   struct instruction *instruction;
   struct action *action, *output;
-  int i;
+  int i, j;
 
   output = NULL;
   for (i = 0; i < INSTRUCTION_INDEX_MAX; i++) {
-    instruction = flow->instruction[i];
+    instruction = instruction_array->index[i];
     if (instruction == NULL) {
       continue;
     }
@@ -957,7 +1396,13 @@ flow_instruction_examination(struct flow *flow) {
       }
     }
     if (instruction->ofpit.type == OFPIT_APPLY_ACTIONS) {
-      output = flow_action_examination(flow, &instruction->action_list);
+      for (j = i + 1; j < INSTRUCTION_INDEX_MAX; j++) {
+        if (instruction_array->index[j] != NULL) {
+          break;
+        }
+      }
+      output = flow_action_examination(flow, &instruction->action_list,
+                                       j == INSTRUCTION_INDEX_MAX);
     }
   }
 }
@@ -989,18 +1434,310 @@ flow_add_sub(struct flow *flow, struct flow_list *flows) {
       ed = off;
     }
   }
-  i = ed;
-  if (i < flows->nflow) {
-    size_t siz;
+  i = ed;
+  if (i < flows->nflow) {
+    size_t siz;
+
+    siz = (size_t)(flows->nflow - i) * sizeof(struct flow *);
+    memmove(&flows->flows[i + 1], &flows->flows[i], siz);
+  }
+  /* Insert flow into the point. */
+  flows->flows[i] = flow;
+  flows->nflow++;
+out:
+  return ret;
+}
+/*
+ * Save the flow before it is changed in the flow_mod batch.  Unless
+ * the batch is atomic, only deleted flows are saved, to be released
+ * at the end of it.  Nothing is saved out of the batch.
+ */
+static lagopus_result_t
+flow_undo_push(struct flowdb *flowdb, int type, struct flow *flow) {
+  struct flow_undo *undo;
+
+  if (flowdb_batch != flowdb ||
+      (flowdb->atomic == false && type != FLOW_UNDO_DELETE)) {
+    return LAGOPUS_RESULT_OK;
+  }
+  undo = (struct flow_undo *)calloc(1, sizeof(struct flow_undo));
+  if (undo == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  undo->type = type;
+  undo->flow = flow;
+  TAILQ_INSERT_HEAD(&flowdb->undo, undo, entry);
+  return LAGOPUS_RESULT_OK;
+}
+
+/*
+ * Replace the flow by another one of the same match and priority in
+ * lookup structures of the table.  The dataplane sees the change when
+ * the table is published.
+ */
+static void
+flow_replace(struct table *table, struct flow *from, struct flow *to) {
+  int i;
+
+#ifdef USE_MBTREE
+  if (mbtree_del_flow(table->flow_list, from) == false ||
+      mbtree_add_flow(table->flow_list, to) == false) {
+    table_update(table, TABLE_PENDING_REBUILD);
+  }
+#endif /* USE_MBTREE */
+  i = flow_list_find(table->flow_list, from);
+  if (i >= 0) {
+    table->flow_list->flows[i] = to;
+  }
+  flow_index_del(&table->identity, from);
+  /* buckets are allocated, does not fail. */
+  (void) flow_index_add(&table->identity, to);
+  if (lagopus_del_flow_hook != NULL) {
+    lagopus_del_flow_hook(from, table);
+  }
+  if (lagopus_add_flow_hook != NULL) {
+    lagopus_add_flow_hook(to, table);
+  }
+  table_update(table, TABLE_PENDING_CACHE | TABLE_PENDING_PUBLISH);
+#ifdef USE_THTABLE
+  table_update(table, TABLE_PENDING_REBUILD);
+#endif /* USE_THTABLE */
+  if (from->flow_timer != NULL) {
+    *from->flow_timer = to;
+    to->flow_timer = from->flow_timer;
+    from->flow_timer = NULL;
+  }
+}
+
+/*
+ * Copy the flow with its match and instructions.  The copy shares the
+ * counter of the flow.
+ */
+static lagopus_result_t
+flow_copy(struct flow *flow, struct flow **copyp) {
+  struct flow *copy;
+  struct ofp_error error;
+  lagopus_result_t ret;
+
+  copy = (struct flow *)calloc(1, sizeof(struct flow));
+  if (copy == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  *copy = *flow;
+  copy->wire = NULL;
+  copy->identity_next = NULL;
+  TAILQ_INIT(&copy->match_list);
+  TAILQ_INIT(&copy->instruction_list);
+  copy->instruction = (struct instruction_array *)
+                      calloc(1, sizeof(struct instruction_array));
+  if (copy->instruction == NULL) {
+    free(copy);
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  ret = copy_match_list(&copy->match_list, &flow->match_list);
+  if (ret == LAGOPUS_RESULT_OK) {
+    ret = copy_instruction_list(&copy->instruction_list,
+                                &flow->instruction_list);
+  }
+  if (ret == LAGOPUS_RESULT_OK) {
+    ret = map_instruction_list_to_array(copy->instruction->index,
+                                        &copy->instruction_list, &error);
+  }
+  if (ret != LAGOPUS_RESULT_OK) {
+    flow_free_copied(copy);
+    return ret;
+  }
+  flow_instruction_examination(copy, copy->instruction);
+  *copyp = copy;
+  return LAGOPUS_RESULT_OK;
+}
+
+/*
+ * Prepare the flow to be modified.  In the atomic flow_mod batch, the
+ * flow is replaced by its copy, which is modified instead, so that the
+ * dataplane keeps the flow until the table is published and the flow
+ * can be put back by the undo.  The flow to be modified is returned.
+ */
+static lagopus_result_t
+flow_stage(struct flowdb *flowdb, struct table *table, struct flow **flowp) {
+  struct flow *flow, *copy;
+  lagopus_result_t ret;
+
+  if (flowdb_batch != flowdb || flowdb->atomic == false) {
+    return LAGOPUS_RESULT_OK;
+  }
+  flow = *flowp;
+  ret = flow_copy(flow, &copy);
+  if (ret != LAGOPUS_RESULT_OK) {
+    return ret;
+  }
+  ret = flow_undo_push(flowdb, FLOW_UNDO_MODIFY, flow);
+  if (ret != LAGOPUS_RESULT_OK) {
+    flow_free_copied(copy);
+    return ret;
+  }
+  TAILQ_FIRST(&flowdb->undo)->staged = copy;
+  /* the copy refers groups after modified. */
+  flow_del_from_group(flow->bridge->group_table, flow);
+  flow_replace(table, flow, copy);
+  *flowp = copy;
+  return LAGOPUS_RESULT_OK;
+}
+
+/*
+ * Free the flow unlinked from its table, and send OFPT_FLOW_REMOVED
+ * if requested.  In the flow_mod batch, both are deferred to the end
+ * of the batch, after the dataplane leaves the flow and when the
+ * atomic batch can no longer restore it.
+ */
+static lagopus_result_t
+flow_release(struct bridge *bridge, struct flow *flow, uint8_t reason) {
+  lagopus_result_t ret = LAGOPUS_RESULT_OK;
+
+  if (flowdb_batch == bridge->flowdb) {
+    return LAGOPUS_RESULT_OK;
+  }
+  if ((flow->flags & OFPFF_SEND_FLOW_REM) != 0) {
+    /* send OFPT_FLOW_REMOVED message */
+    ret = send_flow_removed(bridge->dpid, flow, reason);
+  }
+  flow_free(flow);
+  return ret;
+}
+
+/*
+ * Remove the flow added in the atomic flow_mod batch.  The flow is
+ * freed at the end of the batch, the standby classifier logs it.
+ */
+static bool
+flow_undo_add(struct table *table, struct flow *flow) {
+  int i;
+
+  i = flow_list_find(table->flow_list, flow);
+  if (i < 0) {
+    return false;
+  }
+  table_flow_unlink(table, flow);
+  flow_del_from_group(flow->bridge->group_table, flow);
+  flow_del_from_meter(flow->bridge->meter_table, flow);
+  flow_list_remove(table, i);
+#ifdef USE_THTABLE
+  table_update(table, TABLE_PENDING_REBUILD);
+#endif /* USE_THTABLE */
+  return true;
+}
+
+/*
+ * Put back the flow replaced by its copy in the atomic flow_mod batch.
+ * The copy is freed at the end of the batch.
+ */
+static void
+flow_undo_modify(struct table *table, struct flow_undo *undo) {
+  struct flow *flow;
+  struct ofp_error error;
+
+  flow = undo->flow;
+  flow_del_from_meter(flow->bridge->meter_table, undo->staged);
+  flow_del_from_group(flow->bridge->group_table, undo->staged);
+  flow_replace(table, undo->staged, flow);
+  /* instructions of the flow were valid. */
+  (void) flow_action_check(flow->bridge, flow, &error);
+  undo->flow = undo->staged;
+  undo->staged = NULL;
+}
+
+/*
+ * Link the flow deleted in the atomic flow_mod batch to its table again.
+ */
+static void
+flow_undo_delete(struct table *table, struct flow *flow) {
+  struct ofp_error error;
+
+  /*
+   * changes are undone latest first, the flow list and the index
+   * have held as many flows before, and do not fail.
+   */
+  (void) flow_index_add(&table->identity, flow);
+  (void) flow_add_sub(flow, table->flow_list);
+  if (lagopus_add_flow_hook != NULL) {
+    lagopus_add_flow_hook(flow, table);
+    table_update(table, TABLE_PENDING_PUBLISH);
+  }
+#ifdef USE_MBTREE
+  if (mbtree_add_flow(table->flow_list, flow) == false) {
+    table_update(table, TABLE_PENDING_REBUILD);
+  }
+#endif /* USE_MBTREE */
+#ifdef USE_THTABLE
+  table_update(table, TABLE_PENDING_REBUILD);
+#endif /* USE_THTABLE */
+  (void) flow_action_check(flow->bridge, flow, &error);
+}
+
+/*
+ * Undo changes of the atomic flow_mod batch, latest first.
+ */
+static void
+flow_undo_rollback(struct flowdb *flowdb) {
+  struct flow_undo_list discard;
+  struct flow_undo *undo;
+  struct table *table;
+
+  TAILQ_INIT(&discard);
+  while ((undo = TAILQ_FIRST(&flowdb->undo)) != NULL) {
+    TAILQ_REMOVE(&flowdb->undo, undo, entry);
+    table = flowdb->tables[undo->flow->table_id];
+    switch (undo->type) {
+      case FLOW_UNDO_ADD:
+        if (flow_undo_add(table, undo->flow) == true) {
+          undo->type = FLOW_UNDO_DISCARD;
+        }
+        break;
+      case FLOW_UNDO_MODIFY:
+        flow_undo_modify(table, undo);
+        break;
+      case FLOW_UNDO_DELETE:
+        flow_undo_delete(table, undo->flow);
+        break;
+      default:
+        break;
+    }
+    table_update(table, TABLE_PENDING_CACHE);
+    if (undo->type == FLOW_UNDO_DISCARD || undo->type == FLOW_UNDO_MODIFY) {
+      TAILQ_INSERT_TAIL(&discard, undo, entry);
+      continue;
+    }
+    free(undo);
+  }
+  TAILQ_CONCAT(&flowdb->undo, &discard, entry);
+  flowdb->atomic = false;
+}
 
-    siz = (size_t)(flows->nflow - i) * sizeof(struct flow *);
-    memmove(&flows->flows[i + 1], &flows->flows[i], siz);
+/*
+ * Release flows unlinked or replaced in the flow_mod batch, in changed
+ * order.  Called at the end of the batch after changes are published.
+ */
+static void
+flow_undo_commit(struct flowdb *flowdb) {
+  struct flow_undo *undo;
+
+  flowdb->atomic = false;
+  while ((undo = TAILQ_LAST(&flowdb->undo, flow_undo_list)) != NULL) {
+    TAILQ_REMOVE(&flowdb->undo, undo, entry);
+    if (undo->type == FLOW_UNDO_DELETE) {
+      (void) flow_release(undo->flow->bridge, undo->flow, OFPRR_DELETE);
+    } else if (undo->type == FLOW_UNDO_DISCARD) {
+      flow_free(undo->flow);
+    } else if (undo->type == FLOW_UNDO_MODIFY) {
+      if (undo->staged != NULL &&
+          undo->staged->update_time.tv_sec < undo->flow->update_time.tv_sec) {
+        /* the flow was hit until the copy is published. */
+        undo->staged->update_time = undo->flow->update_time;
+      }
+      flow_free_copied(undo->flow);
+    }
+    free(undo);
   }
-  /* Insert flow into the point. */
-  flows->flows[i] = flow;
-  flows->nflow++;
-out:
-  return ret;
 }
 
 
@@ -1015,6 +1752,7 @@ flowdb_flow_add(struct bridge *bridge,
   struct table *table;
   struct flow *flow;
   struct flow *identical_flow;
+  struct instruction_retired retired;
   lagopus_result_t ret = LAGOPUS_RESULT_OK;
 
   /* OFPIT_ALL is invalid for add. */
@@ -1027,9 +1765,10 @@ flowdb_flow_add(struct bridge *bridge,
   }
 
   flowdb = bridge->flowdb;
+  instruction_retired_init(&retired);
 
   /* Write lock the flowdb. */
-  flowdb_wrlock(flowdb);
+  flowdb_mod_wrlock(flowdb);
 
   /* Get table. */
   table = flowdb_get_table(flowdb, flow_mod->table_id);
@@ -1064,11 +1803,7 @@ flowdb_flow_add(struct bridge *bridge,
   }
 
   /* Overlapping flow check. */
-  if (lagopus_find_flow_hook != NULL) {
-    identical_flow = lagopus_find_flow_hook(flow, table);
-  } else {
-    identical_flow = flow_exist_sub(flow, table->flow_list);
-  }
+  identical_flow = flow_index_find(&table->identity, flow);
   if (identical_flow != NULL) {
     /* Check if overlapped entry exist.  see 6.4 Flow Table Modification
      * Messages. */
@@ -1081,34 +1816,20 @@ flowdb_flow_add(struct bridge *bridge,
       ret = LAGOPUS_RESULT_OFP_ERROR;
       goto out;
     }
-    ret = map_instruction_list_to_array(flow->instruction,
-                                        &flow->instruction_list,
-                                        error);
+    ret = flow_stage(flowdb, table, &identical_flow);
     if (ret != LAGOPUS_RESULT_OK) {
       flow_free(flow);
       goto out;
     }
-    /* Examine apply-action for dataplane. */
-    flow_instruction_examination(flow);
-    /* overriden. */
+    /* overriden.  match is identical, replace instructions only. */
     flow_del_from_meter(bridge->meter_table, identical_flow);
     flow_del_from_group(bridge->group_table, identical_flow);
     if ((flow_mod->flags & OFPFF_RESET_COUNTS) != 0) {
-      identical_flow->packet_count = 0;
-      identical_flow->byte_count = 0;
-    }
-    match_list_entry_free(&identical_flow->match_list);
-    instruction_list_entry_free(&identical_flow->instruction_list);
-    TAILQ_CONCAT(&identical_flow->match_list,
-                 &flow->match_list,
-                 entry);
-    TAILQ_CONCAT(&identical_flow->instruction_list,
-                 &flow->instruction_list,
-                 entry);
+      flow_reset_counts(identical_flow);
+    }
+    ret = flow_instruction_replace(identical_flow, &flow->instruction_list,
+                                   &retired, error);
     flow_free(flow);
-    ret = map_instruction_list_to_array(identical_flow->instruction,
-                                        &identical_flow->instruction_list,
-                                        error);
     if (ret != LAGOPUS_RESULT_OK) {
       goto out;
     }
@@ -1123,55 +1844,67 @@ flowdb_flow_add(struct bridge *bridge,
       goto out;
     }
     /* Examine apply-action for dataplane. */
-    flow_instruction_examination(flow);
+    flow_instruction_examination(flow, flow->instruction);
+    ret = flow_undo_push(flowdb, FLOW_UNDO_ADD, flow);
+    if (ret != LAGOPUS_RESULT_OK) {
+      flow_del_from_group(bridge->group_table, flow);
+      flow_del_from_meter(bridge->meter_table, flow);
+      flow_free(flow);
+      goto out;
+    }
+    ret = flow_index_add(&table->identity, flow);
+    if (ret != LAGOPUS_RESULT_OK) {
+      goto out;
+    }
     ret = flow_add_sub(flow, table->flow_list);
     if (ret != LAGOPUS_RESULT_OK) {
+      flow_index_del(&table->identity, flow);
       goto out;
     }
     if (lagopus_add_flow_hook != NULL) {
       lagopus_add_flow_hook(flow, table);
+      table_update(table, TABLE_PENDING_PUBLISH);
     }
     if (flow->idle_timeout > 0 || flow->hard_timeout > 0) {
       add_flow_timer(flow);
     }
 #ifdef USE_MBTREE
-    if (table->flow_list->update_timer != NULL) {
-      *table->flow_list->update_timer = NULL;
+    if (mbtree_add_flow(table->flow_list, flow) == false) {
+      table_update(table, TABLE_PENDING_REBUILD);
     }
-    add_mbtree_timer(table->flow_list, UPDATE_TIMEOUT);
 #endif /* USE_MBTREE */
 #ifdef USE_THTABLE
-    if (table->flow_list->update_timer != NULL) {
-      *table->flow_list->update_timer = NULL;
-    }
-    add_thtable_timer(table->flow_list, UPDATE_TIMEOUT);
-#endif /* USE_MBTREE */
+    table_update(table, TABLE_PENDING_REBUILD);
+#endif /* USE_THTABLE */
   }
 
-  /* Clear flow cache */
-#ifdef HAVE_DPDK
-  clear_worker_flowcache(false);
-#endif /* HAVE_DPDK */
-  clear_rawsock_flowcache();
+  /* Invalidate flow cache */
+  table_update(table, TABLE_PENDING_CACHE);
 
 out:
+  instruction_list_retire(flowdb, &retired);
+
   /* Unlock the flowdb then return result. */
-  flowdb_wrunlock(flowdb);
+  flowdb_mod_wrunlock(flowdb);
   return ret;
 }
 
 static lagopus_result_t
 flow_modify_sub(struct bridge *bridge,
                 struct ofp_flow_mod *flow_mod,
-                struct flow_list *flow_list,
+                struct table *table,
                 struct match_list *match_list,
                 struct instruction_list *instruction_list,
+                struct instruction_retired *retired,
                 struct ofp_error *error,
                 int strict) {
-  struct flow *flow;
+  struct instruction_list new_list;
+  struct flow_list *flow_list;
+  struct flow *flow, *target;
   lagopus_result_t ret;
   int i;
 
+  flow_list = table->flow_list;
   ret = flow_alloc(flow_mod, match_list, instruction_list, &flow, error);
   if (flow == NULL) {
     goto out;
@@ -1184,41 +1917,44 @@ flow_modify_sub(struct bridge *bridge,
     flow_free(flow);
     goto out;
   }
-  ret = map_instruction_list_to_array(flow->instruction,
+  ret = map_instruction_list_to_array(flow->instruction->index,
                                       &flow->instruction_list,
                                       error);
   if (ret != LAGOPUS_RESULT_OK) {
     flow_free(flow);
     goto out;
   }
-  flow_instruction_examination(flow);
+  flow_instruction_examination(flow, flow->instruction);
   if (strict) {
     /*
      * strict. modify identical flow specified by flow_mod.
      */
-    for (i = 0; i < flow_list->nflow; i++) {
-      if (flow_compare(flow, flow_list->flows[i]) == true) {
-        flow_del_from_meter(bridge->meter_table, flow_list->flows[i]);
-        flow_del_from_group(bridge->group_table, flow_list->flows[i]);
-        if ((flow_mod->flags & OFPFF_RESET_COUNTS) != 0) {
-          flow_list->flows[i]->packet_count = 0;
-          flow_list->flows[i]->byte_count = 0;
-        }
-        instruction_list_entry_free(&flow_list->flows[i]->instruction_list);
-        copy_instruction_list(&flow_list->flows[i]->instruction_list,
-                              &flow->instruction_list);
-        map_instruction_list_to_array(flow_list->flows[i]->instruction,
-                                      &flow_list->flows[i]->instruction_list,
-                                      error);
-        if (ret != LAGOPUS_RESULT_OK) {
-          goto out;
-        }
-        ret = flow_action_check(bridge, flow, error);
-        if (ret != LAGOPUS_RESULT_OK) {
-          goto out;
-        }
-        flow_instruction_examination(flow);
-        break;
+    target = flow_index_find(&table->identity, flow);
+    if (target != NULL) {
+      ret = flow_stage(bridge->flowdb, table, &target);
+      if (ret != LAGOPUS_RESULT_OK) {
+        flow_free(flow);
+        goto out;
+      }
+      flow_del_from_meter(bridge->meter_table, target);
+      flow_del_from_group(bridge->group_table, target);
+      if ((flow_mod->flags & OFPFF_RESET_COUNTS) != 0) {
+        flow_reset_counts(target);
+      }
+      TAILQ_INIT(&new_list);
+      ret = copy_instruction_list(&new_list, &flow->instruction_list);
+      if (ret == LAGOPUS_RESULT_OK) {
+        ret = flow_instruction_replace(target, &new_list, retired, error);
+      }
+      if (ret != LAGOPUS_RESULT_OK) {
+        instruction_list_entry_free(&new_list);
+        flow_free(flow);
+        goto out;
+      }
+      ret = flow_action_check(bridge, target, error);
+      if (ret != LAGOPUS_RESULT_OK) {
+        flow_free(flow);
+        goto out;
       }
     }
     flow_free(flow);
@@ -1241,29 +1977,28 @@ flow_modify_sub(struct bridge *bridge,
       }
       /* filtering by output port and group are not supported yet */
       if (match_compare(&flow->match_list, match_list) == true) {
+        ret = flow_stage(bridge->flowdb, table, &flow);
+        if (ret != LAGOPUS_RESULT_OK) {
+          break;
+        }
         flow_del_from_meter(bridge->meter_table, flow);
         flow_del_from_group(bridge->group_table, flow);
         if ((flow_mod->flags & OFPFF_RESET_COUNTS) != 0) {
-          flow->packet_count = 0;
-          flow->byte_count = 0;
+          flow_reset_counts(flow);
         }
-        instruction_list_entry_free(&flow->instruction_list);
-        ret = copy_instruction_list(&flow->instruction_list,
-                                    instruction_list);
-        if (ret != LAGOPUS_RESULT_OK) {
-          break;
+        TAILQ_INIT(&new_list);
+        ret = copy_instruction_list(&new_list, instruction_list);
+        if (ret == LAGOPUS_RESULT_OK) {
+          ret = flow_instruction_replace(flow, &new_list, retired, error);
         }
-        ret = map_instruction_list_to_array(flow->instruction,
-                                            &flow->instruction_list,
-                                            error);
         if (ret != LAGOPUS_RESULT_OK) {
+          instruction_list_entry_free(&new_list);
           break;
         }
         ret = flow_action_check(bridge, flow, error);
         if (ret != LAGOPUS_RESULT_OK) {
           goto out;
         }
-        flow_instruction_examination(flow);
       }
     }
     instruction_list_entry_free(instruction_list);
@@ -1282,7 +2017,7 @@ flow_del_from_meter(struct meter_table *meter_table, struct flow *flow) {
     return;
   }
   /* remove from meter */
-  inst = flow->instruction[INSTRUCTION_INDEX_METER];
+  inst = flow->instruction->index[INSTRUCTION_INDEX_METER];
   if (inst != NULL) {
     meter = meter_table_lookup(meter_table, inst->ofpit_meter.meter_id);
     if (meter != NULL) {
@@ -1306,7 +2041,7 @@ flow_del_from_group(struct group_table *group_table, struct flow *flow) {
 
   /* remove from group */
   for (i = 0; i < INSTRUCTION_INDEX_MAX; i++) {
-    instruction = flow->instruction[i];
+    instruction = flow->instruction->index[i];
     if (instruction == NULL) {
       continue;
     }
@@ -1341,6 +2076,7 @@ send_flow_removed(uint64_t dpid,
   struct timespec ts;
   struct flow_removed *flow_removed;
   struct eventq_data *eventq_data;
+  uint64_t packet_count, byte_count;
   lagopus_result_t rv;
 
   eventq_data = malloc(sizeof(*eventq_data));
@@ -1372,13 +2108,14 @@ send_flow_removed(uint64_t dpid,
 
   flow_removed->ofp_flow_removed.idle_timeout = flow->idle_timeout;
   flow_removed->ofp_flow_removed.hard_timeout = flow->hard_timeout;
+  flow_get_counts(flow, &packet_count, &byte_count);
   if ((flow->flags & OFPFF_NO_PKT_COUNTS) == 0) {
-    flow_removed->ofp_flow_removed.packet_count = flow->packet_count;
+    flow_removed->ofp_flow_removed.packet_count = packet_count;
   } else {
     flow_removed->ofp_flow_removed.packet_count = 0xffffffffffffffff;
   }
   if ((flow->flags & OFPFF_NO_BYT_COUNTS) == 0) {
-    flow_removed->ofp_flow_removed.byte_count = flow->byte_count;
+    flow_removed->ofp_flow_removed.byte_count = byte_count;
   } else {
     flow_removed->ofp_flow_removed.byte_count = 0xffffffffffffffff;
   }
@@ -1400,7 +2137,7 @@ find_action_output(struct flow *flow, uint32_t out_port) {
   for (i = 0; i < INSTRUCTION_INDEX_MAX; i++) {
     struct instruction *instruction;
 
-    instruction = flow->instruction[i];
+    instruction = flow->instruction->index[i];
     if (instruction == NULL) {
       continue;
     }
@@ -1431,7 +2168,7 @@ find_action_group(struct flow *flow, uint32_t out_group) {
   for (i = 0; i < INSTRUCTION_INDEX_MAX; i++) {
     struct instruction *instruction;
 
-    instruction = flow->instruction[i];
+    instruction = flow->instruction->index[i];
     if (instruction == NULL) {
       continue;
     }
@@ -1466,7 +2203,7 @@ flow_del_sub(struct bridge *bridge,
   struct group_table *group_table;
   struct meter_table *meter_table;
   struct instruction_list instruction_list;
-  struct flow *flow;
+  struct flow *flow, *target;
   lagopus_result_t ret;
   int i;
 
@@ -1487,40 +2224,22 @@ flow_del_sub(struct bridge *bridge,
     if (ret != LAGOPUS_RESULT_OK) {
       goto out;
     }
-    for (i = 0; i < flow_list->nflow; i++) {
-      if (flow_compare(flow, flow_list->flows[i]) == true) {
-        if (lagopus_del_flow_hook != NULL) {
-          lagopus_del_flow_hook(flow_list->flows[i], table);
-        }
-        flow_del_from_group(group_table, flow_list->flows[i]);
-        flow_del_from_meter(meter_table, flow_list->flows[i]);
-        if ((flow_list->flows[i]->flags & OFPFF_SEND_FLOW_REM) != 0) {
-          /* send OFPT_FLOW_REMOVED message */
-          ret = send_flow_removed(bridge->dpid, flow, OFPRR_DELETE);
-        }
-        flow_free(flow_list->flows[i]);
-        flow_list->nflow--;
-        if (i < flow_list->nflow) {
-          memmove(&flow_list->flows[i], &flow_list->flows[i + 1],
-                  sizeof(struct flow *) *
-                  (unsigned int)(flow_list->nflow - i));
-        }
-        break;
-      }
+    target = flow_index_find(&table->identity, flow);
+    i = target != NULL ? flow_list_find(flow_list, target) : -1;
+    if (i >= 0) {
+      ret = flow_undo_push(bridge->flowdb, FLOW_UNDO_DELETE, target);
     }
-    flow_free(flow);
-#ifdef USE_MBTREE
-    if (flow_list->update_timer != NULL) {
-      *flow_list->update_timer = NULL;
+    if (i >= 0 && ret == LAGOPUS_RESULT_OK) {
+      table_flow_unlink(table, target);
+      flow_del_from_group(group_table, target);
+      flow_del_from_meter(meter_table, target);
+      flow_list_remove(table, i);
+      ret = flow_release(bridge, target, OFPRR_DELETE);
     }
-    add_mbtree_timer(flow_list, UPDATE_TIMEOUT);
-#endif /* USE_MBTREE */
+    flow_free(flow);
 #ifdef USE_THTABLE
-    if (flow_list->update_timer != NULL) {
-      *flow_list->update_timer = NULL;
-    }
-    add_thtable_timer(flow_list, UPDATE_TIMEOUT);
-#endif /* USE_THTABLEE */
+    table_update(table, TABLE_PENDING_REBUILD);
+#endif /* USE_THTABLE */
   } else {
     /*
      * not strict. delete all flows if matched by match_list and cookie.
@@ -1547,28 +2266,18 @@ flow_del_sub(struct bridge *bridge,
       }
       /* filtering by output port and group are not supported yet */
       if (match_compare(&flow->match_list, match_list) == true) {
-        if (lagopus_del_flow_hook != NULL) {
-          lagopus_del_flow_hook(flow, table);
+        ret = flow_undo_push(bridge->flowdb, FLOW_UNDO_DELETE, flow);
+        if (ret != LAGOPUS_RESULT_OK) {
+          break;
         }
+        table_flow_unlink(table, flow);
         flow_del_from_group(group_table, flow);
         flow_del_from_meter(meter_table, flow);
-        if ((flow->flags & OFPFF_SEND_FLOW_REM) != 0) {
-          /* send OFPT_FLOW_REMOVED message */
-          ret = send_flow_removed(bridge->dpid, flow, OFPRR_DELETE);
-        }
+        flow_index_del(&table->identity, flow);
         flow_list->flows[i] = NULL;
-        flow_free(flow);
-#ifdef USE_MBTREE
-        if (flow_list->update_timer != NULL) {
-          *flow_list->update_timer = NULL;
-        }
-        add_mbtree_timer(flow_list, UPDATE_TIMEOUT);
-#endif /* USE_MBTREE */
+        ret = flow_release(bridge, flow, OFPRR_DELETE);
 #ifdef USE_THTABLE
-        if (flow_list->update_timer != NULL) {
-          *flow_list->update_timer = NULL;
-        }
-        add_thtable_timer(flow_list, UPDATE_TIMEOUT);
+        table_update(table, TABLE_PENDING_REBUILD);
 #endif /* USE_THTABLE */
       }
     }
@@ -1602,11 +2311,12 @@ table_flow_modify(struct bridge *bridge, struct table *table,
                   struct ofp_flow_mod *flow_mod,
                   struct match_list *match_list,
                   struct instruction_list *instruction_list,
+                  struct instruction_retired *retired,
                   struct ofp_error *error,
                   int strict) {
   flow_modify_sub(bridge, flow_mod,
-                  table->flow_list,
-                  match_list, instruction_list,
+                  table,
+                  match_list, instruction_list, retired,
                   error, strict);
   return LAGOPUS_RESULT_OK;
 }
@@ -1632,6 +2342,7 @@ flowdb_flow_modify(struct bridge *bridge,
                    struct ofp_error *error) {
   struct flow flow;
   struct table *table;
+  struct instruction_retired retired;
   lagopus_result_t result;
   int strict;
 
@@ -1657,8 +2368,10 @@ flowdb_flow_modify(struct bridge *bridge,
     return LAGOPUS_RESULT_OFP_ERROR;
   }
 
+  instruction_retired_init(&retired);
+
   /* Write lock the flowdb. */
-  flowdb_wrlock(bridge->flowdb);
+  flowdb_mod_wrlock(bridge->flowdb);
 
   /* Get table. */
   table = flowdb_get_table(bridge->flowdb, flow_mod->table_id);
@@ -1673,18 +2386,16 @@ flowdb_flow_modify(struct bridge *bridge,
 
   /* Modify table. */
   result = table_flow_modify(bridge, table, &flow, flow_mod,
-                             match_list, instruction_list,
+                             match_list, instruction_list, &retired,
                              error, strict);
 
-  /* Clear flow cache */
-#ifdef HAVE_DPDK
-  clear_worker_flowcache(false);
-#endif /* HAVE_DPDK */
-  clear_rawsock_flowcache();
+  /* Invalidate flow cache */
+  table_update(table, TABLE_PENDING_CACHE);
+  instruction_list_retire(bridge->flowdb, &retired);
 
   /* Unlock the flowdb and return result. */
 out:
-  flowdb_wrunlock(bridge->flowdb);
+  flowdb_mod_wrunlock(bridge->flowdb);
   return result;
 }
 
@@ -1716,7 +2427,7 @@ flowdb_flow_delete(struct bridge *bridge,
   flowdb = bridge->flowdb;
 
   /* Write lock the flowdb. */
-  flowdb_wrlock(flowdb);
+  flowdb_mod_wrlock(flowdb);
 
   /* OFPTT_ALL means targeting all tables. */
   if (flow_mod->table_id == OFPTT_ALL) {
@@ -1745,25 +2456,69 @@ flowdb_flow_delete(struct bridge *bridge,
                       strict, error);
   }
 
-  /* Clear flow cache */
-#ifdef HAVE_DPDK
-  clear_worker_flowcache(false);
-#endif /* HAVE_DPDK */
-  clear_rawsock_flowcache();
-
   /* Unlock the flowdb and return result. */
 out:
-  flowdb_wrunlock(flowdb);
+  flowdb_mod_wrunlock(flowdb);
   return result;
 }
 
+static bool
+flow_stats_match(struct flow *flow,
+                 struct ofp_flow_stats_request *request,
+                 struct match_list *match_list) {
+  if (request->cookie_mask != 0) {
+    if ((flow->cookie & request->cookie_mask) !=
+        (request->cookie & request->cookie_mask)) {
+      return false;
+    }
+  }
+  return match_compare(&flow->match_list, match_list);
+}
+
+static void
+flow_stats_set(struct ofp_flow_stats *ofp, int table_id, struct flow *flow) {
+  struct timespec ts;
+  uint64_t packet_count, byte_count;
+
+  ofp->table_id = (uint8_t)table_id;
+#define COPY_STATS(member) ofp->member = flow->member
+  COPY_STATS(idle_timeout);
+  COPY_STATS(hard_timeout);
+  ofp->priority = (uint16_t)flow->priority;
+  COPY_STATS(flags);
+  COPY_STATS(cookie);
+  flow_get_counts(flow, &packet_count, &byte_count);
+  if ((flow->flags & OFPFF_NO_PKT_COUNTS) == 0) {
+    ofp->packet_count = packet_count;
+  } else {
+    ofp->packet_count =  0xffffffffffffffff;
+  }
+  if ((flow->flags & OFPFF_NO_BYT_COUNTS) == 0) {
+    ofp->byte_count = byte_count;
+  } else {
+    ofp->byte_count = 0xffffffffffffffff;
+  }
+#undef COPY_STATS
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ofp->duration_sec =
+    (uint32_t)(ts.tv_sec - flow->create_time.tv_sec);
+  if (ts.tv_nsec < flow->create_time.tv_nsec) {
+    ofp->duration_sec--;
+    ofp->duration_nsec = 1 * 1000 * 1000 * 1000;
+  } else {
+    ofp->duration_nsec = 0;
+  }
+  ofp->duration_nsec += (uint32_t)ts.tv_nsec;
+  ofp->duration_nsec -= (uint32_t)flow->create_time.tv_nsec;
+}
+
 static lagopus_result_t
 table_flow_stats(struct table *table,
                  int table_id,
                  struct ofp_flow_stats_request *request,
                  struct match_list *match_list,
                  struct flow_stats_list *flow_stats_list) {
-  struct timespec ts;
   struct flow_stats *flow_stats;
   struct flow_list *flow_list;
   struct flow *flow;
@@ -1775,48 +2530,13 @@ table_flow_stats(struct table *table,
   flow_list = table->flow_list;
   for (i = 0; i < flow_list->nflow; i++) {
     flow = flow_list->flows[i];
-    if (request->cookie_mask != 0) {
-      if ((flow->cookie & request->cookie_mask) !=
-          (request->cookie & request->cookie_mask)) {
-        continue;
-      }
-    }
-    if (match_compare(&flow->match_list, match_list) == true) {
+    if (flow_stats_match(flow, request, match_list) == true) {
       /* make flow stats. */
       flow_stats = calloc(1, sizeof(struct flow_stats));
       if (flow_stats == NULL) {
         goto out;
       }
-      flow_stats->ofp.table_id = (uint8_t)table_id;
-#define COPY_STATS(member) flow_stats->ofp.member = flow->member
-      COPY_STATS(idle_timeout);
-      COPY_STATS(hard_timeout);
-      flow_stats->ofp.priority = (uint16_t)flow->priority;
-      COPY_STATS(flags);
-      COPY_STATS(cookie);
-      if ((flow->flags & OFPFF_NO_PKT_COUNTS) == 0) {
-        COPY_STATS(packet_count);
-      } else {
-        flow_stats->ofp.packet_count =  0xffffffffffffffff;
-      }
-      if ((flow->flags & OFPFF_NO_BYT_COUNTS) == 0) {
-        COPY_STATS(byte_count);
-      } else {
-        flow_stats->ofp.byte_count = 0xffffffffffffffff;
-      }
-#undef COPY_STATS
-
-      clock_gettime(CLOCK_MONOTONIC, &ts);
-      flow_stats->ofp.duration_sec =
-        (uint32_t)(ts.tv_sec - flow->create_time.tv_sec);
-      if (ts.tv_nsec < flow->create_time.tv_nsec) {
-        flow_stats->ofp.duration_sec--;
-        flow_stats->ofp.duration_nsec = 1 * 1000 * 1000 * 1000;
-      } else {
-        flow_stats->ofp.duration_nsec = 0;
-      }
-      flow_stats->ofp.duration_nsec += (uint32_t)ts.tv_nsec;
-      flow_stats->ofp.duration_nsec -= (uint32_t)flow->create_time.tv_nsec;
+      flow_stats_set(&flow_stats->ofp, table_id, flow);
 
       /* copy lists. */
       TAILQ_INIT(&flow_stats->match_list);
@@ -1845,7 +2565,7 @@ flowdb_flow_stats(struct flowdb *flowdb,
   rv = LAGOPUS_RESULT_OK;
 
   /* Write lock the flowdb. */
-  flowdb_wrlock(flowdb);
+  flowdb_mod_wrlock(flowdb);
 
   if (request->table_id == OFPTT_ALL) {
     int i;
@@ -1876,7 +2596,142 @@ flowdb_flow_stats(struct flowdb *flowdb,
 
   /* Unlock the flowdb and return result. */
 out:
-  flowdb_wrunlock(flowdb);
+  flowdb_mod_wrunlock(flowdb);
+  return rv;
+}
+
+/**
+ * Get match and instructions of the flow in wire format.  They are
+ * encoded on the first call and kept in the flow, later calls return
+ * the same bytes.  Called under the flowdb read lock, so concurrent
+ * callers may race to set the cache, the loser frees its copy.
+ */
+static lagopus_result_t
+flow_wire_get(struct flow *flow, struct flow_wire **wirep) {
+  struct flow_wire *wire;
+  struct pbuf *pbuf;
+  uint16_t match_len, instruction_len;
+  size_t length;
+  lagopus_result_t rv;
+
+  wire = flow->wire;
+  if (wire != NULL) {
+    *wirep = wire;
+    return LAGOPUS_RESULT_OK;
+  }
+
+  pbuf = pbuf_alloc(OFP_PACKET_MAX_SIZE);
+  if (pbuf == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  pbuf->plen = OFP_PACKET_MAX_SIZE;
+  rv = ofp_match_list_encode(pbuf, &flow->match_list, &match_len);
+  if (rv != LAGOPUS_RESULT_OK) {
+    goto out;
+  }
+  rv = ofp_instruction_list_encode(pbuf, &flow->instruction_list,
+                                   &instruction_len);
+  if (rv != LAGOPUS_RESULT_OK) {
+    goto out;
+  }
+  length = pbuf_readable_size(pbuf);
+  if (length > OFP_PACKET_MAX_SIZE - sizeof(struct ofp_flow_stats)) {
+    rv = LAGOPUS_RESULT_OUT_OF_RANGE;
+    goto out;
+  }
+  wire = malloc(sizeof(struct flow_wire) + length);
+  if (wire == NULL) {
+    rv = LAGOPUS_RESULT_NO_MEMORY;
+    goto out;
+  }
+  wire->length = (uint16_t)length;
+  memcpy(wire->data, pbuf_getp_get(pbuf), length);
+  if (__sync_bool_compare_and_swap(&flow->wire, NULL, wire) == false) {
+    free(wire);
+    wire = flow->wire;
+  }
+  *wirep = wire;
+
+out:
+  pbuf_free(pbuf);
+  return rv;
+}
+
+lagopus_result_t
+flowdb_flow_stats_walk(struct flowdb *flowdb,
+                       struct ofp_flow_stats_request *request,
+                       struct match_list *match_list,
+                       flowdb_flow_stats_proc_t proc,
+                       void *arg,
+                       struct ofp_error *error) {
+  struct ofp_flow_stats ofp;
+  struct flow_list *flow_list;
+  struct flow_wire *wire;
+  struct table *table;
+  struct flow *flow;
+  int table_id, last_id, i, n;
+  lagopus_result_t rv;
+
+  rv = LAGOPUS_RESULT_OK;
+
+  if (request->table_id == OFPTT_ALL) {
+    table_id = 0;
+    last_id = flowdb->table_size - 1;
+  } else {
+    table_id = last_id = request->table_id;
+  }
+
+  /* Read lock the flowdb, flows are not copied. */
+  flowdb_mod_rdlock(flowdb);
+
+  if (request->table_id != OFPTT_ALL &&
+      table_id >= flowdb->table_size) {
+    error->type = OFPET_BAD_REQUEST;
+    error->code = OFPBRC_BAD_TABLE_ID;
+    lagopus_msg_info("flow stats: %d: table not found (%d:%d)\n",
+                     request->table_id, error->type, error->code);
+    rv = LAGOPUS_RESULT_OFP_ERROR;
+    goto out;
+  }
+
+  i = 0;
+  n = 0;
+  while (table_id <= last_id) {
+    table = flowdb->tables[table_id];
+    if (table == NULL || i >= table->flow_list->nflow) {
+      table_id++;
+      i = 0;
+      continue;
+    }
+    flow_list = table->flow_list;
+    flow = flow_list->flows[i++];
+    if (flow_stats_match(flow, request, match_list) == true) {
+      rv = flow_wire_get(flow, &wire);
+      if (rv != LAGOPUS_RESULT_OK) {
+        goto out;
+      }
+      flow_stats_set(&ofp, table_id, flow);
+      rv = proc(&ofp, wire->data, wire->length, arg);
+      if (rv != LAGOPUS_RESULT_OK) {
+        goto out;
+      }
+    }
+    if (++n == FLOW_STATS_WALK_CHUNK) {
+      /*
+       * Let waiting flow_mods in.  The walk resumes at the same
+       * position, so flows added or removed meanwhile may be
+       * skipped or reported twice.
+       */
+      n = 0;
+      flowdb_mod_rdunlock(flowdb);
+      sched_yield();
+      flowdb_mod_rdlock(flowdb);
+    }
+  }
+
+  /* Unlock the flowdb and return result. */
+out:
+  flowdb_mod_rdunlock(flowdb);
   return rv;
 }
 
@@ -1888,6 +2743,7 @@ table_flow_counts(struct table *table,
 
   struct flow_list *flow_list;
   struct flow *flow;
+  uint64_t packet_count, byte_count;
   int i;
 
   flow_list = table->flow_list;
@@ -1900,12 +2756,12 @@ table_flow_counts(struct table *table,
       }
     }
     if (match_compare(&flow->match_list, match_list) == true) {
-
+      flow_get_counts(flow, &packet_count, &byte_count);
       if ((flow->flags & OFPFF_NO_PKT_COUNTS) == 0) {
-        reply->packet_count += flow->packet_count;
+        reply->packet_count += packet_count;
       }
       if ((flow->flags & OFPFF_NO_BYT_COUNTS) == 0) {
-        reply->byte_count += flow->byte_count;
+        reply->byte_count += byte_count;
       }
       reply->flow_count++;
     }
@@ -1923,8 +2779,8 @@ flowdb_aggregate_stats(struct flowdb *flowdb,
 
   result = LAGOPUS_RESULT_OK;
 
-  /* Write lock the flowdb. */
-  flowdb_wrlock(flowdb);
+  /* Read lock the flowdb. */
+  flowdb_mod_rdlock(flowdb);
 
   reply->packet_count = 0;
   reply->byte_count = 0;
@@ -1954,7 +2810,7 @@ flowdb_aggregate_stats(struct flowdb *flowdb,
 
   /* Unlock the flowdb and return result. */
 out:
-  flowdb_wrunlock(flowdb);
+  flowdb_mod_rdunlock(flowdb);
   return result;
 }
 
@@ -1980,8 +2836,8 @@ flowdb_table_stats(struct flowdb *flowdb,
     }
     stats->ofp.table_id = (uint8_t)table_id;
     stats->ofp.active_count = (uint32_t)table->flow_list->nflow;
-    stats->ofp.lookup_count = table->lookup_count;
-    stats->ofp.matched_count = table->matched_count;
+    dp_counter_get(table->counter_id,
+                   &stats->ofp.lookup_count, &stats->ofp.matched_count);
     TAILQ_INSERT_TAIL(list, stats, entry);
   }
   return LAGOPUS_RESULT_OK;
@@ -2357,14 +3213,14 @@ flowdb_get_table_features(struct flowdb *flowdb,
   (void) error;
 
   /* Read lock the flowdb. */
-  flowdb_rdlock(flowdb);
+  flowdb_mod_rdlock(flowdb);
 
   for (i = 0; i < flowdb->table_size; i++) {
     table = flowdb->tables[i];
     if (table != NULL) {
       features = calloc(1, sizeof(struct table_features));
       if (features == NULL) {
-        flowdb_rdunlock(flowdb);
+        flowdb_mod_rdunlock(flowdb);
         return LAGOPUS_RESULT_NO_MEMORY;
       }
       memcpy(&features->ofp,
@@ -2377,7 +3233,7 @@ flowdb_get_table_features(struct flowdb *flowdb,
       TAILQ_INSERT_TAIL(list, features, entry);
     }
   }
-  flowdb_rdunlock(flowdb);
+  flowdb_mod_rdunlock(flowdb);
 
   return LAGOPUS_RESULT_OK;
 }
@@ -2763,7 +3619,7 @@ flowdb_dump(struct flowdb *flowdb, FILE *fp) {
   struct table *table;
   struct flow_list *flow_list;
 
-  flowdb_rdlock(flowdb);
+  flowdb_mod_rdlock(flowdb);
 
   for (i = 0; i < flowdb->table_size; i++) {
     table = flowdb->tables[i];
@@ -2777,7 +3633,7 @@ flowdb_dump(struct flowdb *flowdb, FILE *fp) {
     }
   }
 
-  flowdb_rdunlock(flowdb);
+  flowdb_mod_rdunlock(flowdb);
 }
 
 void
@@ -2877,6 +3733,54 @@ ofp_flow_mod_delete(uint64_t dpid,
   return ret;
 }
 
+lagopus_result_t
+ofp_flow_mod_batch_begin(uint64_t dpid) {
+  struct bridge *bridge;
+
+  bridge = dp_bridge_lookup_by_dpid(dpid);
+  if (bridge == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+  flowdb_batch_begin(bridge->flowdb);
+  return LAGOPUS_RESULT_OK;
+}
+
+lagopus_result_t
+ofp_flow_mod_batch_end(uint64_t dpid) {
+  struct bridge *bridge;
+
+  bridge = dp_bridge_lookup_by_dpid(dpid);
+  if (bridge == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+  flowdb_batch_end(bridge->flowdb);
+  return LAGOPUS_RESULT_OK;
+}
+
+lagopus_result_t
+ofp_flow_mod_batch_atomic_begin(uint64_t dpid) {
+  struct bridge *bridge;
+
+  bridge = dp_bridge_lookup_by_dpid(dpid);
+  if (bridge == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+  flowdb_batch_atomic_begin(bridge->flowdb);
+  return LAGOPUS_RESULT_OK;
+}
+
+lagopus_result_t
+ofp_flow_mod_batch_abort(uint64_t dpid) {
+  struct bridge *bridge;
+
+  bridge = dp_bridge_lookup_by_dpid(dpid);
+  if (bridge == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+  flowdb_batch_abort(bridge->flowdb);
+  return LAGOPUS_RESULT_OK;
+}
+
 /*
  * flow_stats (Agent/DP API)
  */
@@ -2897,6 +3801,24 @@ ofp_flow_stats_get(uint64_t dpid,
                            flow_stats_list, error);
 }
 
+lagopus_result_t
+ofp_flow_stats_walk(uint64_t dpid,
+                    struct ofp_flow_stats_request *flow_stats_request,
+                    struct match_list *match_list,
+                    flowdb_flow_stats_proc_t proc,
+                    void *arg,
+                    struct ofp_error *error) {
+  struct bridge *bridge;
+
+  bridge = dp_bridge_lookup_by_dpid(dpid);
+  if (bridge == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+
+  return flowdb_flow_stats_walk(bridge->flowdb, flow_stats_request,
+                                match_list, proc, arg, error);
+}
+
 /*
  * table_stats (Agent/DP API)
  */
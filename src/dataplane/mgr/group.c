@@ -36,9 +36,17 @@
 #include "lagopus_error.h"
 
 #include "lock.h"
+#include "idtable.h"
 
 #define GROUP_ID_KEY_LEN   32
 
+/* select table entries per bucket, rounded up to the prime below. */
+#define GROUP_SELECT_ENTRIES_PER_BUCKET 32
+
+static const uint32_t group_select_sizes[] = {
+  251, 1021, 4093, 16381, 65521
+};
+
 static struct bucket *
 bucket_alloc(void) {
   struct bucket *bucket;
@@ -52,10 +60,26 @@ bucket_alloc(void) {
   return bucket;
 }
 
+static struct bucket_list *
+bucket_list_alloc(void) {
+  struct bucket_list *bucket_list;
+
+  bucket_list = (struct bucket_list *)
+                malloc(sizeof(struct bucket_list));
+  if (bucket_list != NULL) {
+    TAILQ_INIT(bucket_list);
+  }
+
+  return bucket_list;
+}
+
 static void
 bucket_list_free(struct bucket_list *bucket_list) {
   struct bucket *bucket;
 
+  if (bucket_list == NULL) {
+    return;
+  }
   while (TAILQ_EMPTY(bucket_list) == false) {
     bucket = TAILQ_FIRST(bucket_list);
     if (TAILQ_EMPTY(&bucket->action_list) == false) {
@@ -64,6 +88,7 @@ bucket_list_free(struct bucket_list *bucket_list) {
     TAILQ_REMOVE(bucket_list, bucket, entry);
     free(bucket);
   }
+  free(bucket_list);
 }
 
 struct ref_flow {
@@ -73,35 +98,34 @@ struct ref_flow {
 
 struct group_table {
   lagopus_hashmap_t hashmap;
+  struct dp_id_table ids;       /* Index of groups with small id. */
+  TAILQ_HEAD(, group) ff_groups; /* Fast failover groups. */
   struct bridge *bridge;
 };
 
+/*
+ * Group table shares the modification lock with the flowdb, group delete
+ * removes flows.  Groups referred by the dataplane are released after
+ * dp_rcu_synchronize().
+ */
 static inline void
 group_table_rdlock(struct group_table *group_table) {
-  (void) group_table;
-
-  FLOWDB_RWLOCK_RDLOCK();
+  flowdb_mod_rdlock(group_table->bridge->flowdb);
 }
 
 static inline void
 group_table_rdunlock(struct group_table *group_table) {
-  (void) group_table;
-
-  FLOWDB_RWLOCK_RDUNLOCK();
+  flowdb_mod_rdunlock(group_table->bridge->flowdb);
 }
 
 static inline void
 group_table_wrlock(struct group_table *group_table) {
-  (void) group_table;
-
-  FLOWDB_UPDATE_BEGIN();
+  flowdb_mod_wrlock(group_table->bridge->flowdb);
 }
 
 static inline void
 group_table_wrunlock(struct group_table *group_table) {
-  (void) group_table;
-
-  FLOWDB_UPDATE_END();
+  flowdb_mod_wrunlock(group_table->bridge->flowdb);
 }
 
 struct group_table *
@@ -121,6 +145,8 @@ group_table_alloc(struct bridge *parent) {
     return NULL;
   }
 
+  TAILQ_INIT(&group_table->ff_groups);
+
   /* Reference parent bridge. */
   group_table->bridge = parent;
 
@@ -129,7 +155,9 @@ group_table_alloc(struct bridge *parent) {
 
 void
 group_table_free(struct group_table *group_table) {
+  dp_id_table_clear(&group_table->ids);
   lagopus_hashmap_destroy(&group_table->hashmap, true);
+  dp_id_table_free(&group_table->ids);
   free(group_table);
 }
 
@@ -142,7 +170,7 @@ group_loop_detect(struct group_table *group_table,
   struct group *a_group;
   uint32_t group_id;
 
-  TAILQ_FOREACH(bucket, &group->bucket_list, entry) {
+  TAILQ_FOREACH(bucket, group->bucket_list, entry) {
     TAILQ_FOREACH(action, &bucket->action_list, entry) {
       if (action->ofpat.type == OFPAT_GROUP) {
         group_id = ((struct ofp_action_group *)&action->ofpat)->group_id;
@@ -165,16 +193,15 @@ group_loop_detect(struct group_table *group_table,
   return false;
 }
 
-struct bucket *
-group_live_bucket(struct bridge *bridge,
-                  struct group *group) {
+static struct bucket *
+bucket_list_live(struct bridge *bridge, struct bucket_list *bucket_list) {
   struct group_table *group_table;
   struct bucket *bucket, *rv;
   struct group *a_group;
 
   group_table = bridge->group_table;
 
-  TAILQ_FOREACH(bucket, &group->bucket_list, entry) {
+  TAILQ_FOREACH(bucket, bucket_list, entry) {
     if (port_liveness(bridge, bucket->ofp.watch_port) == true) {
       return bucket;
     }
@@ -193,6 +220,48 @@ group_live_bucket(struct bridge *bridge,
   return NULL;
 }
 
+struct bucket *
+group_live_bucket(struct bridge *bridge,
+                  struct group *group) {
+  return bucket_list_live(bridge, group->bucket_list);
+}
+
+/*
+ * Reselect live buckets of all fast failover groups.  Called with the
+ * group table lock after port status or group changes, so that the
+ * dataplane just refers group->live.
+ */
+static void
+group_table_live_update(struct group_table *group_table) {
+  struct group *group;
+
+  TAILQ_FOREACH(group, &group_table->ff_groups, ff_entry) {
+    DP_RCU_ASSIGN_POINTER(group->live,
+                          group_live_bucket(group_table->bridge, group));
+  }
+}
+
+void
+group_port_live_update(struct port *port) {
+  struct group_table *group_table;
+
+  if (port->bridge == NULL) {
+    return;
+  }
+  group_table = port->bridge->group_table;
+  if (group_table == NULL || TAILQ_EMPTY(&group_table->ff_groups)) {
+    return;
+  }
+  /*
+   * the caller may hold flowdb_rdlock(NULL).  read lock keeps buckets
+   * while live buckets are published by pointer store, and the agent
+   * reselects them again under the write lock on port status.
+   */
+  group_table_rdlock(group_table);
+  group_table_live_update(group_table);
+  group_table_rdunlock(group_table);
+}
+
 lagopus_result_t
 group_table_add(struct group_table *group_table,
                 struct group *group,
@@ -217,19 +286,44 @@ group_table_add(struct group_table *group_table,
   }
   /* Reference table. */
   group->group_table = group_table;
+  if (group->id < DP_ID_TABLE_SIZE) {
+    rv = dp_id_table_set(&group_table->ids, group->id, group);
+    if (rv != LAGOPUS_RESULT_OK) {
+      lagopus_hashmap_delete_no_lock(&group_table->hashmap,
+                                     (void *)key, NULL, false);
+      return rv;
+    }
+  }
+  if (group->type == OFPGT_FF) {
+    TAILQ_INSERT_TAIL(&group_table->ff_groups, group, ff_entry);
+  }
+  group_table_live_update(group_table);
   return LAGOPUS_RESULT_OK;
 }
 
 lagopus_result_t
 group_table_delete(struct group_table *group_table, uint32_t group_id) {
+  struct group *group;
   uint32_t key;
 
   if (group_id == OFPG_ALL) {
+    TAILQ_INIT(&group_table->ff_groups);
+    dp_id_table_clear(&group_table->ids);
     lagopus_hashmap_clear_no_lock(&group_table->hashmap, true);
   } else {
+    group = group_table_lookup(group_table, group_id);
+    if (group != NULL && group->type == OFPGT_FF) {
+      TAILQ_REMOVE(&group_table->ff_groups, group, ff_entry);
+    }
+    /* Unpublish from the index before the group is released. */
+    if (group_id < DP_ID_TABLE_SIZE) {
+      dp_id_table_set(&group_table->ids, group_id, NULL);
+    }
     key = htonl(group_id);
     lagopus_hashmap_delete_no_lock(&group_table->hashmap,
                                    (void *)key, NULL, true);
+    /* groups watching the deleted group. */
+    group_table_live_update(group_table);
   }
 
   return LAGOPUS_RESULT_OK;
@@ -243,6 +337,9 @@ group_table_lookup(struct group_table *group_table, uint32_t id) {
   uint32_t key;
   struct group *group = NULL;
 
+  if (id < DP_ID_TABLE_SIZE) {
+    return dp_id_table_get(&group_table->ids, id);
+  }
   key = htonl(id);
   lagopus_hashmap_find_no_lock(&group_table->hashmap, (uint8_t *)key, &group);
   return group;
@@ -266,6 +363,106 @@ copy_bucket_list(struct bucket_list *dst, const struct bucket_list *src) {
   return LAGOPUS_RESULT_OK;
 }
 
+/*
+ * Identity of the bucket for the select table, derived from its contents
+ * because buckets are copied by group_modify().
+ */
+static uint64_t
+bucket_hash(const struct bucket *bucket) {
+  const struct action *action;
+  const uint8_t *p;
+  uint64_t h;
+  int i;
+
+  h = 0xcbf29ce484222325ULL;
+  TAILQ_FOREACH(action, &bucket->action_list, entry) {
+    p = (const uint8_t *)&action->ofpat;
+    for (i = 0; i < action->ofpat.len; i++) {
+      h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+  }
+  return h;
+}
+
+struct select_perm {
+  struct bucket *bucket;
+  uint64_t weight;
+  uint64_t credit;
+  uint32_t next;
+  uint32_t skip;
+};
+
+/*
+ * Make bucket lookup table of select group.
+ * Each bucket claims the next free entry of its own permutation of the
+ * table, as many times per round as its weight relative to the largest.
+ */
+static struct group_select *
+group_select_alloc(struct bucket_list *bucket_list) {
+  struct group_select *select;
+  struct select_perm *perm;
+  struct bucket *bucket;
+  uint64_t h, max_weight;
+  uint32_t n, i, size, filled;
+
+  n = 0;
+  max_weight = 0;
+  TAILQ_FOREACH(bucket, bucket_list, entry) {
+    if (bucket->ofp.weight > max_weight) {
+      max_weight = bucket->ofp.weight;
+    }
+    n++;
+  }
+  if (n == 0) {
+    return NULL;
+  }
+  size = group_select_sizes[0];
+  for (i = 0; i < sizeof(group_select_sizes) / sizeof(uint32_t); i++) {
+    size = group_select_sizes[i];
+    if (size >= n * GROUP_SELECT_ENTRIES_PER_BUCKET) {
+      break;
+    }
+  }
+  select = calloc(1, sizeof(*select) + size * sizeof(struct bucket *));
+  perm = calloc(n, sizeof(*perm));
+  if (select == NULL || perm == NULL) {
+    free(select);
+    free(perm);
+    return NULL;
+  }
+  select->size = size;
+  i = 0;
+  TAILQ_FOREACH(bucket, bucket_list, entry) {
+    h = bucket_hash(bucket);
+    perm[i].bucket = bucket;
+    /* all buckets are equal if no weight is given. */
+    perm[i].weight = (max_weight == 0) ? 1 : bucket->ofp.weight;
+    perm[i].next = (uint32_t)(h % size);
+    perm[i].skip = (uint32_t)((h >> 32) % (size - 1)) + 1;
+    i++;
+  }
+  if (max_weight == 0) {
+    max_weight = 1;
+  }
+  filled = 0;
+  while (filled < size) {
+    for (i = 0; i < n && filled < size; i++) {
+      perm[i].credit += perm[i].weight;
+      while (perm[i].credit >= max_weight && filled < size) {
+        perm[i].credit -= max_weight;
+        while (select->bucket[perm[i].next] != NULL) {
+          perm[i].next = (perm[i].next + perm[i].skip) % size;
+        }
+        select->bucket[perm[i].next] = perm[i].bucket;
+        filled++;
+      }
+    }
+  }
+  free(perm);
+
+  return select;
+}
+
 struct group *
 group_alloc(struct ofp_group_mod *group_mod,
             struct bucket_list *bucket_list) {
@@ -283,10 +480,14 @@ group_alloc(struct ofp_group_mod *group_mod,
 
   group->id = group_mod->group_id;
   group->type = group_mod->type;
-  TAILQ_INIT(&group->bucket_list);
-  copy_bucket_list(&group->bucket_list, bucket_list);
+  group->bucket_list = bucket_list_alloc();
+  if (group->bucket_list == NULL) {
+    free(group);
+    return NULL;
+  }
+  copy_bucket_list(group->bucket_list, bucket_list);
   if (lagopus_register_action_hook != NULL) {
-    TAILQ_FOREACH(bucket, &group->bucket_list, entry) {
+    TAILQ_FOREACH(bucket, group->bucket_list, entry) {
       int i;
 
       TAILQ_FOREACH(action, &bucket->action_list, entry) {
@@ -298,6 +499,9 @@ group_alloc(struct ofp_group_mod *group_mod,
       merge_action_set(bucket->actions, &bucket->action_list);
     }
   }
+  if (group->type == OFPGT_SELECT) {
+    group->select = group_select_alloc(group->bucket_list);
+  }
   lagopus_hashmap_create(&group->flows, LAGOPUS_HASHMAP_TYPE_ONE_WORD, NULL);
   clock_gettime(CLOCK_MONOTONIC, &group->create_time);
 
@@ -325,29 +529,39 @@ group_do_flow_iterate(void *key, void *val,
 
 void
 group_free(struct group *group) {
-  bucket_list_free(&group->bucket_list);
   /* remove group action from each flows. */
   lagopus_hashmap_iterate_no_lock(&group->flows,
                                   group_do_flow_iterate,
                                   group->group_table->bridge);
   lagopus_hashmap_destroy(&group->flows, false);
+  /* wait for the dataplane to leave the group. */
+  dp_rcu_synchronize();
+  bucket_list_free(group->bucket_list);
+  free(group->select);
   free(group);
 }
 
 void
 group_modify(struct group *group, struct ofp_group_mod *group_mod,
              struct bucket_list *bucket_list) {
-  bucket_list_free(&group->bucket_list);
-  group->type = group_mod->type;
-  TAILQ_INIT(&group->bucket_list);
-  copy_bucket_list(&group->bucket_list, bucket_list);
+  struct group_table *group_table;
+  struct bucket_list *new_list, *old_list;
+  struct group_select *select, *old_select;
+  struct bucket *live;
+
+  /* make new buckets aside, then replace. */
+  new_list = bucket_list_alloc();
+  if (new_list == NULL) {
+    return;
+  }
+  copy_bucket_list(new_list, bucket_list);
 
   /* refresh action hook */
   if (lagopus_register_action_hook != NULL) {
     struct bucket *bucket;
     struct action *action;
 
-    TAILQ_FOREACH(bucket, &group->bucket_list, entry) {
+    TAILQ_FOREACH(bucket, new_list, entry) {
       int i;
 
       TAILQ_FOREACH(action, &bucket->action_list, entry) {
@@ -359,6 +573,45 @@ group_modify(struct group *group, struct ofp_group_mod *group_mod,
       merge_action_set(bucket->actions, &bucket->action_list);
     }
   }
+
+  select = NULL;
+  if (group_mod->type == OFPGT_SELECT) {
+    select = group_select_alloc(new_list);
+  }
+  group_table = group->group_table;
+  live = NULL;
+  if (group_mod->type == OFPGT_FF && group_table != NULL) {
+    live = bucket_list_live(group_table->bridge, new_list);
+  }
+
+  /*
+   * The dataplane reads type, then one of select, live or bucket_list.
+   * Each of them is replaced by a single store and the old objects stay
+   * until the grace period, so any mix of old and new the dataplane
+   * sees still refers to complete buckets.
+   */
+  old_list = group->bucket_list;
+  old_select = group->select;
+  DP_RCU_ASSIGN_POINTER(group->select, select);
+  DP_RCU_ASSIGN_POINTER(group->live, live);
+  DP_RCU_ASSIGN_POINTER(group->bucket_list, new_list);
+  if (group_table != NULL && group->type != group_mod->type) {
+    if (group->type == OFPGT_FF) {
+      TAILQ_REMOVE(&group_table->ff_groups, group, ff_entry);
+    } else if (group_mod->type == OFPGT_FF) {
+      TAILQ_INSERT_TAIL(&group_table->ff_groups, group, ff_entry);
+    }
+  }
+  mbar();
+  group->type = group_mod->type;
+  if (group_table != NULL) {
+    group_table_live_update(group_table);
+  }
+
+  /* wait for the dataplane to leave old buckets. */
+  dp_rcu_synchronize();
+  bucket_list_free(old_list);
+  free(old_select);
 }
 
 void
@@ -401,7 +654,7 @@ set_group_stats(struct group_stats *stats, const struct group *group) {
 
   /* bucket stats */
   TAILQ_INIT(&stats->bucket_counter_list);
-  TAILQ_FOREACH(bucket, &group->bucket_list, entry) {
+  TAILQ_FOREACH(bucket, group->bucket_list, entry) {
     struct bucket_counter *bucket_counter;
 
     bucket_counter = calloc(1, sizeof(struct bucket_counter));
@@ -488,7 +741,7 @@ group_do_descs_iterate(void *key, void *val,
     desc->ofp.type = group->type;
     desc->ofp.group_id = group->id;
     TAILQ_INIT(&desc->bucket_list);
-    copy_bucket_list(&desc->bucket_list, &group->bucket_list);
+    copy_bucket_list(&desc->bucket_list, group->bucket_list);
     TAILQ_INSERT_TAIL(list, desc, entry);
   }
   return true;
@@ -646,6 +899,28 @@ ofp_group_mod_delete(uint64_t dpid,
   return LAGOPUS_RESULT_OK;
 }
 
+/*
+ * port status (Agent/DP API)
+ * Live buckets are already reselected by the dataplane where the port
+ * changed, see group_port_live_update().  This is a backstop for
+ * changes the dataplane does not detect.
+ */
+lagopus_result_t
+ofp_group_live_update(uint64_t dpid) {
+  struct bridge *bridge;
+
+  bridge = dp_bridge_lookup_by_dpid(dpid);
+  if (bridge == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+
+  group_table_wrlock(bridge->group_table);
+  group_table_live_update(bridge->group_table);
+  group_table_wrunlock(bridge->group_table);
+
+  return LAGOPUS_RESULT_OK;
+}
+
 /*
  * group_stats (Agent/DP API)
  */
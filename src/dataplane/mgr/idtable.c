@@ -0,0 +1,67 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   idtable.c
+ *      @brief  Direct indexed table of small object ids.
+ */
+
+#include "lagopus_apis.h"
+#include "rcu.h"
+#include "idtable.h"
+
+lagopus_result_t
+dp_id_table_set(struct dp_id_table *table, uint32_t id, void *val) {
+  void **block;
+
+  block = table->block[id >> DP_ID_TABLE_SHIFT];
+  if (block == NULL) {
+    if (val == NULL) {
+      return LAGOPUS_RESULT_OK;
+    }
+    block = calloc(DP_ID_TABLE_BLOCK, sizeof(void *));
+    if (block == NULL) {
+      return LAGOPUS_RESULT_NO_MEMORY;
+    }
+    DP_RCU_ASSIGN_POINTER(table->block[id >> DP_ID_TABLE_SHIFT], block);
+  }
+  DP_RCU_ASSIGN_POINTER(block[id & DP_ID_TABLE_MASK], val);
+  return LAGOPUS_RESULT_OK;
+}
+
+void
+dp_id_table_clear(struct dp_id_table *table) {
+  int i, j;
+
+  for (i = 0; i < DP_ID_TABLE_BLOCK; i++) {
+    if (table->block[i] != NULL) {
+      for (j = 0; j < DP_ID_TABLE_BLOCK; j++) {
+        table->block[i][j] = NULL;
+      }
+    }
+  }
+  mbar();
+}
+
+void
+dp_id_table_free(struct dp_id_table *table) {
+  int i;
+
+  for (i = 0; i < DP_ID_TABLE_BLOCK; i++) {
+    free(table->block[i]);
+    table->block[i] = NULL;
+  }
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   idtable.h
+ *      @brief  Direct indexed table of small object ids.
+ *
+ * Group and meter ids are usually small and dense.  Objects with ids
+ * below DP_ID_TABLE_SIZE are also registered in a two level array, and
+ * the dataplane finds them with two loads instead of a hashmap lookup.
+ * Updates are serialized by the owner table lock, and readers need no
+ * lock: blocks are never freed while the table is alive, and objects
+ * removed from the table are released after dp_rcu_synchronize().
+ */
+
+#ifndef SRC_DATAPLANE_MGR_IDTABLE_H_
+#define SRC_DATAPLANE_MGR_IDTABLE_H_
+
+#define DP_ID_TABLE_SHIFT 8
+#define DP_ID_TABLE_BLOCK (1 << DP_ID_TABLE_SHIFT)
+#define DP_ID_TABLE_MASK  (DP_ID_TABLE_BLOCK - 1)
+#define DP_ID_TABLE_SIZE  (DP_ID_TABLE_BLOCK * DP_ID_TABLE_BLOCK)
+
+/**
+ * @brief Two level table indexed by id.
+ */
+struct dp_id_table {
+  void **block[DP_ID_TABLE_BLOCK];
+};
+
+/**
+ * Register object to the table.
+ *
+ * @param[in]   table   Table.
+ * @param[in]   id      Id, less than DP_ID_TABLE_SIZE.
+ * @param[in]   val     Object, or NULL to unregister.
+ *
+ * @retval      LAGOPUS_RESULT_OK               Succeeded.
+ * @retval      LAGOPUS_RESULT_NO_MEMORY        Memory exhausted.
+ */
+lagopus_result_t
+dp_id_table_set(struct dp_id_table *table, uint32_t id, void *val);
+
+/**
+ * Unregister all objects.
+ */
+void
+dp_id_table_clear(struct dp_id_table *table);
+
+/**
+ * Free blocks of the table.  Caller must ensure that no dataplane
+ * thread refers it.
+ */
+void
+dp_id_table_free(struct dp_id_table *table);
+
+/**
+ * Find object, id must be less than DP_ID_TABLE_SIZE.
+ */
+static inline void *
+dp_id_table_get(const struct dp_id_table *table, uint32_t id) {
+  void **block;
+
+  block = table->block[id >> DP_ID_TABLE_SHIFT];
+  if (block == NULL) {
+    return NULL;
+  }
+  return block[id & DP_ID_TABLE_MASK];
+}
+
+#endif /* SRC_DATAPLANE_MGR_IDTABLE_H_ */
@@ -24,6 +24,8 @@
 #include "rte_rwlock.h"
 #endif /* HAVE_DPDK */
 
+#include "rcu.h"
+
 /*
  * flowdb lock primitive.
  */
@@ -95,6 +97,7 @@ void flowdb_lock_init(struct flowdb *flowdb);
 
 /**
  * Read lock the flow database.
+ * Registered dataplane thread is online (see rcu.h) while locked.
  *
  * @param[in]   flowdb  Flow database to be locked.
  */
@@ -102,16 +105,19 @@ static inline void
 flowdb_rdlock(struct flowdb *flowdb) {
   (void) flowdb;
   FLOWDB_RWLOCK_RDLOCK();
+  dp_rcu_thread_online();
 }
 
 /**
  * Check write lock the flow database.
+ * Calling dataplane thread leaves read side (see rcu.h).
  *
  * @param[in]   flowdb  Flow database to be locked.
  */
 static inline void
 flowdb_check_update(struct flowdb *flowdb) {
   (void) flowdb;
+  dp_rcu_thread_offline();
   FLOWDB_RWLOCK_RDUNLOCK();
   FLOWDB_UPDATE_CHECK();
   FLOWDB_RWLOCK_RDLOCK();
@@ -137,6 +143,7 @@ flowdb_wrlock(struct flowdb *flowdb) {
 static inline void
 flowdb_rdunlock(struct flowdb *flowdb) {
   (void) flowdb;
+  dp_rcu_thread_offline();
   FLOWDB_RWLOCK_RDUNLOCK();
 }
 
@@ -152,4 +159,40 @@ flowdb_wrunlock(struct flowdb *flowdb) {
   FLOWDB_UPDATE_END();
 }
 
+/*
+ * Per flowdb lock for OpenFlow modification (flow_mod, group_mod).
+ * Writers hold it exclusively and publish changes to the dataplane
+ * with dp_rcu_synchronize(), so that the dataplane threads holding
+ * flowdb_rdlock() are never blocked.  Control plane readers such as
+ * flow stats hold it shared.
+ */
+
+/**
+ * Shared lock the flow database against modification.
+ *
+ * @param[in]   flowdb  Flow database to be locked.
+ */
+void flowdb_mod_rdlock(struct flowdb *flowdb);
+
+/**
+ * Exclusive lock the flow database for modification.
+ *
+ * @param[in]   flowdb  Flow database to be locked.
+ */
+void flowdb_mod_wrlock(struct flowdb *flowdb);
+
+/**
+ * Unlock shared lock of the flow database.
+ *
+ * @param[in]   flowdb  Flow database to be unlocked.
+ */
+void flowdb_mod_rdunlock(struct flowdb *flowdb);
+
+/**
+ * Unlock exclusive lock of the flow database.
+ *
+ * @param[in]   flowdb  Flow database to be unlocked.
+ */
+void flowdb_mod_wrunlock(struct flowdb *flowdb);
+
 #endif /* SRC_DATAPLANE_MGR_LOCK_H_ */
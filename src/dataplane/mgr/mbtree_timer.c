@@ -20,6 +20,7 @@
 #include "lagopus/flowdb.h"
 #include "mbtree.h"
 #include "dp_timer.h"
+#include "lock.h"
 
 #undef DEBUG
 #ifdef DEBUG
@@ -33,6 +34,7 @@
 static void
 mbtree_timer_expire(struct dp_timer *dp_timer) {
   struct flow_list *flow_list;
+  struct flowdb *flowdb;
   int i;
 
   DPRINTF("expired\n");
@@ -42,12 +44,16 @@ mbtree_timer_expire(struct dp_timer *dp_timer) {
     if (flow_list == NULL) {
       continue;
     }
-    system("date");
-    printf("cleanup and build start\n");
-    cleanup_mbtree(flow_list);
-    build_mbtree(flow_list);
-    system("date");
-    printf("cleanup and build end\n");
+    /* flows are not modified while building, forwarding continues. */
+    flowdb = flow_list->flowdb;
+    flowdb_mod_rdlock(flowdb);
+    if (dp_timer->timer_entry[i] == flow_list) {
+      flow_list->update_timer = NULL;
+      DPRINTF("build start\n");
+      build_mbtree(flow_list);
+      DPRINTF("build end\n");
+    }
+    flowdb_mod_rdunlock(flowdb);
   }
 }
 
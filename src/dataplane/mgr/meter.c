@@ -25,6 +25,8 @@
 #include "lagopus/dp_apis.h"
 
 #include "lock.h"
+#include "counter.h"
+#include "idtable.h"
 
 /**
  * @brief Meter table.
@@ -32,39 +34,36 @@
 struct meter_table {                    /** Meter table. */
   pthread_rwlock_t rwlock;              /** Read-write lock. */
   lagopus_hashmap_t hashmap;            /** Meter id hashtable. */
+  struct dp_id_table ids;               /** Small meter id index. */
 };
 
+/*
+ * Meter table lock is not taken by the dataplane.  Meters referred by
+ * the dataplane are released after dp_rcu_synchronize().
+ */
 static inline void
 meter_table_lock_init(struct meter_table *meter_table) {
-  (void) meter_table;
+  pthread_rwlock_init(&meter_table->rwlock, NULL);
 }
 
 static inline void
 meter_table_rdlock(struct meter_table *meter_table) {
-  (void) meter_table;
-
-  FLOWDB_RWLOCK_RDLOCK();
+  pthread_rwlock_rdlock(&meter_table->rwlock);
 }
 
 static inline void
 meter_table_rdunlock(struct meter_table *meter_table) {
-  (void) meter_table;
-
-  FLOWDB_RWLOCK_RDUNLOCK();
+  pthread_rwlock_unlock(&meter_table->rwlock);
 }
 
 static inline void
 meter_table_wrlock(struct meter_table *meter_table) {
-  (void) meter_table;
-
-  FLOWDB_UPDATE_BEGIN();
+  pthread_rwlock_wrlock(&meter_table->rwlock);
 }
 
 static inline void
 meter_table_wrunlock(struct meter_table *meter_table) {
-  (void) meter_table;
-
-  FLOWDB_UPDATE_END();
+  pthread_rwlock_unlock(&meter_table->rwlock);
 }
 
 static struct meter *
@@ -78,6 +77,10 @@ meter_alloc(uint32_t meter_id,
     return NULL;
   }
 
+  if (dp_counter_alloc(&meter->counter_id) != LAGOPUS_RESULT_OK) {
+    free(meter);
+    return NULL;
+  }
   meter->meter_id = meter_id;
   meter->flags = flags;
   TAILQ_INIT(&meter->band_list);
@@ -90,25 +93,28 @@ meter_alloc(uint32_t meter_id,
   return meter;
 }
 
+static void meter_free(struct meter *meter);
+
 static lagopus_result_t
 meter_modify(struct meter *meter,
              uint16_t flags,
              struct meter_band_list *band_list) {
-  struct meter_band *band;
+  struct meter *retired;
 
-  while ((band = TAILQ_FIRST(&meter->band_list)) != NULL) {
-    TAILQ_REMOVE(&meter->band_list, band, entry);
-    meter_band_free(band);
-  }
-  if (lagopus_unregister_meter != NULL) {
-    lagopus_unregister_meter(meter);
+  /* bands and driver data in use are moved, and freed later. */
+  retired = calloc(1, sizeof(struct meter));
+  if (retired == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
   }
+  TAILQ_INIT(&retired->band_list);
+  TAILQ_CONCAT(&retired->band_list, &meter->band_list, entry);
+  retired->driverdata = meter->driverdata;
   meter->flags = flags;
-  TAILQ_INIT(&meter->band_list);
   TAILQ_CONCAT(&meter->band_list, band_list, entry);
   if (lagopus_register_meter != NULL) {
     lagopus_register_meter(meter);
   }
+  meter_free(retired);
 
   return LAGOPUS_RESULT_OK;
 }
@@ -117,6 +123,9 @@ static void
 meter_free(struct meter *meter) {
   struct meter_band *band;
 
+  /* wait for the dataplane to leave the meter. */
+  dp_rcu_synchronize();
+
   while ((band = TAILQ_FIRST(&meter->band_list)) != NULL) {
     TAILQ_REMOVE(&meter->band_list, band, entry);
     meter_band_free(band);
@@ -125,6 +134,7 @@ meter_free(struct meter *meter) {
   if (lagopus_unregister_meter != NULL) {
     lagopus_unregister_meter(meter);
   }
+  dp_counter_free(meter->counter_id);
   free(meter);
 }
 
@@ -152,7 +162,10 @@ meter_table_alloc(void) {
 
 void
 meter_table_free(struct meter_table *meter_table) {
+  dp_id_table_clear(&meter_table->ids);
   lagopus_hashmap_destroy(&meter_table->hashmap, true);
+  dp_id_table_free(&meter_table->ids);
+  pthread_rwlock_destroy(&meter_table->rwlock);
   free(meter_table);
 }
 
@@ -194,6 +207,14 @@ meter_table_meter_add(struct meter_table *meter_table,
   if (rv != LAGOPUS_RESULT_OK) {
     goto out;
   }
+  if (mod->meter_id < DP_ID_TABLE_SIZE) {
+    rv = dp_id_table_set(&meter_table->ids, mod->meter_id, meter);
+    if (rv != LAGOPUS_RESULT_OK) {
+      lagopus_hashmap_delete_no_lock(&meter_table->hashmap,
+                                     (void *)key, NULL, true);
+      goto out;
+    }
+  }
 
 out:
   ofp_meter_band_list_elem_free(band_list);
@@ -257,12 +278,18 @@ meter_table_meter_delete(struct meter_table *meter_table,
   meter_table_wrlock(meter_table);
 
   if (mod->meter_id == OFPM_ALL) {
+    dp_id_table_clear(&meter_table->ids);
     lagopus_hashmap_clear_no_lock(&meter_table->hashmap, true);
   } else {
 
     /* Key is network byte order. */
     key = htonl(mod->meter_id);
 
+    /* Unpublish from the index before the meter is released. */
+    if (mod->meter_id < DP_ID_TABLE_SIZE) {
+      dp_id_table_set(&meter_table->ids, mod->meter_id, NULL);
+    }
+
     /* Lookup node. */
     ret = lagopus_hashmap_delete_no_lock(&meter_table->hashmap,
                                          (void *)key, NULL, true);
@@ -274,10 +301,14 @@ meter_table_meter_delete(struct meter_table *meter_table,
 
 struct meter *
 meter_table_lookup(struct meter_table *meter_table, uint32_t meter_id) {
-  uint32_t key = htonl(meter_id);
+  uint32_t key;
   struct meter *meter;
   lagopus_result_t rv;
 
+  if (meter_id < DP_ID_TABLE_SIZE) {
+    return dp_id_table_get(&meter_table->ids, meter_id);
+  }
+  key = htonl(meter_id);
   rv = lagopus_hashmap_find_no_lock(&meter_table->hashmap,
                                     (void *)key, &meter);
   if (rv != LAGOPUS_RESULT_OK) {
@@ -302,6 +333,10 @@ meter_band_alloc(struct ofp_meter_band_header *band_header) {
   if (band == NULL) {
     return NULL;
   }
+  if (dp_counter_alloc(&band->counter_id) != LAGOPUS_RESULT_OK) {
+    free(band);
+    return NULL;
+  }
 
   band_union = (union meter_band_union *)band_header;
 
@@ -336,6 +371,7 @@ meter_band_alloc(struct ofp_meter_band_header *band_header) {
 
 void
 meter_band_free(struct meter_band *band) {
+  dp_counter_free(band->counter_id);
   free(band);
 }
 
@@ -347,8 +383,8 @@ set_meter_stats(struct meter_stats *stats, const struct meter *meter) {
 
   stats->ofp.meter_id = meter->meter_id;
   stats->ofp.flow_count = meter->flow_count;
-  stats->ofp.packet_in_count = meter->input_packet_count;
-  stats->ofp.byte_in_count = meter->input_byte_count;
+  dp_counter_get(meter->counter_id,
+                 &stats->ofp.packet_in_count, &stats->ofp.byte_in_count);
 
   clock_gettime(CLOCK_MONOTONIC, &ts);
   stats->ofp.duration_sec = (uint32_t)(ts.tv_sec - meter->create_time.tv_sec);
@@ -371,6 +407,9 @@ set_meter_stats(struct meter_stats *stats, const struct meter *meter) {
       return LAGOPUS_RESULT_NO_MEMORY;
     }
     band_stats->ofp = band->stats;
+    dp_counter_get(band->counter_id,
+                   &band_stats->ofp.packet_band_count,
+                   &band_stats->ofp.byte_band_count);
     TAILQ_INSERT_TAIL(&stats->meter_band_stats_list, band_stats, entry);
   }
 
@@ -513,7 +552,7 @@ ofp_meter_band_list_elem_free(struct meter_band_list *band_list) {
   while (TAILQ_EMPTY(band_list) == false) {
     band = TAILQ_FIRST(band_list);
     TAILQ_REMOVE(band_list, band, entry);
-    free(band);
+    meter_band_free(band);
   }
 }
 
@@ -23,6 +23,7 @@
 #include <openflow.h>
 
 #include "lagopus/flowdb.h"
+#include "lagopus/group.h"
 #include "lagopus/port.h"
 #include "lagopus/dataplane.h"
 #include "lagopus/ofp_dp_apis.h"
@@ -171,6 +172,9 @@ dp_port_update_link_status(struct port *port) {
       dpdk_update_port_link_status(port);
       break;
 #endif /* HAVE_DPDK */
+    case DATASTORE_INTERFACE_TYPE_ETHERNET_RAWSOCK:
+      rawsock_update_port_link_status(port);
+      break;
     default:
       break;
   }
@@ -190,6 +194,8 @@ lagopus_change_physical_port(struct port *port) {
                                port->ofp_port.advertised,
                                port->ofp_port.config);
   }
+  /* OFPPC_PORT_DOWN may be changed. */
+  group_port_live_update(port);
   send_port_status(port, OFPPR_MODIFY);
   return LAGOPUS_RESULT_OK;
 }
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   rcu.c
+ *      @brief  Quiescent state based reclamation for dataplane threads.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "lagopus_apis.h"
+#include "rcu.h"
+
+volatile uint64_t dp_rcu_epoch = 1;
+__thread struct dp_rcu_reader *dp_rcu_self = NULL;
+
+static struct dp_rcu_reader dp_rcu_readers[DP_RCU_MAX_THREADS];
+static pthread_mutex_t dp_rcu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+lagopus_result_t
+dp_rcu_thread_register(void) {
+  int i;
+
+  if (dp_rcu_self != NULL) {
+    return LAGOPUS_RESULT_OK;
+  }
+  pthread_mutex_lock(&dp_rcu_lock);
+  for (i = 0; i < DP_RCU_MAX_THREADS; i++) {
+    if (dp_rcu_readers[i].used == false) {
+      dp_rcu_readers[i].epoch = 0;
+      dp_rcu_readers[i].used = true;
+      dp_rcu_self = &dp_rcu_readers[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&dp_rcu_lock);
+  if (dp_rcu_self == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  return LAGOPUS_RESULT_OK;
+}
+
+void
+dp_rcu_thread_unregister(void) {
+  if (dp_rcu_self == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&dp_rcu_lock);
+  dp_rcu_thread_offline();
+  dp_rcu_self->used = false;
+  dp_rcu_self = NULL;
+  pthread_mutex_unlock(&dp_rcu_lock);
+}
+
+void
+dp_rcu_synchronize(void) {
+  struct dp_rcu_reader *reader;
+  uint64_t target, epoch;
+  int i;
+
+  target = __sync_add_and_fetch(&dp_rcu_epoch, 1);
+  for (i = 0; i < DP_RCU_MAX_THREADS; i++) {
+    reader = &dp_rcu_readers[i];
+    if (reader->used == false || reader == dp_rcu_self) {
+      continue;
+    }
+    for (;;) {
+      epoch = reader->epoch;
+      if (epoch == 0 || epoch >= target) {
+        break;
+      }
+      sched_yield();
+    }
+  }
+  mbar();
+}
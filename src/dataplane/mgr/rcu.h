@@ -0,0 +1,110 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   rcu.h
+ *      @brief  Quiescent state based reclamation for dataplane threads.
+ *
+ * Dataplane threads register themselves as readers and are "online"
+ * while they refer to the flow tables.  Writers publish a new
+ * structure by a pointer store, call dp_rcu_synchronize() and then
+ * free the old one.  Readers never wait for writers.
+ */
+
+#ifndef SRC_DATAPLANE_MGR_RCU_H_
+#define SRC_DATAPLANE_MGR_RCU_H_
+
+#define DP_RCU_MAX_THREADS 256
+
+/**
+ * @brief Per thread reader state.
+ */
+struct dp_rcu_reader {
+  volatile uint64_t epoch;      /** Observed epoch, 0 while offline. */
+  bool used;                    /** Slot is registered. */
+  uint8_t pad[64 - sizeof(uint64_t) - sizeof(bool)];
+};
+
+extern volatile uint64_t dp_rcu_epoch;
+extern __thread struct dp_rcu_reader *dp_rcu_self;
+
+/**
+ * Register calling thread as a reader.
+ * Registered thread is offline until dp_rcu_thread_online() is called.
+ *
+ * @retval      LAGOPUS_RESULT_OK               Succeeded.
+ * @retval      LAGOPUS_RESULT_NO_MEMORY        No free slot.
+ */
+lagopus_result_t
+dp_rcu_thread_register(void);
+
+/**
+ * Unregister calling thread.
+ */
+void
+dp_rcu_thread_unregister(void);
+
+/**
+ * Wait until all readers online at the call pass a quiescent state.
+ * Objects unpublished before the call are not referred by any reader
+ * after return.  Calling thread must not be online.
+ */
+void
+dp_rcu_synchronize(void);
+
+/**
+ * Enter read side.  No effect for unregistered thread.
+ */
+static inline void
+dp_rcu_thread_online(void) {
+  if (dp_rcu_self != NULL) {
+    dp_rcu_self->epoch = dp_rcu_epoch;
+    mbar();
+  }
+}
+
+/**
+ * Leave read side.  No effect for unregistered thread.
+ */
+static inline void
+dp_rcu_thread_offline(void) {
+  if (dp_rcu_self != NULL) {
+    mbar();
+    dp_rcu_self->epoch = 0;
+  }
+}
+
+/**
+ * Announce quiescent state, references obtained so far are dropped.
+ */
+static inline void
+dp_rcu_quiescent_state(void) {
+  if (dp_rcu_self != NULL) {
+    mbar();
+    dp_rcu_self->epoch = dp_rcu_epoch;
+    mbar();
+  }
+}
+
+/**
+ * Publish pointer for readers after initialization of the object.
+ */
+#define DP_RCU_ASSIGN_POINTER(p, v) do {        \
+    mbar();                                     \
+    (p) = (v);                                  \
+  } while (0)
+
+#endif /* SRC_DATAPLANE_MGR_RCU_H_ */
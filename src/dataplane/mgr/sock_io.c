@@ -28,9 +28,13 @@
 #include <pthread.h>
 #include <err.h>
 #include <getopt.h>
+#include <time.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/queue.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <net/if.h>
 #include <pthread.h>
 
@@ -41,6 +45,7 @@
 
 #include "lagopus/dp_apis.h"
 #include "lagopus/flowdb.h"
+#include "lagopus/group.h"
 #include "lagopus/meter.h"
 #include "lagopus/ofp_dp_apis.h"
 #include "lagopus/port.h"
@@ -52,6 +57,8 @@
 #include "csum.h"
 #include "thread.h"
 #include "lock.h"
+#include "counter.h"
+#include "dp_timer.h"
 #include "sock_io.h"
 
 #ifdef HAVE_DPDK
@@ -65,11 +72,36 @@ static int kvs_type = FLOWCACHE_HASHMAP_NOLOCK;
 static int hashtype = HASH_TYPE_INTEL64;
 static struct flowcache *flowcache;
 
-static bool volatile clear_cache = false;
+static volatile uint32_t cache_gen = 0;
 
 static int portidx = 0;
 static lagopus_hashmap_t fdifp_hashmap;
 
+/* bumped under flowdb_wrlock() when an interface is (un)configured. */
+static volatile uint32_t rawsock_ifgen = 0;
+
+#if !defined(HAVE_DPDK) && defined(TPACKET3_HDRLEN)
+#define RAWSOCK_RING 1
+#endif /* !HAVE_DPDK && TPACKET3_HDRLEN */
+
+#ifdef RAWSOCK_RING
+#define RAWSOCK_MAX_WORKERS      16
+#define RAWSOCK_MAX_RINGS        64
+#define RAWSOCK_RING_BLOCK_SIZE  (1 << 18)
+#define RAWSOCK_RING_BLOCK_NR    64
+#define RAWSOCK_RING_FRAME_SIZE  2048
+#define RAWSOCK_RING_RETIRE_TOV  1      /* msec */
+#define RAWSOCK_RING_RESERVE     128    /* headroom for push actions */
+#define RAWSOCK_RING_BUDGET      8      /* blocks per ring per wakeup */
+
+/*
+ * --mmap: receive with TPACKET_V3 rings, --workers: spread received
+ * packets over the worker threads by PACKET_FANOUT.
+ */
+static bool use_ring = false;
+static unsigned int nworkers = 1;
+#endif /* RAWSOCK_RING */
+
 static uint32_t
 get_port_number(struct interface *ifp) {
   lagopus_result_t rv;
@@ -87,150 +119,169 @@ put_port_number(struct interface *ifp) {
   lagopus_hashmap_delete(&fdifp_hashmap, (void *)ifp->fd, NULL, false);
 }
 
-struct pollfd_iter {
-  int nfds;
-  struct pollfd pollfd[0];
-};
+/*
+ * Interface sockets are registered to the epoll set when configured,
+ * the I/O loop waits on it without rebuilding the descriptor set.
+ */
+static int rawsock_epfd = -1;
+static pthread_once_t rawsock_epoll_once = PTHREAD_ONCE_INIT;
 
-static bool
-do_pollfd_iterate(void *key, void *val,
-                      lagopus_hashentry_t he, void *arg) {
-  struct pollfd_iter *iter;
-
-  iter = arg;
-  iter->pollfd[iter->nfds].fd = (int)key;
-  iter->pollfd[iter->nfds].events = POLLIN;
-  iter->nfds++;
-  return true;
+static void
+rawsock_epoll_init(void) {
+  rawsock_epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (rawsock_epfd == -1) {
+    lagopus_msg_error("epoll_create1: %s\n", strerror(errno));
+  }
 }
 
-static struct pollfd_iter *
-create_pollfds(void) {
-  struct pollfd_iter *iter;
-  lagopus_result_t nfd;
-
-  nfd = lagopus_hashmap_size(&fdifp_hashmap);
-  if (nfd < 0) {
-    return NULL;
-  }
-  iter = malloc(sizeof(struct pollfd_iter) + nfd * sizeof(struct pollfd));
-  if (iter == NULL) {
-    return NULL;
-  }
-  iter->nfds = 0;
-  lagopus_hashmap_iterate(&fdifp_hashmap, do_pollfd_iterate, iter);
-  return iter;
+static int
+rawsock_epoll_fd(void) {
+  (void)pthread_once(&rawsock_epoll_once, rawsock_epoll_init);
+  return rawsock_epfd;
 }
 
+/*
+ * Restore VLAN tag stripped by the kernel, into the headroom.
+ */
 static void
-destroy_pollfds(struct pollfd_iter *iter) {
-  free(iter);
+restore_vlan_tag(OS_MBUF *m, struct tpacket_auxdata *auxdata) {
+  uint16_t *p;
+  uint16_t ether_type;
+
+#if defined (TP_STATUS_VLAN_VALID)
+  if ((auxdata->tp_status & TP_STATUS_VLAN_VALID) == 0) {
+    return;
+  }
+#else
+  if (auxdata->tp_vlan_tci == 0) {
+    return;
+  }
+#endif /* TP_STATUS_VLAN_VALID */
+  (void)OS_M_PREPEND(m, 4);
+  memmove(OS_MTOD(m, uint8_t *), OS_MTOD(m, uint8_t *) + 4,
+          ETHER_ADDR_LEN * 2);
+  p = (uint16_t *)(OS_MTOD(m, uint8_t *) + ETHER_ADDR_LEN * 2);
+  switch (OS_NTOHS(p[2])) {
+    case ETHERTYPE_PBB:
+    case ETHERTYPE_VLAN:
+      ether_type = 0x88a8;
+      break;
+    default:
+      ether_type = ETHERTYPE_VLAN;
+      break;
+  }
+  p[0] = OS_HTONS(ether_type);
+  p[1] = OS_HTONS(auxdata->tp_vlan_tci);
 }
 
-static ssize_t
-read_packet(int fd, uint8_t *buf, size_t buflen) {
-  struct sockaddr from;
-  struct iovec iov;
-  struct msghdr msg;
+/**
+ * Receive burst of packets by one system call.
+ *
+ * @param[in]   fd      Interface socket.
+ * @param[in]   pkts    Empty packets to be filled.
+ * @param[in]   n       Number of packets.
+ *
+ * @retval      >=0     Number of packets received, 0 if no packet.
+ * @retval      -1      Error, errno is set.
+ */
+static int
+read_packets(int fd, struct lagopus_packet *pkts[], unsigned int n) {
+  struct mmsghdr msgs[LAGOPUS_DP_BULK_MAX];
+  struct iovec iovs[LAGOPUS_DP_BULK_MAX];
   union {
     struct cmsghdr cmsg;
     uint8_t buf[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
-  } cmsgbuf;
+  } cmsgbufs[LAGOPUS_DP_BULK_MAX];
   struct cmsghdr *cmsg;
-  struct tpacket_auxdata *auxdata;
-  uint16_t *p;
-  ssize_t pktlen;
-  uint16_t ether_type;
-
-  iov.iov_base = buf;
-  iov.iov_len = buflen;
-  memset(buf, 0, buflen); /* XXX */
-
-  msg.msg_name = &from;
-  msg.msg_namelen = sizeof(from);
-  msg.msg_iov = &iov;
-  msg.msg_iovlen = 1;
-  msg.msg_control = &cmsgbuf;
-  msg.msg_controllen = sizeof(cmsgbuf);
-  msg.msg_flags = 0;
+  OS_MBUF *m;
+  unsigned int i;
+  int nrecv;
 
-  pktlen = recvmsg(fd, &msg, MSG_TRUNC);
-  if (pktlen == -1) {
+  if (n > LAGOPUS_DP_BULK_MAX) {
+    n = LAGOPUS_DP_BULK_MAX;
+  }
+  for (i = 0; i < n; i++) {
+    iovs[i].iov_base = OS_MTOD(PKT2MBUF(pkts[i]), uint8_t *);
+    iovs[i].iov_len = MAX_PACKET_SZ;
+    msgs[i].msg_hdr.msg_name = NULL;
+    msgs[i].msg_hdr.msg_namelen = 0;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_control = &cmsgbufs[i];
+    msgs[i].msg_hdr.msg_controllen = sizeof(cmsgbufs[i]);
+    msgs[i].msg_hdr.msg_flags = 0;
+  }
+  nrecv = recvmmsg(fd, msgs, n, MSG_DONTWAIT, NULL);
+  if (nrecv == -1) {
     if (errno == EAGAIN) {
-      pktlen = 0;
+      nrecv = 0;
     }
-    return pktlen;
+    return nrecv;
   }
-  for (cmsg = CMSG_FIRSTHDR(&msg);
-       cmsg != NULL;
-       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-    if (cmsg->cmsg_type != PACKET_AUXDATA) {
-      continue;
-    }
-    auxdata = (struct tpacket_auxdata *)CMSG_DATA(cmsg);
-#if defined (TP_STATUS_VLAN_VALID)
-    if ((auxdata->tp_status & TP_STATUS_VLAN_VALID) == 0) {
-      continue;
-    }
-#else
-    if (auxdata->tp_vlan_tci == 0) {
-      continue;
-    }
-#endif /* TP_STATUS_VLAN_VALID */
-    p = (uint16_t *)(buf + ETHER_ADDR_LEN * 2);
-    switch (OS_NTOHS(p[0])) {
-      case ETHERTYPE_PBB:
-      case ETHERTYPE_VLAN:
-        ether_type = 0x88a8;
-        break;
-      default:
-        ether_type = ETHERTYPE_VLAN;
-        break;
+  for (i = 0; i < (unsigned int)nrecv; i++) {
+    m = PKT2MBUF(pkts[i]);
+    m->len = msgs[i].msg_len;
+    for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+         cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+      if (cmsg->cmsg_type == PACKET_AUXDATA) {
+        restore_vlan_tag(m, (struct tpacket_auxdata *)CMSG_DATA(cmsg));
+      }
     }
-    memmove(&p[2], p, pktlen - ETHER_ADDR_LEN * 2);
-    p[0] = OS_HTONS(ether_type);
-    p[1] = OS_HTONS(auxdata->tp_vlan_tci);
-    pktlen += 4;
   }
-  return pktlen;
+  return nrecv;
 }
 
 lagopus_result_t
 rawsock_rx_burst(struct interface *ifp, void *mbufs[], size_t nb) {
-  lagopus_result_t i;
-
-  for (i = 0; i < nb; i++) {
-    struct lagopus_packet *pkt;
-    ssize_t len;
-
-    pkt = alloc_lagopus_packet();
-    mbufs[i] = PKT2MBUF(pkt);
-    len = read_packet(ifp->fd,
-                      OS_MTOD((OS_MBUF *)mbufs[i], uint8_t *), MAX_PACKET_SZ);
-    if (len < 0) {
+  struct lagopus_packet *pkts[LAGOPUS_DP_BULK_MAX];
+  lagopus_result_t count;
+  unsigned int i, n;
+  int nrecv;
+
+  count = 0;
+  while (count < nb) {
+    n = nb - count;
+    if (n > LAGOPUS_DP_BULK_MAX) {
+      n = LAGOPUS_DP_BULK_MAX;
+    }
+    for (i = 0; i < n; i++) {
+      pkts[i] = alloc_lagopus_packet();
+      if (pkts[i] == NULL) {
+        break;
+      }
+    }
+    n = i;
+    nrecv = 0;
+    if (n > 0) {
+      nrecv = read_packets(ifp->fd, pkts, n);
+    }
+    if (nrecv < 0) {
       switch (errno) {
         case ENETDOWN:
         case ENETRESET:
         case ECONNABORTED:
         case ECONNRESET:
-        case EAGAIN:
-          lagopus_packet_free(pkt);
-          goto out;
         case EINTR:
-          continue;
+          nrecv = 0;
+          break;
 
         default:
           lagopus_exit_fatal("read: %s", strerror(errno));
       }
     }
-    if (len == 0) {
-      lagopus_packet_free(pkt);
+    for (i = 0; i < n; i++) {
+      if (i < (unsigned int)nrecv) {
+        mbufs[count++] = PKT2MBUF(pkts[i]);
+      } else {
+        lagopus_packet_free(pkts[i]);
+      }
+    }
+    if ((unsigned int)nrecv < n || n == 0) {
       break;
     }
-    OS_M_TRIM((OS_MBUF *)mbufs[i], MAX_PACKET_SZ - len);
   }
-out:
-  return i;
+  return count;
 }
 
 #ifndef HAVE_DPDK
@@ -240,6 +291,10 @@ rawsock_dataplane_init(int argc, const char *const argv[]) {
     {"no-cache", 0, 0, 0},
     {"kvstype", 1, 0, 0},
     {"hashtype", 1, 0, 0},
+#ifdef RAWSOCK_RING
+    {"mmap", 0, 0, 0},
+    {"workers", 1, 0, 0},
+#endif /* RAWSOCK_RING */
     {NULL, 0, 0, 0}
   };
   int opt, optind;
@@ -255,6 +310,8 @@ rawsock_dataplane_init(int argc, const char *const argv[]) {
             kvs_type = FLOWCACHE_HASHMAP_NOLOCK;
           } else if (!strcmp(optarg, "hashmap")) {
             kvs_type = FLOWCACHE_HASHMAP;
+          } else if (!strcmp(optarg, "openhash")) {
+            kvs_type = FLOWCACHE_OPEN_HASH;
           } else {
             return -1;
           }
@@ -270,6 +327,17 @@ rawsock_dataplane_init(int argc, const char *const argv[]) {
             return -1;
           }
         }
+#ifdef RAWSOCK_RING
+        if (!strcmp(lgopts[optind].name, "mmap")) {
+          use_ring = true;
+        }
+        if (!strcmp(lgopts[optind].name, "workers")) {
+          nworkers = (unsigned int)strtoul(optarg, NULL, 0);
+          if (nworkers == 0 || nworkers > RAWSOCK_MAX_WORKERS) {
+            return -1;
+          }
+        }
+#endif /* RAWSOCK_RING */
         break;
     }
   }
@@ -290,9 +358,17 @@ rawsock_configure_interface(struct interface *ifp) {
   struct packet_mreq mreq;
   struct sockaddr_ll sll;
   unsigned int mtu;
+  uint16_t proto;
   int fd, on;
 
-  fd = socket(PF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(ETH_P_ALL));
+  proto = htons(ETH_P_ALL);
+#ifdef RAWSOCK_RING
+  /* packets are received by the rings of the workers. */
+  if (use_ring == true) {
+    proto = 0;
+  }
+#endif /* RAWSOCK_RING */
+  fd = socket(PF_PACKET, SOCK_RAW | SOCK_NONBLOCK, proto);
   if (fd == -1) {
     lagopus_msg_error("%s: %s\n",
                       ifp->info.eth_rawsock.device, strerror(errno));
@@ -333,9 +409,19 @@ rawsock_configure_interface(struct interface *ifp) {
   lagopus_msg_info("Configuring %s, ifindex %d\n",
                    ifp->info.eth_rawsock.device, ifp->ifindex);
   sll.sll_family = AF_PACKET;
-  sll.sll_protocol = htons(ETH_P_ALL);
+  sll.sll_protocol = proto;
   sll.sll_ifindex = ifp->ifindex;
   bind(fd, (struct sockaddr *)&sll, sizeof(sll));
+  if (proto != 0) {
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(rawsock_epoll_fd(), EPOLL_CTL_ADD, fd, &ev) != 0) {
+      lagopus_msg_warning("%s: epoll: %s\n",
+                          ifp->info.eth_rawsock.device, strerror(errno));
+    }
+  }
 
   /* Set MTU */
   memset(&req, 0, sizeof(req));
@@ -373,6 +459,11 @@ rawsock_configure_interface(struct interface *ifp) {
     return LAGOPUS_RESULT_POSIX_API_ERROR;
   }
   ifp->stats = rawsock_port_stats;
+  /* link state and counters are sampled by the timer thread. */
+  if (ifp->link_timer == NULL) {
+    add_link_timer(ifp);
+  }
+  rawsock_ifgen++;
 
   return LAGOPUS_RESULT_OK;
 }
@@ -384,7 +475,9 @@ rawsock_unconfigure_interface(struct interface *ifp) {
   put_port_number(ifp);
   portid = ifp->info.eth_rawsock.port_number;
   ifp->ifindex = 0;
+  (void)epoll_ctl(rawsock_epoll_fd(), EPOLL_CTL_DEL, ifp->fd, NULL);
   close(ifp->fd);
+  rawsock_ifgen++;
 
   return LAGOPUS_RESULT_OK;
 }
@@ -415,18 +508,78 @@ rawsock_get_hwaddr(struct interface *ifp, uint8_t *hw_addr) {
   return LAGOPUS_RESULT_OK;
 }
 
+/*
+ * Packets to be sent by the I/O thread are queued, and sent together
+ * per port by sendmmsg() at the end of the burst.
+ */
+#define RAWSOCK_TXQ_SIZE  LAGOPUS_DP_BULK_MAX
+
+struct rawsock_txq {
+  unsigned int n;
+  struct {
+    int fd;
+    struct lagopus_packet *pkt;
+    struct iovec iov[2];
+    size_t iovlen;
+  } ent[RAWSOCK_TXQ_SIZE];
+  struct mmsghdr msgs[RAWSOCK_TXQ_SIZE];
+};
+
+/* TX queue of the calling I/O thread, NULL if packets are sent at once. */
+static __thread struct rawsock_txq *rawsock_txq = NULL;
+
+static void
+rawsock_txq_flush(struct rawsock_txq *txq) {
+  unsigned int i, j, nmsg;
+  int fd, nsent;
+
+  for (i = 0; i < txq->n; i++) {
+    fd = txq->ent[i].fd;
+    if (fd == -1) {
+      continue;
+    }
+    nmsg = 0;
+    for (j = i; j < txq->n; j++) {
+      if (txq->ent[j].fd != fd) {
+        continue;
+      }
+      memset(&txq->msgs[nmsg], 0, sizeof(txq->msgs[nmsg]));
+      txq->msgs[nmsg].msg_hdr.msg_iov = txq->ent[j].iov;
+      txq->msgs[nmsg].msg_hdr.msg_iovlen = txq->ent[j].iovlen;
+      txq->ent[j].fd = -1;
+      nmsg++;
+    }
+    for (j = 0; j < nmsg; j += (unsigned int)nsent) {
+      nsent = sendmmsg(fd, &txq->msgs[j], nmsg - j, 0);
+      if (nsent <= 0) {
+        if (nsent == -1 && errno == EINTR) {
+          nsent = 0;
+          continue;
+        }
+        /* socket buffer is full, drop the rest as write() does. */
+        break;
+      }
+    }
+  }
+  for (i = 0; i < txq->n; i++) {
+    lagopus_packet_free(txq->ent[i].pkt);
+  }
+  txq->n = 0;
+}
+
 int
 rawsock_send_packet_physical(struct lagopus_packet *pkt,
 			     struct interface *ifp) {
+  static const uint8_t pad[60];
+
   if (ifp->fd != 0) {
+    struct rawsock_txq *txq;
     OS_MBUF *m;
-    size_t plen;
+    size_t plen, iovlen;
+    struct iovec iov[2];
 
     m = PKT2MBUF(pkt);
     plen = OS_M_PKTLEN(m);
-    if (plen < 60) {
-      memset(OS_M_APPEND(m, 60 - plen), 0, (uint32_t)(60 - plen));
-    }
     if ((pkt->flags & PKT_FLAG_RECALC_CKSUM_MASK) != 0) {
       if (pkt->ether_type == ETHERTYPE_IP) {
         lagopus_update_ipv4_checksum(pkt);
@@ -434,14 +587,40 @@ rawsock_send_packet_physical(struct lagopus_packet *pkt,
         lagopus_update_ipv6_checksum(pkt);
       }
     }
-    (void)write(ifp->fd, OS_MTOD(m, char *), OS_M_PKTLEN(m));
+    iov[0].iov_base = OS_MTOD(m, char *);
+    iov[0].iov_len = plen;
+    iovlen = 1;
+    if (plen < sizeof(pad)) {
+      /* pad without writing past the packet, it may be a ring frame. */
+      iov[1].iov_base = (void *)pad;
+      iov[1].iov_len = sizeof(pad) - plen;
+      iovlen = 2;
+    }
+    txq = rawsock_txq;
+    if (txq != NULL) {
+      if (txq->n == RAWSOCK_TXQ_SIZE) {
+        rawsock_txq_flush(txq);
+      }
+      txq->ent[txq->n].fd = ifp->fd;
+      txq->ent[txq->n].pkt = pkt;
+      memcpy(txq->ent[txq->n].iov, iov, sizeof(iov));
+      txq->ent[txq->n].iovlen = iovlen;
+      txq->n++;
+      /* freed by rawsock_txq_flush(). */
+      return 0;
+    }
+    (void)writev(ifp->fd, iov, (int)iovlen);
   }
   lagopus_packet_free(pkt);
   return 0;
 }
 
-static struct port_stats *
-rawsock_port_stats(struct port *port) {
+/*
+ * Query the kernel for link state and counters of the port.
+ * Counters are stored to port->ofp_port_stats.
+ */
+static lagopus_result_t
+rawsock_port_sample(struct port *port) {
   struct {
     struct nlmsghdr nlh;
     struct ifinfomsg ifinfo;
@@ -459,29 +638,26 @@ rawsock_port_stats(struct port *port) {
   struct rtnl_link_stats *link_stats;
 #endif /* IFLA_STATS64 */
   struct timespec ts;
-  struct port_stats *stats;
+  struct ofp_port_stats *stats;
   int fd, len, rta_len;
 
   if (port->interface == NULL) {
-    return NULL;
+    return LAGOPUS_RESULT_INVALID_OBJECT;
   }
 
   link_stats = NULL;
-  stats = calloc(1, sizeof(struct port_stats));
-  if (stats == NULL) {
-    return NULL;
-  }
+  stats = &port->ofp_port_stats;
 
   fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK, NETLINK_ROUTE);
   if (fd == -1) {
     lagopus_msg_error("netlink socket create error: %s\n", strerror(errno));
-    free(stats);
-    return NULL;
+    return LAGOPUS_RESULT_POSIX_API_ERROR;
   }
   memset(&req, 0, sizeof(req));
   req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
   req.nlh.nlmsg_type = RTM_GETLINK;
-  req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  /* only the link of the port, not dump of all links. */
+  req.nlh.nlmsg_flags = NLM_F_REQUEST;
   req.ifinfo.ifi_family = AF_UNSPEC;
   req.ifinfo.ifi_type = ARPHRD_ETHER;
   req.ifinfo.ifi_index = port->interface->ifindex;
@@ -516,6 +692,7 @@ rawsock_port_stats(struct port *port) {
             port->ofp_port.state = OFPPS_LIVE;
           }
           if (changed == true) {
+            group_port_live_update(port);
             send_port_status(port, OFPPR_MODIFY);
           }
           rta_len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
@@ -542,37 +719,67 @@ found:
   close(fd);
 
   /* if counter is not supported, set all ones value. */
-  stats->ofp.port_no = port->ofp_port.port_no;
+  stats->port_no = port->ofp_port.port_no;
   if (link_stats != NULL) {
-    stats->ofp.rx_packets = link_stats->rx_packets;
-    stats->ofp.tx_packets = link_stats->tx_packets;
-    stats->ofp.rx_bytes = link_stats->rx_bytes;
-    stats->ofp.tx_bytes = link_stats->tx_bytes;
-    stats->ofp.rx_dropped = link_stats->rx_dropped;
-    stats->ofp.tx_dropped = link_stats->tx_dropped;
-    stats->ofp.rx_errors = link_stats->rx_errors;
-    stats->ofp.tx_errors = link_stats->tx_errors;
-    stats->ofp.rx_frame_err = link_stats->rx_frame_errors;
-    stats->ofp.rx_over_err = link_stats->rx_over_errors;
-    stats->ofp.rx_crc_err =  link_stats->rx_crc_errors;
-    stats->ofp.collisions = link_stats->collisions;
+    stats->rx_packets = link_stats->rx_packets;
+    stats->tx_packets = link_stats->tx_packets;
+    stats->rx_bytes = link_stats->rx_bytes;
+    stats->tx_bytes = link_stats->tx_bytes;
+    stats->rx_dropped = link_stats->rx_dropped;
+    stats->tx_dropped = link_stats->tx_dropped;
+    stats->rx_errors = link_stats->rx_errors;
+    stats->tx_errors = link_stats->tx_errors;
+    stats->rx_frame_err = link_stats->rx_frame_errors;
+    stats->rx_over_err = link_stats->rx_over_errors;
+    stats->rx_crc_err =  link_stats->rx_crc_errors;
+    stats->collisions = link_stats->collisions;
   }
 
   clock_gettime(CLOCK_MONOTONIC, &ts);
-  stats->ofp.duration_sec = (uint32_t)(ts.tv_sec - port->create_time.tv_sec);
+  stats->duration_sec = (uint32_t)(ts.tv_sec - port->create_time.tv_sec);
   if (ts.tv_nsec < port->create_time.tv_nsec) {
-    stats->ofp.duration_sec--;
-    stats->ofp.duration_nsec = 1 * 1000 * 1000 * 1000;
+    stats->duration_sec--;
+    stats->duration_nsec = 1 * 1000 * 1000 * 1000;
   } else {
-    stats->ofp.duration_nsec = 0;
+    stats->duration_nsec = 0;
   }
-  stats->ofp.duration_nsec += (uint32_t)ts.tv_nsec;
-  stats->ofp.duration_nsec -= (uint32_t)port->create_time.tv_nsec;
-  OS_MEMCPY(&port->ofp_port_stats, &stats->ofp, sizeof(stats->ofp));
+  stats->duration_nsec += (uint32_t)ts.tv_nsec;
+  stats->duration_nsec -= (uint32_t)port->create_time.tv_nsec;
+
+  return LAGOPUS_RESULT_OK;
+}
+
+static struct port_stats *
+rawsock_port_stats(struct port *port) {
+  struct port_stats *stats;
+
+  if (rawsock_port_sample(port) != LAGOPUS_RESULT_OK) {
+    return NULL;
+  }
+  stats = calloc(1, sizeof(struct port_stats));
+  if (stats == NULL) {
+    return NULL;
+  }
+  OS_MEMCPY(&stats->ofp, &port->ofp_port_stats, sizeof(stats->ofp));
 
   return stats;
 }
 
+/**
+ * Update link state and counters of the port, called by the link timer.
+ *
+ * @param[in]   port    Port.
+ *
+ * @retval      LAGOPUS_RESULT_OK       Success.
+ */
+lagopus_result_t
+rawsock_update_port_link_status(struct port *port) {
+  if (port->interface == NULL || port->interface->ifindex == 0) {
+    return LAGOPUS_RESULT_OK;
+  }
+  return rawsock_port_sample(port);
+}
+
 lagopus_result_t
 rawsock_get_stats(struct interface *ifp, datastore_interface_stats_t *stats) {
   struct {
@@ -683,7 +890,541 @@ rawsock_change_config(struct interface *ifp,
 
 void
 clear_rawsock_flowcache(void) {
-  clear_cache = true;
+  cache_gen++;
+}
+
+#ifdef RAWSOCK_RING
+/*
+ * TPACKET_V3 receive rings.
+ *
+ * Each worker thread opens its own ring socket per interface, and the
+ * sockets of an interface join one PACKET_FANOUT group so that a flow
+ * is always received by the same worker.  Interface sockets configured
+ * by rawsock_configure_interface() are used only for transmission.
+ *
+ * Received frames are not copied.  Packets of a worker refer the frames
+ * of the current block, and the block is returned to the kernel after
+ * all of its packets are processed.  The dataplane releases a packet
+ * before lagopus_match_and_action_bulk() returns, so the packets are
+ * reused for the next block.
+ */
+struct rawsock_ring {
+  struct interface *ifp;
+  uint32_t port_number;         /* identity of the configured interface. */
+  int fd;
+  uint8_t *map;
+  size_t maplen;
+  unsigned int cur;             /* next block to be read. */
+};
+
+struct rawsock_worker {
+  unsigned int id;
+  pthread_t thread;
+  bool *running;
+  struct flowcache *flowcache;
+  uint32_t ifgen;
+  uint32_t cache_gen;
+  unsigned int nrings;
+  struct rawsock_ring ring[RAWSOCK_MAX_RINGS];
+  struct pollfd pollfd[RAWSOCK_MAX_RINGS];
+  struct lagopus_packet *zpkts[LAGOPUS_DP_BULK_MAX];
+};
+
+static struct rawsock_worker rawsock_workers[RAWSOCK_MAX_WORKERS];
+
+static lagopus_result_t
+rawsock_ring_open(struct rawsock_ring *ring, struct interface *ifp) {
+  struct tpacket_req3 req;
+  struct sockaddr_ll sll;
+  int fd, val;
+
+  fd = socket(PF_PACKET, SOCK_RAW | SOCK_NONBLOCK, htons(ETH_P_ALL));
+  if (fd == -1) {
+    goto err;
+  }
+  val = TPACKET_V3;
+  if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &val, sizeof(val)) != 0) {
+    goto err;
+  }
+  val = RAWSOCK_RING_RESERVE;
+  if (setsockopt(fd, SOL_PACKET, PACKET_RESERVE, &val, sizeof(val)) != 0) {
+    goto err;
+  }
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = RAWSOCK_RING_BLOCK_SIZE;
+  req.tp_block_nr = RAWSOCK_RING_BLOCK_NR;
+  req.tp_frame_size = RAWSOCK_RING_FRAME_SIZE;
+  req.tp_frame_nr = (RAWSOCK_RING_BLOCK_SIZE / RAWSOCK_RING_FRAME_SIZE) *
+                    RAWSOCK_RING_BLOCK_NR;
+  req.tp_retire_blk_tov = RAWSOCK_RING_RETIRE_TOV;
+  if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+    goto err;
+  }
+  ring->maplen = (size_t)req.tp_block_size * req.tp_block_nr;
+  ring->map = mmap(NULL, ring->maplen, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    goto err;
+  }
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_ALL);
+  sll.sll_ifindex = ifp->ifindex;
+  if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) != 0) {
+    goto err;
+  }
+  if (nworkers > 1) {
+    /* fanout group id is unique per interface in this process. */
+    val = (int)((getpid() + ifp->ifindex) & 0xffff) |
+          (PACKET_FANOUT_HASH << 16);
+    if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &val, sizeof(val)) != 0) {
+      goto err;
+    }
+  }
+  ring->ifp = ifp;
+  ring->port_number = ifp->info.eth_rawsock.port_number;
+  ring->fd = fd;
+  ring->cur = 0;
+  return LAGOPUS_RESULT_OK;
+
+err:
+  lagopus_msg_warning("%s: rx ring: %s\n",
+                      ifp->info.eth_rawsock.device, strerror(errno));
+  if (ring->map != NULL) {
+    munmap(ring->map, ring->maplen);
+    ring->map = NULL;
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  return LAGOPUS_RESULT_POSIX_API_ERROR;
+}
+
+static void
+rawsock_ring_close(struct rawsock_ring *ring) {
+  munmap(ring->map, ring->maplen);
+  close(ring->fd);
+  ring->map = NULL;
+  ring->fd = -1;
+  ring->ifp = NULL;
+}
+
+static bool
+rawsock_worker_sync_iterate(void *key, void *val,
+                            lagopus_hashentry_t he, void *arg) {
+  struct rawsock_worker *w;
+  struct rawsock_ring *ring;
+  struct interface *ifp;
+  unsigned int i;
+  (void) key;
+  (void) he;
+
+  w = arg;
+  ifp = val;
+  for (i = 0; i < w->nrings; i++) {
+    if (w->ring[i].port_number == ifp->info.eth_rawsock.port_number) {
+      /* still configured, keep the ring. */
+      w->ring[i].ifp = ifp;
+      return true;
+    }
+  }
+  if (w->nrings == RAWSOCK_MAX_RINGS) {
+    lagopus_msg_warning("%s: too many interfaces for rx ring\n",
+                        ifp->info.eth_rawsock.device);
+    return true;
+  }
+  ring = &w->ring[w->nrings];
+  ring->map = NULL;
+  if (rawsock_ring_open(ring, ifp) == LAGOPUS_RESULT_OK) {
+    w->pollfd[w->nrings].fd = ring->fd;
+    w->pollfd[w->nrings].events = POLLIN;
+    w->nrings++;
+  }
+  return true;
+}
+
+/*
+ * Follow interface configuration.  Called with flowdb_rdlock().
+ */
+static void
+rawsock_worker_sync(struct rawsock_worker *w) {
+  unsigned int i, n;
+
+  w->ifgen = rawsock_ifgen;
+  for (i = 0; i < w->nrings; i++) {
+    w->ring[i].ifp = NULL;
+  }
+  n = w->nrings;
+  lagopus_hashmap_iterate(&fdifp_hashmap, rawsock_worker_sync_iterate, w);
+
+  /* close rings of unconfigured interfaces. */
+  for (i = 0; i < n; ) {
+    if (w->ring[i].ifp != NULL) {
+      i++;
+      continue;
+    }
+    rawsock_ring_close(&w->ring[i]);
+    w->nrings--;
+    n--;
+    w->ring[i] = w->ring[w->nrings];
+    w->pollfd[i] = w->pollfd[w->nrings];
+  }
+}
+
+/*
+ * Set up packet referring the frame.  VLAN tag stripped by the kernel
+ * is restored in the headroom.  Byte offset match reads past the end
+ * of the packet, frames packed at the end of the block are copied so
+ * that it does not run off the ring mapping.
+ */
+static struct lagopus_packet *
+rawsock_frame_packet(struct rawsock_worker *w, unsigned int idx,
+                     struct tpacket3_hdr *hdr, const uint8_t *block_end) {
+  struct lagopus_packet *pkt;
+  struct sockaddr_ll *sll;
+  OS_MBUF *m;
+  uint8_t *data;
+  uint16_t *p;
+  uint16_t ether_type;
+  size_t len;
+
+  /* packets sent by the interface socket are seen too. */
+  sll = (struct sockaddr_ll *)((uint8_t *)hdr +
+                               TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+  if (sll->sll_pkttype == PACKET_OUTGOING) {
+    return NULL;
+  }
+  data = (uint8_t *)hdr + hdr->tp_mac;
+  len = hdr->tp_snaplen;
+  if (len != hdr->tp_len || len + 4 > MAX_PACKET_SZ) {
+    /* truncated, or too large for copy. */
+    return NULL;
+  }
+  if ((hdr->tp_status & TP_STATUS_VLAN_VALID) != 0) {
+    data -= 4;
+    memmove(data, data + 4, ETHER_ADDR_LEN * 2);
+    p = (uint16_t *)(data + ETHER_ADDR_LEN * 2);
+#ifdef TP_STATUS_VLAN_TPID_VALID
+    if ((hdr->tp_status & TP_STATUS_VLAN_TPID_VALID) != 0) {
+      ether_type = hdr->hv1.tp_vlan_tpid;
+    } else
+#endif /* TP_STATUS_VLAN_TPID_VALID */
+    switch (OS_NTOHS(p[2])) {
+      case ETHERTYPE_PBB:
+      case ETHERTYPE_VLAN:
+        ether_type = 0x88a8;
+        break;
+      default:
+        ether_type = ETHERTYPE_VLAN;
+        break;
+    }
+    p[0] = OS_HTONS(ether_type);
+    p[1] = OS_HTONS(hdr->hv1.tp_vlan_tci);
+    len += 4;
+  }
+
+  pkt = w->zpkts[idx];
+  if (pkt == NULL) {
+    pkt = alloc_lagopus_packet();
+    if (pkt == NULL) {
+      return NULL;
+    }
+    w->zpkts[idx] = pkt;
+  }
+  m = PKT2MBUF(pkt);
+  memset(pkt, 0, sizeof(*pkt));
+  if (unlikely(data + len + BYTEOFF_MATCH_TAILROOM > block_end)) {
+    m->data = &m->dat[128];
+    memcpy(m->data, data, len);
+  } else {
+    m->data = data;
+  }
+  m->len = len;
+  /* our reference tells whether the dataplane released the packet. */
+  m->refcnt = 1;
+  pkt->cache = w->flowcache;
+  return pkt;
+}
+
+static void
+rawsock_frame_packet_done(struct rawsock_worker *w, unsigned int idx) {
+  OS_MBUF *m;
+
+  m = PKT2MBUF(w->zpkts[idx]);
+  if (m->refcnt != 0) {
+    /* still referred, the holder frees it. */
+    OS_M_FREE(m);
+    w->zpkts[idx] = NULL;
+  }
+}
+
+static void
+rawsock_ring_block(struct rawsock_worker *w, struct rawsock_ring *ring,
+                   struct tpacket_block_desc *bd) {
+#ifdef HYBRID
+  static const uint8_t eth_bcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+#endif /* HYBRID */
+  struct lagopus_packet *pkts[LAGOPUS_DP_BULK_MAX];
+  struct lagopus_packet *pkt;
+  struct tpacket3_hdr *hdr;
+  const uint8_t *block_end;
+  struct port *port;
+  enum switch_mode mode;
+  uint32_t i, nframes;
+  unsigned int npkts, n;
+
+  port = ring->ifp->port;
+  if (port == NULL ||
+      port->bridge == NULL ||
+      (port->ofp_port.config & OFPPC_NO_RECV) != 0) {
+    return;
+  }
+  flowdb_switch_mode_get(port->bridge->flowdb, &mode);
+  nframes = bd->hdr.bh1.num_pkts;
+  hdr = (struct tpacket3_hdr *)((uint8_t *)bd +
+                                bd->hdr.bh1.offset_to_first_pkt);
+  npkts = 0;
+  n = 0;
+  block_end = (uint8_t *)bd + RAWSOCK_RING_BLOCK_SIZE;
+  for (i = 0; i < nframes; i++) {
+    pkt = rawsock_frame_packet(w, n, hdr, block_end);
+    hdr = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+    if (pkt == NULL) {
+      continue;
+    }
+    lagopus_packet_init(pkt, PKT2MBUF(pkt), port);
+    if (
+#ifdef HYBRID
+        !memcmp(OS_MTOD(PKT2MBUF(pkt), uint8_t *),
+                port->interface->hw_addr, ETHER_ADDR_LEN) ||
+        !memcmp(OS_MTOD(PKT2MBUF(pkt), uint8_t *),
+                eth_bcast, ETHER_ADDR_LEN) ||
+#endif /* HYBRID */
+        mode == SWITCH_MODE_STANDALONE) {
+      lagopus_forward_packet_to_port(pkt, OFPP_NORMAL);
+    } else {
+      pkts[npkts++] = pkt;
+    }
+    n++;
+    if (n == LAGOPUS_DP_BULK_MAX) {
+      if (npkts > 0) {
+        lagopus_match_and_action_bulk(pkts, npkts);
+      }
+      /* sent packets release the frames, the slots can be reused. */
+      rawsock_txq_flush(rawsock_txq);
+      while (n > 0) {
+        rawsock_frame_packet_done(w, --n);
+      }
+      npkts = 0;
+    }
+  }
+  if (npkts > 0) {
+    lagopus_match_and_action_bulk(pkts, npkts);
+  }
+  rawsock_txq_flush(rawsock_txq);
+  while (n > 0) {
+    rawsock_frame_packet_done(w, --n);
+  }
+}
+
+static void
+rawsock_ring_input(struct rawsock_worker *w, struct rawsock_ring *ring) {
+  struct tpacket_block_desc *bd;
+  unsigned int budget;
+
+  for (budget = 0; budget < RAWSOCK_RING_BUDGET; budget++) {
+    bd = (struct tpacket_block_desc *)
+         (ring->map + (size_t)ring->cur * RAWSOCK_RING_BLOCK_SIZE);
+    if ((bd->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+      break;
+    }
+    mbar();
+    rawsock_ring_block(w, ring, bd);
+    mbar();
+    bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    ring->cur = (ring->cur + 1) % RAWSOCK_RING_BLOCK_NR;
+  }
+}
+
+static void
+rawsock_worker_loop(struct rawsock_worker *w) {
+  struct rawsock_txq txq;
+  unsigned int i;
+
+  txq.n = 0;
+  rawsock_txq = &txq;
+  if (no_cache == false) {
+    w->flowcache = init_flowcache(kvs_type);
+  }
+  w->cache_gen = cache_gen;
+  w->ifgen = rawsock_ifgen - 1;
+  w->nrings = 0;
+
+  while (*w->running == true) {
+    if (poll(w->pollfd, (nfds_t)w->nrings, SOCK_POLL_TIMEOUT) < 0 &&
+        errno != EINTR) {
+      err(errno, "poll");
+    }
+    flowdb_rdlock(NULL);
+    if (w->ifgen != rawsock_ifgen) {
+      rawsock_worker_sync(w);
+    }
+    if (w->cache_gen != cache_gen && w->flowcache != NULL) {
+      w->cache_gen = cache_gen;
+      clear_all_cache(w->flowcache);
+    }
+    for (i = 0; i < w->nrings; i++) {
+      rawsock_ring_input(w, &w->ring[i]);
+    }
+    flowdb_rdunlock(NULL);
+  }
+
+  for (i = 0; i < w->nrings; i++) {
+    rawsock_ring_close(&w->ring[i]);
+  }
+  w->nrings = 0;
+  rawsock_txq = NULL;
+  for (i = 0; i < LAGOPUS_DP_BULK_MAX; i++) {
+    if (w->zpkts[i] != NULL) {
+      lagopus_packet_free(w->zpkts[i]);
+      w->zpkts[i] = NULL;
+    }
+  }
+  if (w->flowcache != NULL) {
+    fini_flowcache(w->flowcache);
+    w->flowcache = NULL;
+  }
+}
+
+static void *
+rawsock_worker_main(void *arg) {
+  struct rawsock_worker *w;
+
+  w = arg;
+  if (dp_rcu_thread_register() != LAGOPUS_RESULT_OK) {
+    return NULL;
+  }
+  if (dp_counter_thread_register() != LAGOPUS_RESULT_OK) {
+    dp_rcu_thread_unregister();
+    return NULL;
+  }
+  rawsock_worker_loop(w);
+  dp_counter_thread_unregister();
+  dp_rcu_thread_unregister();
+  return NULL;
+}
+
+/*
+ * Run workers, the calling thread is the first one.
+ */
+static lagopus_result_t
+rawsock_ring_workers_run(bool *running) {
+  struct rawsock_worker *w;
+  unsigned int i, nstarted;
+
+  nstarted = 1;
+  for (i = 0; i < nworkers; i++) {
+    w = &rawsock_workers[i];
+    memset(w, 0, sizeof(*w));
+    w->id = i;
+    w->running = running;
+    if (i == 0) {
+      continue;
+    }
+    if (pthread_create(&w->thread, NULL, rawsock_worker_main, w) != 0) {
+      lagopus_msg_warning("rx worker %u: %s\n", i, strerror(errno));
+      break;
+    }
+    nstarted++;
+  }
+  (void)rawsock_worker_main(&rawsock_workers[0]);
+  for (i = 1; i < nstarted; i++) {
+    pthread_join(rawsock_workers[i].thread, NULL);
+  }
+  return LAGOPUS_RESULT_OK;
+}
+#endif /* RAWSOCK_RING */
+
+#define RAWSOCK_MAX_EVENTS  64
+
+/*
+ * Receive a burst from the interface and process it.
+ * rxpkts[] keeps empty packets over calls, packets passed to the
+ * datapath are replaced by new ones at next call.
+ */
+static void
+rawsock_input(struct interface *ifp, struct lagopus_packet *rxpkts[],
+              struct flowcache *cache) {
+#ifdef HYBRID
+  static const uint8_t eth_bcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+#endif /* HYBRID */
+  struct lagopus_packet *pkts[LAGOPUS_DP_BULK_MAX];
+  struct lagopus_packet *pkt;
+  struct port *port;
+  enum switch_mode mode;
+  unsigned int i, n, npkts;
+  int nrecv;
+
+  for (n = 0; n < LAGOPUS_DP_BULK_MAX; n++) {
+    if (rxpkts[n] == NULL) {
+      rxpkts[n] = alloc_lagopus_packet();
+      if (rxpkts[n] == NULL) {
+        break;
+      }
+    }
+  }
+  if (n == 0) {
+    return;
+  }
+  nrecv = read_packets(ifp->fd, rxpkts, n);
+  if (nrecv < 0) {
+    switch (errno) {
+      case ENETDOWN:
+      case ENETRESET:
+      case ECONNABORTED:
+      case ECONNRESET:
+      case EINTR:
+        return;
+
+      default:
+        lagopus_exit_fatal("read: %s", strerror(errno));
+    }
+  }
+  port = ifp->port;
+  if (port == NULL ||
+      port->bridge == NULL ||
+      (port->ofp_port.config & OFPPC_NO_RECV) != 0) {
+    /* drained, discard received packets. */
+    for (i = 0; i < (unsigned int)nrecv; i++) {
+      lagopus_packet_free(rxpkts[i]);
+      rxpkts[i] = NULL;
+    }
+    return;
+  }
+  flowdb_switch_mode_get(port->bridge->flowdb, &mode);
+  npkts = 0;
+  for (i = 0; i < (unsigned int)nrecv; i++) {
+    pkt = rxpkts[i];
+    rxpkts[i] = NULL;
+    pkt->cache = cache;
+    lagopus_packet_init(pkt, PKT2MBUF(pkt), port);
+    if (
+#ifdef HYBRID
+        !memcmp(OS_MTOD(PKT2MBUF(pkt), uint8_t *),
+                port->interface->hw_addr, ETHER_ADDR_LEN) ||
+        !memcmp(OS_MTOD(PKT2MBUF(pkt), uint8_t *),
+                eth_bcast, ETHER_ADDR_LEN) ||
+#endif /* HYBRID */
+        mode == SWITCH_MODE_STANDALONE) {
+      lagopus_forward_packet_to_port(pkt, OFPP_NORMAL);
+    } else {
+      pkts[npkts++] = pkt;
+    }
+  }
+  if (npkts > 0) {
+    lagopus_match_and_action_bulk(pkts, npkts);
+  }
 }
 
 /**
@@ -695,16 +1436,15 @@ clear_rawsock_flowcache(void) {
 static lagopus_result_t
 dp_rawsock_thread_loop(__UNUSED const lagopus_thread_t *selfptr,
                     void *arg) {
-  static const uint8_t eth_bcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
-  struct lagopus_packet *pkt;
-  struct port_stats *stats;
-  ssize_t len;
-  unsigned int i;
-  enum switch_mode mode;
+  struct epoll_event events[RAWSOCK_MAX_EVENTS];
+  struct lagopus_packet *rxpkts[LAGOPUS_DP_BULK_MAX];
+  struct rawsock_txq txq;
+  int i, nevents, epfd;
   lagopus_result_t rv;
   global_state_t cur_state;
   shutdown_grace_level_t cur_grace;
   struct dataplane_arg *dparg;
+  uint32_t seen_cache_gen;
   bool *running = NULL;
 
   rv = global_state_wait_for(GLOBAL_STATE_STARTED,
@@ -715,101 +1455,78 @@ dp_rawsock_thread_loop(__UNUSED const lagopus_thread_t *selfptr,
     return rv;
   }
 
+  dparg = arg;
+  running = dparg->running;
+
+#ifdef RAWSOCK_RING
+  if (use_ring == true) {
+    return rawsock_ring_workers_run(running);
+  }
+#endif /* RAWSOCK_RING */
+
+  epfd = rawsock_epoll_fd();
+  if (epfd == -1) {
+    return LAGOPUS_RESULT_POSIX_API_ERROR;
+  }
   if (no_cache == false) {
     flowcache = init_flowcache(kvs_type);
   } else {
     flowcache = NULL;
   }
 
-  dparg = arg;
-  running = dparg->running;
+  /* refer flowdb without blocking writers. */
+  rv = dp_rcu_thread_register();
+  if (rv != LAGOPUS_RESULT_OK) {
+    return rv;
+  }
+  rv = dp_counter_thread_register();
+  if (rv != LAGOPUS_RESULT_OK) {
+    dp_rcu_thread_unregister();
+    return rv;
+  }
 
+  memset(rxpkts, 0, sizeof(rxpkts));
+  txq.n = 0;
+  rawsock_txq = &txq;
+  seen_cache_gen = cache_gen;
   while (*running == true) {
-    struct port *port;
-    struct pollfd_iter *iter;
-
-    iter = create_pollfds();
-    if (iter == NULL) {
-      err(errno, "create_pollfds");
+    nevents = epoll_wait(epfd, events, RAWSOCK_MAX_EVENTS, SOCK_POLL_TIMEOUT);
+    if (nevents < 0) {
+      if (errno != EINTR) {
+        err(errno, "epoll_wait");
+      }
+      nevents = 0;
     }
-    /* wait 0.1 sec. */
-    if (poll(iter->pollfd, (nfds_t)iter->nfds, 100) < 0) {
-      err(errno, "poll");
+    flowdb_rdlock(NULL);
+    if (seen_cache_gen != cache_gen && flowcache != NULL) {
+      seen_cache_gen = cache_gen;
+      clear_all_cache(flowcache);
     }
-    for (i = 0; i < iter->nfds; i++) {
+    for (i = 0; i < nevents; i++) {
       struct interface *ifp;
-      lagopus_result_t rv;
 
-      if (clear_cache == true && flowcache != NULL) {
-        clear_all_cache(flowcache);
-        clear_cache = false;
-      }
-      if ((iter->pollfd[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
-	continue;
-      }
-      flowdb_rdlock(NULL);
-      rv = lagopus_hashmap_find(&fdifp_hashmap, (void *)iter->pollfd[i].fd,
-				&ifp);
-      if (rv != LAGOPUS_RESULT_OK || ifp->fd != iter->pollfd[i].fd) {
-        flowdb_rdunlock(NULL);
+      if ((events[i].events & EPOLLIN) == 0) {
         continue;
       }
-      /* update port stats. */
-      if (ifp != NULL && ifp->port != NULL && ifp->stats != NULL) {
-        stats = ifp->stats(ifp->port);
-        free(stats);
-      }
-
-      if ((iter->pollfd[i].revents & POLLIN) == 0) {
-        flowdb_rdunlock(NULL);
+      /* interface may be unconfigured after epoll_wait(). */
+      rv = lagopus_hashmap_find(&fdifp_hashmap, (void *)events[i].data.fd,
+                                &ifp);
+      if (rv != LAGOPUS_RESULT_OK || ifp->fd != events[i].data.fd) {
         continue;
       }
-      port = ifp->port;
-      if (port != NULL &&
-	  port->bridge != NULL &&
-          (port->ofp_port.config & OFPPC_NO_RECV) == 0) {
-        pkt = alloc_lagopus_packet();
-        pkt->cache = flowcache;
-
-        /* not enough? */
-        (void)OS_M_APPEND(PKT2MBUF(pkt), MAX_PACKET_SZ);
-        len = read_packet(iter->pollfd[i].fd,
-			  OS_MTOD(PKT2MBUF(pkt), uint8_t *),
-                          MAX_PACKET_SZ);
-        if (len < 0) {
-          switch (errno) {
-            case ENETDOWN:
-            case ENETRESET:
-            case ECONNABORTED:
-            case ECONNRESET:
-            case EINTR:
-              flowdb_rdunlock(NULL);
-              continue;
-
-            default:
-              lagopus_exit_fatal("read: %s", strerror(errno));
-          }
-        }
-        OS_M_TRIM(PKT2MBUF(pkt), MAX_PACKET_SZ - len);
-        lagopus_packet_init(pkt, PKT2MBUF(pkt), port);
-        flowdb_switch_mode_get(port->bridge->flowdb, &mode);
-        if (
-#ifdef HYBRID
-                !memcmp(OS_MTOD(PKT2MBUF(pkt), uint8_t *),
-                        port->interface->hw_addr, ETHER_ADDR_LEN) ||
-                !memcmp(OS_MTOD(PKT2MBUF(pkt), uint8_t *),
-                        eth_bcast, ETHER_ADDR_LEN) ||
-#endif /* HYBRID */
-                mode == SWITCH_MODE_STANDALONE) {
-          lagopus_forward_packet_to_port(pkt, OFPP_NORMAL);
-        } else {
-          lagopus_match_and_action(pkt);
-        }
-      }
-      flowdb_rdunlock(NULL);
+      rawsock_input(ifp, rxpkts, flowcache);
+    }
+    rawsock_txq_flush(&txq);
+    flowdb_rdunlock(NULL);
+  }
+  rawsock_txq = NULL;
+  for (i = 0; i < LAGOPUS_DP_BULK_MAX; i++) {
+    if (rxpkts[i] != NULL) {
+      lagopus_packet_free(rxpkts[i]);
     }
-    destroy_pollfds(iter);
   }
+  dp_counter_thread_unregister();
+  dp_rcu_thread_unregister();
 
   return LAGOPUS_RESULT_OK;
 }
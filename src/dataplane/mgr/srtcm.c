@@ -0,0 +1,190 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   srtcm.c
+ *      @brief  Single rate three color marker shared by dataplane threads.
+ */
+
+#include <time.h>
+
+#include "lagopus_apis.h"
+#include "srtcm.h"
+
+#define NSEC_PER_SEC            1000000000ULL
+#define SRTCM_PERIOD_MIN        100     /* nsec */
+
+#ifdef CLOCK_MONOTONIC_COARSE
+#define SRTCM_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define SRTCM_CLOCK CLOCK_MONOTONIC
+#endif /* CLOCK_MONOTONIC_COARSE */
+
+static unsigned int srtcm_shard_next = 0;
+static __thread int srtcm_shard_self = -1;
+
+static inline unsigned int
+srtcm_shard_id(void) {
+  if (unlikely(srtcm_shard_self < 0)) {
+    srtcm_shard_self = (int)(__sync_fetch_and_add(&srtcm_shard_next, 1) %
+                             DP_SRTCM_SHARDS);
+  }
+  return (unsigned int)srtcm_shard_self;
+}
+
+uint64_t
+dp_srtcm_now(void) {
+  struct timespec ts;
+
+  clock_gettime(SRTCM_CLOCK, &ts);
+  return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+void
+dp_srtcm_config(struct dp_srtcm *m, uint64_t cir, uint64_t cbs, uint64_t ebs) {
+  uint64_t period;
+
+  if (cir == 0) {
+    m->tokens_per_period = 0;
+    m->period = SRTCM_PERIOD_MIN;
+  } else {
+    period = NSEC_PER_SEC / cir;
+    if (period >= SRTCM_PERIOD_MIN) {
+      m->tokens_per_period = 1;
+      m->period = period;
+    } else {
+      m->tokens_per_period = (SRTCM_PERIOD_MIN * cir + NSEC_PER_SEC - 1) /
+                             NSEC_PER_SEC;
+      m->period = NSEC_PER_SEC * m->tokens_per_period / cir;
+    }
+  }
+  m->cbs = cbs;
+  m->ebs = ebs;
+  m->tc = cbs;
+  m->te = ebs;
+  m->time = dp_srtcm_now();
+}
+
+/*
+ * Add tokens to the bucket up to size, returns overflowed tokens.
+ */
+static inline uint64_t
+srtcm_fill(uint64_t *bucket, uint64_t add, uint64_t size) {
+  uint64_t old, new;
+
+  do {
+    old = *bucket;
+    new = old + add;
+    if (new > size) {
+      new = size;
+    }
+  } while (__sync_bool_compare_and_swap(bucket, old, new) == false);
+  return old + add - new;
+}
+
+static inline bool
+srtcm_take(uint64_t *bucket, uint64_t len) {
+  uint64_t old;
+
+  do {
+    old = *bucket;
+    if (old < len) {
+      return false;
+    }
+  } while (__sync_bool_compare_and_swap(bucket, old, old - len) == false);
+  return true;
+}
+
+static inline void
+srtcm_refill(struct dp_srtcm *m, uint64_t now) {
+  uint64_t time, n_periods, excess;
+
+  time = m->time;
+  if (now > time) {
+    n_periods = (now - time) / m->period;
+    /* the thread advanced the time refills the buckets. */
+    if (n_periods > 0 &&
+        __sync_bool_compare_and_swap(&m->time, time,
+                                     time + n_periods * m->period) == true) {
+      excess = srtcm_fill(&m->tc, n_periods * m->tokens_per_period, m->cbs);
+      if (excess > 0) {
+        (void)srtcm_fill(&m->te, excess, m->ebs);
+      }
+    }
+  }
+}
+
+enum dp_srtcm_color
+dp_srtcm_color_blind_check(struct dp_srtcm *m, uint64_t now, uint64_t len) {
+  srtcm_refill(m, now);
+  if (srtcm_take(&m->tc, len) == true) {
+    return DP_SRTCM_GREEN;
+  }
+  if (srtcm_take(&m->te, len) == true) {
+    return DP_SRTCM_YELLOW;
+  }
+  return DP_SRTCM_RED;
+}
+
+void
+dp_srtcm_sharded_config(struct dp_srtcm_sharded *s,
+                        uint64_t cir, uint64_t cbs, uint64_t ebs,
+                        uint64_t unit) {
+  unsigned int i;
+
+  dp_srtcm_config(&s->srtcm, cir, cbs, ebs);
+  s->quantum = cbs / (8 * DP_SRTCM_SHARDS);
+  if (s->quantum < DP_SRTCM_MIN_QUANTUM * unit) {
+    s->quantum = 0;
+  }
+  for (i = 0; i < DP_SRTCM_SHARDS; i++) {
+    s->shard[i].tokens = 0;
+  }
+}
+
+enum dp_srtcm_color
+dp_srtcm_sharded_check(struct dp_srtcm_sharded *s, uint64_t now,
+                       uint64_t len) {
+  struct dp_srtcm_shard *shard;
+  enum dp_srtcm_color color;
+  unsigned int id, i;
+
+  if (s->quantum == 0 || len > s->quantum) {
+    return dp_srtcm_color_blind_check(&s->srtcm, now, len);
+  }
+  id = srtcm_shard_id();
+  shard = &s->shard[id];
+  if (srtcm_take(&shard->tokens, len) == true) {
+    return DP_SRTCM_GREEN;
+  }
+  srtcm_refill(&s->srtcm, now);
+  if (srtcm_take(&s->srtcm.tc, s->quantum) == true) {
+    __sync_fetch_and_add(&shard->tokens, s->quantum - len);
+    return DP_SRTCM_GREEN;
+  }
+  color = dp_srtcm_color_blind_check(&s->srtcm, now, len);
+  if (color != DP_SRTCM_RED) {
+    return color;
+  }
+  /* move tokens left unused by other shards. */
+  for (i = 1; i < DP_SRTCM_SHARDS; i++) {
+    shard = &s->shard[(id + i) % DP_SRTCM_SHARDS];
+    if (shard->tokens >= len && srtcm_take(&shard->tokens, len) == true) {
+      return DP_SRTCM_GREEN;
+    }
+  }
+  return DP_SRTCM_RED;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   srtcm.h
+ *      @brief  Single rate three color marker shared by dataplane threads.
+ *
+ * Single rate three color marker (RFC 2697), same as DPDK
+ * rte_meter_srtcm but time is in nanoseconds.  Committed bucket is
+ * refilled by cir, and overflow of it goes to excess bucket.  Each
+ * field is updated by atomic operation, meter is shared by dataplane
+ * threads without lock.
+ *
+ * Sharded meter keeps a small cache of committed tokens per thread.
+ * Threads take a quantum of tokens from the shared buckets at once and
+ * meter packets from the local cache, so the shared cache line is
+ * touched once per quantum instead of once per packet.  When the
+ * shared buckets run dry, tokens left unused in the caches of other
+ * threads are moved to the calling thread before the packet is marked
+ * red.  Tokens are created only in the shared buckets, the configured
+ * rate is kept and cached tokens add at most 1/8 of cbs to a burst.
+ */
+
+#ifndef SRC_DATAPLANE_MGR_SRTCM_H_
+#define SRC_DATAPLANE_MGR_SRTCM_H_
+
+#define DP_SRTCM_SHARDS         16
+#define DP_SRTCM_MIN_QUANTUM    16      /* in packets */
+
+/**
+ * @brief Meter color.
+ */
+enum dp_srtcm_color {
+  DP_SRTCM_GREEN,
+  DP_SRTCM_YELLOW,
+  DP_SRTCM_RED
+};
+
+/**
+ * @brief Shared token buckets.
+ */
+struct dp_srtcm {
+  uint64_t time;                /** Time of the last refill. */
+  uint64_t tc;                  /** Tokens of committed bucket. */
+  uint64_t te;                  /** Tokens of excess bucket. */
+  uint64_t cbs;                 /** Committed burst size. */
+  uint64_t ebs;                 /** Excess burst size. */
+  uint64_t period;              /** Refill period in nsec. */
+  uint64_t tokens_per_period;   /** Tokens added per period. */
+};
+
+/**
+ * @brief Committed tokens cached by threads of one shard.
+ */
+struct dp_srtcm_shard {
+  uint64_t tokens;
+} __attribute__ ((aligned(64)));
+
+/**
+ * @brief Shared token buckets with per thread caches.
+ */
+struct dp_srtcm_sharded {
+  struct dp_srtcm srtcm;        /** Shared buckets. */
+  uint64_t quantum;             /** Tokens taken at once, 0 if unsharded. */
+  struct dp_srtcm_shard shard[DP_SRTCM_SHARDS];
+};
+
+/**
+ * Current time of the meter clock in nanoseconds.
+ */
+uint64_t
+dp_srtcm_now(void);
+
+/**
+ * Configure meter, buckets are filled.
+ *
+ * @param[in]   m       Meter.
+ * @param[in]   cir     Committed information rate, tokens per second.
+ * @param[in]   cbs     Committed burst size, in tokens.
+ * @param[in]   ebs     Excess burst size, in tokens.
+ */
+void
+dp_srtcm_config(struct dp_srtcm *m, uint64_t cir, uint64_t cbs, uint64_t ebs);
+
+/**
+ * Meter packet in color blind mode.
+ *
+ * @param[in]   m       Meter.
+ * @param[in]   now     Time from dp_srtcm_now().
+ * @param[in]   len     Tokens of the packet, bytes or 1.
+ */
+enum dp_srtcm_color
+dp_srtcm_color_blind_check(struct dp_srtcm *m, uint64_t now, uint64_t len);
+
+/**
+ * Configure sharded meter.  Per thread caches are used only if the
+ * quantum holds DP_SRTCM_MIN_QUANTUM packets of unit tokens, slow
+ * meters are metered by the shared buckets only.
+ *
+ * @param[in]   s       Meter.
+ * @param[in]   cir     Committed information rate, tokens per second.
+ * @param[in]   cbs     Committed burst size, in tokens.
+ * @param[in]   ebs     Excess burst size, in tokens.
+ * @param[in]   unit    Tokens of the largest packet, bytes or 1.
+ */
+void
+dp_srtcm_sharded_config(struct dp_srtcm_sharded *s,
+                        uint64_t cir, uint64_t cbs, uint64_t ebs,
+                        uint64_t unit);
+
+/**
+ * Meter packet in color blind mode using cache of calling thread.
+ *
+ * @param[in]   s       Meter.
+ * @param[in]   now     Time from dp_srtcm_now().
+ * @param[in]   len     Tokens of the packet, bytes or 1.
+ */
+enum dp_srtcm_color
+dp_srtcm_sharded_check(struct dp_srtcm_sharded *s, uint64_t now, uint64_t len);
+
+#endif /* SRC_DATAPLANE_MGR_SRTCM_H_ */
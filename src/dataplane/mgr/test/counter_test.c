@@ -0,0 +1,116 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include "unity.h"
+
+#include "lagopus_apis.h"
+#include "counter.h"
+
+#define NTHREADS 4
+#define NLOOPS 10000
+
+static uint32_t counter_id;
+
+void
+setUp(void) {
+  TEST_ASSERT_EQUAL(dp_counter_alloc(&counter_id), LAGOPUS_RESULT_OK);
+}
+
+void
+tearDown(void) {
+  dp_counter_free(counter_id);
+}
+
+static void *
+counter_worker(void *arg) {
+  int i;
+
+  (void) arg;
+  if (dp_counter_thread_register() != LAGOPUS_RESULT_OK) {
+    return NULL;
+  }
+  for (i = 0; i < NLOOPS; i++) {
+    dp_counter_add(counter_id, 1, 64);
+  }
+  dp_counter_thread_unregister();
+  return NULL;
+}
+
+void
+test_dp_counter_sum(void) {
+  pthread_t tid[NTHREADS];
+  uint64_t packets, bytes;
+  int i;
+
+  TEST_ASSERT_NOT_EQUAL(counter_id, 0);
+  dp_counter_get(counter_id, &packets, &bytes);
+  TEST_ASSERT_EQUAL(packets, 0);
+  TEST_ASSERT_EQUAL(bytes, 0);
+
+  for (i = 0; i < NTHREADS; i++) {
+    TEST_ASSERT_EQUAL(pthread_create(&tid[i], NULL, counter_worker, NULL), 0);
+  }
+  /* unregistered thread is counted too. */
+  dp_counter_add(counter_id, 1, 100);
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  dp_counter_get(counter_id, &packets, &bytes);
+  TEST_ASSERT_EQUAL(packets, NTHREADS * NLOOPS + 1);
+  TEST_ASSERT_EQUAL(bytes, NTHREADS * NLOOPS * 64 + 100);
+}
+
+void
+test_dp_counter_reuse(void) {
+  uint64_t packets, bytes;
+  uint32_t id;
+
+  dp_counter_add(counter_id, 3, 300);
+  dp_counter_free(counter_id);
+  TEST_ASSERT_EQUAL(dp_counter_alloc(&id), LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(id, counter_id);
+  /* reused counter starts from zero. */
+  dp_counter_get(id, &packets, &bytes);
+  TEST_ASSERT_EQUAL(packets, 0);
+  TEST_ASSERT_EQUAL(bytes, 0);
+
+  /* counter 0 is a dummy. */
+  dp_counter_add(0, 1, 1);
+  dp_counter_get(0, &packets, &bytes);
+  TEST_ASSERT_EQUAL(packets, 0);
+  TEST_ASSERT_EQUAL(bytes, 0);
+}
+
+void
+test_dp_counter_grow(void) {
+  uint32_t ids[DP_COUNTER_CHUNK_SIZE + 1];
+  uint64_t packets, bytes;
+  int i;
+
+  TEST_ASSERT_EQUAL(dp_counter_thread_register(), LAGOPUS_RESULT_OK);
+  for (i = 0; i < DP_COUNTER_CHUNK_SIZE + 1; i++) {
+    TEST_ASSERT_EQUAL(dp_counter_alloc(&ids[i]), LAGOPUS_RESULT_OK);
+    dp_counter_add(ids[i], 1, (uint64_t)i);
+  }
+  dp_counter_get(ids[DP_COUNTER_CHUNK_SIZE], &packets, &bytes);
+  TEST_ASSERT_EQUAL(packets, 1);
+  TEST_ASSERT_EQUAL(bytes, DP_COUNTER_CHUNK_SIZE);
+  for (i = 0; i < DP_COUNTER_CHUNK_SIZE + 1; i++) {
+    dp_counter_free(ids[i]);
+  }
+  dp_counter_thread_unregister();
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/queue.h>
+#include "unity.h"
+
+#include "lagopus_apis.h"
+#include "lagopus/flowdb.h"
+#include "openflow13.h"
+#include "flow_index.h"
+
+#define NFLOWS 5000
+
+static struct flow_index identity;
+
+void
+setUp(void) {
+  memset(&identity, 0, sizeof(identity));
+}
+
+void
+tearDown(void) {
+  flow_index_free(&identity);
+}
+
+static void
+add_match(struct flow *flow, uint8_t field, uint32_t val) {
+  struct match *match;
+
+  match = calloc(1, sizeof(struct match) + sizeof(val));
+  TEST_ASSERT_NOT_NULL(match);
+  match->oxm_class = OFPXMC_OPENFLOW_BASIC;
+  match->oxm_field = (uint8_t)(field << 1);
+  match->oxm_length = sizeof(val);
+  memcpy(match->oxm_value, &val, sizeof(val));
+  TAILQ_INSERT_TAIL(&flow->match_list, match, entry);
+  flow->field_bits |= 1ULL << field;
+}
+
+static struct flow *
+new_flow(int32_t priority, uint32_t in_port, uint32_t dst) {
+  struct flow *flow;
+
+  flow = calloc(1, sizeof(struct flow));
+  TEST_ASSERT_NOT_NULL(flow);
+  flow->priority = priority;
+  TAILQ_INIT(&flow->match_list);
+  add_match(flow, OFPXMT_OFB_IN_PORT, in_port);
+  add_match(flow, OFPXMT_OFB_IPV4_DST, dst);
+  return flow;
+}
+
+static void
+free_flow(struct flow *flow) {
+  struct match *match;
+
+  while ((match = TAILQ_FIRST(&flow->match_list)) != NULL) {
+    TAILQ_REMOVE(&flow->match_list, match, entry);
+    free(match);
+  }
+  free(flow);
+}
+
+void
+test_flow_index_find(void) {
+  struct flow *flow, *probe, *other;
+  struct match *match;
+
+  flow = new_flow(10, 1, 0x0a000001);
+  TEST_ASSERT_NULL(flow_index_find(&identity, flow));
+  TEST_ASSERT_EQUAL(flow_index_add(&identity, flow), LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(identity.nflows, 1);
+
+  /* same match in different order is identical. */
+  probe = new_flow(10, 1, 0x0a000001);
+  match = TAILQ_FIRST(&probe->match_list);
+  TAILQ_REMOVE(&probe->match_list, match, entry);
+  TAILQ_INSERT_TAIL(&probe->match_list, match, entry);
+  TEST_ASSERT_EQUAL_PTR(flow_index_find(&identity, probe), flow);
+  TEST_ASSERT_TRUE(flow_identical(flow, probe));
+
+  /* priority and value are part of identity. */
+  other = new_flow(11, 1, 0x0a000001);
+  TEST_ASSERT_NULL(flow_index_find(&identity, other));
+  free_flow(other);
+  other = new_flow(10, 2, 0x0a000001);
+  TEST_ASSERT_NULL(flow_index_find(&identity, other));
+  /* subset of matches is not identical. */
+  match = TAILQ_LAST(&other->match_list, match_list);
+  TAILQ_REMOVE(&other->match_list, match, entry);
+  free(match);
+  TEST_ASSERT_FALSE(flow_identical(flow, other));
+  free_flow(other);
+
+  flow_index_del(&identity, flow);
+  TEST_ASSERT_EQUAL(identity.nflows, 0);
+  TEST_ASSERT_NULL(flow_index_find(&identity, probe));
+  free_flow(probe);
+  free_flow(flow);
+}
+
+void
+test_flow_index_many(void) {
+  struct flow *flows[NFLOWS], *probe;
+  int i;
+
+  for (i = 0; i < NFLOWS; i++) {
+    flows[i] = new_flow(i % 7, (uint32_t)i, (uint32_t)i * 3);
+    TEST_ASSERT_EQUAL(flow_index_add(&identity, flows[i]), LAGOPUS_RESULT_OK);
+  }
+  TEST_ASSERT_EQUAL(identity.nflows, NFLOWS);
+  TEST_ASSERT_TRUE(identity.nbuckets >= NFLOWS);
+  for (i = 0; i < NFLOWS; i++) {
+    probe = new_flow(i % 7, (uint32_t)i, (uint32_t)i * 3);
+    TEST_ASSERT_EQUAL_PTR(flow_index_find(&identity, probe), flows[i]);
+    free_flow(probe);
+  }
+  for (i = 0; i < NFLOWS; i += 2) {
+    flow_index_del(&identity, flows[i]);
+  }
+  TEST_ASSERT_EQUAL(identity.nflows, NFLOWS / 2);
+  for (i = 0; i < NFLOWS; i++) {
+    probe = new_flow(i % 7, (uint32_t)i, (uint32_t)i * 3);
+    if (i % 2 == 0) {
+      TEST_ASSERT_NULL(flow_index_find(&identity, probe));
+    } else {
+      TEST_ASSERT_EQUAL_PTR(flow_index_find(&identity, probe), flows[i]);
+    }
+    free_flow(probe);
+  }
+  for (i = 0; i < NFLOWS; i++) {
+    free_flow(flows[i]);
+  }
+}
@@ -763,6 +763,235 @@ test_flowdb_flow_del_with_cookie(void) {
   /* Cleaned up already. */
 }
 
+void
+test_flowdb_flow_batch(void) {
+  struct table *table;
+  struct ofp_flow_mod flow_mod;
+  struct match_list match_list;
+  struct instruction_list instruction_list;
+  struct ofp_error error;
+  uint64_t generation;
+
+  TAILQ_INIT(&match_list);
+  TAILQ_INIT(&instruction_list);
+
+  flow_mod.table_id = 0;
+  flow_mod.priority = 1;
+  flow_mod.flags = 0;
+  flow_mod.cookie = 0;
+  flow_mod.cookie_mask = 0;
+  flow_mod.out_port = OFPP_ANY;
+  flow_mod.out_group = OFPG_ANY;
+
+  table = flowdb_get_table(flowdb, flow_mod.table_id);
+  generation = table->generation;
+
+  flowdb_batch_begin(flowdb);
+
+  /* Add two flows. */
+  flow_mod.command = OFPFC_ADD;
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  add_port_match(&match_list, 1);
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 2);
+
+  /* Error is reported by each flow mod. */
+  flow_mod.flags = OFPFF_CHECK_OVERLAP;
+  TEST_ASSERT_FLOW_ADD_NG(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_EQUAL(error.type, OFPET_FLOW_MOD_FAILED);
+  TEST_ASSERT_EQUAL(error.code, OFPFMFC_OVERLAP);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 2);
+
+  /* Strictly modify the flow without the match. */
+  flow_mod.flags = 0;
+  flow_mod.command = OFPFC_MODIFY_STRICT;
+  add_write_metadata_instruction(&instruction_list, 0);
+  TEST_ASSERT_FLOW_MODIFY_OK(bridge, &flow_mod, &match_list,
+                             &instruction_list, &error);
+  TEST_ASSERT_HAS_METADATA_WRITE(table->flow_list->flows[0], 0);
+  TEST_ASSERT_NO_METADATA_WRITE(table->flow_list->flows[1]);
+
+  /* Flow cache is invalidated at the end of the batch. */
+  TEST_ASSERT_TRUE(table->generation == generation);
+  TEST_ASSERT_NOT_EQUAL(table->pending, 0);
+
+  /* Classifier of the dataplane is published at the end of the batch. */
+  TEST_ASSERT_EQUAL(((struct flowinfo *)table->userdata)->nflow, 0);
+  TEST_ASSERT_EQUAL(((struct flowinfo *)table->standby)->nflow, 2);
+
+  /* Strictly delete the flow with the match. */
+  flow_mod.command = OFPFC_DELETE_STRICT;
+  add_port_match(&match_list, 1);
+  TEST_ASSERT_FLOW_DELETE_OK(bridge, &flow_mod, &match_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 1);
+
+  flowdb_batch_end(flowdb);
+  TEST_ASSERT_EQUAL(table->pending, 0);
+  TEST_ASSERT_TRUE(table->generation != generation);
+  TEST_ASSERT_EQUAL(((struct flowinfo *)table->userdata)->nflow, 1);
+  TEST_ASSERT_EQUAL(((struct flowinfo *)table->standby)->nflow, 1);
+
+  FLOWDB_DUMP(flowdb, "After batch", stdout);
+
+  /* Cleanup. */
+  flow_mod.command = OFPFC_DELETE;
+  TAILQ_INIT(&match_list);
+  TEST_ASSERT_FLOW_DELETE_OK(bridge, &flow_mod, &match_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 0);
+}
+
+void
+test_flowdb_flow_batch_atomic(void) {
+  struct table *table;
+  struct ofp_flow_mod flow_mod;
+  struct match_list match_list;
+  struct instruction_list instruction_list;
+  struct ofp_error error;
+  struct flow *flow;
+  uint32_t counter_id;
+
+  TAILQ_INIT(&match_list);
+  TAILQ_INIT(&instruction_list);
+
+  flow_mod.table_id = 0;
+  flow_mod.priority = 1;
+  flow_mod.flags = 0;
+  flow_mod.cookie = 0;
+  flow_mod.cookie_mask = 0;
+  flow_mod.out_port = OFPP_ANY;
+  flow_mod.out_group = OFPG_ANY;
+
+  table = flowdb_get_table(flowdb, flow_mod.table_id);
+
+  /* Add a flow before the batch. */
+  flow_mod.command = OFPFC_ADD;
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 1);
+  flow = table->flow_list->flows[0];
+  counter_id = flow->counter_id;
+
+  flowdb_batch_atomic_begin(flowdb);
+
+  /* Modified flow is a copy, the dataplane keeps the flow. */
+  flow_mod.command = OFPFC_MODIFY_STRICT;
+  add_write_metadata_instruction(&instruction_list, 0);
+  TEST_ASSERT_FLOW_MODIFY_OK(bridge, &flow_mod, &match_list,
+                             &instruction_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 1);
+  TEST_ASSERT_TRUE(table->flow_list->flows[0] != flow);
+  TEST_ASSERT_HAS_METADATA_WRITE(table->flow_list->flows[0], 0);
+  TEST_ASSERT_NO_METADATA_WRITE(flow);
+  TEST_ASSERT_EQUAL(table->flow_list->flows[0]->counter_id, counter_id);
+  TEST_ASSERT_EQUAL(((struct flowinfo *)table->userdata)->nflow, 1);
+
+  /* Modified again in the batch. */
+  add_write_metadata_instruction(&instruction_list, 1);
+  TEST_ASSERT_FLOW_MODIFY_OK(bridge, &flow_mod, &match_list,
+                             &instruction_list, &error);
+  TEST_ASSERT_HAS_METADATA_WRITE(table->flow_list->flows[0], 1);
+  TEST_ASSERT_NO_METADATA_WRITE(flow);
+
+  flowdb_batch_end(flowdb);
+  TEST_ASSERT_EQUAL(table->pending, 0);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 1);
+  TEST_ASSERT_HAS_METADATA_WRITE(table->flow_list->flows[0], 1);
+  TEST_ASSERT_EQUAL(table->flow_list->flows[0]->counter_id, counter_id);
+  TEST_ASSERT_EQUAL(((struct flowinfo *)table->userdata)->nflow, 1);
+  TEST_ASSERT_EQUAL(((struct flowinfo *)table->standby)->nflow, 1);
+
+  /* Cleanup. */
+  flow_mod.command = OFPFC_DELETE;
+  TEST_ASSERT_FLOW_DELETE_OK(bridge, &flow_mod, &match_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 0);
+}
+
+void
+test_flowdb_flow_batch_abort(void) {
+  struct table *table;
+  struct ofp_flow_mod flow_mod;
+  struct match_list match_list;
+  struct instruction_list instruction_list;
+  struct ofp_error error;
+  uint64_t generation;
+
+  TAILQ_INIT(&match_list);
+  TAILQ_INIT(&instruction_list);
+
+  flow_mod.table_id = 0;
+  flow_mod.priority = 1;
+  flow_mod.flags = 0;
+  flow_mod.cookie = 0;
+  flow_mod.cookie_mask = 0;
+  flow_mod.out_port = OFPP_ANY;
+  flow_mod.out_group = OFPG_ANY;
+
+  table = flowdb_get_table(flowdb, flow_mod.table_id);
+
+  /* Add two flows before the batch. */
+  flow_mod.command = OFPFC_ADD;
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  add_port_match(&match_list, 1);
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 2);
+  generation = table->generation;
+
+  flowdb_batch_atomic_begin(flowdb);
+
+  /* Add, modify and delete flows. */
+  flow_mod.priority = 2;
+  add_port_match(&match_list, 2);
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  flow_mod.priority = 1;
+  flow_mod.command = OFPFC_MODIFY_STRICT;
+  add_write_metadata_instruction(&instruction_list, 0);
+  TEST_ASSERT_FLOW_MODIFY_OK(bridge, &flow_mod, &match_list,
+                             &instruction_list, &error);
+  flow_mod.command = OFPFC_DELETE_STRICT;
+  add_port_match(&match_list, 1);
+  TEST_ASSERT_FLOW_DELETE_OK(bridge, &flow_mod, &match_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 2);
+
+  /* Overlapped flow fails, and the batch is aborted. */
+  flow_mod.command = OFPFC_ADD;
+  flow_mod.flags = OFPFF_CHECK_OVERLAP;
+  TEST_ASSERT_FLOW_ADD_NG(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_EQUAL(error.type, OFPET_FLOW_MOD_FAILED);
+  TEST_ASSERT_EQUAL(error.code, OFPFMFC_OVERLAP);
+  flowdb_batch_abort(flowdb);
+
+  /* Flows before the batch are restored. */
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 2);
+  TEST_ASSERT_EQUAL(table->flow_list->flows[0]->priority, 1);
+  TEST_ASSERT_EQUAL(table->flow_list->flows[1]->priority, 1);
+  TEST_ASSERT_NO_METADATA_WRITE(table->flow_list->flows[0]);
+  TEST_ASSERT_NO_METADATA_WRITE(table->flow_list->flows[1]);
+  TEST_ASSERT_EQUAL(table->pending, 0);
+  TEST_ASSERT_TRUE(table->generation != generation);
+
+  /* Deleted flow with the match is found again. */
+  flow_mod.flags = 0;
+  flow_mod.command = OFPFC_DELETE_STRICT;
+  add_port_match(&match_list, 1);
+  TEST_ASSERT_FLOW_DELETE_OK(bridge, &flow_mod, &match_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 1);
+
+  FLOWDB_DUMP(flowdb, "After abort", stdout);
+
+  /* Cleanup. */
+  flow_mod.command = OFPFC_DELETE;
+  TAILQ_INIT(&match_list);
+  TEST_ASSERT_FLOW_DELETE_OK(bridge, &flow_mod, &match_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 0);
+}
+
 void
 test_flowdb_flow_stats(void) {
   struct table *table;
@@ -861,6 +1090,144 @@ test_flowdb_flow_stats(void) {
   FLOWDB_DUMP(flowdb, "After cleanup", stdout);
 }
 
+struct flow_stats_walk_count {
+  int count;
+  int stop;
+  uint16_t body_len;
+};
+
+static lagopus_result_t
+flow_stats_walk_count_proc(const struct ofp_flow_stats *ofp,
+                           const uint8_t *body,
+                           uint16_t body_len,
+                           void *arg) {
+  struct flow_stats_walk_count *walk_count = arg;
+
+  TEST_ASSERT_EQUAL_MESSAGE(ofp->table_id, 5,
+                            "table id error");
+  TEST_ASSERT_NOT_NULL_MESSAGE(body, "body error");
+  walk_count->body_len = body_len;
+  if (++walk_count->count == walk_count->stop) {
+    return LAGOPUS_RESULT_STOP;
+  }
+  return LAGOPUS_RESULT_OK;
+}
+
+void
+test_flowdb_flow_stats_walk(void) {
+  struct table *table;
+  struct ofp_flow_mod flow_mod;
+  struct match_list match_list;
+  struct instruction_list instruction_list;
+  struct ofp_flow_stats_request request;
+  struct flow_stats_walk_count walk_count;
+  struct ofp_error error;
+  lagopus_result_t rv;
+  uint16_t body_len;
+  int i, nflow;
+
+  TAILQ_INIT(&match_list);
+  TAILQ_INIT(&instruction_list);
+
+  /* Add flow entries over some walk chunks. */
+  nflow = 2500;
+  flow_mod.table_id = 5;
+  flow_mod.flags = 0;
+  flow_mod.cookie = 0;
+  flow_mod.out_port = OFPP_ANY;
+  flow_mod.out_group = OFPG_ANY;
+
+  table = flowdb_get_table(flowdb, flow_mod.table_id);
+
+  for (i = 0; i < nflow; i++) {
+    flow_mod.priority = (uint16_t)(i + 1);
+    TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                            &instruction_list, &error);
+  }
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, nflow);
+
+  request.table_id = 5;
+  request.cookie = 0;
+  request.cookie_mask = 0;
+
+  /* All flows. */
+  walk_count.count = 0;
+  walk_count.stop = 0;
+  rv = flowdb_flow_stats_walk(flowdb, &request, &match_list,
+                              flow_stats_walk_count_proc, &walk_count,
+                              &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL_MESSAGE(walk_count.count, nflow,
+                            "walk count error");
+
+  request.table_id = OFPTT_ALL;
+  walk_count.count = 0;
+  rv = flowdb_flow_stats_walk(flowdb, &request, &match_list,
+                              flow_stats_walk_count_proc, &walk_count,
+                              &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL_MESSAGE(walk_count.count, nflow,
+                            "walk count error");
+
+  /* No flows. */
+  request.table_id = 0;
+  walk_count.count = 0;
+  rv = flowdb_flow_stats_walk(flowdb, &request, &match_list,
+                              flow_stats_walk_count_proc, &walk_count,
+                              &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL_MESSAGE(walk_count.count, 0,
+                            "walk count error");
+
+  request.table_id = 5;
+  request.cookie = 1;
+  request.cookie_mask = 1;
+  rv = flowdb_flow_stats_walk(flowdb, &request, &match_list,
+                              flow_stats_walk_count_proc, &walk_count,
+                              &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL_MESSAGE(walk_count.count, 0,
+                            "walk count error");
+
+  /* Stopped by proc. */
+  request.cookie = 0;
+  request.cookie_mask = 0;
+  walk_count.stop = 10;
+  rv = flowdb_flow_stats_walk(flowdb, &request, &match_list,
+                              flow_stats_walk_count_proc, &walk_count,
+                              &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_STOP);
+  TEST_ASSERT_EQUAL_MESSAGE(walk_count.count, 10,
+                            "walk count error");
+
+  /* Encoded match and instructions are kept until modified. */
+  TEST_ASSERT_NOT_NULL_MESSAGE(table->flow_list->flows[0]->wire,
+                               "wire cache error");
+  body_len = walk_count.body_len;
+
+  flow_mod.command = OFPFC_MODIFY;
+  add_write_metadata_instruction(&instruction_list, 0);
+  TEST_ASSERT_FLOW_MODIFY_OK(bridge, &flow_mod, &match_list,
+                             &instruction_list, &error);
+  TEST_ASSERT_NULL_MESSAGE(table->flow_list->flows[0]->wire,
+                           "wire cache error");
+
+  walk_count.count = 0;
+  walk_count.stop = 0;
+  rv = flowdb_flow_stats_walk(flowdb, &request, &match_list,
+                              flow_stats_walk_count_proc, &walk_count,
+                              &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL_MESSAGE(walk_count.count, nflow,
+                            "walk count error");
+  TEST_ASSERT_TRUE_MESSAGE(walk_count.body_len > body_len,
+                           "body length error");
+
+  /* Cleanup. */
+  TEST_ASSERT_FLOW_DELETE_OK(bridge, &flow_mod, &match_list, &error);
+  TEST_ASSERT_TABLE_NFLOW(&table, MISC_FLOWS, 0);
+}
+
 void
 test_flowdb_flow_aggregate_stats(void) {
   struct table *table;
@@ -1067,3 +1434,83 @@ test_flow_dump(void) {
   flow_dump(table->flow_list->flows[0], fp);
   fclose(fp);
 }
+
+static struct action *
+add_output_action(struct instruction *insn, uint32_t port_number) {
+  struct action *action;
+  struct ofp_action_output *action_output;
+
+  action = calloc(1, sizeof(*action) +
+                  sizeof(*action_output) - sizeof(struct ofp_action_header));
+  TEST_ASSERT_NOT_NULL_MESSAGE(action, "action: calloc error.");
+  action_output = (struct ofp_action_output *)&action->ofpat;
+  action_output->type = OFPAT_OUTPUT;
+  action_output->port = port_number;
+  lagopus_set_action_function(action);
+  TAILQ_INSERT_TAIL(&insn->action_list, action, entry);
+  return action;
+}
+
+void
+test_flowdb_flow_add_multi_output(void) {
+  struct ofp_flow_mod flow_mod;
+  struct match_list match_list;
+  struct instruction_list instruction_list;
+  struct ofp_error error;
+  struct instruction *insn;
+  struct action *action, *out1, *out2, *out3;
+
+  TAILQ_INIT(&match_list);
+  TAILQ_INIT(&instruction_list);
+
+  flowinfo_init();
+
+  flow_mod.table_id = 0;
+  flow_mod.priority = 1;
+  flow_mod.flags = 0;
+  flow_mod.cookie = 0;
+  flow_mod.out_port = OFPP_ANY;
+  flow_mod.out_group = OFPG_ANY;
+
+  /* only outputs, all but last may share the packet. */
+  insn = add_instruction(&instruction_list, OFPIT_APPLY_ACTIONS);
+  TAILQ_INIT(&insn->action_list);
+  out1 = add_output_action(insn, 1);
+  out2 = add_output_action(insn, OFPP_CONTROLLER);
+  out3 = add_output_action(insn, 3);
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_EQUAL(out1->flags, OUTPUT_COPIED_PACKET | OUTPUT_SHARED_PACKET);
+  TEST_ASSERT_EQUAL(out2->flags, OUTPUT_COPIED_PACKET);
+  TEST_ASSERT_EQUAL(out3->flags, 0);
+
+  /* packet is modified after first output. */
+  flow_mod.priority = 2;
+  insn = add_instruction(&instruction_list, OFPIT_APPLY_ACTIONS);
+  TAILQ_INIT(&insn->action_list);
+  out1 = add_output_action(insn, 1);
+  action = calloc(1, sizeof(*action));
+  TEST_ASSERT_NOT_NULL_MESSAGE(action, "action: calloc error.");
+  action->ofpat.type = OFPAT_DEC_NW_TTL;
+  lagopus_set_action_function(action);
+  TAILQ_INSERT_TAIL(&insn->action_list, action, entry);
+  out2 = add_output_action(insn, 2);
+  out3 = add_output_action(insn, 3);
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_EQUAL(out1->flags, OUTPUT_COPIED_PACKET);
+  TEST_ASSERT_EQUAL(out2->flags, OUTPUT_COPIED_PACKET | OUTPUT_SHARED_PACKET);
+  TEST_ASSERT_EQUAL(out3->flags, 0);
+
+  /* instruction after apply-actions. */
+  flow_mod.priority = 3;
+  insn = add_instruction(&instruction_list, OFPIT_APPLY_ACTIONS);
+  TAILQ_INIT(&insn->action_list);
+  out1 = add_output_action(insn, 1);
+  out2 = add_output_action(insn, 2);
+  add_write_metadata_instruction(&instruction_list, 0);
+  TEST_ASSERT_FLOW_ADD_OK(bridge, &flow_mod, &match_list,
+                          &instruction_list, &error);
+  TEST_ASSERT_EQUAL(out1->flags, OUTPUT_COPIED_PACKET);
+  TEST_ASSERT_EQUAL(out2->flags, OUTPUT_COPIED_PACKET);
+}
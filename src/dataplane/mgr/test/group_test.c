@@ -20,6 +20,7 @@
 #include "lagopus/pbuf.h"
 #include "lagopus/flowdb.h"
 #include "lagopus/group.h"
+#include "lagopus/port.h"
 #include "lagopus/bridge.h"
 #include "lagopus/datastore/bridge.h"
 #include "lagopus/dp_apis.h"
@@ -113,7 +114,7 @@ test_group_table_add(void) {
   ret = group_table_add(group_table, group, &error);
   TEST_ASSERT_EQUAL_MESSAGE(ret, LAGOPUS_RESULT_OK,
                             "group_table_add error");
-  bucket = TAILQ_FIRST(&group->bucket_list);
+  bucket = TAILQ_FIRST(group->bucket_list);
   TEST_ASSERT_NOT_NULL_MESSAGE(bucket, "bucket copy error");
   action = TAILQ_FIRST(&bucket->action_list);
   TEST_ASSERT_NOT_NULL_MESSAGE(action, "action copy error");
@@ -447,3 +448,237 @@ test_group_live_bucket(void) {
   TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
   TEST_ASSERT_NULL(group_live_bucket(bridge, group));
 }
+
+static void
+add_output_bucket(struct bucket_list *bucket_list,
+                  uint32_t port, uint16_t weight) {
+  struct bucket *bucket;
+  struct action *action;
+
+  action = action_alloc(sizeof(struct ofp_action_output) -
+                        sizeof(struct ofp_action_header));
+  TEST_ASSERT_NOT_NULL(action);
+  action->ofpat.type = OFPAT_OUTPUT;
+  action->ofpat.len = sizeof(struct ofp_action_output);
+  ((struct ofp_action_output *)&action->ofpat)->port = port;
+  bucket = calloc(1, sizeof(struct bucket));
+  TEST_ASSERT_NOT_NULL(bucket);
+  bucket->ofp.weight = weight;
+  TAILQ_INIT(&bucket->action_list);
+  TAILQ_INSERT_TAIL(&bucket->action_list, action, entry);
+  TAILQ_INSERT_TAIL(bucket_list, bucket, entry);
+}
+
+static uint32_t
+bucket_port(struct bucket *bucket) {
+  struct action *action;
+
+  action = TAILQ_FIRST(&bucket->action_list);
+  return ((struct ofp_action_output *)&action->ofpat)->port;
+}
+
+void
+test_group_select_table(void) {
+  struct bridge *bridge;
+  struct group *group;
+  struct ofp_group_mod group_mod;
+  struct bucket_list bucket_list;
+  struct ofp_error error;
+  uint32_t ports[251];
+  int count[5], i, kept;
+
+  bridge = dp_bridge_lookup("br0");
+  group_mod.group_id = 1;
+  group_mod.type = OFPGT_SELECT;
+  TAILQ_INIT(&bucket_list);
+  add_output_bucket(&bucket_list, 1, 1);
+  add_output_bucket(&bucket_list, 2, 1);
+  add_output_bucket(&bucket_list, 3, 2);
+  add_output_bucket(&bucket_list, 4, 0);
+  group = group_alloc(&group_mod, &bucket_list);
+  TEST_ASSERT_NOT_NULL(group);
+  TEST_ASSERT_EQUAL(group_table_add(bridge->group_table, group, &error),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_NOT_NULL(group->select);
+  TEST_ASSERT_EQUAL(group->select->size, 251);
+
+  /* entries are in proportion to the weight. */
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < 251; i++) {
+    TEST_ASSERT_NOT_NULL(group->select->bucket[i]);
+    ports[i] = bucket_port(group->select->bucket[i]);
+    count[ports[i]]++;
+  }
+  TEST_ASSERT_EQUAL(count[1], 63);
+  TEST_ASSERT_EQUAL(count[2], 63);
+  TEST_ASSERT_EQUAL(count[3], 125);
+  TEST_ASSERT_EQUAL(count[4], 0);
+
+  /* removing a bucket moves few entries of others. */
+  TAILQ_INIT(&bucket_list);
+  add_output_bucket(&bucket_list, 1, 1);
+  add_output_bucket(&bucket_list, 3, 2);
+  group_modify(group, &group_mod, &bucket_list);
+  TEST_ASSERT_NOT_NULL(group->select);
+  kept = 0;
+  for (i = 0; i < 251; i++) {
+    TEST_ASSERT_NOT_EQUAL(bucket_port(group->select->bucket[i]), 2);
+    if (ports[i] != 2 && bucket_port(group->select->bucket[i]) == ports[i]) {
+      kept++;
+    }
+  }
+  TEST_ASSERT_TRUE(kept >= (count[1] + count[3]) * 9 / 10);
+
+  /* no select table for other types. */
+  group_mod.type = OFPGT_ALL;
+  TAILQ_INIT(&bucket_list);
+  add_output_bucket(&bucket_list, 1, 0);
+  group_modify(group, &group_mod, &bucket_list);
+  TEST_ASSERT_NULL(group->select);
+}
+
+static struct bucket *
+add_watch_bucket(struct bucket_list *bucket_list, uint32_t port,
+                 uint32_t watch_port, uint32_t watch_group) {
+  struct bucket *bucket;
+
+  add_output_bucket(bucket_list, port, 0);
+  bucket = TAILQ_LAST(bucket_list, bucket_list);
+  bucket->ofp.watch_port = watch_port;
+  bucket->ofp.watch_group = watch_group;
+  return bucket;
+}
+
+static struct port *
+add_bridge_port(struct bridge *bridge, const char *name, uint32_t port_no) {
+  struct port *port;
+
+  TEST_ASSERT_EQUAL(dp_port_create(name), LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(dp_bridge_port_set("br0", name, port_no),
+                    LAGOPUS_RESULT_OK);
+  port = port_lookup(&bridge->ports, port_no);
+  TEST_ASSERT_NOT_NULL(port);
+  port->ofp_port.state = OFPPS_LIVE;
+  port->ofp_port.config = 0;
+  return port;
+}
+
+void
+test_group_ff_live_cache(void) {
+  struct bridge *bridge;
+  struct group *group1, *group2;
+  struct ofp_group_mod group_mod;
+  struct bucket_list bucket_list;
+  struct ofp_error error;
+  struct port *port1, *port2;
+  struct bucket *primary;
+
+  bridge = dp_bridge_lookup("br0");
+  port1 = add_bridge_port(bridge, "port1", 1);
+  port2 = add_bridge_port(bridge, "port2", 2);
+
+  /* group 1 fails over to group 2 watching port 2. */
+  group_mod.group_id = 2;
+  group_mod.type = OFPGT_FF;
+  TAILQ_INIT(&bucket_list);
+  add_watch_bucket(&bucket_list, 2, 2, OFPG_ANY);
+  group2 = group_alloc(&group_mod, &bucket_list);
+  TEST_ASSERT_NOT_NULL(group2);
+  TEST_ASSERT_EQUAL(group_table_add(bridge->group_table, group2, &error),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(bucket_port(group2->live), 2);
+
+  group_mod.group_id = 1;
+  TAILQ_INIT(&bucket_list);
+  add_watch_bucket(&bucket_list, 1, 1, OFPG_ANY);
+  add_watch_bucket(&bucket_list, 3, OFPP_ANY, 2);
+  group1 = group_alloc(&group_mod, &bucket_list);
+  TEST_ASSERT_NOT_NULL(group1);
+  TEST_ASSERT_EQUAL(group_table_add(bridge->group_table, group1, &error),
+                    LAGOPUS_RESULT_OK);
+  primary = TAILQ_FIRST(group1->bucket_list);
+  TEST_ASSERT_EQUAL(group1->live, primary);
+
+  /* cached bucket changes only when port status is processed. */
+  port1->ofp_port.state = OFPPS_LINK_DOWN;
+  TEST_ASSERT_EQUAL(group1->live, primary);
+  TEST_ASSERT_EQUAL(ofp_group_live_update(bridge->dpid), LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(bucket_port(group1->live), 3);
+
+  port2->ofp_port.config = OFPPC_PORT_DOWN;
+  TEST_ASSERT_EQUAL(ofp_group_live_update(bridge->dpid), LAGOPUS_RESULT_OK);
+  TEST_ASSERT_NULL(group1->live);
+  TEST_ASSERT_NULL(group2->live);
+
+  port1->ofp_port.state = OFPPS_LIVE;
+  TEST_ASSERT_EQUAL(ofp_group_live_update(bridge->dpid), LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(group1->live, primary);
+
+  /* deleting the watched group updates the watcher. */
+  port1->ofp_port.state = OFPPS_LINK_DOWN;
+  port2->ofp_port.config = 0;
+  TEST_ASSERT_EQUAL(ofp_group_live_update(bridge->dpid), LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(bucket_port(group1->live), 3);
+  group_table_delete(bridge->group_table, 2);
+  TEST_ASSERT_NULL(group1->live);
+
+  /* modified group selects from the new buckets. */
+  TAILQ_INIT(&bucket_list);
+  add_watch_bucket(&bucket_list, 1, 1, OFPG_ANY);
+  add_watch_bucket(&bucket_list, 4, 2, OFPG_ANY);
+  group_modify(group1, &group_mod, &bucket_list);
+  TEST_ASSERT_EQUAL(bucket_port(group1->live), 4);
+
+  group_mod.type = OFPGT_ALL;
+  TAILQ_INIT(&bucket_list);
+  add_watch_bucket(&bucket_list, 1, 1, OFPG_ANY);
+  group_modify(group1, &group_mod, &bucket_list);
+  TEST_ASSERT_NULL(group1->live);
+
+  dp_bridge_port_unset("br0", "port1");
+  dp_bridge_port_unset("br0", "port2");
+  dp_port_destroy("port1");
+  dp_port_destroy("port2");
+}
+
+void
+test_group_port_live_update(void) {
+  struct bridge *bridge;
+  struct group *group;
+  struct ofp_group_mod group_mod;
+  struct bucket_list bucket_list;
+  struct ofp_error error;
+  struct port *port1;
+
+  bridge = dp_bridge_lookup("br0");
+  port1 = add_bridge_port(bridge, "port1", 1);
+  (void) add_bridge_port(bridge, "port2", 2);
+
+  group_mod.group_id = 1;
+  group_mod.type = OFPGT_FF;
+  TAILQ_INIT(&bucket_list);
+  add_watch_bucket(&bucket_list, 1, 1, OFPG_ANY);
+  add_watch_bucket(&bucket_list, 2, 2, OFPG_ANY);
+  group = group_alloc(&group_mod, &bucket_list);
+  TEST_ASSERT_NOT_NULL(group);
+  TEST_ASSERT_EQUAL(group_table_add(bridge->group_table, group, &error),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(bucket_port(group->live), 1);
+
+  /* the dataplane reselects where the link state is changed. */
+  port1->ofp_port.state = OFPPS_LINK_DOWN;
+  group_port_live_update(port1);
+  TEST_ASSERT_EQUAL(bucket_port(group->live), 2);
+  port1->ofp_port.state = OFPPS_LIVE;
+  group_port_live_update(port1);
+  TEST_ASSERT_EQUAL(bucket_port(group->live), 1);
+
+  /* removed port of the bridge is not live. */
+  dp_bridge_port_unset("br0", "port1");
+  TEST_ASSERT_EQUAL(bucket_port(group->live), 2);
+
+  group_table_delete(bridge->group_table, 1);
+  dp_bridge_port_unset("br0", "port2");
+  dp_port_destroy("port1");
+  dp_port_destroy("port2");
+}
@@ -20,8 +20,12 @@
 #include "lagopus_apis.h"
 #include "lagopus/pbuf.h"
 #include "lagopus/meter.h"
+#include "lagopus/dataplane.h"
 #include "openflow13.h"
 #include "ofp_band.h"
+#include "pktbuf.h"
+#include "packet.h"
+#include "counter.h"
 
 static struct meter_table *meter_table;
 
@@ -110,3 +114,108 @@ test_meter_lookup(void) {
   rv = meter_table_meter_delete(meter_table, &meter_mod, &error);
   TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
 }
+
+void
+test_meter_lookup_id_range(void) {
+  static const uint32_t ids[] = { 1, 255, 256, 65535, 65536, OFPM_MAX };
+  struct ofp_meter_mod meter_mod;
+  struct meter_band_list list;
+  struct ofp_error error;
+  struct meter *meter;
+  lagopus_result_t rv;
+  size_t i;
+
+  meter_mod.flags = 0;
+  for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+    TAILQ_INIT(&list);
+    meter_mod.meter_id = ids[i];
+    rv = meter_table_meter_add(meter_table, &meter_mod, &list, &error);
+    TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  }
+  for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+    meter = meter_table_lookup(meter_table, ids[i]);
+    TEST_ASSERT_NOT_NULL(meter);
+    TEST_ASSERT_EQUAL(meter->meter_id, ids[i]);
+  }
+  TEST_ASSERT_NULL(meter_table_lookup(meter_table, 2));
+  TEST_ASSERT_NULL(meter_table_lookup(meter_table, 65537));
+
+  meter_mod.meter_id = 256;
+  rv = meter_table_meter_delete(meter_table, &meter_mod, &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  TEST_ASSERT_NULL(meter_table_lookup(meter_table, 256));
+  TEST_ASSERT_NOT_NULL(meter_table_lookup(meter_table, 255));
+
+  meter_mod.meter_id = OFPM_ALL;
+  rv = meter_table_meter_delete(meter_table, &meter_mod, &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+    TEST_ASSERT_NULL(meter_table_lookup(meter_table, ids[i]));
+  }
+}
+
+static struct meter *
+add_drop_meter(uint32_t meter_id, uint16_t flags,
+               uint32_t rate, uint32_t burst_size) {
+  struct ofp_meter_band_drop drop;
+  struct ofp_meter_mod meter_mod;
+  struct meter_band_list list;
+  struct meter_band *band;
+  struct ofp_error error;
+  lagopus_result_t rv;
+
+  memset(&drop, 0, sizeof(drop));
+  drop.type = OFPMBT_DROP;
+  drop.len = sizeof(drop);
+  drop.rate = rate;
+  drop.burst_size = burst_size;
+  band = meter_band_alloc((struct ofp_meter_band_header *)&drop);
+  TEST_ASSERT_NOT_NULL(band);
+  TAILQ_INIT(&list);
+  TAILQ_INSERT_TAIL(&list, band, entry);
+  meter_mod.meter_id = meter_id;
+  meter_mod.flags = flags;
+  rv = meter_table_meter_add(meter_table, &meter_mod, &list, &error);
+  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  return meter_table_lookup(meter_table, meter_id);
+}
+
+void
+test_meter_packet(void) {
+#ifndef HAVE_DPDK
+  struct lagopus_packet *pkt;
+  struct meter *meter;
+  uint64_t packets, bytes;
+  uint8_t prec_level;
+  int i;
+
+  lagopus_meter_init();
+  pkt = alloc_lagopus_packet();
+  TEST_ASSERT_NOT_NULL(pkt);
+  OS_M_APPEND(PKT2MBUF(pkt), 100);
+
+  /* 10 pps, burst 5 packets. */
+  meter = add_drop_meter(1, OFPMF_PKTPS | OFPMF_BURST | OFPMF_STATS, 10, 5);
+  TEST_ASSERT_NOT_NULL(meter);
+  for (i = 0; i < 15; i++) {
+    TEST_ASSERT_EQUAL(lagopus_meter_packet(pkt, meter, &prec_level), 0);
+  }
+  TEST_ASSERT_EQUAL(lagopus_meter_packet(pkt, meter, &prec_level),
+                    OFPMBT_DROP);
+  dp_counter_get(TAILQ_FIRST(&meter->band_list)->counter_id,
+                 &packets, &bytes);
+  TEST_ASSERT_EQUAL(packets, 1);
+  TEST_ASSERT_EQUAL(bytes, 100);
+
+  /* 8 kbps is 1000 bytes per second, burst is ignored without flag. */
+  meter = add_drop_meter(2, 0, 8, 8);
+  TEST_ASSERT_NOT_NULL(meter);
+  for (i = 0; i < 10; i++) {
+    TEST_ASSERT_EQUAL(lagopus_meter_packet(pkt, meter, &prec_level), 0);
+  }
+  TEST_ASSERT_EQUAL(lagopus_meter_packet(pkt, meter, &prec_level),
+                    OFPMBT_DROP);
+
+  lagopus_packet_free(pkt);
+#endif /* HAVE_DPDK */
+}
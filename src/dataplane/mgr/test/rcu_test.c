@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "unity.h"
+
+#include "lagopus_apis.h"
+#include "rcu.h"
+
+/* reader states */
+#define READER_OFFLINE  0
+#define READER_ONLINE   1
+
+static volatile int reader_ready;
+static volatile int reader_release;
+static volatile int synchronized;
+
+void
+setUp(void) {
+  reader_ready = 0;
+  reader_release = 0;
+  synchronized = 0;
+}
+
+void
+tearDown(void) {
+}
+
+static void *
+rcu_reader(void *arg) {
+  int state = *(int *)arg;
+
+  if (dp_rcu_thread_register() != LAGOPUS_RESULT_OK) {
+    return NULL;
+  }
+  if (state == READER_ONLINE) {
+    dp_rcu_thread_online();
+  }
+  reader_ready = 1;
+  while (reader_release == 0) {
+    sched_yield();
+  }
+  dp_rcu_thread_offline();
+  dp_rcu_thread_unregister();
+  return NULL;
+}
+
+static void *
+rcu_writer(void *arg) {
+  (void) arg;
+  dp_rcu_synchronize();
+  synchronized = 1;
+  return NULL;
+}
+
+static void
+reader_start(pthread_t *tid, int *state) {
+  TEST_ASSERT_EQUAL(pthread_create(tid, NULL, rcu_reader, state), 0);
+  while (reader_ready == 0) {
+    sched_yield();
+  }
+}
+
+void
+test_dp_rcu_synchronize_online(void) {
+  pthread_t reader, writer;
+  int state = READER_ONLINE;
+
+  reader_start(&reader, &state);
+  TEST_ASSERT_EQUAL(pthread_create(&writer, NULL, rcu_writer, NULL), 0);
+  /* writer waits while the reader stays online. */
+  usleep(100 * 1000);
+  TEST_ASSERT_EQUAL(synchronized, 0);
+  reader_release = 1;
+  pthread_join(writer, NULL);
+  TEST_ASSERT_EQUAL(synchronized, 1);
+  pthread_join(reader, NULL);
+}
+
+void
+test_dp_rcu_synchronize_offline(void) {
+  pthread_t reader, writer;
+  int state = READER_OFFLINE;
+
+  reader_start(&reader, &state);
+  TEST_ASSERT_EQUAL(pthread_create(&writer, NULL, rcu_writer, NULL), 0);
+  /* registered but offline reader is not waited for. */
+  pthread_join(writer, NULL);
+  TEST_ASSERT_EQUAL(synchronized, 1);
+  reader_release = 1;
+  pthread_join(reader, NULL);
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include "unity.h"
+
+#include "lagopus_apis.h"
+#include "srtcm.h"
+
+#define NTHREADS 4
+#define RATE 1000000
+
+static struct dp_srtcm_sharded meter __attribute__ ((aligned(64)));
+static uint64_t now;
+
+void
+setUp(void) {
+}
+
+void
+tearDown(void) {
+}
+
+void
+test_dp_srtcm_color(void) {
+  struct dp_srtcm m;
+  int i;
+
+  dp_srtcm_config(&m, 10, 10, 5);
+  now = m.time;
+  for (i = 0; i < 10; i++) {
+    TEST_ASSERT_EQUAL(dp_srtcm_color_blind_check(&m, now, 1), DP_SRTCM_GREEN);
+  }
+  for (i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL(dp_srtcm_color_blind_check(&m, now, 1), DP_SRTCM_YELLOW);
+  }
+  TEST_ASSERT_EQUAL(dp_srtcm_color_blind_check(&m, now, 1), DP_SRTCM_RED);
+
+  /* a token is added every 100msec. */
+  now += 300 * 1000 * 1000;
+  for (i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL(dp_srtcm_color_blind_check(&m, now, 1), DP_SRTCM_GREEN);
+  }
+  TEST_ASSERT_EQUAL(dp_srtcm_color_blind_check(&m, now, 1), DP_SRTCM_RED);
+}
+
+void
+test_dp_srtcm_sharded_slow(void) {
+  int i;
+
+  /* quantum is too small, shared buckets are used. */
+  dp_srtcm_sharded_config(&meter, 100, 100, 0, 1);
+  TEST_ASSERT_EQUAL(meter.quantum, 0);
+  now = meter.srtcm.time;
+  for (i = 0; i < 100; i++) {
+    TEST_ASSERT_EQUAL(dp_srtcm_sharded_check(&meter, now, 1), DP_SRTCM_GREEN);
+  }
+  TEST_ASSERT_EQUAL(dp_srtcm_sharded_check(&meter, now, 1), DP_SRTCM_RED);
+}
+
+static void *
+srtcm_worker(void *arg) {
+  uint64_t *green = arg;
+  int i;
+
+  for (i = 0; i < RATE; i++) {
+    if (dp_srtcm_sharded_check(&meter, now, 1) == DP_SRTCM_GREEN) {
+      (*green)++;
+    }
+  }
+  return NULL;
+}
+
+void
+test_dp_srtcm_sharded_threads(void) {
+  pthread_t tid[NTHREADS];
+  uint64_t green[NTHREADS];
+  uint64_t total, cached;
+  int i;
+
+  dp_srtcm_sharded_config(&meter, RATE, RATE, 0, 1);
+  TEST_ASSERT_NOT_EQUAL(meter.quantum, 0);
+  now = meter.srtcm.time;
+  for (i = 0; i < NTHREADS; i++) {
+    green[i] = 0;
+    TEST_ASSERT_EQUAL(pthread_create(&tid[i], NULL, srtcm_worker,
+                                     &green[i]), 0);
+  }
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  total = 0;
+  for (i = 0; i < NTHREADS; i++) {
+    total += green[i];
+  }
+  cached = 0;
+  for (i = 0; i < DP_SRTCM_SHARDS; i++) {
+    cached += meter.shard[i].tokens;
+  }
+  /* no token is created or lost by the caches. */
+  TEST_ASSERT_EQUAL(total + cached + meter.srtcm.tc, RATE);
+  /* unused tokens of other threads are consumed. */
+  TEST_ASSERT_EQUAL(cached, 0);
+
+  /* refill of one second. */
+  now += 1000 * 1000 * 1000;
+  for (i = 0; i < NTHREADS; i++) {
+    green[i] = 0;
+    TEST_ASSERT_EQUAL(pthread_create(&tid[i], NULL, srtcm_worker,
+                                     &green[i]), 0);
+  }
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  total = 0;
+  for (i = 0; i < NTHREADS; i++) {
+    total += green[i];
+  }
+  TEST_ASSERT_EQUAL(total, RATE);
+}
@@ -24,45 +24,59 @@
 
 #include "dp_timer.c"
 
+static int expired;
+static void *expired_entry[MAX_TIMEOUT_ENTRIES];
+
 void
 setUp(void) {
   init_dp_timer();
+  expired = 0;
 }
 
 void
 tearDown(void) {
 }
 
+static void
+count_expire(struct dp_timer *dp_timer) {
+  int i;
+
+  for (i = 0; i < dp_timer->nentries; i++) {
+    if (dp_timer->timer_entry[i] != NULL) {
+      expired_entry[expired % MAX_TIMEOUT_ENTRIES] = dp_timer->timer_entry[i];
+      expired++;
+    }
+  }
+}
+
 void
 test_add_flow_timer(void) {
-  struct flow flow;
+  struct flow flow, flow2;
   struct dp_timer *dp_timer;
   lagopus_result_t rv;
 
-  clock_gettime(CLOCK_MONOTONIC, &now_ts);
   flow.idle_timeout = 100;
   flow.hard_timeout = 100;
   flow.create_time.tv_sec = now_ts.tv_sec;
   flow.update_time.tv_sec = now_ts.tv_sec;
   rv = add_flow_timer(&flow);
   TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 100);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
-  flow.idle_timeout = 20;
-  flow.hard_timeout = 20;
-  rv = add_flow_timer(&flow);
+  TEST_ASSERT_NOT_NULL(flow.flow_timer);
+  TEST_ASSERT_EQUAL(*flow.flow_timer, &flow);
+  dp_timer = TAILQ_FIRST(&dp_timer_wheel[0][(dp_timer_tick + 100) &
+                                            DP_TIMER_WHEEL_MASK]);
+  TEST_ASSERT_NOT_NULL(dp_timer);
+  TEST_ASSERT_EQUAL(dp_timer->expire, dp_timer_tick + 100);
+  TEST_ASSERT_EQUAL(dp_timer->nentries, 1);
+  TEST_ASSERT_EQUAL_PTR(flow.flow_timer, &dp_timer->timer_entry[0]);
+
+  /* same timeout shares the block. */
+  flow2 = flow;
+  rv = add_flow_timer(&flow2);
   TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 20);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 80);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
+  TEST_ASSERT_EQUAL_PTR(flow2.flow_timer, &dp_timer->timer_entry[1]);
+  TEST_ASSERT_EQUAL(dp_timer->nentries, 2);
+  TEST_ASSERT_NULL(TAILQ_NEXT(dp_timer, next));
 }
 
 void
@@ -72,116 +86,99 @@ test_add_mbtree_timer(void) {
 
   rv = add_mbtree_timer(&flow_list, 100);
   TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+  TEST_ASSERT_NOT_NULL(flow_list.update_timer);
+  TEST_ASSERT_EQUAL_PTR(*flow_list.update_timer, &flow_list);
 }
 
-static void
-t_add_flow_timer(int sec) {
-  struct flow flow;
-  lagopus_result_t rv;
+void
+test_timer_expire(void) {
+  uint64_t start;
+  void **entryp[3];
+  int arg[3];
+
+  start = dp_timer_tick;
+  entryp[0] = add_dp_timer(FLOW_TIMER, 5, count_expire, &arg[0]);
+  entryp[1] = add_dp_timer(FLOW_TIMER, 5, count_expire, &arg[1]);
+  entryp[2] = add_dp_timer(FLOW_TIMER, 3, count_expire, &arg[2]);
+  TEST_ASSERT_NOT_NULL(entryp[0]);
+  TEST_ASSERT_NOT_NULL(entryp[1]);
+  TEST_ASSERT_NOT_NULL(entryp[2]);
+
+  /* cancel. */
+  *entryp[1] = NULL;
+
+  dp_timer_run(start + 2);
+  TEST_ASSERT_EQUAL(expired, 0);
+  dp_timer_run(start + 3);
+  TEST_ASSERT_EQUAL(expired, 1);
+  TEST_ASSERT_EQUAL_PTR(expired_entry[0], &arg[2]);
+  dp_timer_run(start + 10);
+  TEST_ASSERT_EQUAL(expired, 2);
+  TEST_ASSERT_EQUAL_PTR(expired_entry[1], &arg[0]);
+}
 
-  clock_gettime(CLOCK_MONOTONIC, &now_ts);
-  flow.idle_timeout = sec;
-  flow.hard_timeout = sec;
-  flow.create_time.tv_sec = now_ts.tv_sec;
-  flow.update_time.tv_sec = now_ts.tv_sec;
-  rv = add_flow_timer(&flow);
-  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
+void
+test_timer_cascade(void) {
+  static const time_t timeouts[] = {
+    255, 256, 257, 1000, 65535, 65536, 70000
+  };
+  uint64_t start;
+  int arg;
+  size_t i;
+
+  start = dp_timer_tick;
+  for (i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); i++) {
+    TEST_ASSERT_NOT_NULL(add_dp_timer(FLOW_TIMER, timeouts[i],
+                                      count_expire, &arg));
+  }
+  for (i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); i++) {
+    dp_timer_run(start + (uint64_t)timeouts[i] - 1);
+    TEST_ASSERT_EQUAL(expired, i);
+    dp_timer_run(start + (uint64_t)timeouts[i]);
+    TEST_ASSERT_EQUAL(expired, i + 1);
+  }
 }
 
 void
 test_add_multiple_timer(void) {
-  struct flow_list flow_list;
   struct dp_timer *dp_timer;
-  lagopus_result_t rv;
-
-  t_add_flow_timer(100);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 100);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
-
-  t_add_flow_timer(20);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 20);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 80);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
-
-  rv = add_mbtree_timer(&flow_list, 5);
-  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 5);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 15);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 80);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
-
-  t_add_flow_timer(30);
-  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 5);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 15);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 10);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 70);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
-
-  t_add_flow_timer(1);
-  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 1);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 4);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 15);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 10);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 70);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
-
-  rv = add_mbtree_timer(&flow_list, 8);
-  TEST_ASSERT_EQUAL(rv, LAGOPUS_RESULT_OK);
-  dp_timer = TAILQ_FIRST(&dp_timer_list);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 1);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 4);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 3);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 12);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 10);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NOT_NULL(dp_timer);
-  TEST_ASSERT_EQUAL(dp_timer->timeout, 70);
-  dp_timer = TAILQ_NEXT(dp_timer, next);
-  TEST_ASSERT_NULL(dp_timer);
+  void **entryp;
+  uint64_t start;
+  int arg;
+  int i, size, total;
+
+  start = dp_timer_tick;
+  for (i = 0; i < MAX_TIMEOUT_ENTRIES * 2; i++) {
+    entryp = add_dp_timer(FLOW_TIMER, 10, count_expire, &arg);
+    TEST_ASSERT_NOT_NULL(entryp);
+  }
+  /* full block is followed by larger one. */
+  size = MIN_TIMEOUT_ENTRIES;
+  total = 0;
+  TAILQ_FOREACH(dp_timer, &dp_timer_wheel[0][(start + 10) &
+                                             DP_TIMER_WHEEL_MASK], next) {
+    TEST_ASSERT_EQUAL(dp_timer->expire, start + 10);
+    TEST_ASSERT_EQUAL(dp_timer->size, size);
+    total += dp_timer->nentries;
+    if (TAILQ_NEXT(dp_timer, next) != NULL) {
+      TEST_ASSERT_EQUAL(dp_timer->nentries, dp_timer->size);
+    } else {
+      TEST_ASSERT_EQUAL_PTR(entryp,
+                            &dp_timer->timer_entry[dp_timer->nentries - 1]);
+    }
+    size = MIN(size * 4, MAX_TIMEOUT_ENTRIES);
+  }
+  TEST_ASSERT_EQUAL(total, MAX_TIMEOUT_ENTRIES * 2);
+
+  /* other type uses own block. */
+  entryp = add_dp_timer(MBTREE_TIMER, 10, count_expire, &arg);
+  TEST_ASSERT_NOT_NULL(entryp);
+  dp_timer = TAILQ_LAST(&dp_timer_wheel[0][(start + 10) &
+                                           DP_TIMER_WHEEL_MASK],
+                        dp_timer_list);
+  TEST_ASSERT_EQUAL(dp_timer->type, MBTREE_TIMER);
+  TEST_ASSERT_EQUAL(dp_timer->nentries, 1);
+
+  dp_timer_run(start + 10);
+  TEST_ASSERT_EQUAL(expired, MAX_TIMEOUT_ENTRIES * 2 + 1);
 }
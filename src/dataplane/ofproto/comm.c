@@ -133,22 +133,22 @@ dp_process_event_data(uint64_t dpid, struct eventq_data *data) {
 
       case LAGOPUS_EVENTQ_BARRIER_REQUEST:
 #ifdef USE_MBTREE
-        /* rebuild branch tree. */
+        /* rebuild branch tree aside, forwarding is not stopped. */
         {
           struct flowdb *flowdb;
           struct table *table;
           int i;
 
-	  flowdb_wrlock(NULL);
           flowdb = bridge->flowdb;
+          flowdb_mod_rdlock(flowdb);
           for (i = 0; i < FLOWDB_TABLE_SIZE_MAX; i++) {
-            table = flowdb_get_table(flowdb, i);
-            if (table != NULL) {
-              cleanup_mbtree(table->flow_list);
+            table = table_lookup(flowdb, i);
+            /* tree is updated in place, rebuild if it is modified. */
+            if (table != NULL && table->flow_list->mbtree_updates != 0) {
               build_mbtree(table->flow_list);
             }
           }
-	  flowdb_wrunlock(NULL);
+          flowdb_mod_rdunlock(flowdb);
         }
 #endif /* USE_MBTREE */
 #ifdef USE_THTABLE
@@ -55,6 +55,7 @@
 #include "City.h"
 #include "murmurhash3.h"
 #include "mbtree.h"
+#include "counter.h"
 
 #ifdef HAVE_DPDK
 #ifdef __SSE4_2__
@@ -92,6 +93,8 @@
    (SET_FIELD_ETH_DST|SET_FIELD_ETH_SRC))
 
 #define PUT_TIMEOUT 1LL * 1000LL
+/* shorter packets are padded at transmission. */
+#define SHARED_PACKET_MINLEN 60
 #define FIELD(n) ((n) << 1)
 
 /**
@@ -690,6 +693,16 @@ copy_packet(struct lagopus_packet *src_pkt) {
   return pkt;
 }
 
+/**
+ * Check packet data can be referenced by more than one output.
+ * Transmission rewrites short packets and checksums of modified packets.
+ */
+static inline bool
+packet_shareable(struct lagopus_packet *pkt) {
+  return OS_M_PKTLEN(PKT2MBUF(pkt)) >= SHARED_PACKET_MINLEN &&
+         (pkt->flags & PKT_FLAG_RECALC_CKSUM_MASK) == 0;
+}
+
 static struct lagopus_packet *
 copy_packet_with_metadata(struct lagopus_packet *src_pkt) {
   struct lagopus_packet *pkt;
@@ -1335,6 +1348,31 @@ group_select_bucket(struct lagopus_packet *pkt, struct bucket_list *list) {
   return bucket;
 }
 
+/**
+ * Check the bucket only outputs packet to ports not rewriting it.
+ */
+static bool
+bucket_output_only(struct bucket *bucket) {
+  struct action *action;
+  uint32_t port;
+  int i;
+
+  for (i = 0; i < LAGOPUS_ACTION_SET_ORDER_OUTPUT; i++) {
+    if (TAILQ_EMPTY(&bucket->actions[i]) == false) {
+      return false;
+    }
+  }
+  TAILQ_FOREACH(action, &bucket->actions[LAGOPUS_ACTION_SET_ORDER_OUTPUT],
+                entry) {
+    port = ((struct ofp_action_output *)&action->ofpat)->port;
+    if (port > OFPP_MAX && port != OFPP_IN_PORT &&
+        port != OFPP_FLOOD && port != OFPP_ALL) {
+      return false;
+    }
+  }
+  return true;
+}
+
 /**
  * Execute action bucket referenced by group id.
  *
@@ -1351,6 +1389,7 @@ execute_group_action(struct lagopus_packet *pkt, uint32_t group_id) {
    *  optional fast failover
    */
   struct group *group;
+  struct group_select *select;
   struct bucket *bucket;
   lagopus_result_t rv;
 
@@ -1368,11 +1407,27 @@ execute_group_action(struct lagopus_packet *pkt, uint32_t group_id) {
 
   switch (group->type) {
     case OFPGT_ALL:
-      TAILQ_FOREACH(bucket, &group->bucket_list, entry) {
+      if ((pkt->flags & PKT_FLAG_CACHED_FLOW) == 0 && pkt->cache != NULL &&
+          pkt->hash64 != 0) {
+        /* register crc and flows to cache. */
+        register_cache(pkt->cache, pkt->hash64,
+                       pkt->nmatched, pkt->matched_flow);
+      }
+      pkt->flags |= PKT_FLAG_CACHED_FLOW;
+      TAILQ_FOREACH(bucket, group->bucket_list, entry) {
         struct lagopus_packet *cpkt;
 
         bucket->counter.packet_count++;
         bucket->counter.byte_count += OS_M_PKTLEN(PKT2MBUF(pkt));
+        if (bucket_output_only(bucket) && packet_shareable(pkt)) {
+          /* output the original packet, it is not rewritten. */
+          OS_M_ADDREF(PKT2MBUF(pkt));
+          rv = execute_action_set(pkt, bucket->actions);
+          if (rv != LAGOPUS_RESULT_NO_MORE_ACTION) {
+            lagopus_packet_free(pkt);
+          }
+          continue;
+        }
         cpkt = copy_packet(pkt);
         if (cpkt != NULL) {
           re_classify_packet(cpkt);
@@ -1382,12 +1437,6 @@ execute_group_action(struct lagopus_packet *pkt, uint32_t group_id) {
           }
         }
       }
-      if ((pkt->flags & PKT_FLAG_CACHED_FLOW) == 0 && pkt->cache != NULL &&
-          pkt->hash64 != 0) {
-        /* register crc and flows to cache. */
-        register_cache(pkt->cache, pkt->hash64,
-                       pkt->nmatched, pkt->matched_flow);
-      }
       /* to free original packet */
       lagopus_packet_free(pkt);
       rv = LAGOPUS_RESULT_NO_MORE_ACTION;
@@ -1398,7 +1447,15 @@ execute_group_action(struct lagopus_packet *pkt, uint32_t group_id) {
        * select one bucket.
        * selection algorithm is depend on the switch.
        */
-      bucket = group_select_bucket(pkt, &group->bucket_list);
+      select = group->select;
+      if (likely(select != NULL)) {
+        if (pkt->hash64 == 0) {
+          calc_packet_hash(pkt);
+        }
+        bucket = select->bucket[((pkt->hash64 >> 32) * select->size) >> 32];
+      } else {
+        bucket = group_select_bucket(pkt, group->bucket_list);
+      }
       if (bucket != NULL) {
         bucket->counter.packet_count++;
         bucket->counter.byte_count += OS_M_PKTLEN(PKT2MBUF(pkt));
@@ -1408,7 +1465,7 @@ execute_group_action(struct lagopus_packet *pkt, uint32_t group_id) {
 
     case OFPGT_INDIRECT:
       /* execute only one bucket */
-      bucket = TAILQ_FIRST(&group->bucket_list);
+      bucket = TAILQ_FIRST(group->bucket_list);
       if (bucket != NULL) {
         bucket->counter.packet_count++;
         bucket->counter.byte_count += OS_M_PKTLEN(PKT2MBUF(pkt));
@@ -1418,7 +1475,7 @@ execute_group_action(struct lagopus_packet *pkt, uint32_t group_id) {
 
     case OFPGT_FF:
       /* execute only one live bucket */
-      bucket = group_live_bucket(pkt->bridge, group);
+      bucket = group->live;
       if (bucket != NULL) {
         bucket->counter.packet_count++;
         bucket->counter.byte_count += OS_M_PKTLEN(PKT2MBUF(pkt));
@@ -1835,10 +1892,15 @@ execute_action_output(struct lagopus_packet *pkt,
   /* required action */
   port = ((struct ofp_action_output *)&action->ofpat)->port;
   DP_PRINT("action output: %d\n", port);
-  if (unlikely(action->flags == OUTPUT_COPIED_PACKET)) {
+  if (unlikely((action->flags & OUTPUT_COPIED_PACKET) != 0)) {
     /* send copied packet */
     if (port == OFPP_CONTROLLER) {
       dp_interface_tx_packet(copy_packet_with_metadata(pkt), port, action->cookie);
+    } else if ((action->flags & OUTPUT_SHARED_PACKET) != 0 &&
+               packet_shareable(pkt)) {
+      /* following actions only output, send the packet itself. */
+      OS_M_ADDREF(PKT2MBUF(pkt));
+      dp_interface_tx_packet(pkt, port, action->cookie);
     } else {
       dp_interface_tx_packet(copy_packet(pkt), port, action->cookie);
     }
@@ -2736,51 +2798,370 @@ lagopus_set_instruction_function(struct instruction *instruction) {
   }
 }
 
+/*
+ * Compiled actions of the cache entry.
+ *
+ * Instructions of all cached flows are flattened into one op array:
+ * apply-actions are expanded in order, write/clear-actions are merged
+ * at compile time and the resulting action set is appended in the
+ * order of 5.10.  The array is compiled when the entry is registered,
+ * into storage of CACHE_PROG_MAX_OPS ops which the flow cache keeps in
+ * each entry, so a cache hit runs it without walking action lists,
+ * merging the action set or allocating memory per packet.
+ */
+#define CACHE_PROG_MAX_OPS      16
+enum cache_op_type {
+  CACHE_OP_FLOW,                        /* enter next flow of the entry */
+  CACHE_OP_METER,                       /* meter instruction */
+  CACHE_OP_METADATA,                    /* write_metadata instruction */
+  CACHE_OP_ACTION,                      /* an action */
+  CACHE_OP_SET_ETH_ADDR                 /* set-field eth_dst and eth_src */
+};
+
+struct cache_op {
+  int type;
+  union {
+    struct {
+      struct flow *flow;                /** CACHE_OP_FLOW */
+      struct table *table;
+    };
+    const struct instruction *instruction; /** CACHE_OP_METER, METADATA */
+    struct action *action;              /** CACHE_OP_ACTION */
+    uint8_t eth_addr[ETHER_ADDR_LEN * 2]; /** CACHE_OP_SET_ETH_ADDR */
+  };
+};
+
+struct cache_prog {
+  unsigned nops;                        /** number of ops */
+  unsigned run;                         /** first op of set-field run */
+  struct cache_op ops[0];
+};
+
+static inline size_t
+action_list_count(const struct action_list *action_list) {
+  const struct action *action;
+  size_t n;
+
+  n = 0;
+  TAILQ_FOREACH(action, action_list, entry) {
+    n++;
+  }
+  return n;
+}
+
+static inline int
+action_set_priority(const struct action *action) {
+  if (action->ofpat.type >= sizeof(action_prop) / sizeof(action_prop[0])) {
+    /* reserved action type */
+    return 0;
+  }
+  return action_prop[action->ofpat.type].priority;
+}
+
+static inline const uint8_t *
+set_field_value(const struct action *action) {
+  return &((const struct ofp_action_set_field *)&action->ofpat)->field[4];
+}
+
+static inline struct cache_op *
+cache_prog_push(struct cache_prog *prog, int type) {
+  struct cache_op *op;
+
+  op = &prog->ops[prog->nops++];
+  op->type = type;
+  return op;
+}
+
+/**
+ * Append an action.  set-fields in a row modify independent fields,
+ * so an earlier set of the same field is dropped and eth_dst/eth_src
+ * are collapsed into one header rewrite.  set-fields which re-classify
+ * the packet end the row.
+ */
+static void
+cache_prog_add_action(struct cache_prog *prog, struct action *action) {
+  struct cache_op *op;
+  uint8_t field;
+  unsigned i;
+
+  field = 0;
+  if (action->ofpat.type == OFPAT_SET_FIELD) {
+    field = GET_OXM_FIELD(&action->ofpat);
+  }
+  if (action->ofpat.type != OFPAT_SET_FIELD ||
+      field == OFPXMT_OFB_ETH_TYPE || field == OFPXMT_OFB_IP_PROTO) {
+    cache_prog_push(prog, CACHE_OP_ACTION)->action = action;
+    prog->run = prog->nops;
+    return;
+  }
+  for (i = prog->run; i < prog->nops; i++) {
+    op = &prog->ops[i];
+    if (op->type == CACHE_OP_SET_ETH_ADDR) {
+      if (field == OFPXMT_OFB_ETH_DST) {
+        OS_MEMCPY(op->eth_addr, set_field_value(action), ETHER_ADDR_LEN);
+        return;
+      }
+      if (field == OFPXMT_OFB_ETH_SRC) {
+        OS_MEMCPY(&op->eth_addr[ETHER_ADDR_LEN], set_field_value(action),
+                  ETHER_ADDR_LEN);
+        return;
+      }
+      continue;
+    }
+    if (GET_OXM_FIELD(&op->action->ofpat) == field) {
+      /* overwritten, drop it. */
+      memmove(op, op + 1, sizeof(*op) * (prog->nops - i - 1));
+      prog->nops--;
+      break;
+    }
+  }
+  if (field == OFPXMT_OFB_ETH_DST || field == OFPXMT_OFB_ETH_SRC) {
+    for (i = prog->run; i < prog->nops; i++) {
+      op = &prog->ops[i];
+      if (op->type != CACHE_OP_ACTION) {
+        continue;
+      }
+      if (field == OFPXMT_OFB_ETH_DST &&
+          GET_OXM_FIELD(&op->action->ofpat) == OFPXMT_OFB_ETH_SRC) {
+        OS_MEMCPY(&op->eth_addr[ETHER_ADDR_LEN], set_field_value(op->action),
+                  ETHER_ADDR_LEN);
+        OS_MEMCPY(op->eth_addr, set_field_value(action), ETHER_ADDR_LEN);
+        op->type = CACHE_OP_SET_ETH_ADDR;
+        return;
+      }
+      if (field == OFPXMT_OFB_ETH_SRC &&
+          GET_OXM_FIELD(&op->action->ofpat) == OFPXMT_OFB_ETH_DST) {
+        OS_MEMCPY(op->eth_addr, set_field_value(op->action), ETHER_ADDR_LEN);
+        OS_MEMCPY(&op->eth_addr[ETHER_ADDR_LEN], set_field_value(action),
+                  ETHER_ADDR_LEN);
+        op->type = CACHE_OP_SET_ETH_ADDR;
+        return;
+      }
+    }
+  }
+  cache_prog_push(prog, CACHE_OP_ACTION)->action = action;
+}
+
+/**
+ * Merge written actions into the action set, same rule as
+ * merge_action_set().
+ */
+static void
+cache_prog_merge_action_set(struct action **aset, size_t *naset,
+                            const struct action_list *action_list) {
+  struct action *action;
+  size_t i;
+
+  TAILQ_FOREACH(action, action_list, entry) {
+    if (action_set_priority(action) == 0) {
+      continue;
+    }
+    for (i = 0; i < *naset; i++) {
+      if (aset[i]->ofpat.type == action->ofpat.type &&
+          (action->ofpat.type != OFPAT_SET_FIELD ||
+           GET_OXM_FIELD(&aset[i]->ofpat) == GET_OXM_FIELD(&action->ofpat))) {
+        memmove(&aset[i], &aset[i + 1], sizeof(*aset) * (*naset - i - 1));
+        (*naset)--;
+        break;
+      }
+    }
+    aset[(*naset)++] = action;
+  }
+}
+
+size_t
+cache_prog_size(void) {
+  return sizeof(struct cache_prog) +
+         sizeof(struct cache_op) * CACHE_PROG_MAX_OPS;
+}
+
+struct cache_prog *
+cache_prog_compile(void *buf, const struct cache_entry *cache_entry) {
+  struct cache_prog *prog;
+  struct instruction * const *insns;
+  struct action *aset[CACHE_PROG_MAX_OPS];
+  struct action *action;
+  size_t nops, nwrite, naset;
+  unsigned i;
+  int priority;
+
+  /* upper bound, ops are never added beyond it. */
+  nops = 0;
+  nwrite = 0;
+  for (i = 0; i < cache_entry->nmatched; i++) {
+    insns = cache_entry->flow[i]->instruction->index;
+    nops++;
+    if (insns[INSTRUCTION_INDEX_METER] != NULL) {
+      nops++;
+    }
+    if (insns[INSTRUCTION_INDEX_APPLY_ACTIONS] != NULL) {
+      nops += action_list_count(
+                &insns[INSTRUCTION_INDEX_APPLY_ACTIONS]->action_list);
+    }
+    if (insns[INSTRUCTION_INDEX_WRITE_ACTIONS] != NULL) {
+      nwrite += action_list_count(
+                  &insns[INSTRUCTION_INDEX_WRITE_ACTIONS]->action_list);
+    }
+    if (insns[INSTRUCTION_INDEX_WRITE_METADATA] != NULL) {
+      nops++;
+    }
+  }
+  if (nops + nwrite > CACHE_PROG_MAX_OPS) {
+    return NULL;
+  }
+  prog = buf;
+  prog->nops = 0;
+  prog->run = 0;
+  naset = 0;
+  for (i = 0; i < cache_entry->nmatched; i++) {
+    struct cache_op *op;
+
+    insns = cache_entry->flow[i]->instruction->index;
+    op = cache_prog_push(prog, CACHE_OP_FLOW);
+    op->flow = cache_entry->flow[i];
+    op->table = cache_entry->tables[i].table;
+    if (insns[INSTRUCTION_INDEX_METER] != NULL) {
+      cache_prog_push(prog, CACHE_OP_METER)->instruction =
+        insns[INSTRUCTION_INDEX_METER];
+    }
+    prog->run = prog->nops;
+    if (insns[INSTRUCTION_INDEX_APPLY_ACTIONS] != NULL) {
+      TAILQ_FOREACH(action,
+                    &insns[INSTRUCTION_INDEX_APPLY_ACTIONS]->action_list,
+                    entry) {
+        cache_prog_add_action(prog, action);
+      }
+    }
+    if (insns[INSTRUCTION_INDEX_CLEAR_ACTIONS] != NULL) {
+      naset = 0;
+    }
+    if (insns[INSTRUCTION_INDEX_WRITE_ACTIONS] != NULL) {
+      cache_prog_merge_action_set(
+        aset, &naset, &insns[INSTRUCTION_INDEX_WRITE_ACTIONS]->action_list);
+    }
+    if (insns[INSTRUCTION_INDEX_WRITE_METADATA] != NULL) {
+      cache_prog_push(prog, CACHE_OP_METADATA)->instruction =
+        insns[INSTRUCTION_INDEX_WRITE_METADATA];
+    }
+    /* goto_table is resolved by the cache entry itself. */
+  }
+  prog->run = prog->nops;
+  for (priority = 1; priority <= LAGOPUS_ACTION_SET_ORDER_MAX; priority++) {
+    for (i = 0; i < naset; i++) {
+      if (action_set_priority(aset[i]) == priority) {
+        cache_prog_add_action(prog, aset[i]);
+      }
+    }
+  }
+  return prog;
+}
+
+static inline void
+cache_op_count(const struct cache_op *op, uint64_t npkts, uint64_t bytes) {
+  struct flow *flow;
+
+  flow = op->flow;
+  dp_counter_add(flow->counter_id, npkts, bytes);
+  if (flow->idle_timeout != 0 || flow->hard_timeout != 0) {
+    flow_update_hit_time(flow);
+  }
+  /* cache lookup returns only the entry with unchanged tables. */
+  dp_counter_add(op->table->counter_id, npkts,
+                 flow->priority > 0 ? npkts : 0);
+}
+
 static inline lagopus_result_t
-dp_openflow_do_cached_action(struct lagopus_packet *pkt) {
-  struct flowdb *flowdb;
+cache_op_exec(struct lagopus_packet *pkt, const struct cache_op *op) {
+  switch (op->type) {
+    case CACHE_OP_FLOW:
+      pkt->flow = op->flow;
+      pkt->table_id = op->flow->table_id;
+      return LAGOPUS_RESULT_OK;
+
+    case CACHE_OP_METER:
+      return execute_instruction_meter(pkt, op->instruction);
+
+    case CACHE_OP_METADATA:
+      return execute_instruction_write_metadata(pkt, op->instruction);
+
+    case CACHE_OP_SET_ETH_ADDR:
+      /* ether_dhost and ether_shost are adjacent. */
+      OS_MEMCPY(ETHER_DST(pkt->eth), op->eth_addr, sizeof(op->eth_addr));
+      return LAGOPUS_RESULT_OK;
+
+    case CACHE_OP_ACTION:
+    default:
+      return op->action->exec(pkt, op->action);
+  }
+}
+
+STATIC lagopus_result_t
+dp_openflow_do_cached_prog(struct lagopus_packet *pkt,
+                           const struct cache_prog *prog) {
+  const struct cache_op *op;
+  lagopus_result_t rv;
+
+  rv = LAGOPUS_RESULT_OK;
+  for (op = prog->ops; op < &prog->ops[prog->nops]; op++) {
+    if (op->type == CACHE_OP_FLOW) {
+      cache_op_count(op, 1, OS_M_PKTLEN(PKT2MBUF(pkt)));
+    }
+    rv = cache_op_exec(pkt, op);
+    if (rv != LAGOPUS_RESULT_OK) {
+      break;
+    }
+  }
+  return rv;
+}
+
+/**
+ * Execute instructions of cached flows one by one.  Used when the
+ * entry could not be compiled.
+ */
+STATIC lagopus_result_t
+dp_openflow_do_cached_flows(struct lagopus_packet *pkt,
+                            const struct cache_entry *cache_entry) {
   struct flow *flow;
-  struct flow **flowp;
+  struct flow * const *flowp;
   struct table *table;
-  const struct cache_entry *cache_entry;
   lagopus_result_t rv;
   unsigned i;
 
-  flowdb = pkt->bridge->flowdb;
+  flowp = cache_entry->flow;
+  rv = LAGOPUS_RESULT_OK;
+  for (i = 0; i < cache_entry->nmatched; i++) {
+    flow = *flowp++;
+    dp_counter_add(flow->counter_id, 1, OS_M_PKTLEN(PKT2MBUF(pkt)));
+    if (flow->idle_timeout != 0 || flow->hard_timeout != 0) {
+      flow_update_hit_time(flow);
+    }
+    pkt->flow = flow;
+    pkt->table_id = flow->table_id;
+    /* cache_lookup() returns only the entry with unchanged tables. */
+    table = cache_entry->tables[i].table;
+    dp_counter_add(table->counter_id, 1, flow->priority > 0 ? 1 : 0);
+    rv = execute_instruction(pkt, (const struct instruction **)
+                             flow->instruction->index);
+    if (rv != LAGOPUS_RESULT_OK) {
+      break;
+    }
+  }
+  return rv;
+}
+
+static inline lagopus_result_t
+dp_openflow_do_cached_action(struct lagopus_packet *pkt) {
+  struct cache_entry *cache_entry;
+  lagopus_result_t rv;
 
-  calc_packet_hash(pkt);
   cache_entry = cache_lookup(pkt->cache, pkt);
   if (likely(cache_entry != NULL)) {
     DP_PRINT("MATCHED (cache)\n");
     pkt->flags |= PKT_FLAG_CACHED_FLOW;
-    flowp = cache_entry->flow;
-
-    rv = LAGOPUS_RESULT_OK;
-    for (i = 0; i < cache_entry->nmatched; i++) {
-      flow = *flowp++;
-      flow->packet_count++;
-      flow->byte_count += OS_M_PKTLEN(PKT2MBUF(pkt));
-      if (flow->idle_timeout != 0 || flow->hard_timeout != 0) {
-        flow->update_time = get_current_time();
-      }
-      pkt->flow = flow;
-      pkt->table_id = flow->table_id;
-      table = table_lookup(flowdb, pkt->table_id);
-#ifdef DIAGNOSTIC
-      if (table == NULL) {
-        printf("cache_entry->flow[%u].table_id = %d, invalid\n",
-               i, flow->table_id);
-      }
-#endif /* DIAGNOSTIC */
-      table->lookup_count++;
-      if (likely(flow->priority > 0)) {
-        table->matched_count++;
-      }
-      rv = execute_instruction(pkt,
-                               (const struct instruction **)flow->instruction);
-      if (rv != LAGOPUS_RESULT_OK) {
-        break;
-      }
+    if (likely(cache_entry->prog != NULL)) {
+      rv = dp_openflow_do_cached_prog(pkt, cache_entry->prog);
+    } else {
+      rv = dp_openflow_do_cached_flows(pkt, cache_entry);
     }
   } else {
     rv = LAGOPUS_RESULT_NOT_FOUND;
@@ -2807,7 +3188,7 @@ dp_openflow_match(struct lagopus_packet *pkt) {
     return LAGOPUS_RESULT_STOP;
   }
 
-  table->lookup_count++;
+  dp_counter_add(table->counter_id, 1, 0);
 #ifdef USE_MBTREE
   flow = find_mbtree(pkt, table->flow_list);
 #else
@@ -2839,8 +3220,8 @@ dp_openflow_do_action(struct lagopus_packet *pkt) {
   lagopus_result_t rv;
 
   flow = pkt->flow;
-  rv = execute_instruction(pkt,
-                           (const struct instruction **)flow->instruction);
+  rv = execute_instruction(pkt, (const struct instruction **)
+                           flow->instruction->index);
 
   return rv;
 }
@@ -2872,11 +3253,23 @@ dp_openflow_do_action_set(struct lagopus_packet *pkt) {
   return rv;
 }
 
+static inline lagopus_result_t
+dp_openflow_finish(struct lagopus_packet *pkt, lagopus_result_t rv) {
+  if (rv == LAGOPUS_RESULT_OK) {
+    rv = dp_openflow_do_action_set(pkt);
+  }
+  /* required: if no output action, drop packet. */
+  if (rv != LAGOPUS_RESULT_NO_MORE_ACTION) {
+    lagopus_packet_free(pkt);
+  }
+  return rv;
+}
+
 /*
- * process received packet.
+ * process received packet, hash value is already calculated.
  */
-lagopus_result_t
-lagopus_match_and_action(struct lagopus_packet *pkt) {
+static lagopus_result_t
+dp_openflow_match_and_action(struct lagopus_packet *pkt) {
   lagopus_result_t rv;
 
   rv = dp_openflow_do_cached_action(pkt);
@@ -2892,14 +3285,122 @@ lagopus_match_and_action(struct lagopus_packet *pkt) {
       }
     }
   }
-  if (rv == LAGOPUS_RESULT_OK) {
-    rv = dp_openflow_do_action_set(pkt);
+  return dp_openflow_finish(pkt, rv);
+}
+
+/*
+ * process received packet.
+ */
+lagopus_result_t
+lagopus_match_and_action(struct lagopus_packet *pkt) {
+  calc_packet_hash(pkt);
+  return dp_openflow_match_and_action(pkt);
+}
+
+/**
+ * Execute cached flows over the packets which hit the same cache entry.
+ * Compiled ops are applied to the group in order, and a packet leaves
+ * the group when an op does not return LAGOPUS_RESULT_OK.
+ */
+static void
+dp_openflow_do_cached_action_group(struct cache_entry *cache_entry,
+                                   struct lagopus_packet *pkts[],
+                                   lagopus_result_t rvs[],
+                                   size_t n) {
+  const struct cache_prog *prog;
+  const struct cache_op *op;
+  uint64_t bytes;
+  size_t i, nactive;
+
+  for (i = 0; i < n; i++) {
+    pkts[i]->flags |= PKT_FLAG_CACHED_FLOW;
+    rvs[i] = LAGOPUS_RESULT_OK;
+  }
+  prog = cache_entry->prog;
+  if (unlikely(prog == NULL)) {
+    for (i = 0; i < n; i++) {
+      rvs[i] = dp_openflow_do_cached_flows(pkts[i], cache_entry);
+    }
+    return;
   }
-  /* required: if no output action, drop packet. */
-  if (rv != LAGOPUS_RESULT_NO_MORE_ACTION) {
-    lagopus_packet_free(pkt);
+  nactive = n;
+  for (op = prog->ops; op < &prog->ops[prog->nops] && nactive > 0; op++) {
+    if (op->type == CACHE_OP_FLOW) {
+      bytes = 0;
+      for (i = 0; i < n; i++) {
+        if (rvs[i] == LAGOPUS_RESULT_OK) {
+          bytes += OS_M_PKTLEN(PKT2MBUF(pkts[i]));
+        }
+      }
+      cache_op_count(op, nactive, bytes);
+    }
+    for (i = 0; i < n; i++) {
+      if (rvs[i] != LAGOPUS_RESULT_OK) {
+        continue;
+      }
+      rvs[i] = cache_op_exec(pkts[i], op);
+      if (rvs[i] != LAGOPUS_RESULT_OK) {
+        nactive--;
+      }
+    }
+  }
+}
+
+/*
+ * process a burst of received packets.
+ */
+void
+lagopus_match_and_action_bulk(struct lagopus_packet *pkts[], size_t n) {
+  struct cache_entry *entries[LAGOPUS_DP_BULK_MAX];
+  struct lagopus_packet *group[LAGOPUS_DP_BULK_MAX];
+  lagopus_result_t rvs[LAGOPUS_DP_BULK_MAX];
+  bool cached[LAGOPUS_DP_BULK_MAX];
+  struct cache_entry *cache_entry;
+  size_t i, j, ngroup, nhit, off, chunk;
+
+  for (off = 0; off < n; off += chunk) {
+    chunk = n - off;
+    if (chunk > LAGOPUS_DP_BULK_MAX) {
+      chunk = LAGOPUS_DP_BULK_MAX;
+    }
+    for (i = off; i < off + chunk; i++) {
+      calc_packet_hash(pkts[i]);
+    }
+    nhit = cache_lookup_bulk(pkts[off]->cache, &pkts[off], chunk, entries);
+    for (i = 0; i < chunk; i++) {
+      cached[i] = (entries[i] != NULL);
+    }
+
+    /* packets of the same entry are processed together, in arrival order. */
+    for (i = 0; i < chunk && nhit > 0; i++) {
+      cache_entry = entries[i];
+      if (cache_entry == NULL) {
+        continue;
+      }
+      ngroup = 0;
+      for (j = i; j < chunk; j++) {
+        if (entries[j] == cache_entry) {
+          group[ngroup++] = pkts[off + j];
+          entries[j] = NULL;
+        }
+      }
+      nhit -= ngroup;
+      DP_PRINT("MATCHED (cache, %zu packets)\n", ngroup);
+      dp_openflow_do_cached_action_group(cache_entry, group, rvs, ngroup);
+      for (j = 0; j < ngroup; j++) {
+        (void)dp_openflow_finish(group[j], rvs[j]);
+      }
+    }
+    /*
+     * missed packets.  lookup again to register the key, earlier
+     * missed packets of the same flow may be registered already.
+     */
+    for (i = 0; i < chunk; i++) {
+      if (cached[i] == false) {
+        (void)dp_openflow_match_and_action(pkts[off + i]);
+      }
+    }
   }
-  return rv;
 }
 
 #ifdef HYBRID
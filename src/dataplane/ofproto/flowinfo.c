@@ -19,60 +19,248 @@
  *      @brief  Flow database optimized for speed.
  */
 
+#include "lagopus_apis.h"
 #include "lagopus/flowdb.h"
 #include "lagopus/flowinfo.h"
+#include "rcu.h"
 
 static void add_flow(struct flow *, struct table *);
 static void del_flow(struct flow *, struct table *);
-static struct flow *find_flow(struct flow *, struct table *);
+static void publish_flow(struct table *);
+static lagopus_result_t set_classifier(struct table *, uint8_t);
+
+/*
+ * Changes of the standby flowinfo not applied to the other copy yet.
+ */
+struct standby_change {
+  struct flow *flow;
+  bool add;
+};
+
+struct standby_log {
+  int nchange;
+  int alloced;
+  struct standby_change *change;
+};
 
 void
 flowinfo_init(void) {
+  match_basic_init();
   lagopus_add_flow_hook = add_flow;
   lagopus_del_flow_hook = del_flow;
-  lagopus_find_flow_hook = find_flow;
+  lagopus_publish_flow_hook = publish_flow;
+  lagopus_set_classifier_hook = set_classifier;
+}
+
+static struct flowinfo *
+new_flowinfo_root_classifier(struct table *table, uint8_t classifier) {
+  if (classifier == FLOW_CLASSIFIER_TUPLE) {
+    /* dispatch by ETH_TYPE, other fields are in the tuple space. */
+    return new_flowinfo_eth_type_tuple();
+  }
+  if (table->table_id == 0) {
+    /* at first, match by ETH_TYPE for table 0 */
+    return new_flowinfo_vlan_vid();
+  } else {
+    /* at first, match by metadata for other table */
+    return new_flowinfo_metadata_mask();
+  }
+}
+
+static struct flowinfo *
+new_flowinfo_root(struct table *table) {
+  return new_flowinfo_root_classifier(table, table->classifier);
+}
+
+/*
+ * Flowinfo of the table is doubled.  Dataplane refers table->userdata,
+ * writer modifies table->standby and logs the change.  publish_flow()
+ * swaps them, waits for the dataplane to leave the old one, and then
+ * applies the logged changes to it.  flowdb publishes after each
+ * flow_mod, or once per table at the end of the flow_mod batch.
+ */
+static lagopus_result_t
+standby_log_add(struct table *table, struct flow *flow, bool add) {
+  struct standby_log *log;
+  struct standby_change *change;
+  int alloced;
+
+  log = table->standby_log;
+  if (log == NULL) {
+    log = calloc(1, sizeof(struct standby_log));
+    if (log == NULL) {
+      return LAGOPUS_RESULT_NO_MEMORY;
+    }
+    table->standby_log = log;
+  }
+  if (log->nchange == log->alloced) {
+    alloced = (log->alloced == 0) ? 16 : log->alloced * 2;
+    change = realloc(log->change,
+                     (size_t)alloced * sizeof(struct standby_change));
+    if (change == NULL) {
+      return LAGOPUS_RESULT_NO_MEMORY;
+    }
+    log->change = change;
+    log->alloced = alloced;
+  }
+  log->change[log->nchange].flow = flow;
+  log->change[log->nchange].add = add;
+  log->nchange++;
+  return LAGOPUS_RESULT_OK;
+}
+
+static void
+swap_flowinfo(struct table *table) {
+  struct standby_log *log;
+  struct flowinfo *flowinfo;
+  int i;
+
+  flowinfo = table->userdata;
+  DP_RCU_ASSIGN_POINTER(table->userdata, table->standby);
+  table->standby = flowinfo;
+  dp_rcu_synchronize();
+  log = table->standby_log;
+  if (log != NULL) {
+    for (i = 0; i < log->nchange; i++) {
+      if (log->change[i].add == true) {
+        flowinfo->add_func(flowinfo, log->change[i].flow);
+      } else {
+        flowinfo->del_func(flowinfo, log->change[i].flow);
+      }
+    }
+    log->nchange = 0;
+  }
+}
+
+static void
+publish_flow(struct table *table) {
+  struct standby_log *log;
+
+  log = table->standby_log;
+  if (log != NULL && log->nchange != 0) {
+    swap_flowinfo(table);
+  }
+}
+
+/*
+ * Accumulate header bits examined by the flow, for wildcard cache.
+ */
+static void
+add_wildcard(struct flow *flow, struct table *table) {
+  int i, off;
+
+  for (i = 0; i < MAX_BASE; i++) {
+    table->wildcard[i].bits |= flow->byteoff_match[i].bits;
+    for (off = 0; off < 32; off++) {
+      table->wildcard[i].masks[off] |= flow->byteoff_match[i].masks[off];
+    }
+  }
 }
 
 static void
 add_flow(struct flow *flow, struct table *table) {
   struct flowinfo *flowinfo;
 
-  if (table->userdata == NULL) {
-    if (table->table_id == 0) {
-      /* at first, match by ETH_TYPE for table 0 */
-      table->userdata = new_flowinfo_vlan_vid();
-    } else {
-      /* at first, match by metadata for other table */
-      table->userdata = new_flowinfo_metadata_mask();
+  if (table->standby == NULL) {
+    table->standby = new_flowinfo_root(table);
+    if (table->standby == NULL) {
+      return;
     }
-    if (table->userdata == NULL) {
+  }
+  if (table->userdata == NULL) {
+    flowinfo = new_flowinfo_root(table);
+    if (flowinfo == NULL) {
       return;
     }
+    DP_RCU_ASSIGN_POINTER(table->userdata, flowinfo);
   }
-  flowinfo = table->userdata;
+  flowinfo = table->standby;
   flowinfo->add_func(flowinfo, flow);
+  add_wildcard(flow, table);
+  if (standby_log_add(table, flow, true) != LAGOPUS_RESULT_OK) {
+    /* cannot be logged, publish now and add to the other copy. */
+    swap_flowinfo(table);
+    flowinfo = table->standby;
+    flowinfo->add_func(flowinfo, flow);
+  }
 }
 
+/*
+ * The flow is referred by the dataplane until publish_flow().
+ */
 static void
 del_flow(struct flow *flow, struct table *table) {
   struct flowinfo *flowinfo;
 
-  if (table->userdata == NULL) {
+  if (table->userdata == NULL || table->standby == NULL) {
     /* flows are not exist, nothing to do. */
     return;
   }
-  flowinfo = table->userdata;
+  flowinfo = table->standby;
   flowinfo->del_func(flowinfo, flow);
+  if (standby_log_add(table, flow, false) != LAGOPUS_RESULT_OK) {
+    swap_flowinfo(table);
+    flowinfo = table->standby;
+    flowinfo->del_func(flowinfo, flow);
+  }
 }
 
-static struct flow *
-find_flow(struct flow *flow, struct table *table) {
+static struct flowinfo *
+build_flowinfo(struct table *table, uint8_t classifier) {
   struct flowinfo *flowinfo;
+  struct flow_list *flow_list;
+  int i;
 
-  if (table->userdata == NULL) {
-    /* flows are not exist, nothing to do. */
+  flowinfo = new_flowinfo_root_classifier(table, classifier);
+  if (flowinfo == NULL) {
     return NULL;
   }
-  flowinfo = table->userdata;
-  return flowinfo->find_func(flowinfo, flow);
+  flow_list = table->flow_list;
+  for (i = 0; i < flow_list->nflow; i++) {
+    if (flowinfo->add_func(flowinfo, flow_list->flows[i])
+        != LAGOPUS_RESULT_OK) {
+      flowinfo->destroy_func(flowinfo);
+      return NULL;
+    }
+  }
+  return flowinfo;
+}
+
+/*
+ * Rebuild both copies of flowinfo with the classifier.  The old
+ * copies are destroyed after the dataplane leaves them.
+ */
+static lagopus_result_t
+set_classifier(struct table *table, uint8_t classifier) {
+  struct flowinfo *active, *standby, *old_active, *old_standby;
+
+  if (table->userdata == NULL && table->standby == NULL) {
+    /* created by add_flow() with table->classifier. */
+    return LAGOPUS_RESULT_OK;
+  }
+  active = build_flowinfo(table, classifier);
+  if (active == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  standby = build_flowinfo(table, classifier);
+  if (standby == NULL) {
+    active->destroy_func(active);
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  old_active = table->userdata;
+  old_standby = table->standby;
+  DP_RCU_ASSIGN_POINTER(table->userdata, active);
+  table->standby = standby;
+  if (table->standby_log != NULL) {
+    /* both copies are built from all flows of the table. */
+    ((struct standby_log *)table->standby_log)->nchange = 0;
+  }
+  dp_rcu_synchronize();
+  if (old_active != NULL) {
+    old_active->destroy_func(old_active);
+  }
+  if (old_standby != NULL) {
+    old_standby->destroy_func(old_standby);
+  }
+  return LAGOPUS_RESULT_OK;
 }
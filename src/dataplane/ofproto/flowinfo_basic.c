@@ -51,6 +51,7 @@
 #include "lagopus/dataplane.h"
 #include "pktbuf.h"
 #include "packet.h"
+#include "counter.h"
 
 #include "lagopus/flowinfo.h"
 
@@ -86,56 +87,232 @@ destroy_flowinfo_basic(struct flowinfo *);
 #define FIELD(n) ((n) << 1)
 #define FIELD_WITH_MASK(n) (((n) << 1) + 1)
 
-STATIC bool
-match_basic(const struct lagopus_packet *pkt, struct flow *flow) {
-  struct byteoff_match *match;
+/*
+ * Byte offset match kernels.  Each kernel scans the flows sorted by
+ * priority and returns the first one matching the packet, or NULL if
+ * none has higher priority than prio.  Header windows of the packet
+ * are loaded once and shared by the flows.
+ */
+typedef struct flow *
+(*match_flows_func_t)(const struct lagopus_packet *, struct flow * const *,
+                      int, int32_t);
+
+static inline int
+match_max_base(const struct lagopus_packet *pkt) {
+  if (unlikely(pkt->ether_type == ETHERTYPE_IPV6)) {
+    return MAX_BASE;
+  }
+  return OOB2_BASE + 1;
+}
+
+STATIC struct flow *
+match_flows_scalar(const struct lagopus_packet *pkt,
+                   struct flow * const *flows, int nflow, int32_t prio) {
+  const struct byteoff_match *match;
   uint8_t *base;
   uint32_t bits;
-  int off, i, max;
+  int off, i, n, max;
 
-  if (unlikely(pkt->ether_type == ETHERTYPE_IPV6)) {
-    max = MAX_BASE;
-  } else {
-    max = OOB2_BASE + 1;
+  max = match_max_base(pkt);
+  for (n = 0; n < nflow; n++) {
+    if (prio >= flows[n]->priority) {
+      break;
+    }
+    for (i = 0; i < max; i++) {
+      match = &flows[n]->byteoff_match[i];
+      if (match->bits == 0) {
+        continue;
+      }
+      base = pkt->base[i];
+      if (base == NULL) {
+        DPRINT("byteoff not matched (index=%d, base is NULL)\n", i);
+        goto next;
+      }
+      off = 0;
+      bits = match->bits;
+      do {
+        if ((bits & 0x0f) != 0) {
+          uint32_t b, m, c;
+
+          memcpy(&b, &base[off], sizeof(uint32_t));
+          memcpy(&m, &match->masks[off], sizeof(uint32_t));
+          memcpy(&c, &match->bytes[off], sizeof(uint32_t));
+          if ((b & m) != c) {
+            DPRINT("pkt 0x%04x, mask 0x%04x, flow 0x%04x\n", b, m, c);
+            DPRINT("byteoff not matched (index=%d, off=%d)\n", i, off);
+            goto next;
+          }
+        }
+        off += 4;
+        bits >>= 4;
+      } while (bits != 0);
+    }
+    DPRINT("byteoff matched\n");
+    return flows[n];
+ next:
+    ;
   }
-  for (i = 0; i < max; i++) {
-    match = &flow->byteoff_match[i];
-    if (match->bits == 0) {
-      continue;
+  return NULL;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATCH_SIMD
+#include <immintrin.h>
+
+/*
+ * Unused bytes of byteoff_match have zero mask and zero value, so the
+ * whole 16 or 32 byte window is compared at once.  The upper half is
+ * loaded only if the flow uses it.  Windows may be read up to
+ * BYTEOFF_MATCH_TAILROOM bytes beyond the packet data, which may be
+ * other data but must be mapped: mbuf and sock_buf are followed by
+ * their own memory, and raw socket ring frames near the end of the
+ * block are copied by rawsock_frame_packet().
+ */
+__attribute__((target("sse2")))
+STATIC struct flow *
+match_flows_sse2(const struct lagopus_packet *pkt,
+                 struct flow * const *flows, int nflow, int32_t prio) {
+  const struct byteoff_match *match;
+  __m128i win[MAX_BASE][2], v;
+  uint32_t loaded[2];
+  int i, n, max;
+
+  max = match_max_base(pkt);
+  loaded[0] = loaded[1] = 0;
+  for (n = 0; n < nflow; n++) {
+    if (prio >= flows[n]->priority) {
+      break;
     }
-    base = pkt->base[i];
-    if (base == NULL) {
-      DPRINT("byteoff not matched (index=%d, base is NULL)\n", i);
-      return false;
+    for (i = 0; i < max; i++) {
+      match = &flows[n]->byteoff_match[i];
+      if (match->bits == 0) {
+        continue;
+      }
+      if (unlikely(pkt->base[i] == NULL)) {
+        goto next;
+      }
+      if ((loaded[0] & (1U << i)) == 0) {
+        win[i][0] = _mm_loadu_si128((const __m128i *)pkt->base[i]);
+        loaded[0] |= 1U << i;
+      }
+      v = _mm_and_si128(win[i][0],
+                        _mm_loadu_si128((const __m128i *)match->masks));
+      v = _mm_cmpeq_epi8(v, _mm_loadu_si128((const __m128i *)match->bytes));
+      if (_mm_movemask_epi8(v) != 0xffff) {
+        goto next;
+      }
+      if ((match->bits & 0xffff0000) == 0) {
+        continue;
+      }
+      if ((loaded[1] & (1U << i)) == 0) {
+        win[i][1] = _mm_loadu_si128((const __m128i *)(pkt->base[i] + 16));
+        loaded[1] |= 1U << i;
+      }
+      v = _mm_and_si128(win[i][1],
+                        _mm_loadu_si128((const __m128i *)
+                                        (match->masks + 16)));
+      v = _mm_cmpeq_epi8(v, _mm_loadu_si128((const __m128i *)
+                                            (match->bytes + 16)));
+      if (_mm_movemask_epi8(v) != 0xffff) {
+        goto next;
+      }
     }
-    off = 0;
-    bits = match->bits;
-    do {
-      if ((bits & 0x0f) != 0) {
-        uint32_t b, m, c;
-
-        memcpy(&b, &base[off], sizeof(uint32_t));
-        memcpy(&m, &match->masks[off], sizeof(uint32_t));
-        memcpy(&c, &match->bytes[off], sizeof(uint32_t));
-        if ((b & m) != c) {
-          DPRINT("pkt 0x%04x, mask 0x%04x, flow 0x%04x\n", b, m, c);
-          DPRINT("byteoff not matched (index=%d, off=%d)\n", i, off);
-          return false;
+    return flows[n];
+ next:
+    ;
+  }
+  return NULL;
+}
+
+__attribute__((target("avx2")))
+STATIC struct flow *
+match_flows_avx2(const struct lagopus_packet *pkt,
+                 struct flow * const *flows, int nflow, int32_t prio) {
+  const struct byteoff_match *match;
+  __m256i win[MAX_BASE], v;
+  __m128i v128;
+  uint32_t loaded;
+  int i, n, max;
+
+  max = match_max_base(pkt);
+  loaded = 0;
+  for (n = 0; n < nflow; n++) {
+    if (prio >= flows[n]->priority) {
+      break;
+    }
+    for (i = 0; i < max; i++) {
+      match = &flows[n]->byteoff_match[i];
+      if (match->bits == 0) {
+        continue;
+      }
+      if (unlikely(pkt->base[i] == NULL)) {
+        goto next;
+      }
+      if ((match->bits & 0xffff0000) == 0 && (loaded & (1U << i)) == 0) {
+        /* lower half only, do not load the whole window. */
+        v128 = _mm_loadu_si128((const __m128i *)pkt->base[i]);
+        v128 = _mm_and_si128(v128, _mm_loadu_si128((const __m128i *)
+                                                   match->masks));
+        v128 = _mm_cmpeq_epi8(v128, _mm_loadu_si128((const __m128i *)
+                                                    match->bytes));
+        if (_mm_movemask_epi8(v128) != 0xffff) {
+          goto next;
         }
+        continue;
+      }
+      if ((loaded & (1U << i)) == 0) {
+        win[i] = _mm256_loadu_si256((const __m256i *)pkt->base[i]);
+        loaded |= 1U << i;
       }
-      off += 4;
-      bits >>= 4;
-    } while (bits != 0);
+      v = _mm256_and_si256(win[i],
+                           _mm256_loadu_si256((const __m256i *)match->masks));
+      v = _mm256_cmpeq_epi8(v, _mm256_loadu_si256((const __m256i *)
+                                                  match->bytes));
+      if ((uint32_t)_mm256_movemask_epi8(v) != 0xffffffff) {
+        goto next;
+      }
+    }
+    return flows[n];
+ next:
+    ;
   }
-  DPRINT("byteoff matched\n");
+  return NULL;
+}
+#endif /* __GNUC__ && (__x86_64__ || __i386__) */
 
-  if ((flow->flags & OFPFF_NO_PKT_COUNTS) == 0) {
-    flow->packet_count++;
+static match_flows_func_t match_flows = match_flows_scalar;
+
+void
+match_basic_init(void) {
+#ifdef MATCH_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    match_flows = match_flows_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    match_flows = match_flows_sse2;
+  } else {
+    match_flows = match_flows_scalar;
   }
-  if ((flow->flags & OFPFF_NO_BYT_COUNTS) == 0) {
-    flow->byte_count += OS_M_PKTLEN(PKT2MBUF(pkt));
+#endif /* MATCH_SIMD */
+}
+
+bool
+match_byteoff(const struct lagopus_packet *pkt, const struct flow *flow) {
+  struct flow *flows[1];
+
+  flows[0] = (struct flow *)flow;
+  return match_flows(pkt, flows, 1, INT32_MIN) != NULL;
+}
+
+STATIC bool
+match_basic(const struct lagopus_packet *pkt, struct flow *flow) {
+  if (match_byteoff(pkt, flow) == false) {
+    return false;
   }
 
+  /* stats readers hide counts for OFPFF_NO_PKT_COUNTS/NO_BYT_COUNTS. */
+  dp_counter_add(flow->counter_id, 1, OS_M_PKTLEN(PKT2MBUF(pkt)));
+
   return true;
 }
 
@@ -189,14 +366,19 @@ destroy_flowinfo_basic(struct flowinfo *self) {
 #define MAKE_BYTE_W(field, type, member, base)                  \
   MAKE_BYTEOFF_W(field, offsetof(struct type, member), base)
 
-/* analyze flow entry and make byte offset match. */
+/*
+ * analyze flow entry and make byte offset match.
+ * the result is built aside and copied at once, the flow may be
+ * referred by the dataplane already when it is added to standby
+ * flowinfo.
+ */
 void
 flow_make_match(struct flow *flow) {
-  struct byteoff_match *byteoff;
+  struct byteoff_match byteoff[MAX_BASE];
   struct match *match;
   uint16_t l3_ether_type = 0;
 
-  byteoff = flow->byteoff_match;
+  memset(byteoff, 0, sizeof(byteoff));
 
   TAILQ_FOREACH(match, &flow->match_list, entry) {
     switch (match->oxm_field) {
@@ -621,6 +803,7 @@ flow_make_match(struct flow *flow) {
         break;
     }
   }
+  memcpy(flow->byteoff_match, byteoff, sizeof(byteoff));
 }
 
 static lagopus_result_t
@@ -673,28 +856,19 @@ match_flow_basic(struct flowinfo *self, struct lagopus_packet *pkt,
                  int32_t *pri) {
   struct flow *matched;
   int32_t prio;
-  int i;
 
   prio = *pri;
-  matched = NULL;
-
-  for (i = 0; i < self->nflow; i++) {
-    struct flow *flow = self->flows[i];
-
-    if (prio >= flow->priority) {
-      break;
-    }
-    if (match_basic(pkt, flow) == true) {
-      matched = flow;
-      *pri = flow->priority;
-      break;
-    }
+  matched = match_flows(pkt, self->flows, self->nflow, prio);
+  if (matched != NULL) {
+    /* stats readers hide counts for OFPFF_NO_PKT_COUNTS/NO_BYT_COUNTS. */
+    dp_counter_add(matched->counter_id, 1, OS_M_PKTLEN(PKT2MBUF(pkt)));
+    *pri = matched->priority;
   }
   return matched;
 }
 
-static bool
-flow_compare(struct flow *f1, struct flow *f2) {
+bool
+flow_compare_basic(struct flow *f1, struct flow *f2) {
   struct match *m1;
   struct match *m2;
 
@@ -735,7 +909,7 @@ find_flow_basic(struct flowinfo *self, struct flow *flow) {
   int i;
 
   for (i = 0; i < self->nflow; i++) {
-    if (flow_compare(flow, self->flows[i]) == true) {
+    if (flow_compare_basic(flow, self->flows[i]) == true) {
       return self->flows[i];
     }
   }
@@ -79,6 +79,27 @@ new_flowinfo_eth_type(void) {
   return self;
 }
 
+/* userdata of eth_type flowinfo, children are tuple space search. */
+#define ETH_TYPE_TUPLE 1
+
+struct flowinfo *
+new_flowinfo_eth_type_tuple(void) {
+  struct flowinfo *self;
+
+  self = new_flowinfo_eth_type();
+  if (self != NULL) {
+    self->misc->destroy_func(self->misc);
+    self->misc = new_flowinfo_tuple();
+    if (self->misc == NULL) {
+      free(self->next);
+      free(self);
+      return NULL;
+    }
+    self->userdata = ETH_TYPE_TUPLE;
+  }
+  return self;
+}
+
 static void
 destroy_flowinfo_eth_type(struct flowinfo *self) {
   struct flowinfo *flowinfo;
@@ -106,22 +127,26 @@ add_flow_eth_type(struct flowinfo *self, struct flow *flow) {
   if (match != NULL) {
     eth_type = OS_NTOHS(eth_type);
     if (self->next[eth_type] == NULL) {
-      switch (eth_type) {
-        case ETHERTYPE_IP:
-          self->next[eth_type] = new_flowinfo_ipv4_dst_mask();
-          break;
-        case ETHERTYPE_IPV6:
-          self->next[eth_type] = new_flowinfo_ipv6();
-          break;
-        case ETHERTYPE_MPLS:
-        case ETHERTYPE_MPLS_MCAST:
-          self->next[eth_type] = new_flowinfo_mpls();
-          break;
-        case ETHERTYPE_ARP:
-        case ETHERTYPE_PBB:
-        default:
-          self->next[eth_type] = new_flowinfo_basic();
-          break;
+      if (self->userdata == ETH_TYPE_TUPLE) {
+        self->next[eth_type] = new_flowinfo_tuple();
+      } else {
+        switch (eth_type) {
+          case ETHERTYPE_IP:
+            self->next[eth_type] = new_flowinfo_ipv4_dst_mask();
+            break;
+          case ETHERTYPE_IPV6:
+            self->next[eth_type] = new_flowinfo_ipv6();
+            break;
+          case ETHERTYPE_MPLS:
+          case ETHERTYPE_MPLS_MCAST:
+            self->next[eth_type] = new_flowinfo_mpls();
+            break;
+          case ETHERTYPE_ARP:
+          case ETHERTYPE_PBB:
+          default:
+            self->next[eth_type] = new_flowinfo_basic();
+            break;
+        }
       }
     }
     match->except_flag = true;
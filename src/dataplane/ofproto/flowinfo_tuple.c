@@ -0,0 +1,439 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   flowinfo_tuple.c
+ *      @brief  Optimized flow database for dataplane, tuple space search
+ *
+ * Flows are grouped into subtables by the masks of byte offset match.
+ * Each subtable is a hash table keyed by the masked bytes, so lookup
+ * cost depends on the number of distinct masks, not on the number of
+ * flows.  Subtables are sorted by the max priority of their flows and
+ * the search stops when no remaining subtable can have higher priority.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "openflow.h"
+#include "lagopus/ethertype.h"
+#include "lagopus/flowdb.h"
+#include "lagopus/dataplane.h"
+#include "pktbuf.h"
+#include "packet.h"
+#include "counter.h"
+
+#include "lagopus/flowinfo.h"
+
+#define TUPLE_INITIAL_BUCKETS 16
+
+/**
+ * @brief Flow entry in the subtable.
+ */
+struct tuple_entry {
+  struct tuple_entry *next;     /** next entry in the bucket. */
+  uint32_t hash;                /** hash of masked bytes. */
+  struct flow *flow;            /** flow. */
+};
+
+/**
+ * @brief Flows with the same match masks.
+ */
+struct flowinfo_subtable {
+  struct byteoff_match mask[MAX_BASE];  /** bits and masks, bytes unused. */
+  int nbase;                    /** last used base + 1. */
+  int32_t max_priority;         /** max priority of the flows. */
+  int nflow;                    /** number of flows. */
+  uint32_t nbucket;             /** number of buckets, power of 2. */
+  struct tuple_entry **bucket;  /** chains sorted by priority. */
+};
+
+static lagopus_result_t
+add_flow_tuple(struct flowinfo *, struct flow *);
+static lagopus_result_t
+del_flow_tuple(struct flowinfo *, struct flow *);
+static struct flow *
+match_flow_tuple(struct flowinfo *, struct lagopus_packet *, int32_t *);
+static struct flow *
+find_flow_tuple(struct flowinfo *, struct flow *);
+static void
+destroy_flowinfo_tuple(struct flowinfo *);
+
+struct flowinfo *
+new_flowinfo_tuple(void) {
+  struct flowinfo *self;
+
+  self = calloc(1, sizeof(struct flowinfo));
+  if (self != NULL) {
+    self->add_func = add_flow_tuple;
+    self->del_func = del_flow_tuple;
+    self->match_func = match_flow_tuple;
+    self->find_func = find_flow_tuple;
+    self->destroy_func = destroy_flowinfo_tuple;
+  }
+  return self;
+}
+
+static void
+subtable_free(struct flowinfo_subtable *st) {
+  struct tuple_entry *entry, *next;
+  uint32_t i;
+
+  for (i = 0; i < st->nbucket; i++) {
+    for (entry = st->bucket[i]; entry != NULL; entry = next) {
+      next = entry->next;
+      free(entry);
+    }
+  }
+  free(st->bucket);
+  free(st);
+}
+
+static void
+destroy_flowinfo_tuple(struct flowinfo *self) {
+  unsigned int i;
+
+  for (i = 0; i < self->nnext; i++) {
+    subtable_free(self->subtables[i]);
+  }
+  free(self->subtables);
+  free(self);
+}
+
+/*
+ * masked bytes are hashed by 32bit word, same as match_basic() compares.
+ */
+static inline uint32_t
+tuple_hash(const struct flowinfo_subtable *st, uint8_t * const *base) {
+  const struct byteoff_match *mask;
+  uint32_t hash, bits, b, m;
+  int i, off;
+
+  hash = 0;
+  for (i = 0; i < st->nbase; i++) {
+    mask = &st->mask[i];
+    if (mask->bits == 0) {
+      continue;
+    }
+    off = 0;
+    bits = mask->bits;
+    do {
+      if ((bits & 0x0f) != 0) {
+        memcpy(&b, &base[i][off], sizeof(uint32_t));
+        memcpy(&m, &mask->masks[off], sizeof(uint32_t));
+        hash ^= b & m;
+        hash *= 0x9e3779b1U;
+        hash ^= hash >> 15;
+      }
+      off += 4;
+      bits >>= 4;
+    } while (bits != 0);
+  }
+  return hash ^ (hash >> 16);
+}
+
+static inline uint32_t
+flow_hash(const struct flowinfo_subtable *st, const struct flow *flow) {
+  uint8_t *base[MAX_BASE];
+  int i;
+
+  for (i = 0; i < st->nbase; i++) {
+    base[i] = (uint8_t *)flow->byteoff_match[i].bytes;
+  }
+  return tuple_hash(st, base);
+}
+
+static void
+flow_mask(const struct flow *flow, struct byteoff_match *mask) {
+  int i;
+
+  memset(mask, 0, sizeof(struct byteoff_match) * MAX_BASE);
+  for (i = 0; i < MAX_BASE; i++) {
+    mask[i].bits = flow->byteoff_match[i].bits;
+    memcpy(mask[i].masks, flow->byteoff_match[i].masks,
+           sizeof(mask[i].masks));
+  }
+}
+
+static struct flowinfo_subtable *
+subtable_lookup(struct flowinfo *self, const struct byteoff_match *mask,
+                unsigned int *idx) {
+  unsigned int i;
+
+  for (i = 0; i < self->nnext; i++) {
+    if (memcmp(self->subtables[i]->mask, mask,
+               sizeof(struct byteoff_match) * MAX_BASE) == 0) {
+      if (idx != NULL) {
+        *idx = i;
+      }
+      return self->subtables[i];
+    }
+  }
+  return NULL;
+}
+
+static struct flowinfo_subtable *
+subtable_alloc(const struct byteoff_match *mask) {
+  struct flowinfo_subtable *st;
+  int i;
+
+  st = calloc(1, sizeof(struct flowinfo_subtable));
+  if (st == NULL) {
+    return NULL;
+  }
+  st->nbucket = TUPLE_INITIAL_BUCKETS;
+  st->bucket = calloc(st->nbucket, sizeof(struct tuple_entry *));
+  if (st->bucket == NULL) {
+    free(st);
+    return NULL;
+  }
+  memcpy(st->mask, mask, sizeof(st->mask));
+  for (i = 0; i < MAX_BASE; i++) {
+    if (mask[i].bits != 0) {
+      st->nbase = i + 1;
+    }
+  }
+  st->max_priority = -1;
+  return st;
+}
+
+static void
+bucket_insert(struct flowinfo_subtable *st, struct tuple_entry *entry) {
+  struct tuple_entry **pp;
+
+  pp = &st->bucket[entry->hash & (st->nbucket - 1)];
+  while (*pp != NULL && (*pp)->flow->priority >= entry->flow->priority) {
+    pp = &(*pp)->next;
+  }
+  entry->next = *pp;
+  *pp = entry;
+}
+
+static void
+subtable_grow(struct flowinfo_subtable *st) {
+  struct tuple_entry **old, *entry, *next;
+  uint32_t i, nold;
+
+  old = st->bucket;
+  nold = st->nbucket;
+  st->bucket = calloc(nold * 2, sizeof(struct tuple_entry *));
+  if (st->bucket == NULL) {
+    /* keep current size, chains get longer. */
+    st->bucket = old;
+    return;
+  }
+  st->nbucket = nold * 2;
+  for (i = 0; i < nold; i++) {
+    for (entry = old[i]; entry != NULL; entry = next) {
+      next = entry->next;
+      bucket_insert(st, entry);
+    }
+  }
+  free(old);
+}
+
+/*
+ * keep subtables sorted by max priority, descending.
+ */
+static void
+subtable_sort(struct flowinfo *self) {
+  struct flowinfo_subtable *st;
+  unsigned int i, j;
+
+  for (i = 1; i < self->nnext; i++) {
+    st = self->subtables[i];
+    for (j = i; j > 0 &&
+         self->subtables[j - 1]->max_priority < st->max_priority; j--) {
+      self->subtables[j] = self->subtables[j - 1];
+    }
+    self->subtables[j] = st;
+  }
+}
+
+static lagopus_result_t
+add_flow_tuple(struct flowinfo *self, struct flow *flow) {
+  struct byteoff_match mask[MAX_BASE];
+  struct flowinfo_subtable *st, **subtables;
+  struct tuple_entry *entry;
+
+  flow_make_match(flow);
+  flow_mask(flow, mask);
+
+  entry = calloc(1, sizeof(struct tuple_entry));
+  if (entry == NULL) {
+    return LAGOPUS_RESULT_NO_MEMORY;
+  }
+  st = subtable_lookup(self, mask, NULL);
+  if (st == NULL) {
+    subtables = realloc(self->subtables,
+                        sizeof(struct flowinfo_subtable *) * (self->nnext + 1));
+    if (subtables == NULL) {
+      free(entry);
+      return LAGOPUS_RESULT_NO_MEMORY;
+    }
+    self->subtables = subtables;
+    st = subtable_alloc(mask);
+    if (st == NULL) {
+      free(entry);
+      return LAGOPUS_RESULT_NO_MEMORY;
+    }
+    self->subtables[self->nnext++] = st;
+  }
+  if ((uint32_t)st->nflow >= st->nbucket * 2) {
+    subtable_grow(st);
+  }
+  entry->flow = flow;
+  entry->hash = flow_hash(st, flow);
+  bucket_insert(st, entry);
+  st->nflow++;
+  if (flow->priority > st->max_priority) {
+    st->max_priority = flow->priority;
+    subtable_sort(self);
+  }
+  self->nflow++;
+  return LAGOPUS_RESULT_OK;
+}
+
+static lagopus_result_t
+del_flow_tuple(struct flowinfo *self, struct flow *flow) {
+  struct byteoff_match mask[MAX_BASE];
+  struct flowinfo_subtable *st;
+  struct tuple_entry **pp, *entry;
+  unsigned int idx;
+  uint32_t i;
+
+  flow_mask(flow, mask);
+  st = subtable_lookup(self, mask, &idx);
+  if (st == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+  pp = &st->bucket[flow_hash(st, flow) & (st->nbucket - 1)];
+  while (*pp != NULL && (*pp)->flow != flow) {
+    pp = &(*pp)->next;
+  }
+  if (*pp == NULL) {
+    return LAGOPUS_RESULT_NOT_FOUND;
+  }
+  entry = *pp;
+  *pp = entry->next;
+  free(entry);
+  st->nflow--;
+  self->nflow--;
+
+  if (st->nflow == 0) {
+    subtable_free(st);
+    self->nnext--;
+    memmove(&self->subtables[idx], &self->subtables[idx + 1],
+            sizeof(struct flowinfo_subtable *) * (self->nnext - idx));
+    return LAGOPUS_RESULT_OK;
+  }
+  if (flow->priority == st->max_priority) {
+    /* head of each chain has the highest priority in the chain. */
+    st->max_priority = -1;
+    for (i = 0; i < st->nbucket; i++) {
+      if (st->bucket[i] != NULL &&
+          st->bucket[i]->flow->priority > st->max_priority) {
+        st->max_priority = st->bucket[i]->flow->priority;
+      }
+    }
+    subtable_sort(self);
+  }
+  return LAGOPUS_RESULT_OK;
+}
+
+static struct flow *
+match_flow_tuple(struct flowinfo *self, struct lagopus_packet *pkt,
+                 int32_t *pri) {
+  struct flowinfo_subtable *st;
+  struct tuple_entry *entry;
+  struct flow *matched;
+  uint32_t hash;
+  int32_t prio;
+  unsigned int i;
+  int j, nbase;
+
+  prio = *pri;
+  matched = NULL;
+
+  /* same as match_basic(), IPv6 bases are valid only for IPv6. */
+  if (unlikely(pkt->ether_type == ETHERTYPE_IPV6)) {
+    nbase = MAX_BASE;
+  } else {
+    nbase = OOB2_BASE + 1;
+  }
+  for (i = 0; i < self->nnext; i++) {
+    st = self->subtables[i];
+    if (prio >= st->max_priority) {
+      break;
+    }
+    if (st->nbase > nbase) {
+      continue;
+    }
+    for (j = 0; j < st->nbase; j++) {
+      if (st->mask[j].bits != 0 && pkt->base[j] == NULL) {
+        break;
+      }
+    }
+    if (j < st->nbase) {
+      continue;
+    }
+    hash = tuple_hash(st, pkt->base);
+    for (entry = st->bucket[hash & (st->nbucket - 1)];
+         entry != NULL;
+         entry = entry->next) {
+      if (prio >= entry->flow->priority) {
+        break;
+      }
+      if (entry->hash == hash && match_byteoff(pkt, entry->flow) == true) {
+        matched = entry->flow;
+        prio = matched->priority;
+        break;
+      }
+    }
+  }
+  if (matched != NULL) {
+    /* stats readers hide counts for OFPFF_NO_PKT_COUNTS/NO_BYT_COUNTS. */
+    dp_counter_add(matched->counter_id, 1, OS_M_PKTLEN(PKT2MBUF(pkt)));
+    *pri = prio;
+  }
+  return matched;
+}
+
+static struct flow *
+find_flow_tuple(struct flowinfo *self, struct flow *flow) {
+  struct byteoff_match mask[MAX_BASE];
+  struct flowinfo_subtable *st;
+  struct tuple_entry *entry;
+  uint32_t hash;
+
+  /* the flow is not added yet, make match to know the masks. */
+  flow_make_match(flow);
+  flow_mask(flow, mask);
+  st = subtable_lookup(self, mask, NULL);
+  if (st == NULL) {
+    return NULL;
+  }
+  hash = flow_hash(st, flow);
+  for (entry = st->bucket[hash & (st->nbucket - 1)];
+       entry != NULL;
+       entry = entry->next) {
+    if (entry->hash == hash &&
+        flow_compare_basic(flow, entry->flow) == true) {
+      return entry->flow;
+    }
+  }
+  return NULL;
+}
@@ -23,6 +23,9 @@
 
 #include <inttypes.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include <sys/queue.h>
@@ -49,6 +52,7 @@
 #include "lagopus/flowinfo.h"
 #include "pktbuf.h"
 #include "packet.h"
+#include "rcu.h"
 #include "mbtree.h"
 
 #include <netinet/if_ether.h>
@@ -68,6 +72,14 @@ enum {
 
 #define DPRINTF(...)
 
+/*
+ * rebuild parameters.
+ */
+#define MBTREE_BUILD_THREADS_MAX        8       /* max threads to build */
+#define MBTREE_PARALLEL_MIN_FLOWS       1024    /* build in parallel if more */
+#define MBTREE_UPDATE_MIN               64      /* in place updates allowed
+                                                   before rebuild */
+
 #define MAKE_MATCH_IDX(base, type, member,  mask, shift)        \
   { base, offsetof(struct type, member), sizeof(((struct type *)0)->member), mask, shift }
 #define OXM_FIELD_TYPE(field) ((field) >> 1)
@@ -137,6 +149,8 @@ static void
 build_mbtree_child(struct flow_list *flow_list, void *arg);
 static struct flow *
 find_mbtree_child(struct lagopus_packet *pkt, struct flow_list *flows);
+static void
+free_mbtree_node(void *arg);
 
 static struct match *
 get_match_eth_type(struct match_list *match_list, uint16_t *eth_type) {
@@ -254,6 +268,14 @@ get_match_stats_array(struct flow_list *flow_list) {
   TAILQ_INIT(&match_stats_list);
   nmatch = count_flow_list_match(flow_list, &match_stats_list);
   match_array = calloc(nmatch + 1, sizeof(struct match_stats *));
+  if (match_array == NULL) {
+    while (TAILQ_FIRST(&match_stats_list) != NULL) {
+      match_array = (void *)TAILQ_FIRST(&match_stats_list);
+      TAILQ_REMOVE(&match_stats_list, TAILQ_FIRST(&match_stats_list), entry);
+      free(match_array);
+    }
+    return NULL;
+  }
   for (i = 0; i < nmatch; i++) {
     match_array[i] = TAILQ_FIRST(&match_stats_list);
     TAILQ_REMOVE(&match_stats_list, TAILQ_FIRST(&match_stats_list), entry);
@@ -262,6 +284,16 @@ get_match_stats_array(struct flow_list *flow_list) {
   return match_array;
 }
 
+static void
+free_match_stats_array(struct match_stats **match_array) {
+  int i;
+
+  for (i = 0; match_array[i] != NULL; i++) {
+    free(match_array[i]);
+  }
+  free(match_array);
+}
+
 static struct match *
 get_match_field(struct match_list *match_list, struct match *match_stats) {
   struct match *match;
@@ -314,16 +346,13 @@ get_shifted_value(uint8_t origin[],
   }
 }
 
-static void *
-get_child_flow_list(struct flow_list *flow_list,
-                    struct match *match,
-                    struct match_stats *most_match,
-                    void *child_array[]) {
-  uint8_t key[sizeof(uint64_t)];
-  void *child;
-  lagopus_result_t rv;
+static inline void
+get_child_key(struct flow_list *flow_list,
+              struct match *match,
+              uint8_t key[]) {
   int i;
 
+  memset(key, 0, sizeof(uint64_t));
   get_shifted_value(match->oxm_value,
                     OXM_MATCH_VALUE_LEN(match),
                     flow_list->shift, flow_list->keylen, key);
@@ -332,18 +361,38 @@ get_child_flow_list(struct flow_list *flow_list,
     DPRINTF(" %d", match->oxm_value[i]);
   }
   DPRINTF(" keylen %d, key %d\n", flow_list->keylen, *(void **)key);
+}
+
+static void *
+get_child_flow_list(struct flow_list *flow_list,
+                    struct match *match,
+                    struct match_stats *most_match,
+                    void *child_array[]) {
+  uint8_t key[sizeof(uint64_t)];
+  void *child;
+  lagopus_result_t rv;
+
+  (void) most_match;
+
+  get_child_key(flow_list, match, key);
   switch (flow_list->type) {
     case HASHMAP:
       if (child_array[0] == NULL) {
-        child_array[0] = calloc(1, sizeof(lagopus_hashmap_t));
-        lagopus_hashmap_create((void *)&child_array[0],
-                               LAGOPUS_HASHMAP_TYPE_ONE_WORD, cleanup_mbtree);
+        rv = lagopus_hashmap_create((void *)&child_array[0],
+                                    LAGOPUS_HASHMAP_TYPE_ONE_WORD,
+                                    free_mbtree_node);
+        if (rv != LAGOPUS_RESULT_OK) {
+          return NULL;
+        }
       }
       rv = lagopus_hashmap_find_no_lock((void *)&child_array[0], *(void **)key, &child);
       if (rv != LAGOPUS_RESULT_OK) {
         void *val;
 
         child = calloc(1, sizeof(struct flow_list) + sizeof(void *));
+        if (child == NULL) {
+          return NULL;
+        }
         val = child;
         lagopus_hashmap_add_no_lock((void *)&child_array[0], *(void **)key, &val, false);
       }
@@ -356,11 +405,19 @@ get_child_flow_list(struct flow_list *flow_list,
   return child;
 }
 
-static void
+static bool
 set_flow_list_desc(struct flow_list *flow_list,
-                   struct match_stats *match_stats) {
+                   const struct match_stats *match_stats) {
+  size_t size;
   int idx;
 
+  /* kept for distributing flows added after the build. */
+  size = sizeof(struct match) + match_stats->match.oxm_length;
+  flow_list->split = malloc(size);
+  if (flow_list->split == NULL) {
+    return false;
+  }
+  memcpy(flow_list->split, &match_stats->match, size);
   flow_list->type = HASHMAP;
   idx = OXM_FIELD_TYPE(match_stats->match.oxm_field);
   flow_list->base = match_idx[idx].base;
@@ -368,6 +425,7 @@ set_flow_list_desc(struct flow_list *flow_list,
   flow_list->shift = match_idx[idx].shift;
   flow_list->keylen = match_idx[idx].size;
   get_mask(match_idx[idx].mask, match_idx[idx].size, flow_list->mask);
+  return true;
 }
 
 static void
@@ -463,7 +521,13 @@ build_mbtree_child(struct flow_list *flow_list,
   }
 
   /* set flow_list type and related values */
-  set_flow_list_desc(flow_list, most_match);
+  if (flow_list->flows_dontcare == NULL ||
+      set_flow_list_desc(flow_list, most_match) == false) {
+    free(flow_list->flows_dontcare);
+    flow_list->flows_dontcare = NULL;
+    build_mbtree_sequencial(flow_list);
+    return;
+  }
 
   DPRINTF("most_match: oxm_field %d\n", most_match->match.oxm_field);
   DPRINTF("most_match: oxm_length %d\n", most_match->match.oxm_length);
@@ -569,97 +633,329 @@ dump_mbtree(struct flow_list *flows) {
 }
 #endif
 
+static struct flow_list *
+alloc_mbtree_root(void) {
+  struct flow_list *root;
+
+  root = calloc(1, sizeof(struct flow_list) + sizeof(void *) * 65536);
+  if (root != NULL) {
+    root->nbranch = 65536;
+  }
+  return root;
+}
+
+/*
+ * free node and its descendants.  value free function of the hashmap.
+ */
+static void
+free_mbtree_node(void *arg) {
+  struct flow_list *flow_list;
+
+  flow_list = arg;
+  if (flow_list == NULL) {
+    return;
+  }
+  if (flow_list->type == HASHMAP && flow_list->branch[0] != NULL) {
+    lagopus_hashmap_destroy((lagopus_hashmap_t *)&flow_list->branch[0], true);
+  }
+  if (flow_list->basic != NULL) {
+    flow_list->basic->destroy_func(flow_list->basic);
+  }
+  free_mbtree_node(flow_list->flows_dontcare);
+  free(flow_list->split);
+  free(flow_list->flows);
+  free(flow_list);
+}
+
+static void
+free_mbtree_root(struct flow_list *root) {
+  int i;
+
+  if (root == NULL) {
+    return;
+  }
+  for (i = 0; i < root->nbranch; i++) {
+    free_mbtree_node(root->branch[i]);
+  }
+  free_mbtree_node(root);
+}
+
+/*
+ * child of the root, decided by ether type.
+ */
+static struct flow_list **
+get_root_child(struct flow_list *root, struct flow *flow) {
+  struct match *match;
+  uint16_t eth_type;
+
+  match = get_match_eth_type(&flow->match_list, &eth_type);
+  if (match != NULL) {
+    match->except_flag = true;
+    return (struct flow_list **)&root->branch[ntohs(eth_type)];
+  }
+  return &root->flows_dontcare;
+}
+
+static void
+build_mbtree_subtree(struct flow_list *flow_list) {
+  struct match_stats **match_array;
+
+  match_array = get_match_stats_array(flow_list);
+  if (match_array == NULL) {
+    build_mbtree_sequencial(flow_list);
+    return;
+  }
+  build_mbtree_child(flow_list, match_array);
+  free_match_stats_array(match_array);
+}
+
+/**
+ * Subtrees of the root, shared by build threads.
+ */
+struct mbtree_build_job {
+  struct flow_list **subtrees;  /** subtrees, larger first */
+  int nsubtree;                 /** number of subtrees */
+  int next;                     /** next subtree to be built */
+};
+
+static void *
+build_mbtree_worker(void *arg) {
+  struct mbtree_build_job *job;
+  int i;
+
+  job = arg;
+  while ((i = __sync_fetch_and_add(&job->next, 1)) < job->nsubtree) {
+    build_mbtree_subtree(job->subtrees[i]);
+  }
+  return NULL;
+}
+
+static int
+subtree_cmp(const void *a, const void *b) {
+  const struct flow_list *fa, *fb;
+
+  fa = *(struct flow_list * const *)a;
+  fb = *(struct flow_list * const *)b;
+
+  return fb->nflow - fa->nflow;
+}
+
+/*
+ * subtrees have no shared node, build them by multiple threads.
+ */
+static void
+build_mbtree_parallel(struct mbtree_build_job *job, int nflow) {
+  pthread_t tids[MBTREE_BUILD_THREADS_MAX - 1];
+  long ncpu;
+  int i, nthread;
+
+  qsort(job->subtrees, (size_t)job->nsubtree, sizeof(struct flow_list *),
+        subtree_cmp);
+  job->next = 0;
+  nthread = 0;
+  if (nflow >= MBTREE_PARALLEL_MIN_FLOWS && job->nsubtree > 1) {
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu > MBTREE_BUILD_THREADS_MAX) {
+      ncpu = MBTREE_BUILD_THREADS_MAX;
+    }
+    if (ncpu > job->nsubtree) {
+      ncpu = job->nsubtree;
+    }
+    /* calling thread is one of the builders. */
+    nthread = (int)ncpu - 1;
+  }
+  for (i = 0; i < nthread; i++) {
+    if (pthread_create(&tids[i], NULL, build_mbtree_worker, job) != 0) {
+      break;
+    }
+  }
+  nthread = i;
+  build_mbtree_worker(job);
+  for (i = 0; i < nthread; i++) {
+    pthread_join(tids[i], NULL);
+  }
+}
+
 void
 build_mbtree(struct flow_list *flows) {
-  struct flow_list **childp;
+  struct flow_list *root, *old, **childp;
+  struct mbtree_build_job job;
   struct flow *flow;
-  struct match *match;
-  struct match_stats **match_array;
-  uint16_t eth_type;
   int i;
 
+  root = alloc_mbtree_root();
+  if (root == NULL) {
+    return;
+  }
+  job.subtrees = calloc((size_t)root->nbranch + 1, sizeof(struct flow_list *));
+  if (job.subtrees == NULL) {
+    free(root);
+    return;
+  }
   /* store flow into child flow_list. */
   for (i = 0; i < flows->nflow; i++) {
     flow = flows->flows[i];
-    match = get_match_eth_type(&flow->match_list, &eth_type);
-    if (match != NULL) {
-      match->except_flag = true;
-      childp = &flows->branch[ntohs(eth_type)];
-    } else {
-      childp = &flows->flows_dontcare;
-    }
+    childp = get_root_child(root, flow);
     if (*childp == NULL) {
-      *childp = calloc(1, sizeof(struct flow_list)
-                       + sizeof(void *) * 65536);
-      (*childp)->nbranch = 65536;
+      *childp = calloc(1, sizeof(struct flow_list) + sizeof(void *));
+      if (*childp == NULL) {
+        goto fail;
+      }
+    }
+    if (flow_add_sub(flow, *childp) != LAGOPUS_RESULT_OK) {
+      goto fail;
     }
-    flow_add_sub(flow, *childp);
   }
   /* process for each child flow_list. */
-  for (i = 0; i < flows->nbranch; i++) {
-    if (flows->branch[i] != NULL) {
-      match_array = get_match_stats_array(flows->branch[i]);
-      build_mbtree_child(flows->branch[i], match_array);
-      free(match_array);
+  job.nsubtree = 0;
+  for (i = 0; i < root->nbranch; i++) {
+    if (root->branch[i] != NULL) {
+      job.subtrees[job.nsubtree++] = root->branch[i];
     }
   }
-  if (flows->flows_dontcare != NULL) {
-    match_array = get_match_stats_array(flows->flows_dontcare);
-    build_mbtree_child(flows->flows_dontcare, match_array);
-    free(match_array);
+  if (root->flows_dontcare != NULL) {
+    job.subtrees[job.nsubtree++] = root->flows_dontcare;
   }
+  build_mbtree_parallel(&job, flows->nflow);
+  free(job.subtrees);
 #if 0
-  dump_mbtree(flows);
+  dump_mbtree(root);
 #endif
-}
 
-static void
-free_mbtree(int type, void *arg) {
-  struct flow_list *flow_list;
-  int i;
-
-  if (arg != NULL) {
-    switch (type) {
-      case HASHMAP:
-        lagopus_hashmap_destroy(arg, true);
-        break;
-
-      case SEQUENCIAL:
-        flow_list = arg;
-        if (flow_list->basic != NULL) {
-          flow_list->basic->destroy_func(flow_list->basic);
-        }
-        free(flow_list);
-        break;
-    }
+  /* publish, then free the old tree after readers leave. */
+  old = flows->mbtree;
+  DP_RCU_ASSIGN_POINTER(flows->mbtree, root);
+  flows->mbtree_updates = 0;
+  if (old != NULL) {
+    dp_rcu_synchronize();
+    free_mbtree_root(old);
   }
+  return;
+
+fail:
+  free(job.subtrees);
+  free_mbtree_root(root);
 }
 
 void
 cleanup_mbtree(struct flow_list *flows) {
-  int i, type;
+  struct flow_list *old;
 
   if (flows->update_timer != NULL) {
     *flows->update_timer = NULL;
+    flows->update_timer = NULL;
   }
-  type = flows->type;
-  flows->type = SEQUENCIAL;
-  for (i = 0; i < flows->nbranch; i++) {
-    if (flows->branch[i] != NULL) {
-      free_mbtree(type, flows->branch[i]);
-      flows->branch[i] = NULL;
+  old = flows->mbtree;
+  if (old != NULL) {
+    flows->mbtree = NULL;
+    dp_rcu_synchronize();
+    free_mbtree_root(old);
+  }
+}
+
+/*
+ * child of the node where build_mbtree_child() distributes the flow.
+ */
+static struct flow_list *
+get_flow_child(struct flow_list *flow_list, struct flow *flow, bool create) {
+  uint8_t key[sizeof(uint64_t)];
+  struct match *match;
+  void *child;
+
+  match = get_match_field(&flow->match_list, flow_list->split);
+  if (match != NULL) {
+    if (create == true) {
+      return get_child_flow_list(flow_list, match, NULL, flow_list->branch);
+    }
+    get_child_key(flow_list, match, key);
+    if (lagopus_hashmap_find_no_lock((lagopus_hashmap_t *)&flow_list->branch[0],
+                                     *(void **)key, &child)
+        != LAGOPUS_RESULT_OK) {
+      return NULL;
     }
+    return child;
   }
-  if (flows->flows_dontcare != NULL) {
-    cleanup_mbtree(flows->flows_dontcare);
-    flows->flows_dontcare = NULL;
+  if (flow_list->flows_dontcare == NULL && create == true) {
+    flow_list->flows_dontcare = calloc(1, sizeof(struct flow_list)
+                                       + sizeof(void *));
+  }
+  return flow_list->flows_dontcare;
+}
+
+static inline bool
+mbtree_update_done(struct flow_list *flows) {
+  int limit;
+
+  limit = flows->nflow / 8;
+  if (limit < MBTREE_UPDATE_MIN) {
+    limit = MBTREE_UPDATE_MIN;
+  }
+  return ++flows->mbtree_updates <= limit;
+}
+
+bool
+mbtree_add_flow(struct flow_list *flows, struct flow *flow) {
+  struct flow_list *root, *flow_list, **childp;
+
+  root = flows->mbtree;
+  if (root == NULL) {
+    root = alloc_mbtree_root();
+    if (root == NULL) {
+      return false;
+    }
+    DP_RCU_ASSIGN_POINTER(flows->mbtree, root);
+  }
+  childp = get_root_child(root, flow);
+  if (*childp == NULL) {
+    *childp = calloc(1, sizeof(struct flow_list) + sizeof(void *));
+  }
+  flow_list = *childp;
+  while (flow_list != NULL && flow_list->type == HASHMAP) {
+    flow_list = get_flow_child(flow_list, flow, true);
+  }
+  if (flow_list == NULL) {
+    return false;
+  }
+  if (flow_list->basic == NULL) {
+    flow_list->basic = new_flowinfo_basic();
+    if (flow_list->basic == NULL) {
+      return false;
+    }
+  }
+  if (flow_list->basic->add_func(flow_list->basic, flow)
+      != LAGOPUS_RESULT_OK) {
+    return false;
+  }
+  return mbtree_update_done(flows);
+}
+
+bool
+mbtree_del_flow(struct flow_list *flows, struct flow *flow) {
+  struct flow_list *flow_list;
+
+  if (flows->mbtree == NULL) {
+    return true;
+  }
+  flow_list = *get_root_child(flows->mbtree, flow);
+  while (flow_list != NULL && flow_list->type == HASHMAP) {
+    flow_list = get_flow_child(flow_list, flow, false);
   }
+  if (flow_list == NULL || flow_list->basic == NULL ||
+      flow_list->basic->del_func(flow_list->basic, flow)
+      != LAGOPUS_RESULT_OK) {
+    return false;
+  }
+  return mbtree_update_done(flows);
 }
 
 struct flow *
 find_mbtree(struct lagopus_packet *pkt, struct flow_list *flows) {
   struct flow *flow, *alt_flow;
 
+  flows = flows->mbtree;
+  if (flows == NULL) {
+    return NULL;
+  }
   flow = find_mbtree_child(pkt, flows->branch[pkt->ether_type]);
   if (pkt->mpls != NULL) {
     alt_flow = find_mbtree_child(pkt,
@@ -685,40 +981,45 @@ find_mbtree(struct lagopus_packet *pkt, struct flow_list *flows) {
 
 static struct flow *
 find_mbtree_child(struct lagopus_packet *pkt, struct flow_list *flows) {
-  struct flow *flow;
+  struct flow *flow, *alt_flow;
   uint8_t *src;
   lagopus_result_t rv;
 
-  if (flows == NULL) {
-    return NULL;
-  }
-  while (flows->type == HASHMAP) {
+  flow = NULL;
+  while (flows != NULL && flows->type == HASHMAP) {
     uint8_t key[sizeof(uint64_t)];
     int i;
 
-    src = pkt->base[flows->base] + flows->match_off;
+    /* flows without the branch field may match as well. */
+    alt_flow = find_mbtree_child(pkt, flows->flows_dontcare);
+    if (alt_flow != NULL &&
+        (flow == NULL || alt_flow->priority > flow->priority)) {
+      flow = alt_flow;
+    }
+    src = pkt->base[flows->base];
+    if (src == NULL) {
+      return flow;
+    }
+    src += flows->match_off;
+    memset(key, 0, sizeof(key));
     for (i = 0; i < flows->keylen; i++) {
       key[i] = src[i] & flows->mask[i];
     }
     rv = lagopus_hashmap_find_no_lock(&flows->branch[0],
-                                      *(void **)key, &flows);
+                                      *(void **)key, (void **)&flows);
     if (rv != LAGOPUS_RESULT_OK) {
-      return NULL;
+      return flow;
     }
   }
+  if (flows == NULL) {
+    return flow;
+  }
   if (flows->basic != NULL) {
     int32_t pri = -1;
 
-    flow = flows->basic->match_func(flows->basic, pkt, &pri);
+    alt_flow = flows->basic->match_func(flows->basic, pkt, &pri);
     DPRINTF("find: basic: flow %p (nflow %d)\n",
-            flow, flows->basic->nflow);
-  } else {
-    flow = NULL;
-  }
-  if (flows->flows_dontcare != NULL) {
-    struct flow *alt_flow;
-
-    alt_flow = find_mbtree_child(pkt, flows->flows_dontcare);
+            alt_flow, flows->basic->nflow);
     if (alt_flow != NULL &&
         (flow == NULL || alt_flow->priority > flow->priority)) {
       flow = alt_flow;
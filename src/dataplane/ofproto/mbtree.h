@@ -17,12 +17,55 @@
 #ifndef SRC_DATAPLANE_OFPROTO_MBTREE_H_
 #define SRC_DATAPLANE_OFPROTO_MBTREE_H_
 
+#include <stdbool.h>
+
 struct flow;
 struct flow_list;
 struct lagopus_packet;
 
+/**
+ * Free the decision tree of the flow list.
+ *
+ * @param[in]   flows   Flow list of the table.
+ */
 void cleanup_mbtree(struct flow_list *flows);
+
+/**
+ * Build a new decision tree from all flows of the flow list, and
+ * publish it.  The old tree is freed after the dataplane leaves it.
+ * The tree is built aside, subtrees of each ether type are built by
+ * multiple threads if there are many flows.  The caller must prevent
+ * flows from being modified, e.g. by flowdb_mod_rdlock(), but the
+ * dataplane is not stopped.
+ *
+ * @param[in]   flows   Flow list of the table.
+ */
 void build_mbtree(struct flow_list *flows);
+
+/**
+ * Add the flow to the published decision tree in place.
+ * The dataplane must be stopped by flowdb_wrlock().
+ *
+ * @param[in]   flows   Flow list of the table.
+ * @param[in]   flow    Flow to be added.
+ *
+ * @retval      true    Tree is updated.
+ * @retval      false   Tree should be rebuilt by build_mbtree().
+ */
+bool mbtree_add_flow(struct flow_list *flows, struct flow *flow);
+
+/**
+ * Delete the flow from the published decision tree in place.
+ * The dataplane must be stopped by flowdb_wrlock().
+ *
+ * @param[in]   flows   Flow list of the table.
+ * @param[in]   flow    Flow to be deleted.
+ *
+ * @retval      true    Tree is updated.
+ * @retval      false   Tree should be rebuilt by build_mbtree().
+ */
+bool mbtree_del_flow(struct flow_list *flows, struct flow *flow);
+
 struct flow *find_mbtree(struct lagopus_packet *pkt, struct flow_list *flows);
 
 #endif /* SRC_DATAPLANE_OFPROTO_MBTREE_H_ */
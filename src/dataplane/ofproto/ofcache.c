@@ -26,10 +26,14 @@
 #include <inttypes.h>
 
 #include "lagopus_apis.h"
+#include "lagopus/bridge.h"
 #include "lagopus/flowdb.h"
+#include "lagopus/ethertype.h"
+#include "lagopus/port.h"
 
 #include "pktbuf.h"
 #include "packet.h"
+#include "City.h"
 
 #ifdef HAVE_DPDK
 #include <rte_version.h>
@@ -58,10 +62,54 @@
 #define FLOWCACHE_BITLEN 32
 #define FLOWCACHE_MAX_ENTRIES 100000
 
+/*
+ * open hash (FLOWCACHE_OPEN_HASH) parameters.
+ */
+#define OH_NWAYS        4       /* entries per bucket */
+#define OH_MAX_FLOWS    8       /* max flows per entry */
+#define OH_KEY_MAX      88      /* max length of extracted header data */
+
+/**
+ * Packet key.  Same header fields as calc_packet_hash() are extracted.
+ */
+struct flowcache_key {
+  uint32_t ifindex;                     /** input interface */
+  uint16_t ether_type;                  /** classified ether type */
+  uint16_t len;                         /** length of data */
+  uint8_t data[OH_KEY_MAX];             /** extracted header fields */
+};
+
+#define OH_KEY_SIZE(key) \
+  (offsetof(struct flowcache_key, data) + (key)->len)
+
+/**
+ * Open hash entry.  flow pointers follow cache_entry.
+ */
+struct oh_slot {
+  struct flowcache_key key;
+  uint8_t used;                         /** entry is valid */
+  uint8_t ref;                          /** referenced bit for CLOCK */
+  struct cache_entry entry;             /** must be last */
+};
+
+/**
+ * Open hash table, preallocated at initialization.
+ */
+struct oh_table {
+  uint32_t mask;                        /** number of buckets - 1 */
+  uint32_t hand;                        /** CLOCK hand */
+  size_t slot_size;                     /** size of each entry */
+  uint8_t *slots;                       /** entries */
+  bool pending_valid;                   /** pending key is valid */
+  uint64_t pending_hash;                /** hash64 of pending key */
+  struct flowcache_key pending;         /** key of the last missed packet */
+};
+
 struct flowcache_bank {
   int kvs_type;
   union {
     lagopus_hashmap_t hashmap;
+    struct oh_table *oht;
 #ifdef HAVE_DPDK
 #if RTE_VERSION >= RTE_VERSION_NUM(2, 1, 0, 0)
     struct rte_hash *hash;
@@ -82,6 +130,7 @@ struct flowcache {
   int used_bank;
   uint64_t max_entries;
   struct flowcache_bank *bank[NBANK];
+  struct mf_cache *mf;                  /** wildcard cache, or NULL */
 };
 
 TAILQ_HEAD(cache_entry_list, cache_entry);
@@ -91,6 +140,41 @@ struct cache_list {
   struct cache_entry_list entries;
 };
 
+/**
+ * Take references of tables which have matched flows.
+ */
+static inline void
+cache_entry_set_tables(struct cache_entry *cache_entry,
+                       unsigned nmatched,
+                       const struct flow **flow) {
+  unsigned i;
+
+  cache_entry->tables = (struct cache_table_ref *)
+                        (void *)&cache_entry->flow[nmatched];
+  for (i = 0; i < nmatched; i++) {
+    cache_entry->tables[i].table = table_lookup(flow[i]->bridge->flowdb,
+                                                flow[i]->table_id);
+    cache_entry->tables[i].generation =
+      cache_entry->tables[i].table->generation;
+  }
+}
+
+/**
+ * Check whether referenced tables are not changed after registration.
+ */
+static inline bool
+cache_entry_is_valid(const struct cache_entry *cache_entry) {
+  unsigned i;
+
+  for (i = 0; i < cache_entry->nmatched; i++) {
+    if (unlikely(cache_entry->tables[i].table->generation !=
+                 cache_entry->tables[i].generation)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 static struct cache_list *
 init_cache_list(void) {
   struct cache_list *list;
@@ -110,6 +194,19 @@ add_cache_list(struct cache_list *list, struct cache_entry *cache_entry) {
   list->nentries++;
 }
 
+/**
+ * Compile actions of the entry into its storage, which follows
+ * flows and tables of up to max flows.
+ */
+static inline void
+cache_entry_compile(struct cache_entry *cache_entry, unsigned max) {
+  void *buf;
+
+  buf = (uint8_t *)(void *)&cache_entry->flow[max] +
+        sizeof(struct cache_table_ref) * max;
+  cache_entry->prog = cache_prog_compile(buf, cache_entry);
+}
+
 static void
 remove_cache_list(struct cache_list *list, struct cache_entry *cache_entry) {
   TAILQ_REMOVE(&list->entries, cache_entry, next);
@@ -128,6 +225,608 @@ fini_cache_list(struct cache_list *list) {
   free(list);
 }
 
+static inline bool
+oh_key_append(struct flowcache_key *key, const void *data, size_t len) {
+  if (unlikely(key->len + len > OH_KEY_MAX)) {
+    return false;
+  }
+  memcpy(&key->data[key->len], data, len);
+  key->len = (uint16_t)(key->len + len);
+  return true;
+}
+
+static inline bool
+oh_key_append_l4(struct flowcache_key *key,
+                 const struct lagopus_packet *pkt) {
+  switch (*pkt->proto) {
+    case IPPROTO_ICMP:
+      return oh_key_append(key, pkt->l4_hdr, sizeof(uint8_t) * 2);
+    case IPPROTO_TCP:
+    case IPPROTO_UDP:
+    case IPPROTO_SCTP:
+      return oh_key_append(key, pkt->l4_hdr, sizeof(uint16_t) * 2);
+    case IPPROTO_ICMPV6:
+      if (oh_key_append(key, pkt->l4_hdr, sizeof(uint8_t) * 2) == false) {
+        return false;
+      }
+      if (pkt->nd_sll != NULL) {
+        return oh_key_append(key, &pkt->nd_sll[2], ETHER_ADDR_LEN);
+      } else if (pkt->nd_tll != NULL) {
+        return oh_key_append(key, &pkt->nd_tll[2], ETHER_ADDR_LEN);
+      }
+      return true;
+    default:
+      return true;
+  }
+}
+
+/**
+ * Extract packet key.  This must be kept in sync with calc_packet_hash().
+ *
+ * @retval      true    key is extracted.
+ * @retval      false   headers are too long to be cached.
+ */
+static bool
+oh_key_extract(struct flowcache_key *key, const struct lagopus_packet *pkt) {
+  key->ifindex = pkt->in_port->ifindex;
+  key->ether_type = pkt->ether_type;
+  key->len = 0;
+  if (oh_key_append(key, pkt->l2_hdr,
+                    (size_t)(pkt->l3_hdr - pkt->l2_hdr)) == false) {
+    return false;
+  }
+  switch (pkt->ether_type) {
+    case ETHERTYPE_IP:
+      if (oh_key_append(key, &pkt->ipv4->ip_tos,
+                        sizeof(pkt->ipv4->ip_tos)) == false ||
+          oh_key_append(key, &pkt->ipv4->ip_src,
+                        sizeof(pkt->ipv4->ip_src) << 1) == false ||
+          oh_key_append(key, &pkt->ipv4->ip_p,
+                        sizeof(pkt->ipv4->ip_p)) == false) {
+        return false;
+      }
+      return oh_key_append_l4(key, pkt);
+
+    case ETHERTYPE_IPV6:
+      if (oh_key_append(key, pkt->ipv6, 4) == false ||
+          oh_key_append(key, pkt->proto, 1) == false ||
+          oh_key_append(key, &pkt->ipv6->ip6_src,
+                        sizeof(struct in6_addr) << 1) == false) {
+        return false;
+      }
+      return oh_key_append_l4(key, pkt);
+
+    case ETHERTYPE_ARP:
+      return oh_key_append(key, pkt->arp->arp_sha,
+                           ETHER_ADDR_LEN * 2 + 4 + 4);
+
+    default:
+      return true;
+  }
+}
+
+static inline struct oh_slot *
+oh_slot_get(const struct oh_table *oht, uint32_t bucket, unsigned way) {
+  return (struct oh_slot *)(void *)
+         (oht->slots + ((size_t)bucket * OH_NWAYS + way) * oht->slot_size);
+}
+
+static inline uint32_t
+oh_alt_bucket(const struct oh_table *oht, uint32_t hash32_h, uint32_t hash32_l) {
+  return (hash32_h ^ (hash32_l * 0x5bd1e995U)) & oht->mask;
+}
+
+static struct oh_table *
+oh_table_create(uint64_t max_entries) {
+  struct oh_table *oht;
+  uint32_t nbuckets;
+
+  oht = calloc(1, sizeof(struct oh_table));
+  if (oht == NULL) {
+    return NULL;
+  }
+  /* power of 2, not exceed max_entries. */
+  nbuckets = 2;
+  while ((uint64_t)nbuckets * 2 * OH_NWAYS <= max_entries) {
+    nbuckets <<= 1;
+  }
+  oht->mask = nbuckets - 1;
+  oht->slot_size = sizeof(struct oh_slot) +
+                   (sizeof(struct flow *) + sizeof(struct cache_table_ref)) *
+                   OH_MAX_FLOWS + cache_prog_size();
+  /* keep flow pointers aligned. */
+  oht->slot_size = (oht->slot_size + sizeof(void *) - 1) &
+                   ~(sizeof(void *) - 1);
+  oht->slots = calloc((size_t)nbuckets * OH_NWAYS, oht->slot_size);
+  if (oht->slots == NULL) {
+    free(oht);
+    return NULL;
+  }
+  return oht;
+}
+
+static void
+oh_table_destroy(struct oh_table *oht) {
+  free(oht->slots);
+  free(oht);
+}
+
+static void
+oh_table_clear(struct oh_table *oht) {
+  struct oh_slot *slot;
+  uint32_t bucket;
+  unsigned way;
+
+  for (bucket = 0; bucket <= oht->mask; bucket++) {
+    for (way = 0; way < OH_NWAYS; way++) {
+      slot = oh_slot_get(oht, bucket, way);
+      slot->used = 0;
+    }
+  }
+  oht->pending_valid = false;
+}
+
+static inline struct oh_slot *
+oh_lookup_bucket(struct oh_table *oht, uint32_t bucket, uint64_t hash64,
+                 const struct flowcache_key *key) {
+  struct oh_slot *slot;
+  unsigned way;
+
+  for (way = 0; way < OH_NWAYS; way++) {
+    slot = oh_slot_get(oht, bucket, way);
+    if (slot->used != 0 &&
+        slot->entry.hash64 == hash64 &&
+        slot->key.len == key->len &&
+        memcmp(&slot->key, key, OH_KEY_SIZE(key)) == 0) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+static inline struct oh_slot *
+oh_find(struct oh_table *oht, uint64_t hash64,
+        const struct flowcache_key *key) {
+  struct oh_slot *slot;
+  union {
+    uint64_t hash64;
+    struct {
+      uint32_t hash32_h;
+      uint32_t hash32_l;
+    };
+  } val;
+  uint32_t b1, b2;
+
+  val.hash64 = hash64;
+  b1 = val.hash32_h & oht->mask;
+  slot = oh_lookup_bucket(oht, b1, hash64, key);
+  if (slot == NULL) {
+    b2 = oh_alt_bucket(oht, val.hash32_h, val.hash32_l);
+    if (b2 != b1) {
+      slot = oh_lookup_bucket(oht, b2, hash64, key);
+    }
+  }
+  return slot;
+}
+
+/**
+ * Prefetch primary bucket of the packet.  Only used and hash64
+ * are touched before the key is compared.
+ */
+static inline void
+oh_prefetch(const struct oh_table *oht, const struct lagopus_packet *pkt) {
+  uint32_t bucket;
+  unsigned way;
+
+  bucket = pkt->hash32_h & oht->mask;
+  for (way = 0; way < OH_NWAYS; way++) {
+    __builtin_prefetch(&oh_slot_get(oht, bucket, way)->used, 0, 3);
+  }
+}
+
+/**
+ * Lookup without capturing the pending key, for cache_lookup_bulk().
+ */
+static struct cache_entry *
+oh_probe(struct oh_table *oht, const struct lagopus_packet *pkt) {
+  struct flowcache_key key;
+  struct oh_slot *slot;
+
+  if (unlikely(oh_key_extract(&key, pkt) == false)) {
+    return NULL;
+  }
+  slot = oh_find(oht, pkt->hash64, &key);
+  if (likely(slot != NULL)) {
+    slot->ref = 1;
+    return &slot->entry;
+  }
+  return NULL;
+}
+
+static struct cache_entry *
+oh_lookup(struct oh_table *oht, const struct lagopus_packet *pkt) {
+  struct oh_slot *slot;
+
+  if (unlikely(oh_key_extract(&oht->pending, pkt) == false)) {
+    oht->pending_valid = false;
+    return NULL;
+  }
+  slot = oh_find(oht, pkt->hash64, &oht->pending);
+  if (likely(slot != NULL)) {
+    slot->ref = 1;
+    oht->pending_valid = false;
+    return &slot->entry;
+  }
+  oht->pending_valid = true;
+  oht->pending_hash = pkt->hash64;
+  return NULL;
+}
+
+/**
+ * Register pending key to the table.
+ *
+ * @retval      1       new entry is used.
+ * @retval      0       existing entry is replaced.
+ * @retval      -1      not registered.
+ */
+static int
+oh_register(struct oh_table *oht,
+            uint64_t hash64,
+            unsigned nmatched,
+            const struct flow **flow) {
+  struct oh_slot *slot, *cand[OH_NWAYS * 2];
+  union {
+    uint64_t hash64;
+    struct {
+      uint32_t hash32_h;
+      uint32_t hash32_l;
+    };
+  } val;
+  uint32_t b1, b2;
+  unsigned i, ncand, way;
+  int rv;
+
+  if (oht->pending_valid == false || oht->pending_hash != hash64 ||
+      nmatched > OH_MAX_FLOWS) {
+    return -1;
+  }
+  oht->pending_valid = false;
+
+  slot = NULL;
+  ncand = 0;
+  val.hash64 = hash64;
+  b1 = val.hash32_h & oht->mask;
+  b2 = oh_alt_bucket(oht, val.hash32_h, val.hash32_l);
+  for (way = 0; way < OH_NWAYS; way++) {
+    cand[ncand++] = oh_slot_get(oht, b1, way);
+  }
+  if (b2 != b1) {
+    for (way = 0; way < OH_NWAYS; way++) {
+      cand[ncand++] = oh_slot_get(oht, b2, way);
+    }
+  }
+  for (i = 0; i < ncand; i++) {
+    if (cand[i]->used == 0) {
+      slot = cand[i];
+      break;
+    }
+  }
+  if (slot != NULL) {
+    rv = 1;
+  } else {
+    /* CLOCK: evict first candidate not referenced since last sweep. */
+    for (i = 0; i < ncand * 2; i++) {
+      slot = cand[(oht->hand + i) % ncand];
+      if (slot->ref == 0) {
+        break;
+      }
+      slot->ref = 0;
+    }
+    oht->hand++;
+    rv = 0;
+  }
+  memcpy(&slot->key, &oht->pending, OH_KEY_SIZE(&oht->pending));
+  slot->entry.hash64 = hash64;
+  slot->entry.nmatched = nmatched;
+  memcpy(slot->entry.flow, flow, nmatched * sizeof(struct flow *));
+  cache_entry_set_tables(&slot->entry, nmatched, flow);
+  cache_entry_compile(&slot->entry, OH_MAX_FLOWS);
+  slot->ref = 0;
+  slot->used = 1;
+  return rv;
+}
+
+/**
+ * Drop stale entry.  If keep is true, the key captured by oh_lookup()
+ * is kept for re-registration, otherwise the pending key is dropped
+ * since it is not of the entry.
+ */
+static void
+oh_invalidate(struct oh_table *oht, struct cache_entry *cache_entry,
+              bool keep) {
+  struct oh_slot *slot;
+
+  slot = (struct oh_slot *)(void *)
+         ((uint8_t *)cache_entry - offsetof(struct oh_slot, entry));
+  slot->used = 0;
+  oht->pending_valid = keep;
+  oht->pending_hash = cache_entry->hash64;
+}
+
+/*
+ * wildcard cache parameters.
+ */
+#define MF_MAX_MASKS    16      /* max number of distinct masks */
+#define MF_MAX_ENTRIES  (FLOWCACHE_MAX_ENTRIES / 4)
+#define MF_WINDOW       32      /* bytes of byteoff_match for each base */
+
+/**
+ * Header windows of the last missed packet.
+ */
+struct mf_snapshot {
+  uint16_t ether_type;                  /** classified ether type */
+  uint16_t mpls_type;                   /** ether type of MPLS, or 0 */
+  uint8_t pbb;                          /** PBB header is present */
+  uint32_t basemap;                     /** bases present in the packet */
+  uint8_t data[MAX_BASE][MF_WINDOW];    /** header windows */
+};
+
+/**
+ * Wildcard cache, looked up when the exact match cache is missed.
+ * An entry covers all packets which have the same bits under its mask.
+ * The mask is the union of wildcards of the tables which have the
+ * matched flows, i.e. header bits examined by the flows in the tables.
+ * Entries of all masks are in one open hash table, keyed by the mask
+ * index and the masked header bytes.
+ */
+struct mf_cache {
+  struct oh_table *oht;                 /** entries */
+  unsigned nmasks;                      /** number of masks */
+  struct byteoff_mask masks[MF_MAX_MASKS][MAX_BASE];
+  bool pending_valid;                   /** pending snapshot is valid */
+  uint64_t pending_hash;                /** hash64 of the snapshot packet */
+  struct mf_snapshot pending;           /** snapshot of the missed packet */
+  uint64_t nentries;
+  uint64_t hit;
+};
+
+static void
+mf_snapshot_take(struct mf_snapshot *snap, const struct lagopus_packet *pkt) {
+  int i, max;
+
+  snap->ether_type = pkt->ether_type;
+  snap->mpls_type = 0;
+  if (pkt->mpls != NULL) {
+    OS_MEMCPY(&snap->mpls_type, ((const uint16_t *)(void *)pkt->mpls) - 1,
+              sizeof(uint16_t));
+  }
+  snap->pbb = (pkt->pbb != NULL);
+  snap->basemap = 0;
+  /* same range as byte offset match. */
+  if (pkt->ether_type == ETHERTYPE_IPV6) {
+    max = MAX_BASE;
+  } else {
+    max = OOB2_BASE + 1;
+  }
+  for (i = 0; i < max; i++) {
+    if (pkt->base[i] != NULL) {
+      snap->basemap |= 1U << i;
+      OS_MEMCPY(snap->data[i], pkt->base[i], MF_WINDOW);
+    }
+  }
+}
+
+/**
+ * Make key from the snapshot.
+ *
+ * @retval      true    key is made.
+ * @retval      false   masked bytes are too long to be cached.
+ */
+static bool
+mf_key_build(struct flowcache_key *key, unsigned idx,
+             const struct byteoff_mask *mask,
+             const struct mf_snapshot *snap) {
+  uint32_t basemap;
+  int i, off;
+
+  key->ifindex = idx;
+  key->ether_type = snap->ether_type;
+  key->len = 0;
+  basemap = 0;
+  for (i = 0; i < MAX_BASE; i++) {
+    if (mask[i].bits != 0) {
+      basemap |= 1U << i;
+    }
+  }
+  basemap &= snap->basemap;
+  if (oh_key_append(key, &snap->mpls_type, sizeof(snap->mpls_type)) == false ||
+      oh_key_append(key, &snap->pbb, sizeof(snap->pbb)) == false ||
+      oh_key_append(key, &basemap, sizeof(basemap)) == false) {
+    return false;
+  }
+  for (i = 0; i < MAX_BASE; i++) {
+    if ((basemap & (1U << i)) == 0) {
+      continue;
+    }
+    for (off = 0; off < MF_WINDOW; off++) {
+      if (mask[i].masks[off] != 0) {
+        if (unlikely(key->len >= OH_KEY_MAX)) {
+          return false;
+        }
+        key->data[key->len++] = snap->data[i][off] & mask[i].masks[off];
+      }
+    }
+  }
+  return true;
+}
+
+static inline uint64_t
+mf_key_hash(const struct flowcache_key *key) {
+  return CityHash64((const char *)key, OH_KEY_SIZE(key));
+}
+
+/**
+ * Next table examines headers of the packet modified by apply actions.
+ * If the actions change header layout, examined bytes are not in the
+ * snapshot of the original packet, then the flows are not covered.
+ */
+static bool
+mf_flows_cacheable(unsigned nmatched, const struct flow **flow) {
+  const struct instruction *insn;
+  const struct action *action;
+  unsigned i;
+
+  for (i = 0; i + 1 < nmatched; i++) {
+    insn = flow[i]->instruction->index[INSTRUCTION_INDEX_APPLY_ACTIONS];
+    if (insn == NULL) {
+      continue;
+    }
+    TAILQ_FOREACH(action, &insn->action_list, entry) {
+      switch (action->ofpat.type) {
+        case OFPAT_PUSH_MPLS:
+        case OFPAT_POP_MPLS:
+        case OFPAT_PUSH_PBB:
+        case OFPAT_POP_PBB:
+#ifdef GENERAL_TUNNEL_SUPPORT
+        case OFPAT_ENCAP:
+        case OFPAT_DECAP:
+#endif /* GENERAL_TUNNEL_SUPPORT */
+          return false;
+        default:
+          break;
+      }
+    }
+  }
+  return true;
+}
+
+static struct mf_cache *
+mf_cache_create(void) {
+  struct mf_cache *mf;
+
+  mf = calloc(1, sizeof(struct mf_cache));
+  if (mf == NULL) {
+    return NULL;
+  }
+  mf->oht = oh_table_create(MF_MAX_ENTRIES);
+  if (mf->oht == NULL) {
+    free(mf);
+    return NULL;
+  }
+  return mf;
+}
+
+static void
+mf_cache_clear(struct mf_cache *mf) {
+  oh_table_clear(mf->oht);
+  mf->nmasks = 0;
+  mf->nentries = 0;
+  mf->pending_valid = false;
+}
+
+static void
+mf_cache_destroy(struct mf_cache *mf) {
+  mf_cache_clear(mf);
+  oh_table_destroy(mf->oht);
+  free(mf);
+}
+
+/**
+ * Lookup wildcard cache.  On miss, the packet is kept as the pending
+ * snapshot for mf_register().
+ */
+static struct cache_entry *
+mf_lookup(struct mf_cache *mf, const struct lagopus_packet *pkt) {
+  struct flowcache_key key;
+  struct oh_slot *slot;
+  uint64_t hash64;
+  unsigned idx;
+
+  mf_snapshot_take(&mf->pending, pkt);
+  for (idx = 0; idx < mf->nmasks; idx++) {
+    if (mf_key_build(&key, idx, mf->masks[idx], &mf->pending) == false) {
+      continue;
+    }
+    hash64 = mf_key_hash(&key);
+    slot = oh_find(mf->oht, hash64, &key);
+    if (slot == NULL) {
+      continue;
+    }
+    if (likely(cache_entry_is_valid(&slot->entry))) {
+      slot->ref = 1;
+      mf->hit++;
+      mf->pending_valid = false;
+      return &slot->entry;
+    }
+    oh_invalidate(mf->oht, &slot->entry, false);
+    mf->nentries--;
+  }
+  mf->pending_valid = true;
+  mf->pending_hash = pkt->hash64;
+  return NULL;
+}
+
+/**
+ * Register flows matched by the pending snapshot.
+ */
+static void
+mf_register(struct mf_cache *mf,
+            uint64_t hash64,
+            unsigned nmatched,
+            const struct flow **flow) {
+  struct byteoff_mask mask[MAX_BASE];
+  struct table *table;
+  uint64_t key_hash;
+  uint32_t bits;
+  unsigned i, idx;
+  int base, off;
+
+  if (mf->pending_valid == false || mf->pending_hash != hash64) {
+    return;
+  }
+  mf->pending_valid = false;
+  if (nmatched == 0 || mf_flows_cacheable(nmatched, flow) == false) {
+    return;
+  }
+  memset(mask, 0, sizeof(mask));
+  bits = 0;
+  for (i = 0; i < nmatched; i++) {
+    table = table_lookup(flow[i]->bridge->flowdb, flow[i]->table_id);
+    for (base = 0; base < MAX_BASE; base++) {
+      mask[base].bits |= table->wildcard[base].bits;
+      for (off = 0; off < MF_WINDOW; off++) {
+        mask[base].masks[off] |= table->wildcard[base].masks[off];
+      }
+      bits |= mask[base].bits;
+    }
+  }
+  if (bits == 0) {
+    /* no header is examined, exact match cache is enough. */
+    return;
+  }
+  for (idx = 0; idx < mf->nmasks; idx++) {
+    if (memcmp(mf->masks[idx], mask, sizeof(mask)) == 0) {
+      break;
+    }
+  }
+  if (idx == mf->nmasks) {
+    if (mf->nmasks == MF_MAX_MASKS) {
+      return;
+    }
+    memcpy(mf->masks[idx], mask, sizeof(mask));
+    mf->nmasks++;
+  }
+  if (mf_key_build(&mf->oht->pending, idx, mask, &mf->pending) == false) {
+    return;
+  }
+  key_hash = mf_key_hash(&mf->oht->pending);
+  mf->oht->pending_valid = true;
+  mf->oht->pending_hash = key_hash;
+  if (oh_register(mf->oht, key_hash, nmatched, flow) > 0) {
+    mf->nentries++;
+  }
+}
+
 static struct flowcache_bank *
 init_flowcache_bank(int kvs_type, int bank) {
   struct flowcache_bank *cache;
@@ -159,6 +858,14 @@ init_flowcache_bank(int kvs_type, int bank) {
 #endif /* RTE_VERSION */
 #endif /* HAVE_DPDK */
 
+    case FLOWCACHE_OPEN_HASH:
+      cache->oht = oh_table_create(FLOWCACHE_MAX_ENTRIES);
+      if (cache->oht == NULL) {
+        free(cache);
+        return NULL;
+      }
+      break;
+
     case FLOWCACHE_HASHMAP:
     case FLOWCACHE_HASHMAP_NOLOCK:
     default:
@@ -181,11 +888,24 @@ register_cache_bank(struct flowcache_bank *cache,
   uint32_t hash32_h;
 
   DPRINTF("register cache (nmatched %d) to %p\n", nmatched, cache);
+  if (cache->kvs_type == FLOWCACHE_OPEN_HASH) {
+    if (oh_register(cache->oht, hash64, nmatched, flow) > 0) {
+      cache->nentries++;
+    }
+    return;
+  }
   cache_entry = calloc(1, sizeof(struct cache_entry) +
-                       sizeof(struct flow *) * nmatched);
+                       (sizeof(struct flow *) +
+                        sizeof(struct cache_table_ref)) * nmatched +
+                       cache_prog_size());
+  if (cache_entry == NULL) {
+    return;
+  }
   cache_entry->hash64 = hash64;
   cache_entry->nmatched = nmatched;
   memcpy(cache_entry->flow, flow, nmatched * sizeof(struct flow *));
+  cache_entry_set_tables(cache_entry, nmatched, flow);
+  cache_entry_compile(cache_entry, nmatched);
   hash32_h = cache_entry->hash32_h;
 
   switch (cache->kvs_type) {
@@ -278,6 +998,10 @@ clear_all_cache_bank(struct flowcache_bank *cache) {
 #endif /* RTE_VERSION */
 #endif /* HAVE_DPDK */
 
+    case FLOWCACHE_OPEN_HASH:
+      oh_table_clear(cache->oht);
+      break;
+
     case  FLOWCACHE_HASHMAP:
       lagopus_hashmap_clear(&cache->hashmap, true);
       break;
@@ -292,8 +1016,15 @@ clear_all_cache_bank(struct flowcache_bank *cache) {
   cache->miss = 0;
 }
 
+/**
+ * Lookup cache bank.
+ *
+ * If probe is true, miss is not counted and open hash does not
+ * capture the pending key.
+ */
 static struct cache_entry *
-cache_lookup_bank(struct flowcache_bank *cache, struct lagopus_packet *pkt) {
+cache_lookup_bank(struct flowcache_bank *cache, struct lagopus_packet *pkt,
+                  bool probe) {
   struct cache_entry *cache_entry;
   struct cache_list *list;
 
@@ -302,6 +1033,26 @@ cache_lookup_bank(struct flowcache_bank *cache, struct lagopus_packet *pkt) {
     return NULL;
   }
   DPRINTF("cache_lookup (hit %lu, miss %lu)\n", cache->hit, cache->miss);
+  if (cache->kvs_type == FLOWCACHE_OPEN_HASH) {
+    if (probe == true) {
+      cache_entry = oh_probe(cache->oht, pkt);
+    } else {
+      cache_entry = oh_lookup(cache->oht, pkt);
+    }
+    if (likely(cache_entry != NULL)) {
+      if (likely(cache_entry_is_valid(cache_entry))) {
+        cache->hit++;
+        return cache_entry;
+      }
+      /* probe does not capture the key of the packet. */
+      oh_invalidate(cache->oht, cache_entry, probe == false);
+      cache->nentries--;
+    }
+    if (probe == false) {
+      cache->miss++;
+    }
+    return NULL;
+  }
   switch (cache->kvs_type) {
 #ifdef HAVE_DPDK
 #if RTE_VERSION >= RTE_VERSION_NUM(2, 1, 0, 0)
@@ -335,12 +1086,20 @@ cache_lookup_bank(struct flowcache_bank *cache, struct lagopus_packet *pkt) {
   if (likely(list != NULL)) {
     TAILQ_FOREACH(cache_entry, &list->entries, next) {
       if (pkt->hash32_l == cache_entry->hash32_l) {
-        cache->hit++;
-        return cache_entry;
+        if (likely(cache_entry_is_valid(cache_entry))) {
+          cache->hit++;
+          return cache_entry;
+        }
+        /* flows are changed after registration, remove stale entry. */
+        remove_cache_list(list, cache_entry);
+        cache->nentries--;
+        break;
       }
     }
   }
-  cache->miss++;
+  if (probe == false) {
+    cache->miss++;
+  }
   return NULL;
 }
 
@@ -367,6 +1126,10 @@ fini_flowcache_bank(struct flowcache_bank *cache) {
 #endif /* RTE_VERSION */
 #endif /* HAVE_DPDK */
 
+    case FLOWCACHE_OPEN_HASH:
+      oh_table_destroy(cache->oht);
+      break;
+
     case  FLOWCACHE_HASHMAP:
     case  FLOWCACHE_HASHMAP_NOLOCK:
       lagopus_hashmap_destroy(&cache->hashmap, false);
@@ -387,26 +1150,35 @@ init_flowcache(int kvs_type) {
     return NULL;
   }
   for (bank = 0; bank < NBANK; bank++) {
+    if (kvs_type == FLOWCACHE_OPEN_HASH && bank > 0) {
+      /* open hash evicts by itself, alternate bank is unnecessary. */
+      break;
+    }
     cache->bank[bank] = init_flowcache_bank(kvs_type, bank);
     if (cache->bank[bank] == NULL) {
+      while (--bank >= 0) {
+        fini_flowcache_bank(cache->bank[bank]);
+      }
       free(cache);
       return NULL;
     }
   }
   cache->max_entries = FLOWCACHE_MAX_ENTRIES;
+  /* works without wildcard cache if memory is exhausted. */
+  cache->mf = mf_cache_create();
   return cache;
 }
 
-void
-register_cache(struct flowcache *cache,
-               uint64_t hash64,
-               unsigned nmatched,
-               const struct flow **flow) {
+static void
+register_cache_exact(struct flowcache *cache,
+                     uint64_t hash64,
+                     unsigned nmatched,
+                     const struct flow **flow) {
   struct flowcache_bank *bank, *alt_bank;
 
   bank = cache->bank[0];
   register_cache_bank(bank, hash64, nmatched, flow);
-  if (bank->nentries >= cache->max_entries / 2) {
+  if (cache->bank[1] != NULL && bank->nentries >= cache->max_entries / 2) {
     alt_bank = init_flowcache_bank(bank->kvs_type, cache->bank[1]->bank + 1);
     alt_bank->hit = cache->bank[1]->hit;
     alt_bank->miss = cache->bank[1]->miss;
@@ -416,6 +1188,17 @@ register_cache(struct flowcache *cache,
   }
 }
 
+void
+register_cache(struct flowcache *cache,
+               uint64_t hash64,
+               unsigned nmatched,
+               const struct flow **flow) {
+  register_cache_exact(cache, hash64, nmatched, flow);
+  if (cache->mf != NULL) {
+    mf_register(cache->mf, hash64, nmatched, flow);
+  }
+}
+
 void
 clear_all_cache(struct flowcache *cache) {
   int bank;
@@ -424,9 +1207,12 @@ clear_all_cache(struct flowcache *cache) {
     /* flowcache is not running, nothing to do. */
     return;
   }
-  for (bank = 0; bank < NBANK; bank++) {
+  for (bank = 0; bank < NBANK && cache->bank[bank] != NULL; bank++) {
     clear_all_cache_bank(cache->bank[bank]);
   }
+  if (cache->mf != NULL) {
+    mf_cache_clear(cache->mf);
+  }
 }
 
 struct cache_entry *
@@ -436,13 +1222,56 @@ cache_lookup(struct flowcache *cache, struct lagopus_packet *pkt) {
   if (cache == NULL) {
     return NULL;
   }
-  rv = cache_lookup_bank(cache->bank[0], pkt);
-  if (rv == NULL) {
-    rv = cache_lookup_bank(cache->bank[1], pkt);
+  rv = cache_lookup_bank(cache->bank[0], pkt, false);
+  if (rv == NULL && cache->bank[1] != NULL) {
+    rv = cache_lookup_bank(cache->bank[1], pkt, false);
+  }
+  if (rv == NULL && cache->mf != NULL) {
+    rv = mf_lookup(cache->mf, pkt);
+    if (rv != NULL) {
+      /* promote to exact match cache, key is captured by miss above. */
+      register_cache_exact(cache, pkt->hash64, rv->nmatched,
+                           (const struct flow **)rv->flow);
+    }
   }
   return rv;
 }
 
+size_t
+cache_lookup_bulk(struct flowcache *cache,
+                  struct lagopus_packet *pkts[],
+                  size_t n,
+                  struct cache_entry *entries[]) {
+  size_t i, nhit;
+  int bank;
+
+  if (cache == NULL) {
+    for (i = 0; i < n; i++) {
+      entries[i] = NULL;
+    }
+    return 0;
+  }
+  /* issue all bucket loads before the first key compare. */
+  for (bank = 0; bank < NBANK && cache->bank[bank] != NULL; bank++) {
+    if (cache->bank[bank]->kvs_type == FLOWCACHE_OPEN_HASH) {
+      for (i = 0; i < n; i++) {
+        oh_prefetch(cache->bank[bank]->oht, pkts[i]);
+      }
+    }
+  }
+  nhit = 0;
+  for (i = 0; i < n; i++) {
+    entries[i] = cache_lookup_bank(cache->bank[0], pkts[i], true);
+    if (entries[i] == NULL && cache->bank[1] != NULL) {
+      entries[i] = cache_lookup_bank(cache->bank[1], pkts[i], true);
+    }
+    if (entries[i] != NULL) {
+      nhit++;
+    }
+  }
+  return nhit;
+}
+
 void
 get_flowcache_statistics(struct flowcache *cache, struct ofcachestat *st) {
   struct flowcache_bank *bank;
@@ -451,20 +1280,29 @@ get_flowcache_statistics(struct flowcache *cache, struct ofcachestat *st) {
   st->nentries = 0;
   st->hit = 0;
   st->miss = 0;
-  for (i = 0; i < NBANK; i++) {
+  st->wildcard_entries = 0;
+  st->wildcard_hit = 0;
+  for (i = 0; i < NBANK && cache->bank[i] != NULL; i++) {
     bank = cache->bank[i];
     st->nentries += bank->nentries;
     st->hit += bank->hit;
     st->miss += bank->miss;
   }
+  if (cache->mf != NULL) {
+    st->wildcard_entries = cache->mf->nentries;
+    st->wildcard_hit = cache->mf->hit;
+  }
 }
 
 void
 fini_flowcache(struct flowcache *cache) {
   int bank;
 
-  for (bank = 0; bank < NBANK; bank++) {
+  for (bank = 0; bank < NBANK && cache->bank[bank] != NULL; bank++) {
     fini_flowcache_bank(cache->bank[bank]);
   }
+  if (cache->mf != NULL) {
+    mf_cache_destroy(cache->mf);
+  }
   free(cache);
 }
@@ -222,6 +222,12 @@ enum {
  */
 #define LAGOPUS_DP_PIPELINE_MAX 254
 
+/**
+ * max number of packets classified at once by
+ * lagopus_match_and_action_bulk().
+ */
+#define LAGOPUS_DP_BULK_MAX 64
+
 #define MBUF2PKT(m) ((struct lagopus_packet *)&(m)[1])
 #define PKT2MBUF(p) (&((OS_MBUF *)(p))[-1])
 
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unity.h"
+
+#include "lagopus/flowdb.h"
+#include "lagopus/port.h"
+#include "pktbuf.h"
+#include "packet.h"
+#include "lagopus/dataplane.h"
+#include "lagopus/flowinfo.h"
+#include "datapath_test_misc.h"
+
+#define NFLOWS 4
+
+static struct flowinfo *flowinfo;
+static struct flow *flows[NFLOWS];
+
+void
+setUp(void) {
+  int i;
+
+  flowinfo = new_flowinfo_eth_type_tuple();
+  TEST_ASSERT_NOT_NULL(flowinfo);
+  for (i = 0; i < NFLOWS; i++) {
+    flows[i] = allocate_test_flow(10 * sizeof(struct match));
+    TEST_ASSERT_NOT_NULL(flows[i]);
+  }
+}
+
+void
+tearDown(void) {
+  int i;
+
+  for (i = 0; i < NFLOWS; i++) {
+    free_test_flow(flows[i]);
+    flows[i] = NULL;
+  }
+  flowinfo->destroy_func(flowinfo);
+  flowinfo = NULL;
+}
+
+/*
+ * ACL style rules:
+ *   flows[0] pri 10: ipv4, tcp
+ *   flows[1] pri 20: ipv4, tcp, src 10.0.0.0/8
+ *   flows[2] pri 30: ipv4, tcp, src 10.0.0.0/8, dst port 80
+ *   flows[3] pri 40: ipv4, tcp, src 10.1.0.0/16, dst port 80
+ */
+static void
+add_acl_flows(void) {
+  int i;
+
+  for (i = 0; i < NFLOWS; i++) {
+    flows[i]->priority = (i + 1) * 10;
+    add_match(&flows[i]->match_list, 2, OFPXMT_OFB_ETH_TYPE << 1,
+              0x08, 0x00);
+    add_match(&flows[i]->match_list, 1, OFPXMT_OFB_IP_PROTO << 1,
+              IPPROTO_TCP);
+  }
+  add_match(&flows[1]->match_list, 8, (OFPXMT_OFB_IPV4_SRC << 1) + 1,
+            10, 0, 0, 0, 255, 0, 0, 0);
+  add_match(&flows[2]->match_list, 8, (OFPXMT_OFB_IPV4_SRC << 1) + 1,
+            10, 0, 0, 0, 255, 0, 0, 0);
+  add_match(&flows[2]->match_list, 2, OFPXMT_OFB_TCP_DST << 1,
+            0, 80);
+  add_match(&flows[3]->match_list, 8, (OFPXMT_OFB_IPV4_SRC << 1) + 1,
+            10, 1, 0, 0, 255, 255, 0, 0);
+  add_match(&flows[3]->match_list, 2, OFPXMT_OFB_TCP_DST << 1,
+            0, 80);
+  for (i = 0; i < NFLOWS; i++) {
+    TEST_ASSERT_EQUAL(flowinfo->add_func(flowinfo, flows[i]),
+                      LAGOPUS_RESULT_OK);
+  }
+  TEST_ASSERT_EQUAL(flowinfo->nflow, NFLOWS);
+}
+
+static struct flow *
+match_tcp(struct lagopus_packet *pkt, uint8_t src0, uint8_t src1,
+          uint16_t dport) {
+  struct port port;
+  OS_MBUF *m;
+  int32_t prio;
+
+  m = PKT2MBUF(pkt);
+  OS_MTOD(m, uint8_t *)[12] = 0x08;
+  OS_MTOD(m, uint8_t *)[13] = 0x00;
+  OS_MTOD(m, uint8_t *)[14] = 0x45;
+  OS_MTOD(m, uint8_t *)[23] = IPPROTO_TCP;
+  OS_MTOD(m, uint8_t *)[26] = src0;
+  OS_MTOD(m, uint8_t *)[27] = src1;
+  OS_MTOD(m, uint8_t *)[36] = (uint8_t)(dport >> 8);
+  OS_MTOD(m, uint8_t *)[37] = (uint8_t)dport;
+  lagopus_packet_init(pkt, m, &port);
+  prio = -1;
+  return flowinfo->match_func(flowinfo, pkt, &prio);
+}
+
+void
+test_flowinfo_tuple_match(void) {
+  struct lagopus_packet *pkt;
+  OS_MBUF *m;
+
+  pkt = alloc_lagopus_packet();
+  TEST_ASSERT_NOT_NULL(pkt);
+  m = PKT2MBUF(pkt);
+  OS_M_APPEND(m, 64);
+
+  add_acl_flows();
+  TEST_ASSERT_EQUAL(match_tcp(pkt, 192, 168, 22), flows[0]);
+  TEST_ASSERT_EQUAL(match_tcp(pkt, 10, 2, 22), flows[1]);
+  TEST_ASSERT_EQUAL(match_tcp(pkt, 10, 2, 80), flows[2]);
+  TEST_ASSERT_EQUAL(match_tcp(pkt, 10, 1, 80), flows[3]);
+
+  /* subtable of flows[3] is removed, flows[2] has same masks. */
+  TEST_ASSERT_EQUAL(flowinfo->del_func(flowinfo, flows[3]),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(match_tcp(pkt, 10, 1, 80), flows[2]);
+  TEST_ASSERT_EQUAL(flowinfo->del_func(flowinfo, flows[3]),
+                    LAGOPUS_RESULT_NOT_FOUND);
+  TEST_ASSERT_EQUAL(flowinfo->del_func(flowinfo, flows[2]),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(match_tcp(pkt, 10, 1, 80), flows[1]);
+  TEST_ASSERT_EQUAL(flowinfo->del_func(flowinfo, flows[1]),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(flowinfo->del_func(flowinfo, flows[0]),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_NULL(match_tcp(pkt, 10, 1, 80));
+  TEST_ASSERT_EQUAL(flowinfo->nflow, 0);
+}
+
+void
+test_flowinfo_tuple_find(void) {
+  struct flow *flow;
+
+  add_acl_flows();
+  flow = allocate_test_flow(10 * sizeof(struct match));
+  TEST_ASSERT_NOT_NULL(flow);
+  flow->priority = 30;
+  add_match(&flow->match_list, 2, OFPXMT_OFB_ETH_TYPE << 1,
+            0x08, 0x00);
+  add_match(&flow->match_list, 1, OFPXMT_OFB_IP_PROTO << 1,
+            IPPROTO_TCP);
+  add_match(&flow->match_list, 8, (OFPXMT_OFB_IPV4_SRC << 1) + 1,
+            10, 0, 0, 0, 255, 0, 0, 0);
+  add_match(&flow->match_list, 2, OFPXMT_OFB_TCP_DST << 1,
+            0, 80);
+  TEST_ASSERT_EQUAL(flowinfo->find_func(flowinfo, flow), flows[2]);
+  flow->priority = 31;
+  TEST_ASSERT_NULL(flowinfo->find_func(flowinfo, flow));
+  free_test_flow(flow);
+}
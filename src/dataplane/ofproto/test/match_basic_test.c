@@ -288,3 +288,117 @@ xtest_match_basic_TUNNEL_ID(void) {
 void
 xtest_match_basic_TUNNEL_ID_W(void) {
 }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+struct flow *
+match_flows_scalar(const struct lagopus_packet *, struct flow * const *,
+                   int, int32_t);
+struct flow *
+match_flows_sse2(const struct lagopus_packet *, struct flow * const *,
+                 int, int32_t);
+struct flow *
+match_flows_avx2(const struct lagopus_packet *, struct flow * const *,
+                 int, int32_t);
+
+#define DIFF_NFLOW 8
+#define DIFF_LOOP 20000
+
+/*
+ * Random byte offset match of a flow.  Matching bytes are taken from
+ * the packet window, and sometimes one of them is flipped to make the
+ * flow mismatch.
+ */
+static void
+diff_byteoff_match(struct byteoff_match *match, const uint8_t *win,
+                   int nbytes) {
+  int off;
+
+  memset(match, 0, sizeof(*match));
+  for (off = 0; off < nbytes; off++) {
+    if (random() % 4 != 0) {
+      continue;
+    }
+    match->masks[off] = (uint8_t)(random() | 1);
+    match->bytes[off] = win[off] & match->masks[off];
+    match->bits |= 1U << off;
+  }
+  if (match->bits != 0 && random() % 4 == 0) {
+    do {
+      off = (int)(random() % nbytes);
+    } while ((match->bits & (1U << off)) == 0);
+    match->bytes[off] ^= match->masks[off] & -match->masks[off];
+  }
+}
+
+static void
+diff_match_flows(int nbytes, int nullbase) {
+  static uint8_t win[MAX_BASE][32 + BYTEOFF_MATCH_TAILROOM];
+  struct flow *flows[DIFF_NFLOW], *expect;
+  struct lagopus_packet pkt;
+  int32_t prio;
+  int loop, i, n;
+  bool sse2, avx2;
+
+  __builtin_cpu_init();
+  sse2 = __builtin_cpu_supports("sse2");
+  avx2 = __builtin_cpu_supports("avx2");
+  for (n = 0; n < DIFF_NFLOW; n++) {
+    flows[n] = calloc(1, sizeof(struct flow));
+    TEST_ASSERT_NOT_NULL(flows[n]);
+    flows[n]->priority = DIFF_NFLOW - n;
+  }
+  srandom(nbytes + nullbase);
+  for (loop = 0; loop < DIFF_LOOP; loop++) {
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.ether_type = (random() % 2 == 0) ? ETHERTYPE_IP : ETHERTYPE_IPV6;
+    for (i = 0; i < MAX_BASE; i++) {
+      for (n = 0; n < (int)sizeof(win[i]); n++) {
+        win[i][n] = (uint8_t)random();
+      }
+      pkt.base[i] = win[i];
+    }
+    for (n = 0; n < DIFF_NFLOW; n++) {
+      for (i = 0; i < MAX_BASE; i++) {
+        if (random() % 3 == 0) {
+          diff_byteoff_match(&flows[n]->byteoff_match[i], win[i], nbytes);
+        } else {
+          memset(&flows[n]->byteoff_match[i], 0,
+                 sizeof(flows[n]->byteoff_match[i]));
+        }
+      }
+    }
+    if (nullbase != 0) {
+      pkt.base[random() % MAX_BASE] = NULL;
+    }
+    prio = (random() % 2 == 0) ? INT32_MIN : (int32_t)(random() % DIFF_NFLOW);
+    expect = match_flows_scalar(&pkt, flows, DIFF_NFLOW, prio);
+    if (sse2) {
+      TEST_ASSERT_EQUAL_PTR(expect,
+                            match_flows_sse2(&pkt, flows, DIFF_NFLOW, prio));
+    }
+    if (avx2) {
+      TEST_ASSERT_EQUAL_PTR(expect,
+                            match_flows_avx2(&pkt, flows, DIFF_NFLOW, prio));
+    }
+  }
+  for (n = 0; n < DIFF_NFLOW; n++) {
+    free(flows[n]);
+  }
+}
+
+void
+test_match_flows_simd_lower_half(void) {
+  diff_match_flows(16, 0);
+}
+
+void
+test_match_flows_simd_both_halves(void) {
+  diff_match_flows(32, 0);
+}
+
+void
+test_match_flows_simd_null_base(void) {
+  diff_match_flows(16, 1);
+  diff_match_flows(32, 1);
+}
+#endif /* __GNUC__ && (__x86_64__ || __i386__) */
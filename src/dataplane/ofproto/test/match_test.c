@@ -21,6 +21,7 @@
 #include "lagopus/datastore/bridge.h"
 #include "pktbuf.h"
 #include "packet.h"
+#include "counter.h"
 #include "lagopus/dataplane.h"
 #include "lagopus/flowinfo.h"
 #include "datapath_test_misc.h"
@@ -37,6 +38,14 @@ tearDown(void) {
   dp_api_fini();
 }
 
+static uint64_t
+table_lookup_count(struct table *table) {
+  uint64_t lookup_count, matched_count;
+
+  dp_counter_get(table->counter_id, &lookup_count, &matched_count);
+  return lookup_count;
+}
+
 void
 test_lagopus_find_flow(void) {
   datastore_bridge_info_t info;
@@ -69,7 +78,7 @@ test_lagopus_find_flow(void) {
   table = flowdb_get_table(pkt->in_port->bridge->flowdb, 0);
   table->userdata = new_flowinfo_eth_type();
   flow = lagopus_find_flow(pkt, table);
-  TEST_ASSERT_EQUAL_MESSAGE(table->lookup_count, 0,
+  TEST_ASSERT_EQUAL_MESSAGE(table_lookup_count(table), 0,
                             "lookup_count(misc) error.");
   TEST_ASSERT_NULL_MESSAGE(flow,
                            "flow(misc) error.");
@@ -77,7 +86,7 @@ test_lagopus_find_flow(void) {
   OS_MTOD(m, uint8_t *)[15] = 0x06;
   lagopus_packet_init(pkt, m, &port);
   flow = lagopus_find_flow(pkt, table);
-  TEST_ASSERT_EQUAL_MESSAGE(table->lookup_count, 0,
+  TEST_ASSERT_EQUAL_MESSAGE(table_lookup_count(table), 0,
                             "lookup_count(arp) error.");
   TEST_ASSERT_NULL_MESSAGE(flow,
                            "flow(arp) error.");
@@ -85,7 +94,7 @@ test_lagopus_find_flow(void) {
   OS_MTOD(m, uint8_t *)[15] = 0x00;
   lagopus_packet_init(pkt, m, port_lookup(&bridge->ports, 1));
   flow = lagopus_find_flow(pkt, table);
-  TEST_ASSERT_EQUAL_MESSAGE(table->lookup_count, 0,
+  TEST_ASSERT_EQUAL_MESSAGE(table_lookup_count(table), 0,
                             "lookup_count(ipv4) error.");
   TEST_ASSERT_NULL_MESSAGE(flow,
                            "flow(ipv4) error.");
@@ -94,7 +103,7 @@ test_lagopus_find_flow(void) {
   OS_MTOD(m, uint8_t *)[20] = IPPROTO_TCP;
   lagopus_packet_init(pkt, m, port_lookup(&bridge->ports, 1));
   flow = lagopus_find_flow(pkt, table);
-  TEST_ASSERT_EQUAL_MESSAGE(table->lookup_count, 0,
+  TEST_ASSERT_EQUAL_MESSAGE(table_lookup_count(table), 0,
                             "lookup_count(ipv6) error.");
   TEST_ASSERT_NULL_MESSAGE(flow,
                            "flow(ipv6) error.");
@@ -102,7 +111,7 @@ test_lagopus_find_flow(void) {
   OS_MTOD(m, uint8_t *)[15] = 0x47;
   lagopus_packet_init(pkt, m, port_lookup(&bridge->ports, 1));
   flow = lagopus_find_flow(pkt, table);
-  TEST_ASSERT_EQUAL_MESSAGE(table->lookup_count, 0,
+  TEST_ASSERT_EQUAL_MESSAGE(table_lookup_count(table), 0,
                             "lookup_count(mpls) error.");
   TEST_ASSERT_NULL_MESSAGE(flow,
                            "flow(mpls) error.");
@@ -110,7 +119,7 @@ test_lagopus_find_flow(void) {
   OS_MTOD(m, uint8_t *)[15] = 0x48;
   lagopus_packet_init(pkt, m, port_lookup(&bridge->ports, 1));
   flow = lagopus_find_flow(pkt, table);
-  TEST_ASSERT_EQUAL_MESSAGE(table->lookup_count, 0,
+  TEST_ASSERT_EQUAL_MESSAGE(table_lookup_count(table), 0,
                             "lookup_count(mpls-mc) error.");
   TEST_ASSERT_NULL_MESSAGE(flow,
                            "flow(mpls-mc) error.");
@@ -118,7 +127,7 @@ test_lagopus_find_flow(void) {
   OS_MTOD(m, uint8_t *)[15] = 0xe7;
   lagopus_packet_init(pkt, m, port_lookup(&bridge->ports, 1));
   flow = lagopus_find_flow(pkt, table);
-  TEST_ASSERT_EQUAL_MESSAGE(table->lookup_count, 0,
+  TEST_ASSERT_EQUAL_MESSAGE(table_lookup_count(table), 0,
                             "lookup_count(pbb) error.");
   TEST_ASSERT_NULL_MESSAGE(flow,
                            "flow(pbb) error.");
@@ -72,3 +72,83 @@ test_get_shifted_value(void) {
     TEST_ASSERT_EQUAL(key[i], oxm_value[i]);
   }
 }
+
+#define NFLOWS 8
+
+static struct flow *
+find_ipv4_dst(struct lagopus_packet *pkt, struct flow_list *flow_list,
+              uint8_t dst_last) {
+  struct port port;
+  OS_MBUF *m;
+
+  m = PKT2MBUF(pkt);
+  OS_MTOD(m, uint8_t *)[12] = 0x08;
+  OS_MTOD(m, uint8_t *)[13] = 0x00;
+  OS_MTOD(m, uint8_t *)[14] = 0x45;
+  OS_MTOD(m, uint8_t *)[23] = IPPROTO_TCP;
+  OS_MTOD(m, uint8_t *)[30] = 10;
+  OS_MTOD(m, uint8_t *)[33] = dst_last;
+  lagopus_packet_init(pkt, m, &port);
+  return find_mbtree(pkt, flow_list);
+}
+
+void
+test_mbtree_build_and_update(void) {
+  struct flow_list *flow_list;
+  struct flow *flows[NFLOWS], *flow;
+  struct lagopus_packet *pkt;
+  int i;
+
+  flow_list = calloc(1, sizeof(struct flow_list) + sizeof(void *) * 65536);
+  TEST_ASSERT_NOT_NULL(flow_list);
+  flow_list->nbranch = 65536;
+  for (i = 0; i < NFLOWS; i++) {
+    flows[i] = allocate_test_flow(10 * sizeof(struct match));
+    TEST_ASSERT_NOT_NULL(flows[i]);
+    flows[i]->priority = i + 1;
+    add_match(&flows[i]->match_list, 2, OFPXMT_OFB_ETH_TYPE << 1,
+              0x08, 0x00);
+    add_match(&flows[i]->match_list, 4, OFPXMT_OFB_IPV4_DST << 1,
+              10, 0, 0, i + 1);
+    TEST_ASSERT_EQUAL(flow_add_sub(flows[i], flow_list), LAGOPUS_RESULT_OK);
+  }
+  pkt = alloc_lagopus_packet();
+  TEST_ASSERT_NOT_NULL(pkt);
+  OS_M_APPEND(PKT2MBUF(pkt), 64);
+
+  /* nothing is published before build. */
+  TEST_ASSERT_NULL(find_ipv4_dst(pkt, flow_list, 3));
+  build_mbtree(flow_list);
+  TEST_ASSERT_NOT_NULL(flow_list->mbtree);
+  TEST_ASSERT_EQUAL_PTR(find_ipv4_dst(pkt, flow_list, 3), flows[2]);
+  TEST_ASSERT_NULL(find_ipv4_dst(pkt, flow_list, 100));
+
+  /* added to the built tree in place. */
+  flow = allocate_test_flow(10 * sizeof(struct match));
+  TEST_ASSERT_NOT_NULL(flow);
+  flow->priority = 100;
+  add_match(&flow->match_list, 2, OFPXMT_OFB_ETH_TYPE << 1, 0x08, 0x00);
+  add_match(&flow->match_list, 4, OFPXMT_OFB_IPV4_DST << 1, 10, 0, 0, 3);
+  TEST_ASSERT_TRUE(mbtree_add_flow(flow_list, flow));
+  TEST_ASSERT_EQUAL_PTR(find_ipv4_dst(pkt, flow_list, 3), flow);
+  TEST_ASSERT_EQUAL(flow_list->mbtree_updates, 1);
+
+  /* deleted in place, then rebuild resets updates. */
+  TEST_ASSERT_TRUE(mbtree_del_flow(flow_list, flow));
+  TEST_ASSERT_EQUAL_PTR(find_ipv4_dst(pkt, flow_list, 3), flows[2]);
+  TEST_ASSERT_FALSE(mbtree_del_flow(flow_list, flow));
+  build_mbtree(flow_list);
+  TEST_ASSERT_EQUAL(flow_list->mbtree_updates, 0);
+  TEST_ASSERT_EQUAL_PTR(find_ipv4_dst(pkt, flow_list, 8), flows[7]);
+
+  cleanup_mbtree(flow_list);
+  TEST_ASSERT_NULL(flow_list->mbtree);
+  TEST_ASSERT_NULL(find_ipv4_dst(pkt, flow_list, 3));
+  lagopus_packet_free(pkt);
+  free_test_flow(flow);
+  for (i = 0; i < NFLOWS; i++) {
+    free_test_flow(flows[i]);
+  }
+  free(flow_list->flows);
+  free(flow_list);
+}
@@ -0,0 +1,504 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/queue.h>
+
+#include "unity.h"
+
+#include "lagopus/bridge.h"
+#include "lagopus/flowdb.h"
+#include "lagopus/ethertype.h"
+#include "lagopus/port.h"
+#include "lagopus/dataplane.h"
+#include "lagopus/ofcache.h"
+#include "pktbuf.h"
+#include "packet.h"
+#include "datapath_test_misc.h"
+
+lagopus_result_t
+dp_openflow_do_cached_prog(struct lagopus_packet *, const struct cache_prog *);
+lagopus_result_t
+dp_openflow_do_cached_flows(struct lagopus_packet *,
+                            const struct cache_entry *);
+void clear_action_set(struct lagopus_packet *);
+
+static struct port port;
+static struct bridge bridge;
+static struct instruction_array instruction;
+static struct flow flow;
+
+void
+setUp(void) {
+  memset(&port, 0, sizeof(port));
+  port.ifindex = 1;
+  memset(&bridge, 0, sizeof(bridge));
+  bridge.flowdb = flowdb_alloc(2);
+  TEST_ASSERT_NOT_NULL(bridge.flowdb);
+  memset(&instruction, 0, sizeof(instruction));
+  memset(&flow, 0, sizeof(flow));
+  flow.bridge = &bridge;
+  flow.table_id = 0;
+  flow.instruction = &instruction;
+}
+
+void
+tearDown(void) {
+  flowdb_free(bridge.flowdb);
+  bridge.flowdb = NULL;
+}
+
+static struct lagopus_packet *
+make_tcp_packet(uint8_t src_last) {
+  struct lagopus_packet *pkt;
+  OS_MBUF *m;
+
+  pkt = alloc_lagopus_packet();
+  TEST_ASSERT_NOT_NULL_MESSAGE(pkt, "lagopus_alloc_packet error.");
+  m = PKT2MBUF(pkt);
+  OS_M_PKTLEN(m) = 64;
+  memset(OS_MTOD(m, uint8_t *), 0, 64);
+  OS_MTOD(m, uint8_t *)[12] = 0x08;
+  OS_MTOD(m, uint8_t *)[13] = 0x00;
+  OS_MTOD(m, uint8_t *)[14] = 0x45;
+  OS_MTOD(m, uint8_t *)[23] = IPPROTO_TCP;
+  OS_MTOD(m, uint8_t *)[29] = src_last;
+  lagopus_packet_init(pkt, m, &port);
+  /* use same hash value to emulate collision. */
+  pkt->hash64 = 0x0123456789abcdefULL;
+
+  return pkt;
+}
+
+void
+test_flowcache_open_hash_collision(void) {
+  struct flowcache *cache;
+  struct lagopus_packet *pkt1, *pkt2;
+  struct cache_entry *entry;
+  struct ofcachestat st;
+  const struct flow *flows[1];
+
+  cache = init_flowcache(FLOWCACHE_OPEN_HASH);
+  TEST_ASSERT_NOT_NULL(cache);
+  pkt1 = make_tcp_packet(1);
+  pkt2 = make_tcp_packet(2);
+  flows[0] = &flow;
+
+  /* miss, then register. */
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt1));
+  register_cache(cache, pkt1->hash64, 1, flows);
+  entry = cache_lookup(cache, pkt1);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(entry->nmatched, 1);
+  TEST_ASSERT_EQUAL_PTR(entry->flow[0], &flow);
+
+  /* same hash value but different header, must not hit. */
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt2));
+
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.nentries, 1);
+  TEST_ASSERT_EQUAL(st.hit, 1);
+  TEST_ASSERT_EQUAL(st.miss, 2);
+
+  clear_all_cache(cache);
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt1));
+
+  lagopus_packet_free(pkt1);
+  lagopus_packet_free(pkt2);
+  fini_flowcache(cache);
+}
+
+void
+test_flowcache_open_hash_register_without_lookup(void) {
+  struct flowcache *cache;
+  struct lagopus_packet *pkt;
+  struct ofcachestat st;
+  const struct flow *flows[1];
+
+  cache = init_flowcache(FLOWCACHE_OPEN_HASH);
+  TEST_ASSERT_NOT_NULL(cache);
+  pkt = make_tcp_packet(1);
+  flows[0] = &flow;
+
+  /* key is not captured, nothing to register. */
+  register_cache(cache, pkt->hash64, 1, flows);
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.nentries, 0);
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt));
+
+  lagopus_packet_free(pkt);
+  fini_flowcache(cache);
+}
+
+static void
+flowcache_generation_common(int kvs_type) {
+  struct flowcache *cache;
+  struct lagopus_packet *pkt;
+  struct ofcachestat st;
+  struct table *table;
+  const struct flow *flows[1];
+
+  cache = init_flowcache(kvs_type);
+  TEST_ASSERT_NOT_NULL(cache);
+  pkt = make_tcp_packet(1);
+  flows[0] = &flow;
+  table = table_lookup(bridge.flowdb, 0);
+  TEST_ASSERT_NOT_NULL(table);
+
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt));
+  register_cache(cache, pkt->hash64, 1, flows);
+  TEST_ASSERT_NOT_NULL(cache_lookup(cache, pkt));
+
+  /* flow table is changed, cached entry must not be used. */
+  table->generation++;
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt));
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.nentries, 0);
+
+  /* register again with new generation. */
+  register_cache(cache, pkt->hash64, 1, flows);
+  TEST_ASSERT_NOT_NULL(cache_lookup(cache, pkt));
+
+  lagopus_packet_free(pkt);
+  fini_flowcache(cache);
+}
+
+void
+test_flowcache_open_hash_generation(void) {
+  flowcache_generation_common(FLOWCACHE_OPEN_HASH);
+}
+
+void
+test_flowcache_hashmap_generation(void) {
+  flowcache_generation_common(FLOWCACHE_HASHMAP);
+}
+
+void
+test_flowcache_open_hash_lookup_bulk(void) {
+  struct flowcache *cache;
+  struct lagopus_packet *pkts[3];
+  struct cache_entry *entries[3];
+  struct ofcachestat st;
+  const struct flow *flows[1];
+
+  cache = init_flowcache(FLOWCACHE_OPEN_HASH);
+  TEST_ASSERT_NOT_NULL(cache);
+  pkts[0] = make_tcp_packet(1);
+  pkts[1] = make_tcp_packet(2);
+  pkts[2] = make_tcp_packet(1);
+  flows[0] = &flow;
+
+  TEST_ASSERT_NULL(cache_lookup(cache, pkts[0]));
+  register_cache(cache, pkts[0]->hash64, 1, flows);
+
+  TEST_ASSERT_EQUAL(cache_lookup_bulk(cache, pkts, 3, entries), 2);
+  TEST_ASSERT_NOT_NULL(entries[0]);
+  TEST_ASSERT_NULL(entries[1]);
+  TEST_ASSERT_EQUAL_PTR(entries[0], entries[2]);
+
+  /* bulk miss is not counted, and leaves no key to register. */
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.hit, 2);
+  TEST_ASSERT_EQUAL(st.miss, 1);
+  register_cache(cache, pkts[1]->hash64, 1, flows);
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.nentries, 1);
+
+  /* missed packet is looked up again, then registered. */
+  TEST_ASSERT_NULL(cache_lookup(cache, pkts[1]));
+  register_cache(cache, pkts[1]->hash64, 1, flows);
+  TEST_ASSERT_EQUAL(cache_lookup_bulk(cache, pkts, 3, entries), 3);
+
+  lagopus_packet_free(pkts[0]);
+  lagopus_packet_free(pkts[1]);
+  lagopus_packet_free(pkts[2]);
+  fini_flowcache(cache);
+}
+
+void
+test_flowcache_open_hash_lookup_bulk_invalidate(void) {
+  struct flowcache *cache;
+  struct lagopus_packet *pkt1, *pkt2;
+  struct cache_entry *entries[1];
+  struct ofcachestat st;
+  struct table *table;
+  const struct flow *flows[1];
+
+  cache = init_flowcache(FLOWCACHE_OPEN_HASH);
+  TEST_ASSERT_NOT_NULL(cache);
+  pkt1 = make_tcp_packet(1);
+  pkt2 = make_tcp_packet(2);
+  flows[0] = &flow;
+  table = table_lookup(bridge.flowdb, 0);
+  TEST_ASSERT_NOT_NULL(table);
+
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt1));
+  register_cache(cache, pkt1->hash64, 1, flows);
+  /* key of pkt2 is captured but not registered. */
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt2));
+
+  /* stale entry found by bulk lookup leaves no key to register. */
+  table->generation++;
+  TEST_ASSERT_EQUAL(cache_lookup_bulk(cache, &pkt1, 1, entries), 0);
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.nentries, 0);
+  register_cache(cache, pkt1->hash64, 1, flows);
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.nentries, 0);
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt2));
+
+  /* stale entry found by single lookup is registered again. */
+  register_cache(cache, pkt2->hash64, 1, flows);
+  TEST_ASSERT_NOT_NULL(cache_lookup(cache, pkt2));
+  table->generation++;
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt2));
+  register_cache(cache, pkt2->hash64, 1, flows);
+  TEST_ASSERT_NOT_NULL(cache_lookup(cache, pkt2));
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt1));
+
+  lagopus_packet_free(pkt1);
+  lagopus_packet_free(pkt2);
+  fini_flowcache(cache);
+}
+
+void
+test_flowcache_wildcard(void) {
+  struct flowcache *cache;
+  struct lagopus_packet *pkt1, *pkt2;
+  struct cache_entry *entry;
+  struct ofcachestat st;
+  struct table *table;
+  const struct flow *flows[1];
+
+  table = table_lookup(bridge.flowdb, 0);
+  TEST_ASSERT_NOT_NULL(table);
+  /* flows of the table examine first byte of ipv4 src only. */
+  table->wildcard[L3_BASE].bits = 1 << 12;
+  table->wildcard[L3_BASE].masks[12] = 0xff;
+  cache = init_flowcache(FLOWCACHE_OPEN_HASH);
+  TEST_ASSERT_NOT_NULL(cache);
+  pkt1 = make_tcp_packet(1);
+  pkt2 = make_tcp_packet(2);
+  flows[0] = &flow;
+
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt1));
+  register_cache(cache, pkt1->hash64, 1, flows);
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.nentries, 1);
+  TEST_ASSERT_EQUAL(st.wildcard_entries, 1);
+
+  /* differs in unexamined byte, hit wildcard entry and promoted. */
+  entry = cache_lookup(cache, pkt2);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL_PTR(entry->flow[0], &flow);
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.wildcard_hit, 1);
+  TEST_ASSERT_EQUAL(st.nentries, 2);
+  TEST_ASSERT_NOT_NULL(cache_lookup(cache, pkt2));
+  get_flowcache_statistics(cache, &st);
+  TEST_ASSERT_EQUAL(st.wildcard_hit, 1);
+  TEST_ASSERT_EQUAL(st.hit, 1);
+
+  /* flow table is changed, wildcard entry must not be used. */
+  table->generation++;
+  clear_all_cache(cache);
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt2));
+
+  lagopus_packet_free(pkt1);
+  lagopus_packet_free(pkt2);
+  fini_flowcache(cache);
+}
+
+static struct action *
+make_action(struct action_list *action_list, uint16_t type, uint16_t len) {
+  struct action *action;
+
+  action = calloc(1, sizeof(*action) + len);
+  TEST_ASSERT_NOT_NULL(action);
+  action->ofpat.type = type;
+  action->ofpat.len = len;
+  lagopus_set_action_function(action);
+  TAILQ_INSERT_TAIL(action_list, action, entry);
+  return action;
+}
+
+static void
+make_set_eth(struct action_list *action_list, uint8_t field, uint8_t last) {
+  struct action *action;
+
+  action = make_action(action_list, OFPAT_SET_FIELD, 16);
+  set_match(((struct ofp_action_set_field *)&action->ofpat)->field, 6,
+            field << 1, 0x02, 0x00, 0x00, 0x00, 0x00, last);
+}
+
+static struct instruction *
+make_actions_instruction(struct instruction_array *insns, int index,
+                         uint16_t type) {
+  struct instruction *insn;
+
+  insn = calloc(1, sizeof(*insn));
+  TEST_ASSERT_NOT_NULL(insn);
+  insn->ofpit.type = type;
+  lagopus_set_instruction_function(insn);
+  TAILQ_INIT(&insn->action_list);
+  insns->index[index] = insn;
+  return insn;
+}
+
+static void
+free_instructions(struct instruction_array *insns) {
+  struct action *action;
+  int i;
+
+  for (i = 0; i < INSTRUCTION_INDEX_MAX; i++) {
+    if (insns->index[i] == NULL) {
+      continue;
+    }
+    while ((action = TAILQ_FIRST(&insns->index[i]->action_list)) != NULL) {
+      TAILQ_REMOVE(&insns->index[i]->action_list, action, entry);
+      free(action);
+    }
+    free(insns->index[i]);
+  }
+}
+
+static void
+make_set_ipv4(struct action_list *action_list, uint8_t field, uint8_t last) {
+  struct action *action;
+
+  action = make_action(action_list, OFPAT_SET_FIELD, 16);
+  set_match(((struct ofp_action_set_field *)&action->ofpat)->field, 4,
+            field << 1, 192, 168, 0, last);
+}
+
+/**
+ * Run the compiled program of the entry and instructions of the flows
+ * on the same packet, and compare the results.
+ */
+static void
+cache_prog_diff(int kvs_type, unsigned nmatched, const struct flow **flows) {
+  struct flowcache *cache;
+  struct lagopus_packet *pkt1, *pkt2;
+  struct cache_entry *entry;
+  OS_MBUF *m1, *m2;
+  int i;
+
+  cache = init_flowcache(kvs_type);
+  TEST_ASSERT_NOT_NULL(cache);
+  pkt1 = make_tcp_packet(1);
+  pkt2 = make_tcp_packet(1);
+  m1 = PKT2MBUF(pkt1);
+  m2 = PKT2MBUF(pkt2);
+  OS_MTOD(m1, uint8_t *)[22] = OS_MTOD(m2, uint8_t *)[22] = 64;
+
+  /* compiled at registration. */
+  TEST_ASSERT_NULL(cache_lookup(cache, pkt1));
+  register_cache(cache, pkt1->hash64, nmatched, flows);
+  entry = cache_lookup(cache, pkt1);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_NOT_NULL(entry->prog);
+
+  TEST_ASSERT_EQUAL(dp_openflow_do_cached_prog(pkt1, entry->prog),
+                    LAGOPUS_RESULT_OK);
+  TEST_ASSERT_EQUAL(dp_openflow_do_cached_flows(pkt2, entry),
+                    LAGOPUS_RESULT_OK);
+  for (i = 0; i < LAGOPUS_ACTION_SET_ORDER_MAX; i++) {
+    TEST_ASSERT_EQUAL(execute_action(pkt2, &pkt2->actions[i]),
+                      LAGOPUS_RESULT_OK);
+  }
+  TEST_ASSERT_EQUAL(OS_M_PKTLEN(m1), OS_M_PKTLEN(m2));
+  TEST_ASSERT_EQUAL_MEMORY(OS_MTOD(m2, uint8_t *),
+                           OS_MTOD(m1, uint8_t *), OS_M_PKTLEN(m1));
+  TEST_ASSERT_EQUAL_MEMORY(&pkt2->oob_data.metadata,
+                           &pkt1->oob_data.metadata,
+                           sizeof(pkt1->oob_data.metadata));
+  TEST_ASSERT_EQUAL_PTR(pkt1->flow, flows[nmatched - 1]);
+
+  clear_action_set(pkt2);
+  lagopus_packet_free(pkt1);
+  lagopus_packet_free(pkt2);
+  fini_flowcache(cache);
+}
+
+void
+test_flowcache_cache_prog_set_field(void) {
+  struct instruction *insn;
+  const struct flow *flows[1];
+
+  /*
+   * eth_src is merged into the preceding eth_dst, later eth_dst
+   * overwrites the merged one, and the first ipv4_src is dropped.
+   */
+  insn = make_actions_instruction(&instruction,
+                                  INSTRUCTION_INDEX_APPLY_ACTIONS,
+                                  OFPIT_APPLY_ACTIONS);
+  make_set_eth(&insn->action_list, OFPXMT_OFB_ETH_DST, 0x01);
+  make_set_ipv4(&insn->action_list, OFPXMT_OFB_IPV4_SRC, 1);
+  make_set_eth(&insn->action_list, OFPXMT_OFB_ETH_SRC, 0x02);
+  make_set_ipv4(&insn->action_list, OFPXMT_OFB_IPV4_SRC, 2);
+  make_set_eth(&insn->action_list, OFPXMT_OFB_ETH_DST, 0x03);
+  flows[0] = &flow;
+
+  cache_prog_diff(FLOWCACHE_OPEN_HASH, 1, flows);
+  cache_prog_diff(FLOWCACHE_HASHMAP_NOLOCK, 1, flows);
+  free_instructions(&instruction);
+}
+
+void
+test_flowcache_cache_prog_action_set(void) {
+  struct instruction_array insns1;
+  struct instruction *insn;
+  struct action *action;
+  struct flow flow1;
+  const struct flow *flows[2];
+
+  /*
+   * table 0 writes eth_src, vlan_vid before push_vlan, dec_nw_ttl and
+   * ipv4_dst.  table 1 replaces ipv4_dst and writes eth_dst, which is
+   * merged with eth_src of table 0.
+   */
+  insn = make_actions_instruction(&instruction,
+                                  INSTRUCTION_INDEX_WRITE_ACTIONS,
+                                  OFPIT_WRITE_ACTIONS);
+  make_set_eth(&insn->action_list, OFPXMT_OFB_ETH_SRC, 0x05);
+  action = make_action(&insn->action_list, OFPAT_SET_FIELD, 16);
+  set_match(((struct ofp_action_set_field *)&action->ofpat)->field, 2,
+            OFPXMT_OFB_VLAN_VID << 1, 0x10, 0x05);
+  action = make_action(&insn->action_list, OFPAT_PUSH_VLAN, 8);
+  ((struct ofp_action_push *)&action->ofpat)->ethertype = 0x8100;
+  make_action(&insn->action_list, OFPAT_DEC_NW_TTL, 8);
+  make_set_ipv4(&insn->action_list, OFPXMT_OFB_IPV4_DST, 1);
+  insn = make_actions_instruction(&instruction,
+                                  INSTRUCTION_INDEX_WRITE_METADATA,
+                                  OFPIT_WRITE_METADATA);
+  insn->ofpit_write_metadata.metadata = 0x5a;
+  insn->ofpit_write_metadata.metadata_mask = 0xff;
+
+  memset(&insns1, 0, sizeof(insns1));
+  memcpy(&flow1, &flow, sizeof(flow1));
+  flow1.table_id = 1;
+  flow1.instruction = &insns1;
+  insn = make_actions_instruction(&insns1, INSTRUCTION_INDEX_WRITE_ACTIONS,
+                                  OFPIT_WRITE_ACTIONS);
+  make_set_ipv4(&insn->action_list, OFPXMT_OFB_IPV4_DST, 2);
+  make_set_eth(&insn->action_list, OFPXMT_OFB_ETH_DST, 0x06);
+  flows[0] = &flow;
+  flows[1] = &flow1;
+
+  cache_prog_diff(FLOWCACHE_OPEN_HASH, 2, flows);
+  cache_prog_diff(FLOWCACHE_HASHMAP_NOLOCK, 2, flows);
+  free_instructions(&instruction);
+  free_instructions(&insns1);
+}
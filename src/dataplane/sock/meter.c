@@ -0,0 +1,178 @@
+/*
+ * Copyright 2014-2017 Nippon Telegraph and Telephone Corporation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *      @file   meter.c
+ *      @brief  Metering support without DPDK
+ */
+
+#include <sys/queue.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openflow.h>
+#include "lagopus/flowdb.h"
+#include "lagopus/meter.h"
+#include "lagopus/port.h"
+#include "lagopus/dataplane.h"
+#include "pktbuf.h"
+#include "packet.h"
+#include "counter.h"
+#include "srtcm.h"
+
+#undef METER_DEBUG
+#ifdef METER_DEBUG
+#define DPRINT(...) printf(__VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+#define KBPS2BYTEPS(kbps) ((kbps) * 1000 / 8)
+#define METER_MAX_FRAME_LEN 1518
+
+struct lagopus_band {
+  TAILQ_ENTRY(lagopus_band) next;
+  struct meter_band *band;
+  struct dp_srtcm_sharded srtcm;
+};
+
+TAILQ_HEAD(lagopus_band_list, lagopus_band);
+
+static void sock_register_meter(struct meter *);
+static void sock_unregister_meter(struct meter *);
+
+void
+lagopus_meter_init(void) {
+  lagopus_register_meter = sock_register_meter;
+  lagopus_unregister_meter = sock_unregister_meter;
+}
+
+/**
+ * ofp_meter_band_flags has multiple type of meter.
+ * - kbps
+ * - pps
+ * - burst size
+ * - collect statistics
+ *
+ * srtcm parameters are same as DPDK:
+ *  cir - commited information rate, in bytes (or packets) per second
+ *  cbs - commited burst size, in bytes (or packets)
+ *  ebs - excess burst size, in bytes (or packets)
+ * high rate bands are sharded per thread.
+ */
+static void
+sock_register_meter(struct meter *meter) {
+  struct meter_band *band;
+  struct lagopus_band_list *list;
+  struct lagopus_band *lband;
+  uint64_t cir, ebs, unit;
+  void *p;
+
+  DPRINT("registering meter, id=%d\n", meter->meter_id);
+  meter->driverdata = NULL;
+  list = calloc(1, sizeof(struct lagopus_band_list));
+  if (list == NULL) {
+    return;
+  }
+  TAILQ_INIT(list);
+  TAILQ_FOREACH(band, &meter->band_list, entry) {
+    if (posix_memalign(&p, 64, sizeof(struct lagopus_band)) != 0) {
+      break;
+    }
+    lband = p;
+    memset(lband, 0, sizeof(struct lagopus_band));
+    lband->band = band;
+    if ((meter->flags & OFPMF_PKTPS) == 0) {
+      /* unit of rate is kbps, srtcm needs Bytes/sec */
+      DPRINT("rate limit: %d kilo bit per second\n", band->rate);
+      cir = KBPS2BYTEPS((uint64_t)band->rate);
+      ebs = KBPS2BYTEPS((uint64_t)band->burst_size);
+      unit = METER_MAX_FRAME_LEN;
+    } else {
+      /* unit of rate is pps */
+      DPRINT("rate limit: %d packet per second\n", band->rate);
+      cir = band->rate;
+      ebs = band->burst_size;
+      unit = 1;
+    }
+    if ((meter->flags & OFPMF_BURST) == 0) {
+      ebs = 0;
+    }
+    dp_srtcm_sharded_config(&lband->srtcm, cir, cir, ebs, unit);
+    TAILQ_INSERT_TAIL(list, lband, next);
+  }
+  meter->driverdata = list;
+}
+
+static void
+sock_unregister_meter(struct meter *meter) {
+  struct lagopus_band_list *list;
+  struct lagopus_band *lband;
+
+  list = meter->driverdata;
+  if (list == NULL) {
+    return;
+  }
+  while ((lband = TAILQ_FIRST(list)) != NULL) {
+    TAILQ_REMOVE(list, lband, next);
+    free(lband);
+  }
+  free(list);
+  meter->driverdata = NULL;
+}
+
+int
+lagopus_meter_packet(struct lagopus_packet *pkt, struct meter *meter,
+                     uint8_t *prec_level) {
+  struct lagopus_band_list *list;
+  struct lagopus_band *lband, *color_band;
+  uint64_t now, len;
+
+  DPRINT("metering packet\n");
+  if ((meter->flags & OFPMF_STATS) != 0) {
+    dp_counter_add(meter->counter_id, 1, OS_M_PKTLEN(PKT2MBUF(pkt)));
+  }
+  list = meter->driverdata;
+  if (list == NULL) {
+    return 0;
+  }
+  if ((meter->flags & OFPMF_PKTPS) == 0) {
+    len = OS_M_PKTLEN(PKT2MBUF(pkt));
+  } else {
+    len = 1;
+  }
+  now = dp_srtcm_now();
+  color_band = NULL;
+  TAILQ_FOREACH(lband, list, next) {
+    if (dp_srtcm_sharded_check(&lband->srtcm, now, len) == DP_SRTCM_RED &&
+        color_band == NULL) {
+      color_band = lband;
+    }
+  }
+  if (color_band != NULL) {
+    DPRINT("color == red\n");
+    if ((meter->flags & OFPMF_STATS) != 0) {
+      dp_counter_add(color_band->band->counter_id,
+                     1, OS_M_PKTLEN(PKT2MBUF(pkt)));
+    }
+    if (color_band->band->type == OFPMBT_DSCP_REMARK) {
+      *prec_level = color_band->band->prec_level;
+    }
+    return color_band->band->type;
+  }
+  DPRINT("color != red\n");
+  return 0;
+}
@@ -78,23 +78,12 @@ lagopus_instruction_experimenter(__UNUSED struct lagopus_packet *pkt,
   /* writing your own instruction */
 }
 
-int
-lagopus_meter_packet(__UNUSED struct lagopus_packet *pkt,
-                     __UNUSED struct meter *meter,
-                     __UNUSED uint8_t *prec_level) {
-  /* XXX not implemented */
-  return 0;
-}
-
-void
-lagopus_meter_init(void) {
-  /* XXX not implemented */
-}
-
 void
 dp_get_flowcache_statistics(struct bridge *bridge, struct ofcachestat *st) {
   st->nentries = 0;
   st->hit = 0;
   st->miss = 0;
+  st->wildcard_entries = 0;
+  st->wildcard_hit = 0;
   /* not implemented yet */
 }
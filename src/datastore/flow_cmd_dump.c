@@ -2666,6 +2666,9 @@ static inline lagopus_result_t
 dump_flow_stat(struct flow *flow,
                lagopus_dstring_t *result) {
   lagopus_result_t ret = LAGOPUS_RESULT_ANY_FAILURES;
+  uint64_t packet_count, byte_count;
+
+  flow_get_counts(flow, &packet_count, &byte_count);
 
   if ((ret = lagopus_dstring_appendf(
           result, DELIMITER_INSTERN(KEY_FMT "{"),
@@ -2678,7 +2681,7 @@ dump_flow_stat(struct flow *flow,
   if ((ret = lagopus_dstring_appendf(
           result, KEY_FMT "%"PRIu64,
           flow_stat_strs[FLOW_STAT_PACKET_COUNT],
-          flow->packet_count)) !=
+          packet_count)) !=
       LAGOPUS_RESULT_OK) {
     lagopus_perror(ret);
     goto done;
@@ -2687,7 +2690,7 @@ dump_flow_stat(struct flow *flow,
   if ((ret = lagopus_dstring_appendf(
           result, DELIMITER_INSTERN(KEY_FMT "%"PRIu64),
           flow_stat_strs[FLOW_STAT_BYTE_COUNT],
-          flow->byte_count)) !=
+          byte_count)) !=
       LAGOPUS_RESULT_OK) {
     lagopus_perror(ret);
     goto done;
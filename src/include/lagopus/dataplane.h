@@ -241,6 +241,19 @@ lagopus_forward_packet_to_port_hybrid(struct lagopus_packet *);
  */
 lagopus_result_t lagopus_match_and_action(struct lagopus_packet *);
 
+/**
+ * Process a burst of packets by OpenFlow rule.
+ *
+ * @param[in]   pkts    packets, pkt->cache of all packets must be same.
+ * @param[in]   n       number of packets.
+ *
+ * hash values are calculated and flow cache is looked up for the
+ * whole burst, then packets hit to the same cache entry are processed
+ * together.  missed packets are processed as lagopus_match_and_action().
+ * packet order is kept for packets of the same cache entry.
+ */
+void lagopus_match_and_action_bulk(struct lagopus_packet *pkts[], size_t n);
+
 /**
  * Execute experimenter instruction.
  *
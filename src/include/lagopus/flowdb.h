@@ -138,6 +138,20 @@ struct byteoff_match {
   uint8_t masks[32];
 };
 
+/**
+ * Bytes which must be readable after the end of packet data.  Byte
+ * offset match loads the whole window of byteoff_match at each base.
+ */
+#define BYTEOFF_MATCH_TAILROOM  32
+
+/**
+ * @brief Byte offset mask, union of masks of byteoff_match.
+ */
+struct byteoff_mask {
+  uint32_t bits;
+  uint8_t masks[32];
+};
+
 /**
  * @brief Out Of Bound data structure.  size are equal or less then 32byte.
  */
@@ -160,6 +174,21 @@ struct oob2_data {
 
 TAILQ_HEAD(instruction_list, instruction);      /** Instruction list. */
 
+struct flow_wire;
+
+/**
+ * @brief Instructions of the flow indexed by INSTRUCTION_INDEX_*.
+ *
+ * Replaced as a whole when the flow is modified, so that the dataplane
+ * executes either old or new instructions.
+ */
+struct instruction_array {
+  struct instruction *index[INSTRUCTION_INDEX_MAX];
+  TAILQ_ENTRY(instruction_array) entry;         /** Retired list. */
+};
+
+TAILQ_HEAD(instruction_array_list, instruction_array);
+
 /**
  * @brief Flow entry.
  */
@@ -168,9 +197,10 @@ struct flow {
   struct byteoff_match byteoff_match[MAX_BASE];
 
   /* Instruction array for execution. */
-  struct instruction *instruction[INSTRUCTION_INDEX_MAX];
-  uint64_t packet_count;                        /** Matched packet count. */
-  uint64_t byte_count;                          /** Mtched byte count. */
+  struct instruction_array *instruction;
+  uint32_t counter_id;                          /** Per worker counter. */
+  uint64_t packet_count_base;                   /** Packet count at reset. */
+  uint64_t byte_count_base;                     /** Byte count at reset. */
   uint16_t flags;                               /** ofp_flow_mod flags. */
   int32_t priority;                             /** Priority. */
   uint64_t cookie;                              /** ofp_flow_mod cookie. a*/
@@ -182,9 +212,18 @@ struct flow {
   uint64_t field_bits;                          /** Match field type bits. */
   uint8_t table_id;                             /** Table ID. */
   struct timespec create_time;                  /** Creation time. */
-  struct timespec update_time;                  /** Last updated time. */
+  struct timespec update_time;                  /** Last updated time,
+                                                 ** only tv_sec is kept
+                                                 ** by the dataplane. */
   struct flow **flow_timer;                     /** Back reference to entry
                                                  ** of the flow timer. */
+  uint64_t identity_hash;                       /** Hash of priority and
+                                                 ** match. */
+  struct flow *identity_next;                   /** Next flow in the
+                                                 ** identity bucket. */
+  struct flow_wire *wire;                       /** Wire encoding of match
+                                                 ** and instructions for
+                                                 ** flow stats, or NULL. */
 
 };
 
@@ -192,7 +231,8 @@ enum action_flag {
   SET_FIELD_ETH_DST    = 1 << 0,
   SET_FIELD_ETH_SRC    = 1 << 1,
   OUTPUT_PACKET        = 1 << 2,
-  OUTPUT_COPIED_PACKET = 1 << 3
+  OUTPUT_COPIED_PACKET = 1 << 3,
+  OUTPUT_SHARED_PACKET = 1 << 4   /* packet is not rewritten after output */
 };
 #define SET_FIELD_ETH (SET_FIELD_ETH_DST | SET_FIELD_ETH_SRC)
 
@@ -239,23 +279,58 @@ struct flow_list {
   struct flow_list **update_timer;
   struct thtable *thtable;
 
+  /* decision tree published for the dataplane, see mbtree.h */
+  struct flow_list *mbtree;
+  int mbtree_updates;           /* in place updates since last build */
+  struct match *split;          /* match distributing flows to branch */
+  struct flowdb *flowdb;        /* owner, locked while building */
+
   int nbranch;
   void *branch[0];
 };
 
+/**
+ * @brief Classifier used by the dataplane to look up the table.
+ */
+enum flow_classifier {
+  FLOW_CLASSIFIER_DEFAULT = 0,  /** Decision tree by match field types. */
+  FLOW_CLASSIFIER_TUPLE,        /** Tuple space search by match masks. */
+  FLOW_CLASSIFIER_MAX
+};
+
 /**
  * @brief Flow table.
  */
+/**
+ * @brief Hash index of flows by priority and match.
+ */
+struct flow_index {
+  struct flow **buckets;        /** Chains of flows. */
+  uint32_t nbuckets;            /** Number of buckets, power of 2. */
+  uint32_t nflows;              /** Number of indexed flows. */
+};
+
 struct table {
   struct flow_list *flow_list;  /** Flows by types. */
-  uint64_t lookup_count;        /** Lookup count */
-  uint64_t matched_count;       /** Matched count */
+  struct flow_index identity;   /** Flows by identity. */
+  uint32_t counter_id;          /** Per worker lookup and matched
+                                 ** counter. */
   uint8_t table_id;             /** Table id. */
   uint16_t flow_match_type_count[OFPXMT_OFB_IPV6_EXTHDR + 1];  /** Flow counts
                                                                 ** by match
                                                                 ** type. */
   struct ofp_table_features features;   /** Features. */
   void *userdata;               /** userdata used in dataplane */
+  void *standby;                /** standby copy of userdata updated
+                                 ** by writer. */
+  void *standby_log;            /** changes of standby to be applied
+                                 ** to userdata after published. */
+  uint64_t generation;          /** Incremented when flows are changed. */
+  uint8_t classifier;           /** enum flow_classifier. */
+  uint8_t pending;              /** Updates deferred by flow_mod batch. */
+  struct byteoff_mask wildcard[MAX_BASE];       /** Header bits examined
+                                                 ** by flows ever added.
+                                                 ** never shrinks. */
 };
 
 
@@ -273,7 +348,8 @@ void (*lagopus_register_action_hook)(struct action *);
 void (*lagopus_register_instruction_hook)(struct instruction *);
 void (*lagopus_add_flow_hook)(struct flow *, struct table *);
 void (*lagopus_del_flow_hook)(struct flow *, struct table *);
-struct flow *(*lagopus_find_flow_hook)(struct flow *, struct table *);
+void (*lagopus_publish_flow_hook)(struct table *);
+lagopus_result_t (*lagopus_set_classifier_hook)(struct table *, uint8_t);
 
 /**
  * Allocate a new flow database.
@@ -316,6 +392,71 @@ flowdb_switch_mode_get(struct flowdb *flowdb, enum switch_mode *switch_mode);
 lagopus_result_t
 flowdb_switch_mode_set(struct flowdb *flowdb, enum switch_mode switch_mode);
 
+/**
+ * Select classifier of the flow table.  Flows already in the table
+ * are moved to the new classifier.
+ *
+ * @param[in]   flowdb          Flow database.
+ * @param[in]   table_id        Table id.
+ * @param[in]   classifier      enum flow_classifier.
+ *
+ * @retval LAGOPUS_RESULT_OK            Succeeded.
+ * @retval LAGOPUS_RESULT_INVALID_ARGS  Failed, invalid classifier.
+ * @retval LAGOPUS_RESULT_NO_MEMORY     Failed, no memory.
+ */
+lagopus_result_t
+flowdb_table_classifier_set(struct flowdb *flowdb,
+                            uint8_t table_id,
+                            enum flow_classifier classifier);
+
+/**
+ * Begin flow_mod batch of the current thread.  The flow database is
+ * locked until flowdb_batch_end(), and flow modifications by this
+ * thread defer publication and rebuild of classifiers, invalidation
+ * of flow cache, and release of deleted flows and replaced
+ * instructions to the end of the batch.  Each
+ * modification still returns its own result.  Batch of another flow
+ * database held by the thread is ended.
+ *
+ * @param[in]   flowdb  Flow database.
+ */
+void
+flowdb_batch_begin(struct flowdb *flowdb);
+
+/**
+ * End flow_mod batch of the current thread, apply deferred updates
+ * and unlock the flow database.  Nothing is done if the batch of the
+ * flow database is not held.
+ *
+ * @param[in]   flowdb  Flow database.
+ */
+void
+flowdb_batch_end(struct flowdb *flowdb);
+
+/**
+ * Begin atomic flow_mod batch of the current thread.  It is the same
+ * as flowdb_batch_begin(), and flow modifications from now can be
+ * undone by flowdb_batch_abort().  Modified flows are replaced by
+ * their copies, so that the dataplane sees no change of a table until
+ * flowdb_batch_end() publishes it.  Flows deleted in the batch are
+ * freed, and OFPT_FLOW_REMOVED messages for them are sent, by
+ * flowdb_batch_end().
+ *
+ * @param[in]   flowdb  Flow database.
+ */
+void
+flowdb_batch_atomic_begin(struct flowdb *flowdb);
+
+/**
+ * Undo flow modifications of the atomic flow_mod batch of the current
+ * thread, latest first, and end the batch.  Nothing is done if the
+ * batch of the flow database is not held.
+ *
+ * @param[in]   flowdb  Flow database.
+ */
+void
+flowdb_batch_abort(struct flowdb *flowdb);
+
 /**
  * Add flow entry to the flow database.
  *
@@ -398,6 +539,54 @@ flowdb_flow_stats(struct flowdb *flowdb,
                   struct flow_stats_list *flow_stats_list,
                   struct ofp_error *error);
 
+/**
+ * Function called for each flow by flowdb_flow_stats_walk().
+ *
+ * @param[in]   ofp     Flow stats of the flow.
+ * @param[in]   body    Wire encoding of match and instructions of the
+ *                      flow, which follows ofp_flow_stats.
+ * @param[in]   body_len        Length of body.
+ * @param[in]   arg     Argument passed to flowdb_flow_stats_walk().
+ *
+ * @retval LAGOPUS_RESULT_OK    Continue the walk.
+ * @retval !=LAGOPUS_RESULT_OK  Stop the walk and return the value.
+ */
+typedef lagopus_result_t
+(*flowdb_flow_stats_proc_t)(const struct ofp_flow_stats *ofp,
+                            const uint8_t *body,
+                            uint16_t body_len,
+                            void *arg);
+
+/**
+ * Walk stats of flows in the flow database.
+ *
+ * @param[in]   flowdb  Flow database.
+ * @param[in]   request ofp_flow_stats_request structure of the flow.
+ * @param[in]   match_list list of match structures.
+ * @param[in]   proc    Function called for each matched flow.
+ * @param[in]   arg     Argument passed to proc.
+ * @param[out]  error   OFP_ERROR value.
+ *
+ * @retval LAGOPUS_RESULT_OK            Succeeded.
+ * @retval LAGOPUS_RESULT_NO_MEMORY     Failed, no memory.
+ * @retval LAGOPUS_RESULT_OFP_ERROR     Failed with OFP error message.
+ * @retval !=LAGOPUS_RESULT_OK          Value returned by proc.
+ *
+ * Unlike flowdb_flow_stats(), flows are not copied.  proc is called
+ * under the flowdb read lock with the encoded match and instructions
+ * cached in the flow, which must not be kept after proc returns.  The
+ * cache is built on the first walk and dropped when the instructions
+ * of the flow are replaced.  The lock is released every some flows,
+ * so the result is not a snapshot of the whole flowdb.
+ */
+lagopus_result_t
+flowdb_flow_stats_walk(struct flowdb *flowdb,
+                       struct ofp_flow_stats_request *request,
+                       struct match_list *match_list,
+                       flowdb_flow_stats_proc_t proc,
+                       void *arg,
+                       struct ofp_error *error);
+
 /**
  * Get aggregated stats of flows from the flow database.
  *
@@ -449,6 +638,18 @@ flow_add_sub(struct flow *flow, struct flow_list *flows);
 void
 flow_dump(struct flow *flow, FILE *fp);
 
+/**
+ * Get matched packet and byte count of the flow.
+ *
+ * @param[in]   flow            Flow entry.
+ * @param[out]  packet_count    Packet count summed over workers.
+ * @param[out]  byte_count      Byte count summed over workers.
+ */
+void
+flow_get_counts(const struct flow *flow,
+                uint64_t *packet_count,
+                uint64_t *byte_count);
+
 /**
  * Dump all flows as human readable in flowdb.
  *
@@ -516,6 +717,23 @@ get_current_time(void) {
   return ts;
 }
 
+/**
+ * Record hit of the flow for idle timeout.  The time is read from
+ * now_ts refreshed by the timer thread every second, and the flow is
+ * written at most once per second.
+ *
+ * @param[in]   flow    flow.
+ */
+static inline void
+flow_update_hit_time(struct flow *flow) {
+  time_t now;
+
+  now = now_ts.tv_sec;
+  if (flow->update_time.tv_sec != now) {
+    flow->update_time.tv_sec = now;
+  }
+}
+
 /**
  * initialize flow timer related structure.
  */
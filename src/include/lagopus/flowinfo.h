@@ -22,6 +22,8 @@
 #ifndef SRC_INCLUDE_LAGOPUS_FLOWINFO_H_
 #define SRC_INCLUDE_LAGOPUS_FLOWINFO_H_
 
+struct flowinfo_subtable;
+
 /**
  * @brief Structured flow table.
  */
@@ -32,6 +34,7 @@ struct flowinfo {
     lagopus_hashmap_t hashmap;  /** hashmap entries. */
     struct flow **flows;        /** simple array entries. */
     struct flowinfo **next;     /** child flowinfo array. */
+    struct flowinfo_subtable **subtables;  /** tuple space subtables. */
     /* add more types if needed. */
   };
   struct flowinfo *misc;        /** flowinfo includes no specific match. */
@@ -53,6 +56,15 @@ struct flowinfo {
  */
 struct flowinfo *new_flowinfo_basic(void);
 
+/**
+ * Allocate and initialize flowinfo for tuple space search.
+ * Flows are grouped by match mask into hashed subtables.
+ *
+ * @retval      !=NULL  Created flowinfo.
+ *              ==NULL  failed to create flowinfo.
+ */
+struct flowinfo *new_flowinfo_tuple(void);
+
 /**
  * Allocate and initialize flowinfo for ingress port.
  *
@@ -85,6 +97,15 @@ struct flowinfo *new_flowinfo_vlan_vid(void);
  */
 struct flowinfo *new_flowinfo_eth_type(void);
 
+/**
+ * Allocate and initialize flowinfo for ethernet type,
+ * using tuple space search for the other fields.
+ *
+ * @retval      !=NULL  Created flowinfo.
+ *              ==NULL  failed to create flowinfo.
+ */
+struct flowinfo *new_flowinfo_eth_type_tuple(void);
+
 /**
  * Allocate and initialize flowinfo for IPv4 destination address with mask.
  *
@@ -170,4 +191,32 @@ void flowinfo_init(void);
  */
 void flow_make_match(struct flow *flow);
 
+/**
+ * Select byte offset match kernel by CPU features.
+ */
+void match_basic_init(void);
+
+/**
+ * Compare byte offset match of the flow with the packet.
+ * Unlike match_basic(), flow counter is not updated.
+ *
+ * @param[in]   pkt     Packet.
+ * @param[in]   flow    Flow made by flow_make_match().
+ *
+ * @retval      true    Matched.
+ * @retval      false   Not matched.
+ */
+bool match_byteoff(const struct lagopus_packet *pkt, const struct flow *flow);
+
+/**
+ * Compare priority and match list of the flows.
+ *
+ * @param[in]   f1      Flow.
+ * @param[in]   f2      Flow.
+ *
+ * @retval      true    Identical.
+ * @retval      false   Different.
+ */
+bool flow_compare_basic(struct flow *f1, struct flow *f2);
+
 #endif /* SRC_INCLUDE_LAGOPUS_FLOWINFO_H_ */
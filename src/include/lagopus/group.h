@@ -27,15 +27,30 @@
 struct group_stats_list;
 struct group_desc_list;
 
+/**
+ * @brief Bucket lookup table of OFPGT_SELECT group.
+ *
+ * Buckets fill the table in proportion to their weights, in the
+ * permutation order of Maglev hashing.  Replacing the buckets moves
+ * only a few entries of the buckets still present.
+ */
+struct group_select {
+  uint32_t size;                        /** Number of entries (prime). */
+  struct bucket *bucket[];              /** Bucket indexed by packet hash. */
+};
+
 /**
  * @brief Group structure.
  */
 struct group {                          /** Internal group structure. */
   uint32_t id;                          /** OpenFlow group id. */
   enum ofp_group_type type;             /** Group type. */
-  struct bucket_list bucket_list;       /** List of goup bucket */
-  int select;                           /** Round-robin index
+  struct bucket_list *bucket_list;      /** List of goup bucket,
+                                         ** replaced as a whole */
+  struct group_select *select;          /** Bucket lookup table
                                          ** for OFPGT_SELECT */
+  struct bucket *live;                  /** Live bucket for OFPGT_FF. */
+  TAILQ_ENTRY(group) ff_entry;          /** Fast failover group list. */
   uint64_t packet_count;                /** Packet count. */
   uint64_t byte_count;                  /** Byte count. */
   uint32_t duration_sec;                /** Duration (sec part) */
@@ -191,7 +206,8 @@ get_group_features(struct group_table *group_table,
                    struct ofp_error *error);
 
 /**
- * Get live bucket.
+ * Get live bucket.  Liveness of ports and watched groups is evaluated
+ * recursively, the dataplane refers the result cached in group->live.
  *
  * @param[in]   bridge  Bridge.
  * @param[in]   group   Group.
@@ -203,4 +219,14 @@ struct bucket *
 group_live_bucket(struct bridge *bridge,
                   struct group *group);
 
+/**
+ * Reselect live buckets of fast failover groups of the bridge of the
+ * port.  Called where state or config of the port is changed, so that
+ * packets do not wait for the agent to handle the port status.
+ *
+ * @param[in]   port    Port.
+ */
+void
+group_port_live_update(struct port *port);
+
 #endif /* SRC_INCLUDE_LAGOPUS_GROUP_H_ */
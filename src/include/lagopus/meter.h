@@ -50,6 +50,8 @@ struct meter_band {
                                          ** to add.  Only used by
                                          ** OFPMBT_DSCP_REMARK. */
   uint32_t experimenter;                /** Experimenter. */
+  uint32_t counter_id;                  /** Per worker band packet and
+                                         ** byte counter. */
   struct ofp_meter_band_stats stats;    /** Counters. */
 };
 
@@ -63,8 +65,8 @@ struct meter {
   uint16_t flags;                       /** ofp_meter_flags. */
   struct meter_band_list band_list;     /** Unordered list of meter band. */
   uint32_t flow_count;                  /** Flow count. */
-  uint64_t input_packet_count;          /** Input packet count. */
-  uint64_t input_byte_count;            /** Input byte count. */
+  uint32_t counter_id;                  /** Per worker input packet and
+                                         ** byte counter. */
   uint32_t duration_sec;                /** Duration (sec part) */
   uint32_t duration_nanosec;            /** Duration (nanosec part) */
   struct timespec create_time;          /** Creation time. */
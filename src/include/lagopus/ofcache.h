@@ -25,12 +25,15 @@
 #define FLOWCACHE_HASHMAP        1
 #define FLOWCACHE_PTREE          2
 #define FLOWCACHE_RTE_HASH       3
+#define FLOWCACHE_OPEN_HASH      4
 
 #define CACHE_NODE_MAX_ENTRIES 256
 
 struct lagopus_packet;
 struct rte_hash;
 struct flowcache;
+struct table;
+struct cache_prog;
 
 /**
  * @brief Flow cache statistics.
@@ -39,10 +42,26 @@ struct ofcachestat {
   uint64_t nentries;                    /** number of cache entry */
   uint64_t hit;                         /** cache hit count */
   uint64_t miss;                        /** cache miss count */
+  uint64_t wildcard_entries;            /** number of wildcard entry */
+  uint64_t wildcard_hit;                /** wildcard hit count of misses */
+};
+
+/**
+ * @brief Table referenced by flow cache entry.
+ */
+struct cache_table_ref {
+  struct table *table;                  /** table of matched flow */
+  uint64_t generation;                  /** table generation at register */
 };
 
 /**
  * @brief Flow cache entry.
+ *
+ * The entry is stale if generation of any referenced table is changed.
+ * Stale entry is never returned by cache_lookup().
+ * prog is compiled by cache_prog_compile() at registration into
+ * storage kept with the entry, or NULL if the flows have too many
+ * actions to compile.
  */
 struct cache_entry {
   TAILQ_ENTRY(cache_entry) next;        /** link for next entry */
@@ -54,6 +73,8 @@ struct cache_entry {
     };
   };
   unsigned nmatched;                    /** number of flow. */
+  struct cache_prog *prog;              /** compiled actions, or NULL. */
+  struct cache_table_ref *tables;       /** tables, follows flow entries. */
   struct flow *flow[0];                 /** flow entries. */
 };
 
@@ -69,6 +90,17 @@ struct cache_entry {
  *      FLOWCACHE_HASHMAP_NOLOCK
  *      FLOWCACHE_HASHMAP
  *      FLOWCACHE_PTREE
+ *      FLOWCACHE_OPEN_HASH
+ *
+ * FLOWCACHE_OPEN_HASH is a preallocated, bucketized open addressing
+ * table.  It keeps the extracted packet key in each entry and verifies
+ * it on hit, so hash collisions never return another flow's entry.
+ *
+ * Every type is backed by a wildcard cache.  Its entry is keyed by
+ * header bits examined by flows of the matched tables only, so one
+ * entry covers all packets which differ in unexamined fields.
+ * cache_lookup() consults it when the exact match cache is missed,
+ * and copies the hit entry into the exact match cache.
  */
 struct flowcache *init_flowcache(int kvs_type);
 
@@ -79,6 +111,11 @@ struct flowcache *init_flowcache(int kvs_type);
  * @param[in]   hash64          Hash value for lookup cache entry.
  * @param[in]   nmatched        Number of flows.
  * @param[in]   flow            Flow entries.
+ *
+ * With FLOWCACHE_OPEN_HASH, the entry is keyed by the packet key
+ * captured at the last missed cache_lookup() with the same hash64.
+ * If there is no such key, or too many flows are matched, nothing
+ * is registered.
  */
 void
 register_cache(struct flowcache *cache,
@@ -86,6 +123,27 @@ register_cache(struct flowcache *cache,
                unsigned nmatched,
                const struct flow **flow);
 
+/**
+ * Size of storage for compiled actions of a cache entry.
+ *
+ * @retval      Size in bytes.
+ */
+size_t cache_prog_size(void);
+
+/**
+ * Compile instructions of the cached flows.
+ *
+ * @param[out]  buf             Storage of cache_prog_size() bytes.
+ * @param[in]   cache_entry     Cache entry, flows and tables are set.
+ *
+ * @retval      !=NULL  compiled program in buf.
+ * @retval      ==NULL  too many ops, flows are executed one by one.
+ *
+ * Implemented by the datapath.
+ */
+struct cache_prog *
+cache_prog_compile(void *buf, const struct cache_entry *cache_entry);
+
 /**
  * Clear all cache entry.
  *
@@ -105,6 +163,27 @@ void clear_all_cache(struct flowcache *cache);
 struct cache_entry *
 cache_lookup(struct flowcache *cache, struct lagopus_packet *pkt);
 
+/**
+ * Lookup cache for a burst of packets.
+ *
+ * @param[in]   cache   Flow cache object.
+ * @param[in]   pkts    Packets, hash64 must be calculated.
+ * @param[in]   n       Number of packets.
+ * @param[out]  entries Cache entry of each packet, NULL if not in cache.
+ *
+ * @retval      Number of packets found in cache.
+ *
+ * Buckets of all packets are prefetched before they are compared.
+ * Missed packets are not counted and do not leave the key for
+ * register_cache(), look them up again by cache_lookup() before
+ * they are matched against flow tables.
+ */
+size_t
+cache_lookup_bulk(struct flowcache *cache,
+                  struct lagopus_packet *pkts[],
+                  size_t n,
+                  struct cache_entry *entries[]);
+
 /**
  * Finalize cache.
  *
@@ -99,6 +99,62 @@ ofp_flow_mod_delete(uint64_t dpid,
                     struct ofp_flow_mod *flow_mod,
                     struct match_list *match_list,
                     struct ofp_error *error);
+/**
+ * Begin batch of \b OFPT_FLOW_MOD for the bridge.
+ *
+ *     @param[in]	dpid	Datapath id.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_NOT_FOUND	Bridge is not found.
+ *
+ *     @details	Flow mods of the calling thread until
+ *     ofp_flow_mod_batch_end() are applied under one lock, and
+ *     classifiers and flow caches are updated once at the end.
+ *     Each flow mod still reports its own error.  Other requests
+ *     to the Data-Plane must not be issued in the batch.
+ */
+lagopus_result_t
+ofp_flow_mod_batch_begin(uint64_t dpid);
+
+/**
+ * End batch of \b OFPT_FLOW_MOD for the bridge.
+ *
+ *     @param[in]	dpid	Datapath id.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_NOT_FOUND	Bridge is not found.
+ */
+lagopus_result_t
+ofp_flow_mod_batch_end(uint64_t dpid);
+
+/**
+ * Begin atomic batch of \b OFPT_FLOW_MOD for the bridge.
+ *
+ *     @param[in]	dpid	Datapath id.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_NOT_FOUND	Bridge is not found.
+ *
+ *     @details	Same as ofp_flow_mod_batch_begin(), and flow mods
+ *     in the batch can be undone by ofp_flow_mod_batch_abort().
+ *     The Data-Plane forwards packets by flow tables before the batch
+ *     until ofp_flow_mod_batch_end() publishes each of them at once.
+ *     \b OFPT_FLOW_REMOVED for flows deleted in the batch are sent
+ *     at ofp_flow_mod_batch_end().
+ */
+lagopus_result_t
+ofp_flow_mod_batch_atomic_begin(uint64_t dpid);
+
+/**
+ * Undo flow mods of the atomic batch for the bridge and end it.
+ *
+ *     @param[in]	dpid	Datapath id.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_NOT_FOUND	Bridge is not found.
+ */
+lagopus_result_t
+ofp_flow_mod_batch_abort(uint64_t dpid);
 /* FlowMod END */
 
 #endif /* __LAGOPUS_OFP_FLOW_MOD_APIS_H__ */
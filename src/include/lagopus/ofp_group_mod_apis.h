@@ -101,6 +101,18 @@ lagopus_result_t
 ofp_group_mod_delete(uint64_t dpid,
                      struct ofp_group_mod *group_mod,
                      struct ofp_error *error);
+
+/**
+ * Live buckets of fast failover groups are reselected
+ * for \b OFPT_PORT_STATUS.
+ *
+ *     @param[in]	dpid	Datapath id.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_NOT_FOUND	Bridge is not found.
+ */
+lagopus_result_t
+ofp_group_live_update(uint64_t dpid);
 /* GroupMod END */
 
 #endif /* __LAGOPUS_OFP_GROUP_MOD_APIS_H__ */
@@ -68,6 +68,33 @@ ofp_flow_stats_get(uint64_t dpid,
                    struct match_list *match_list,
                    struct flow_stats_list *flow_stats_list,
                    struct ofp_error *error);
+
+/**
+ * Walk flow statistics for \b OFPMP_FLOW.
+ *
+ *     @param[in]	dpid	Datapath id.
+ *     @param[in]	flow_stats_reques	A pointer to \e ofp_flow_stats_reques
+ *     structure.
+ *     @param[in]       match_list      A pointer to list of match.
+ *     @param[in]	proc	Function called for each matched flow.
+ *     @param[in]	arg	Argument passed to \e proc.
+ *     @param[out]	error	A pointer to \e ofp_error structure.
+ *     If errors occur, set filed values.
+ *
+ *     @retval	LAGOPUS_RESULT_OK	Succeeded.
+ *     @retval	LAGOPUS_RESULT_ANY_FAILURES	Failed.
+ *
+ *     @details	No list is allocated, \e proc is called with the
+ *     encoded match and instructions of each flow under the flowdb
+ *     read lock and must copy them before it returns.
+ */
+lagopus_result_t
+ofp_flow_stats_walk(uint64_t dpid,
+                    struct ofp_flow_stats_request *flow_stats_request,
+                    struct match_list *match_list,
+                    flowdb_flow_stats_proc_t proc,
+                    void *arg,
+                    struct ofp_error *error);
 /* Multipart - Flow Stats END */
 
 /* Multipart - Queue stats */
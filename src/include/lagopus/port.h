@@ -181,5 +181,6 @@ enum {
 void lagopus_send_packet(uint32_t, struct lagopus_packet *);
 void dp_port_update_link_status(struct port *port);
 lagopus_result_t dpdk_update_port_link_status(struct port *port);
+lagopus_result_t rawsock_update_port_link_status(struct port *port);
 
 #endif /* SRC_INCLUDE_LAGOPUS_PORT_H_ */
@@ -1187,6 +1187,69 @@ struct ofp_experimenter_header {
   uint32_t exp_type;
 };
 
+// OpenFlow 1.4 bundles for OpenFlow 1.3 (ONF extension EXT-230).
+#define ONF_EXPERIMENTER_ID 0x4F4E4600
+
+enum onf_exp_type {
+  ONF_ET_BUNDLE_CONTROL     = 2300,
+  ONF_ET_BUNDLE_ADD_MESSAGE = 2301,
+};
+
+enum ofp_bundle_ctrl_type {
+  OFPBCT_OPEN_REQUEST    = 0,
+  OFPBCT_OPEN_REPLY      = 1,
+  OFPBCT_CLOSE_REQUEST   = 2,
+  OFPBCT_CLOSE_REPLY     = 3,
+  OFPBCT_COMMIT_REQUEST  = 4,
+  OFPBCT_COMMIT_REPLY    = 5,
+  OFPBCT_DISCARD_REQUEST = 6,
+  OFPBCT_DISCARD_REPLY   = 7,
+};
+
+enum ofp_bundle_flags {
+  OFPBF_ATOMIC  = 1 << 0,
+  OFPBF_ORDERED = 1 << 1,
+};
+
+// Codes of OFPET_EXPERIMENTER error with ONF_EXPERIMENTER_ID.
+enum onf_bundle_error_type {
+  ONFERR_ET_UNKNOWN            = 2300,
+  ONFERR_ET_EPERM              = 2301,
+  ONFERR_ET_BAD_ID             = 2302,
+  ONFERR_ET_BUNDLE_EXIST       = 2303,
+  ONFERR_ET_BUNDLE_CLOSED      = 2304,
+  ONFERR_ET_OUT_OF_BUNDLES     = 2305,
+  ONFERR_ET_BAD_TYPE           = 2306,
+  ONFERR_ET_BAD_FLAGS          = 2307,
+  ONFERR_ET_MSG_BAD_LEN        = 2308,
+  ONFERR_ET_MSG_BAD_XID        = 2309,
+  ONFERR_ET_MSG_UNSUP          = 2310,
+  ONFERR_ET_MSG_CONFLICT       = 2311,
+  ONFERR_ET_MSG_TOO_MANY       = 2312,
+  ONFERR_ET_MSG_FAILED         = 2313,
+  ONFERR_ET_TIMEOUT            = 2314,
+  ONFERR_ET_BUNDLE_IN_PROGRESS = 2315,
+};
+
+struct ofp_bundle_ctrl_msg {
+  struct ofp_header header;
+  uint32_t experimenter;
+  uint32_t exp_type;
+  uint32_t bundle_id;
+  uint16_t type;
+  uint16_t flags;
+};
+
+// Followed by the message added to the bundle.
+struct ofp_bundle_add_msg {
+  struct ofp_header header;
+  uint32_t experimenter;
+  uint32_t exp_type;
+  uint32_t bundle_id;
+  uint8_t pad[2];
+  uint16_t flags;
+};
+
 struct ofp_meter_band_header {
   uint16_t type;
   uint16_t len;